@@ -0,0 +1,59 @@
+; conout.asm - Console output flood benchmark
+; Part of MP/M II Emulator
+; SPDX-License-Identifier: GPL-3.0-or-later
+;
+; 200 lines through BDOS 9 (print string), then 4000 characters through
+; BDOS 2 (console output). Measures the BDOS/XDOS path as much as the
+; console itself.
+;
+; Assemble with: z80asm -o CONOUT.COM conout.asm
+
+        ORG     0100H
+
+LINES:          EQU     200
+CHARS:          EQU     4000
+
+START:
+        LD      SP,STACK
+        CALL    PSTART
+        LD      B,LINES
+LINE1:  PUSH    BC
+        LD      DE,MLINE
+        CALL    PRSTR
+        POP     BC
+        DJNZ    LINE1
+        LD      DE,MSTR
+        CALL    PRSTR
+        CALL    PSTOP
+
+        CALL    PSTART
+        LD      HL,CHARS
+CHAR1:  PUSH    HL
+        LD      A,L
+        AND     3FH
+        JR      NZ,CHAR2
+        CALL    CRLF
+        XOR     A
+CHAR2:  ADD     A,' '
+        CALL    PUTCH
+        POP     HL
+        DEC     HL
+        LD      A,H
+        OR      L
+        JR      NZ,CHAR1
+        CALL    CRLF
+        LD      DE,MCHAR
+        CALL    PRSTR
+        CALL    PSTOP
+
+        LD      C,0
+        JP      BDOS
+
+MLINE:  DB      'The quick brown fox jumps over the lazy dog 0123456789',13,10,'$'
+MSTR:   DB      'CONOUT  200 lines via BDOS 9',13,10,'$'
+MCHAR:  DB      'CONOUT  4000 chars via BDOS 2',13,10,'$'
+
+        INCLUDE "perf.inc"
+
+        DS      128
+STACK:
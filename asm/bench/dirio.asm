@@ -0,0 +1,83 @@
+; dirio.asm - Directory create/delete benchmark
+; Part of MP/M II Emulator
+; SPDX-License-Identifier: GPL-3.0-or-later
+;
+; Eight rounds of: make and close BENCH00.TMP .. BENCH63.TMP, then
+; delete them again. Every call searches the directory, so this mostly
+; times directory sector reads and writes.
+;
+; Assemble with: z80asm -o DIRIO.COM dirio.asm
+
+        ORG     0100H
+
+FILES:          EQU     64
+ROUNDS:         EQU     8
+
+START:
+        LD      SP,STACK
+        LD      DE,MTITLE
+        CALL    PRSTR
+        CALL    PSTART
+        LD      A,ROUNDS
+ROUND:  PUSH    AF
+
+        CALL    NAME0
+        LD      B,FILES
+MAKE1:  PUSH    BC
+        CALL    FCBCLR
+        LD      DE,FCB
+        LD      C,22            ; Make file
+        CALL    BDOS
+        INC     A
+        JP      Z,FAIL
+        LD      DE,FCB
+        LD      C,16            ; Close file
+        CALL    BDOS
+        CALL    NAMEUP
+        POP     BC
+        DJNZ    MAKE1
+
+        CALL    NAME0
+        LD      B,FILES
+DEL1:   PUSH    BC
+        LD      DE,FCB
+        LD      C,19            ; Delete file
+        CALL    BDOS
+        CALL    NAMEUP
+        POP     BC
+        DJNZ    DEL1
+
+        POP     AF
+        DEC     A
+        JR      NZ,ROUND
+        CALL    PSTOP
+        JP      EXIT
+
+; NAME0 - first file name (BENCH00)
+NAME0:
+        LD      HL,'0'*256+'0'
+        LD      (FCB+6),HL
+        RET
+
+; NAMEUP - next file name, counting in the last two characters
+NAMEUP:
+        LD      HL,FCB+7
+        INC     (HL)
+        LD      A,(HL)
+        CP      '9'+1
+        RET     C
+        LD      (HL),'0'
+        DEC     HL
+        INC     (HL)
+        RET
+
+MTITLE: DB      'DIRIO   64 files x8 make/close/delete',13,10,'$'
+
+FCB:    DB      0,'BENCH00 TMP'
+        DS      24
+
+        INCLUDE "perf.inc"
+        INCLUDE "fileio.inc"
+
+        DS      128
+STACK:
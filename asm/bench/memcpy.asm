@@ -0,0 +1,61 @@
+; memcpy.asm - Memory copy benchmark
+; Part of MP/M II Emulator
+; SPDX-License-Identifier: GPL-3.0-or-later
+;
+; Copies an 8K block 32 times with LDIR, then 32 times with a byte loop
+; (LD A,(HL); LD (DE),A; INC HL; INC DE; DEC BC; LD A,B; OR C; JR NZ).
+;
+; Assemble with: z80asm -o MEMCPY.COM memcpy.asm
+
+        ORG     0100H
+
+BLOCK:          EQU     2000H
+REPS:           EQU     32
+
+START:
+        LD      SP,STACK
+        LD      DE,MLDIR
+        CALL    PRSTR
+        CALL    PSTART
+        LD      A,REPS
+LDIR1:  LD      HL,SRC
+        LD      DE,DST
+        LD      BC,BLOCK
+        LDIR
+        DEC     A
+        JR      NZ,LDIR1
+        CALL    PSTOP
+
+        LD      DE,MLOOP
+        CALL    PRSTR
+        CALL    PSTART
+        LD      A,REPS
+LOOP1:  PUSH    AF
+        LD      HL,SRC
+        LD      DE,DST
+        LD      BC,BLOCK
+LOOP2:  LD      A,(HL)
+        LD      (DE),A
+        INC     HL
+        INC     DE
+        DEC     BC
+        LD      A,B
+        OR      C
+        JR      NZ,LOOP2
+        POP     AF
+        DEC     A
+        JR      NZ,LOOP1
+        CALL    PSTOP
+
+        LD      C,0
+        JP      BDOS
+
+MLDIR:  DB      'MEMCPY  LDIR 8K x32',13,10,'$'
+MLOOP:  DB      'MEMCPY  loop 8K x32',13,10,'$'
+
+        INCLUDE "perf.inc"
+
+        DS      128
+STACK:
+SRC:    EQU     $               ; Two blocks past the end of the image
+DST:    EQU     SRC+BLOCK
@@ -0,0 +1,126 @@
+; rndio.asm - Random file I/O benchmark
+; Part of MP/M II Emulator
+; SPDX-License-Identifier: GPL-3.0-or-later
+;
+; Writes the 2048 records of BENCH.TMP in a scattered order through
+; BDOS 34, then reads them back in a different order through BDOS 33.
+; The order comes from r = (5 * r + 1) mod 2048, which visits every
+; record exactly once per 2048 steps.
+;
+; Assemble with: z80asm -o RNDIO.COM rndio.asm
+
+        ORG     0100H
+
+RECS:           EQU     2048            ; Power of two (see NEXTREC)
+
+START:
+        LD      SP,STACK
+        LD      DE,BUF
+        LD      C,26            ; Set DMA
+        CALL    BDOS
+        LD      HL,BUF
+        LD      B,128
+FILL:   LD      (HL),B
+        INC     HL
+        DJNZ    FILL
+        LD      DE,FCB
+        LD      C,19            ; Delete a leftover copy
+        CALL    BDOS
+
+        ; Write
+        CALL    FCBCLR
+        LD      DE,MWRITE
+        CALL    PRSTR
+        CALL    PSTART
+        LD      DE,FCB
+        LD      C,22            ; Make file
+        CALL    BDOS
+        INC     A
+        JP      Z,FAIL
+        LD      HL,0
+        LD      (RREC),HL
+        LD      HL,RECS
+WRITE1: PUSH    HL
+        CALL    NEXTREC
+        LD      DE,FCB
+        LD      C,34            ; Write random
+        CALL    BDOS
+        POP     HL
+        OR      A
+        JP      NZ,FAIL
+        DEC     HL
+        LD      A,H
+        OR      L
+        JR      NZ,WRITE1
+        LD      DE,FCB
+        LD      C,16            ; Close file
+        CALL    BDOS
+        CALL    PSTOP
+
+        ; Read
+        CALL    FCBCLR
+        LD      DE,MREAD
+        CALL    PRSTR
+        CALL    PSTART
+        LD      DE,FCB
+        LD      C,15            ; Open file
+        CALL    BDOS
+        INC     A
+        JP      Z,FAIL
+        LD      HL,1234
+        LD      (RREC),HL
+        LD      HL,RECS
+READ1:  PUSH    HL
+        CALL    NEXTREC
+        LD      DE,FCB
+        LD      C,33            ; Read random
+        CALL    BDOS
+        POP     HL
+        OR      A
+        JP      NZ,FAIL
+        DEC     HL
+        LD      A,H
+        OR      L
+        JR      NZ,READ1
+        LD      DE,FCB
+        LD      C,16
+        CALL    BDOS
+        CALL    PSTOP
+
+        LD      DE,FCB
+        LD      C,19
+        CALL    BDOS
+        JP      EXIT
+
+; NEXTREC - step RREC and put it in the FCB random record field
+NEXTREC:
+        LD      HL,(RREC)
+        LD      D,H
+        LD      E,L
+        ADD     HL,HL
+        ADD     HL,HL
+        ADD     HL,DE
+        INC     HL
+        LD      A,H
+        AND     (RECS-1)/256
+        LD      H,A
+        LD      (RREC),HL
+        LD      (FCB+33),HL
+        XOR     A
+        LD      (FCB+35),A
+        RET
+
+MWRITE: DB      'RNDIO   write 2048 records',13,10,'$'
+MREAD:  DB      'RNDIO   read 2048 records',13,10,'$'
+
+RREC:   DS      2
+
+FCB:    DB      0,'BENCH   TMP'
+        DS      24
+
+        INCLUDE "perf.inc"
+        INCLUDE "fileio.inc"
+
+BUF:    DS      128
+        DS      128
+STACK:
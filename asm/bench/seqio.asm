@@ -0,0 +1,99 @@
+; seqio.asm - Sequential file I/O benchmark
+; Part of MP/M II Emulator
+; SPDX-License-Identifier: GPL-3.0-or-later
+;
+; Writes BENCH.TMP with 2048 records (256K) through BDOS 21, reads it
+; back through BDOS 20, then deletes it. Each phase is timed separately,
+; make/open and close included.
+;
+; Assemble with: z80asm -o SEQIO.COM seqio.asm
+
+        ORG     0100H
+
+RECS:           EQU     2048
+
+START:
+        LD      SP,STACK
+        LD      DE,BUF
+        LD      C,26            ; Set DMA
+        CALL    BDOS
+        LD      HL,BUF
+        LD      B,128
+FILL:   LD      (HL),B
+        INC     HL
+        DJNZ    FILL
+        LD      DE,FCB
+        LD      C,19            ; Delete a leftover copy
+        CALL    BDOS
+
+        ; Write
+        CALL    FCBCLR
+        LD      DE,MWRITE
+        CALL    PRSTR
+        CALL    PSTART
+        LD      DE,FCB
+        LD      C,22            ; Make file
+        CALL    BDOS
+        INC     A
+        JP      Z,FAIL
+        LD      HL,RECS
+WRITE1: PUSH    HL
+        LD      DE,FCB
+        LD      C,21            ; Write sequential
+        CALL    BDOS
+        POP     HL
+        OR      A
+        JP      NZ,FAIL
+        DEC     HL
+        LD      A,H
+        OR      L
+        JR      NZ,WRITE1
+        LD      DE,FCB
+        LD      C,16            ; Close file
+        CALL    BDOS
+        CALL    PSTOP
+
+        ; Read
+        CALL    FCBCLR
+        LD      DE,MREAD
+        CALL    PRSTR
+        CALL    PSTART
+        LD      DE,FCB
+        LD      C,15            ; Open file
+        CALL    BDOS
+        INC     A
+        JP      Z,FAIL
+        LD      HL,RECS
+READ1:  PUSH    HL
+        LD      DE,FCB
+        LD      C,20            ; Read sequential
+        CALL    BDOS
+        POP     HL
+        OR      A
+        JP      NZ,FAIL
+        DEC     HL
+        LD      A,H
+        OR      L
+        JR      NZ,READ1
+        LD      DE,FCB
+        LD      C,16
+        CALL    BDOS
+        CALL    PSTOP
+
+        LD      DE,FCB
+        LD      C,19
+        CALL    BDOS
+        JP      EXIT
+
+MWRITE: DB      'SEQIO   write 256K',13,10,'$'
+MREAD:  DB      'SEQIO   read 256K',13,10,'$'
+
+FCB:    DB      0,'BENCH   TMP'
+        DS      24
+
+        INCLUDE "perf.inc"
+        INCLUDE "fileio.inc"
+
+BUF:    DS      128
+        DS      128
+STACK:
@@ -249,11 +249,17 @@ inthnd:
 	call	xdos		; set flag #1 (tick)
 notick:
 
-	; Update 1-second counter
+	; Update 1-second counter, reloaded from SYSDAT's ticks/second
 	lxi	h,cnt60
 	dcr	m
 	jnz	notsec
-	mvi	m,60
+	push	h
+	lhld	sysdat
+	lxi	d,122		; ticks per second
+	dad	d
+	mov	a,m
+	pop	h
+	mov	m,a
 	mvi	c,flagset
 	mvi	e,2
 	call	xdos		; set flag #2 (1 sec)
@@ -273,7 +279,7 @@ notsec:
 ; Data area
 ;
 tickn:	db	0		; tick enable flag
-cnt60:	db	60		; 60 Hz counter
+cnt60:	db	60		; ticks left in this second
 preemp:	db	0		; preempted flag
 
 ;
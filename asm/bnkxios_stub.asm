@@ -1,5 +1,5 @@
 ; bnkxios_stub.asm - Minimal BNKXIOS for MP/M II emulator
-; This stub forwards all calls to the emulator XIOS at FC00H
+; This stub forwards all calls to the emulator XIOS at FB00H
 ; Part of MP/M II Emulator
 ; SPDX-License-Identifier: GPL-3.0-or-later
 
@@ -7,12 +7,13 @@
     org 0
 
 ; XIOS entries must be exactly 3 bytes each
-; All entries jump to the emulator XIOS at FC00H
+; All entries jump to the emulator XIOS at FB00H
 
-; Emulator XIOS base address - must not conflict with MP/M system areas
-; Must be below 9100H (TMP) but in common memory (8000+)
-; Using 8800H which is in common area below all SPR loads
-XIOS_BASE   equ 08800h
+; Emulator XIOS base address - the XIOSJMP TBL page, where the emulator
+; installs xios_port.asm. GENSYS puts that page at FB00H for a top page
+; of FF with 8 consoles and user stacks, and needs it above the common
+; base (C000H).
+XIOS_BASE   equ 0FB00h
 
 ; Offset 0000: COLDBOOT
 coldboot:
@@ -143,5 +144,14 @@ xdosent:
 sysdat:
     dw  0FF00h                  ; 2 bytes: pointer to system data at FF00H
 
-; End of XIOS stub - pad to 256 bytes
-    ds  256 - ($-coldboot), 0
+; Common memory for the emulator's disk tables, filled in by SELDSK:
+; the BDOS reads DIRBUF and programs read the DPB with the user's bank in
+    ds  80h - ($-coldboot), 0
+
+; Offset 0080: DIRBUF (128 bytes)
+dirbuf:
+    ds  128, 0
+
+; Offset 0100: DPH and DPB for drives A-P (32 bytes each)
+dphtbl:
+    ds  16 * 32, 0
@@ -154,11 +154,17 @@ INTHND:
         CALL    XDOS
 
 NOTICK:
-        ; 1-second counter
+        ; 1-second counter, reloaded from SYSDAT's ticks/second
         LD      HL,CNT60
         DEC     (HL)
         JR      NZ,NOTSEC
-        LD      (HL),60
+        PUSH    HL
+        LD      HL,(SYSDAT)
+        LD      DE,122          ; Ticks per second
+        ADD     HL,DE
+        LD      A,(HL)
+        POP     HL
+        LD      (HL),A
         LD      C,133           ; flagset
         LD      E,2             ; flag 2
         CALL    XDOS
@@ -179,7 +185,7 @@ NOTSEC:
 ; =============================================================================
 
 TICKN:  DB      0
-CNT60:  DB      60
+CNT60:  DB      60              ; Ticks left in this second
 PREEMP: DB      0
 
 ; Minimal DPH
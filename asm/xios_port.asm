@@ -50,6 +50,10 @@ FUNC_SWTSYS:    EQU     51H
 FUNC_PDISP:     EQU     54H
 FUNC_XDOSENT:   EQU     57H
 FUNC_SYSDAT:    EQU     5AH
+FUNC_POLLALL:   EQU     0EDH    ; Internal: offset of POLLALL
+
+; POLLDEVICE device numbers
+POLL_CONIN:     EQU     18H     ; Console input 0-7 (devices 18H-1FH)
 
 ; Number of consoles
 NMBCNS:         EQU     8
@@ -97,177 +101,192 @@ SYSDAT:     DW      0FF00H          ; 5Ah - System data pointer
 
 ; =============================================================================
 ; Entry point implementations
-; Each routine: LD B, function; OUT (dispatch_port), A; RET
+; Each routine: LD A, function; JR DISPATCH (OUT (dispatch_port), A; RET).
+; DISPATCH sits mid-way so every entry reaches it with a JR.
 ; =============================================================================
 
 DO_BOOT:
         LD      A, FUNC_BOOT
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_WBOOT:
         LD      A, FUNC_WBOOT
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_CONST:
         LD      A, FUNC_CONST
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_CONIN:
         LD      A, FUNC_CONIN
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_CONOUT:
         LD      A, FUNC_CONOUT
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_LIST:
         LD      A, FUNC_LIST
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_PUNCH:
         LD      A, FUNC_PUNCH
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_READER:
         LD      A, FUNC_READER
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_HOME:
         LD      A, FUNC_HOME
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_SELDSK:
         LD      A, FUNC_SELDSK
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_SETTRK:
         ; BC = track - save to HL for emulator
         LD      H, B
         LD      L, C
         LD      A, FUNC_SETTRK
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_SETSEC:
         ; BC = sector - save to HL for emulator
         LD      H, B
         LD      L, C
         LD      A, FUNC_SETSEC
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_SETDMA:
         ; BC = DMA address - save to HL for emulator
         LD      H, B
         LD      L, C
         LD      A, FUNC_SETDMA
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_READ:
         LD      A, FUNC_READ
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_WRITE:
         LD      A, FUNC_WRITE
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_LISTST:
         LD      A, FUNC_LISTST
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_SECTRAN:
         ; BC = logical sector - save to HL for emulator
         LD      H, B
         LD      L, C
         LD      A, FUNC_SECTRAN
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_SELMEM:
         LD      A, FUNC_SELMEM
+        JR      DISPATCH
+
+DISPATCH:
         OUT     (XIOS_DISPATCH), A
         RET
 
 DO_POLLDEV:
-        LD      A, FUNC_POLLDEV
-        OUT     (XIOS_DISPATCH), A
+        ; Console input (devices 18H-1FH) is answered from CINRDY, which
+        ; the emulator keeps current; everything else traps
+        LD      A, C
+        SUB     POLL_CONIN
+        CP      NMBCNS
+        JR      NC, POLLSLOW
+        ADD     A, CINRDY AND 0FFH
+        LD      L, A
+        LD      H, CINRDY SHR 8
+        LD      A, (HL)
         RET
+POLLSLOW:
+        LD      A, FUNC_POLLDEV
+        JR      DISPATCH
 
 DO_STARTCLK:
         LD      A, FUNC_STARTCLK
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_STOPCLK:
         LD      A, FUNC_STOPCLK
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_EXITRGN:
         LD      A, FUNC_EXITRGN
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_MAXCON:
         LD      A, FUNC_MAXCON
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_SYSINIT:
         LD      A, FUNC_SYSINIT
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_IDLE:
         LD      A, FUNC_IDLE
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_COMMONBASE:
         LD      A, FUNC_COMMONBASE
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_SWTUSER:
         LD      A, FUNC_SWTUSER
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_SWTSYS:
         LD      A, FUNC_SWTSYS
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_PDISP:
         LD      A, FUNC_PDISP
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 DO_XDOSENT:
         LD      A, FUNC_XDOSENT
-        OUT     (XIOS_DISPATCH), A
-        RET
+        JR      DISPATCH
 
 ; =============================================================================
-; Data area
+; Poll all (must stay at 0FBEDH - XIOS_POLLALL in xios.h)
+; Extended call, not in the jump table: one trap returns the readiness
+; of every device. HL = console input bitmap, DE = console output bitmap
+; (bit n = console n), A = bit 0 list, bit 1 reader, bit 2 punch.
 ; =============================================================================
 
-TICKN:      DB      0           ; Tick enable flag
-CNT60:      DB      60          ; 60 Hz counter
-PREEMP:     DB      0           ; Preempted flag
+POLLALL:
+        LD      A, FUNC_POLLALL
+        JR      DISPATCH
+
+; =============================================================================
+; Console input ready (must stay at 0FBF1H - XIOS_CINRDY in xios.h)
+; One byte per console, 0FFH if input is queued. Written by the emulator
+; from its console ready bitmap, so POLLDEVICE needs no trap for them.
+; =============================================================================
+
+CINRDY:     DS      NMBCNS
+            DB      0           ; Spare
+
+; =============================================================================
+; Poll return (must stay at 0FBFAH - XIOS_POLLRET in xios.h)
+; When a device is not ready the emulator parks the caller on the XDOS
+; poll list: it pushes the retry entry, BC, DE and POLLRET, loads
+; C=131 (poll), E=device and jumps to the XDOS. XDOS returns here once
+; POLLDEVICE reports the device ready; we restore the registers and
+; RET into the jump table entry to run the XIOS function again.
+; =============================================================================
+
+POLLRET:
+        POP     DE
+        POP     BC
+        RET
+
+            DS      3           ; Spare (end of page)
 
         END
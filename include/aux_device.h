@@ -0,0 +1,128 @@
+// aux_device.h - Host bridge for the READER/PUNCH auxiliary devices
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef AUX_DEVICE_H
+#define AUX_DEVICE_H
+
+#include "console_queue.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Host endpoint an AUX device is attached to
+enum class AuxEndpoint {
+    NONE,       // Not configured - reader returns EOF, punch discards
+    FILE,       // Regular file (reader: read once, punch: append)
+    FIFO,       // Named pipe, reopened after each writer/reader session
+    TCP         // Listening TCP socket, one client at a time
+};
+
+// One auxiliary device (READER is input, PUNCH is output).
+// The Z80 side only touches the buffer queue and never blocks on the host;
+// all file/socket I/O is done non-blocking by the AuxSystem I/O thread.
+class AuxDevice {
+public:
+    enum class Direction { INPUT, OUTPUT };
+
+    static constexpr size_t BUFFER_SIZE = 4096;
+
+    AuxDevice(const char* name, Direction dir);
+    ~AuxDevice();
+
+    // Non-copyable
+    AuxDevice(const AuxDevice&) = delete;
+    AuxDevice& operator=(const AuxDevice&) = delete;
+
+    // Configure endpoint from spec: "file:PATH", "fifo:PATH" or "tcp:[HOST:]PORT"
+    // Returns false if the spec is invalid or the endpoint cannot be created
+    bool configure(const std::string& spec);
+    void close();
+
+    bool is_configured() const { return endpoint_ != AuxEndpoint::NONE; }
+    const char* name() const { return name_; }
+
+    // Z80 side (called from XIOS)
+    // Reader: returns next byte, or -1 if nothing is buffered
+    int read_byte(unsigned timeout_ms = 0);
+    // Reader: true once the host source has ended and the buffer is drained.
+    // Consumes the EOF so the next FIFO writer / TCP client starts fresh.
+    bool take_eof();
+    // Punch: returns false if the buffer is full
+    bool write_byte(uint8_t ch, unsigned timeout_ms = 0);
+
+    // POLLDEVICE status
+    bool input_ready() const;
+    bool output_ready() const;
+
+    // Statistics
+    uint64_t bytes_transferred() const { return bytes_.load(); }
+
+    // I/O thread side
+    // eventfd the I/O thread polls; rung when the Z80 side frees reader
+    // space or queues punch data the thread is waiting for
+    void set_doorbell(int fd) { doorbell_ = fd; }
+    int poll_fd() const;
+    short poll_events() const;
+    void service(short revents);
+    void retry_open();
+
+private:
+    bool open_endpoint();
+    void close_data_fd();
+    void handle_eof();
+    void fill_from_host();
+    void drain_to_host();
+    void ring_io();
+
+    const char* name_;
+    Direction dir_;
+    AuxEndpoint endpoint_;
+    std::string path_;
+    std::string host_;
+    int port_;
+
+    int fd_;            // Data fd (file, fifo or connected client)
+    int listen_fd_;     // TCP listening socket
+
+    ConsoleQueue<BUFFER_SIZE> queue_;   // Z80 <-> I/O thread buffer
+    std::vector<uint8_t> pending_;      // Bytes held by the I/O thread
+    size_t pending_pos_;
+
+    int doorbell_;
+    std::atomic<bool> io_waiting_;      // I/O thread waits for the Z80 side
+
+    bool host_eof_;                     // I/O thread saw end of source
+    std::atomic<bool> eof_;             // EOF visible to the Z80 side
+    std::atomic<uint64_t> bytes_;
+};
+
+// AUX subsystem - owns the READER and PUNCH devices and their I/O thread
+class AuxSystem {
+public:
+    static AuxSystem& instance();
+
+    AuxDevice& reader() { return reader_; }
+    AuxDevice& punch() { return punch_; }
+
+    // Start/stop the I/O thread (no-op if no device is configured)
+    void start();
+    void stop();
+
+private:
+    AuxSystem();
+    ~AuxSystem();
+
+    void thread_func();
+
+    AuxDevice reader_;
+    AuxDevice punch_;
+    int doorbell_;      // Shared by both devices
+
+    std::thread thread_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stop_requested_;
+};
+
+#endif // AUX_DEVICE_H
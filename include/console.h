@@ -6,13 +6,23 @@
 #define CONSOLE_H
 
 #include "console_queue.h"
+#include "interrupt_controller.h"
+#include "line_editor.h"
+#include "screen_model.h"
+#include "term_translate.h"
+#include "output_broadcast.h"
+#include "rate_limiter.h"
 #include <atomic>
 #include <string>
 #include <array>
+#include <memory>
 #include <mutex>
+#include <vector>
+#include <cstdint>
 
 // Maximum number of consoles supported
 constexpr int MAX_CONSOLES = 8;
+static_assert(MAX_CONSOLES <= 32, "console ready bitmap is 32 bits");
 
 // Console state for one terminal
 class Console {
@@ -29,6 +39,28 @@ public:
     bool is_connected() const { return connected_.load(); }
     void set_connected(bool c) { connected_.store(c); }
 
+    // Persistent sessions - a console stays bound to its SSH user while
+    // detached, so the same user can reattach to the running program.
+    // key is the fingerprint of the public key the user proved to hold;
+    // only a console with a key can be reattached, and only with that key.
+    std::string owner() const {
+        std::lock_guard<std::mutex> lock(term_mutex_);
+        return owner_;
+    }
+    std::string key() const {
+        std::lock_guard<std::mutex> lock(term_mutex_);
+        return key_;
+    }
+    bool is_detached() const { return detached_.load(); }
+    // Bind to user (and key) and mark connected
+    void attach(const std::string& user, const std::string& key = std::string());
+    void detach();                          // Disconnected, output to scrollback
+    int64_t detached_ms() const;            // Time spent detached (0 if attached)
+
+    // Scrollback kept while detached (oldest output is overwritten)
+    static constexpr size_t SCROLLBACK_SIZE = 16384;
+    size_t take_scrollback(std::vector<uint8_t>& out);
+
     // Local console mode (outputs to stdout)
     bool is_local() const { return local_mode_.load(); }
     void set_local_mode(bool l) { local_mode_.store(l); connected_.store(l); }
@@ -54,23 +86,101 @@ public:
     ConsoleQueue<256>& input_queue() { return input_queue_; }
     ConsoleQueue<1024>& output_queue() { return output_queue_; }
 
+    // Queue keyboard input, returns count accepted
+    size_t put_input(const uint8_t* data, size_t len);
+    // Same without ringing the doorbell (for the bridges that drain it)
+    size_t push_input(const uint8_t* data, size_t len);
+
+    // Paste staging: client input beyond what the input queue holds waits
+    // here and is fed in as the guest reads CONIN (or at the paste pacer's
+    // rate). Sessions stop reading from the client above the high-water
+    // mark, so SSH flow control holds back the rest of a large paste.
+    static constexpr size_t PASTE_HIGH_WATER = 65536;
+    void stage_input(const uint8_t* data, size_t len);
+    size_t feed_input();                    // Staged -> queue, returns count
+    size_t staged_input() const;
+    bool input_backlogged() const { return staged_input() >= PASTE_HIGH_WATER; }
+
+    // Optional pacing for programs that drop fast input (rate 0 = off)
+    void set_paste_pace(uint32_t cps, uint32_t burst);
+
+    // Bridge wakeup: an eventfd written once per burst of queued output or
+    // input. The bridge re-arms it after draining. -1 disables.
+    void set_doorbell(int fd) { doorbell_fd_ = fd; }
+    void arm_doorbell() { doorbell_armed_.store(true); }
+    // Same, as a futex word in shared memory (nullptr disables)
+    void set_doorbell_futex(std::atomic<uint32_t>* word, std::atomic<uint32_t>* waiting) {
+        doorbell_waiting_ = waiting;
+        doorbell_word_.store(word);
+    }
+
+    // Host-side screen model for diff-based output (fps = 0 disables)
+    void enable_screen_model(int fps);
+    ScreenModel* screen_model() { return screen_.get(); }
+    int screen_fps() const { return screen_fps_; }
+
+    // Guest -> client terminal translation (used when no screen model)
+    OutputTranslator& output_translator() { return translator_; }
+
+    // Read-only viewers (published by the session draining output_queue)
+    OutputBroadcast& broadcast() { return broadcast_; }
+
+    // Output shaping (Z80 thread only). A console is output-ready while
+    // its queue has room and the token bucket allows another byte.
+    TokenBucket& output_shaper() { return shaper_; }
+    bool output_ready();
+
+    // Throughput metrics
+    uint64_t bytes_out() const { return bytes_out_.load(); }
+    uint64_t throttled() const { return throttled_.load(); }
+    void count_throttle() { throttled_++; }
+
     // XIOS interface (called from Z80 thread)
     // Returns 0xFF if input available, 0x00 if not
     uint8_t const_status();
 
-    // Read character (may block briefly)
-    uint8_t read_char();
+    // Take the next input character, or -1 if none is queued (never blocks)
+    int read_char();
+
+    // Put input back in front of the queue (Z80 thread only). It survives
+    // detach, so the owner's typeahead is still there on reattach; reset
+    // drops it (on the Z80 thread's next read, which owns the buffer).
+    void unread(const uint8_t* data, size_t len);
+    bool has_unread() const { return has_unread_.load(); }
 
     // Write character
     void write_char(uint8_t ch);
 
-    // Reset on disconnect
+    // Cursor column as left by write_char (Z80 thread only)
+    int column() const { return column_; }
+
+    // True while the current output line starts with a CCP prompt ("A>",
+    // "0A>"), i.e. no program is running. Fed by write_char, or by the
+    // front end for output that arrives through the shared segment.
+    bool at_prompt() const { return at_prompt_.load(); }
+    void track_output(uint8_t ch);
+
+    // Host line discipline state for BDOS function 10
+    LineEditor& line_editor() { return line_editor_; }
+
+    // Reset on disconnect (or idle reap) - console returns to the pool.
+    // A program still running keeps running; find_free skips the console
+    // until the program exits back to the prompt.
     void reset();
 
 private:
+    void scrollback_put(uint8_t ch);
+    void clear_staged();
+    void sync_input_ready();
+    void ring_doorbell();
+
     int id_;
     std::atomic<bool> connected_;
     std::atomic<bool> local_mode_;
+    std::atomic<bool> detached_;
+    std::atomic<int64_t> detached_at_;     // steady_clock ms
+    std::string owner_;                    // Guarded by term_mutex_
+    std::string key_;                      // Guarded by term_mutex_
     std::atomic<int> term_width_;
     std::atomic<int> term_height_;
     std::string term_type_;
@@ -78,6 +188,39 @@ private:
 
     ConsoleQueue<256> input_queue_;    // SSH -> Z80 (keyboard)
     ConsoleQueue<1024> output_queue_;  // Z80 -> SSH (display)
+
+    std::unique_ptr<ScreenModel> screen_;  // Owned by the attached session
+    int screen_fps_;
+    OutputTranslator translator_;      // Owned by the attached session
+    OutputBroadcast broadcast_;
+
+    int doorbell_fd_;
+    std::atomic<bool> doorbell_armed_;
+    std::atomic<std::atomic<uint32_t>*> doorbell_word_;
+    std::atomic<uint32_t>* doorbell_waiting_;
+
+    TokenBucket shaper_;
+    std::atomic<uint64_t> bytes_out_;
+    std::atomic<uint64_t> throttled_;      // Times CONOUT had to wait
+
+    std::string unread_;                   // Read before the queue (Z80 thread)
+    std::atomic<bool> has_unread_;
+    std::atomic<bool> unread_stale_;       // Set by reset, unread_ to be dropped
+    int column_;
+    std::atomic<bool> at_prompt_;          // Written by one output thread
+    char prompt_line_[4];                  // Start of the current line
+    size_t prompt_len_;
+    LineEditor line_editor_;
+
+    std::string staged_;                   // Input waiting for queue space
+    size_t staged_pos_;
+    TokenBucket paste_pacer_;              // Guarded by staged_mutex_
+    mutable std::mutex staged_mutex_;
+
+    std::vector<uint8_t> scrollback_;
+    size_t scrollback_head_;
+    size_t scrollback_count_;
+    std::mutex scrollback_mutex_;
 };
 
 // Global console manager
@@ -91,19 +234,57 @@ public:
     // Get console by ID (0 to MAX_CONSOLES-1)
     Console* get(int id);
 
-    // Find a free (disconnected) console, returns nullptr if none
+    // Find a free (disconnected, not detached, at the CCP prompt) console,
+    // returns nullptr if none
     Console* find_free();
 
+    // Attach console id to owner if it is still neither connected nor
+    // detached (and, with at_prompt, is back at the CCP prompt). SSH, the
+    // front end and local clients all claim through here, so two of them
+    // can't take the same console.
+    bool try_claim(int id, const std::string& owner, const std::string& key = std::string(),
+                   bool at_prompt = false);
+
+    // Find a detached console owned by user and bound to the same key,
+    // returns nullptr if none (or if key is empty)
+    Console* find_detached(const std::string& user, const std::string& key);
+
+    // Seconds a detached console is kept before it is reaped (0 = no
+    // persistence, consoles are reset as soon as the connection drops)
+    void set_detach_timeout(int seconds) { detach_timeout_ = seconds; }
+    int detach_timeout() const { return detach_timeout_; }
+
+    // Reset detached consoles idle longer than the timeout, returns count.
+    // The guest program is not stopped (a CP/M program can ignore ^C), so
+    // a reaped console stays out of find_free until it is back at the CCP.
+    int reap_idle();
+
     // Number of currently connected consoles
     int connected_count() const;
 
     // Maximum console number
     int max_console() const { return MAX_CONSOLES; }
 
+    // Consoles with queued input, bit n = console n. Producers set a bit
+    // after queueing; the Z80 thread clears it once the queue drains, so
+    // every console is polled with a single load and no queue lock.
+    uint32_t input_ready_mask() const { return input_ready_.load(std::memory_order_acquire); }
+    void set_input_ready(int id, bool ready) {
+        uint32_t bit = 1u << id;
+        if (!ready) {
+            input_ready_.fetch_and(~bit, std::memory_order_release);
+        } else if (!(input_ready_.fetch_or(bit, std::memory_order_acq_rel) & bit)) {
+            InterruptController::instance().raise(IRQ_CONSOLE);
+        }
+    }
+
 private:
     ConsoleManager() = default;
     std::array<std::unique_ptr<Console>, MAX_CONSOLES> consoles_;
     bool initialized_ = false;
+    int detach_timeout_ = 0;
+    std::atomic<uint32_t> input_ready_{0};
+    std::mutex claim_mutex_;
 };
 
 #endif // CONSOLE_H
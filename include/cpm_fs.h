@@ -0,0 +1,106 @@
+// cpm_fs.h - Host-side access to files on CP/M disk images
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef CPM_FS_H
+#define CPM_FS_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+class Disk;
+
+// Directory listing entry
+struct CpmFileInfo {
+    uint8_t user;           // User area 0-15
+    std::string name;       // "NAME.EXT" (or "NAME"), upper case
+    uint32_t size;          // Bytes, a multiple of 128
+    bool read_only;         // T1' attribute
+    bool system;            // T2' attribute
+};
+
+// Whole-file operations on a mounted drive, using its DPB.
+// Every operation holds the drive lock for its duration, so it never
+// interleaves with a guest sector transfer. Writes allocate blocks from
+// the top of the disk down, away from where the BDOS allocates, and are
+// refused once the guest has logged the drive in (see
+// Disk::guest_logged_in), since the BDOS allocation vector is not
+// visible from here.
+class CpmFs {
+public:
+    enum class Result {
+        OK,
+        NOT_FOUND,
+        EXISTS,
+        READ_ONLY,      // Disk image or file is read-only
+        IN_USE,         // Guest has logged the drive in (writes only)
+        DISK_FULL,
+        DIR_FULL,
+        BAD_NAME,
+        IO_ERROR
+    };
+
+    explicit CpmFs(Disk* disk);
+
+    // All files in all user areas
+    Result list(std::vector<CpmFileInfo>& files);
+
+    Result stat(uint8_t user, const std::string& name, CpmFileInfo& info);
+    Result read_file(uint8_t user, const std::string& name, std::vector<uint8_t>& data);
+
+    // Create or replace a file; data is padded to a record with ^Z
+    Result write_file(uint8_t user, const std::string& name, const std::vector<uint8_t>& data);
+
+    Result remove(uint8_t user, const std::string& name);
+    Result rename(uint8_t user, const std::string& from, const std::string& to);
+
+    uint32_t free_bytes();
+
+    // "name.ext" to the 11-byte directory form; false if not a CP/M name
+    static bool make_name(const std::string& name, uint8_t fcb[11]);
+
+    static const char* result_string(Result r);
+
+private:
+    // Directory entry fields
+    static constexpr int ENTRY_SIZE = 32;
+    static constexpr uint8_t DELETED = 0xE5;
+
+    uint32_t records_per_block() const { return 1u << bsh_; }
+    uint32_t records_per_entry() const { return 128u * (exm_ + 1); }
+    int pointers_per_entry() const { return big_ ? 8 : 16; }
+    uint32_t dir_blocks() const;
+
+    int read_block_record(uint32_t block, uint32_t record, uint8_t* buf);
+    int write_block_record(uint32_t block, uint32_t record, const uint8_t* buf);
+
+    // Directory cache for one operation
+    bool load_dir();
+    bool store_dir_entry(size_t index);
+    uint8_t* entry(size_t index) { return &dir_[index * ENTRY_SIZE]; }
+
+    bool matches(size_t index, uint8_t user, const uint8_t fcb[11]) const;
+    uint32_t block_at(size_t index, int slot) const;
+    void set_block(size_t index, int slot, uint32_t block);
+    static uint32_t extent_number(const uint8_t* e);
+
+    // Entries of a file, in extent order
+    std::vector<size_t> file_entries(uint8_t user, const uint8_t fcb[11]) const;
+    uint32_t file_records(const std::vector<size_t>& entries) const;
+    std::vector<bool> used_blocks() const;
+
+    Disk* disk_;
+    uint16_t spt_;
+    uint8_t bsh_;
+    uint8_t exm_;
+    uint16_t dsm_;
+    uint16_t drm_;
+    uint16_t off_;
+    uint16_t dir_alloc_;    // AL0/AL1
+    bool big_;              // 16-bit block pointers
+
+    std::vector<uint8_t> dir_;
+};
+
+#endif // CPM_FS_H
@@ -5,11 +5,15 @@
 #ifndef DISK_H
 #define DISK_H
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 #include <fstream>
 #include <vector>
 #include <memory>
+#include <mutex>
+
+class DiskJournal;
 
 // Disk Parameter Header (DPH) - 16 bytes
 struct DiskParameterHeader {
@@ -58,6 +62,11 @@ public:
     bool is_open() const { return file_.is_open(); }
     bool is_read_only() const { return read_only_; }
 
+    // Send writes through a write-ahead journal (see disk_journal.h)
+    // instead of flushing the image on every sector
+    bool enable_journal();
+    bool is_journaled() const { return journal_ != nullptr; }
+
     // Disk geometry
     void set_geometry(uint16_t sectors_per_track, uint16_t tracks,
                       uint16_t sector_size = 128);
@@ -81,6 +90,26 @@ public:
     int read_sector(uint8_t* buffer);
     int write_sector(const uint8_t* buffer);
 
+    // Read/write one 128-byte CP/M record by track and logical sector,
+    // applying the format's skew. Leaves the current track/sector alone.
+    // Returns 0 on success, non-zero on error
+    int read_record(uint16_t track, uint16_t sector, uint8_t* buffer);
+    int write_record(uint16_t track, uint16_t sector, const uint8_t* buffer);
+
+    // Logical to physical record skew within a track
+    uint16_t translate(uint16_t logical_sector) const;
+
+    // Drive lock: held by the XIOS for each transfer and by host-side
+    // filesystem access for a whole operation
+    std::mutex& mutex() { return mutex_; }
+
+    // Set once the guest BDOS selects the drive. From then on its
+    // in-memory allocation vector may hold blocks the directory does not
+    // show yet, so host-side writes could hand the same blocks out twice.
+    // Set and tested with mutex() held.
+    void mark_guest_login() { guest_login_.store(true); }
+    bool guest_logged_in() const { return guest_login_.load(); }
+
     // Get DPB for standard disk formats
     const DiskParameterBlock& dpb() const { return dpb_; }
 
@@ -88,6 +117,12 @@ private:
     // Calculate file offset for current track/sector
     size_t sector_offset() const;
 
+    // File offset of a logical record, with skew applied
+    size_t record_offset(uint16_t track, uint16_t sector) const;
+
+    // Read from the image file, E5 past its end
+    void read_image(size_t offset, uint8_t* buffer, size_t length);
+
     std::fstream file_;
     std::string path_;
     bool read_only_;
@@ -101,6 +136,11 @@ private:
     uint16_t current_sector_;
 
     DiskParameterBlock dpb_;
+
+    std::unique_ptr<DiskJournal> journal_;
+    std::atomic<bool> guest_login_{false};
+
+    std::mutex mutex_;
 };
 
 // Disk subsystem - manages multiple drives
@@ -110,6 +150,9 @@ public:
 
     static DiskSystem& instance();
 
+    // Journal writes on drives mounted from now on
+    void set_journal(bool on) { journal_ = on; }
+
     // Mount disk image on drive (0 = A:, 1 = B:, etc.)
     bool mount(int drive, const std::string& path, bool read_only = false);
     void unmount(int drive);
@@ -141,6 +184,7 @@ private:
     std::unique_ptr<Disk> disks_[MAX_DISKS];
     int current_drive_;
     uint16_t dma_addr_;
+    bool journal_;
 };
 
 #endif // DISK_H
@@ -0,0 +1,88 @@
+// disk_journal.h - Write-ahead journal for disk images
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef DISK_JOURNAL_H
+#define DISK_JOURNAL_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Journal for one disk image, kept next to it as IMAGE.journal.
+//
+// write() appends the sector to the journal without syncing and returns;
+// lookup() sees it at once. A group commit thread fdatasyncs the journal
+// once per commit window, so one sync covers every write appended in
+// that window. Past a size limit the journal is renamed IMAGE.journal.old
+// and a fresh one started, and its sectors are copied into the image with
+// the lock released (checkpoint). Writes go on meanwhile; lookup() serves
+// the sectors being copied until the image is synced and the old journal
+// removed.
+//
+// Records carry a sequence number and a CRC. Replay applies the longest
+// valid run from the start of the journal, so after a host crash the
+// image holds the acknowledged writes up to some point, in order, and at
+// most the last commit window is lost. No sector is ever half written.
+class DiskJournal {
+public:
+    static constexpr std::chrono::milliseconds COMMIT_WINDOW{5};
+    static constexpr size_t CHECKPOINT_BYTES = 4 * 1024 * 1024;
+
+    explicit DiskJournal(const std::string& image_path);
+    ~DiskJournal();
+
+    // Replay a leftover journal, start an empty one and the commit thread
+    bool open();
+    // Commit, checkpoint and remove the journal
+    void close();
+
+    // Append a sector at image offset; false if the journal has failed
+    bool write(size_t offset, const uint8_t* data, size_t length);
+    // Latest journalled copy of the sector at offset, if any
+    bool lookup(size_t offset, uint8_t* data, size_t length);
+
+    // Apply IMAGE.journal.old and IMAGE.journal, if present, to the image
+    // and remove them
+    static bool recover(const std::string& image_path);
+
+private:
+    static std::string journal_path(const std::string& image_path);
+    static std::string old_journal_path(const std::string& image_path);
+    static bool sync_dir(const std::string& path);
+    static bool replay_file(int image_fd, const std::string& path);
+    static bool replay(int image_fd, int journal_fd, const std::string& path);
+
+    void commit_func();
+    bool checkpoint();
+
+    std::string image_path_;
+    std::string journal_path_;
+    std::string old_path_;
+    int image_fd_;
+    int journal_fd_;
+
+    std::mutex mutex_;
+    std::condition_variable commit_cv_;
+    std::thread thread_;
+    bool running_;
+    bool failed_;               // Sync or append error: refuse writes
+
+    // Sectors not yet checkpointed, by image offset
+    std::unordered_map<size_t, std::vector<uint8_t>> sectors_;
+    // Sectors of the old journal while a checkpoint copies them. Written
+    // by the checkpoint under mutex_, read by it without.
+    std::unordered_map<size_t, std::vector<uint8_t>> checkpointing_;
+    uint64_t next_seq_;
+    uint64_t appended_;         // Last sequence number written
+    uint64_t durable_;          // Last sequence number synced
+    size_t journal_bytes_;
+};
+
+#endif // DISK_JOURNAL_H
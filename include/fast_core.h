@@ -0,0 +1,150 @@
+// fast_core.h - Z80 interpreter with lazily evaluated condition flags
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef FAST_CORE_H
+#define FAST_CORE_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class MpmCpu;
+class qkz80_cpu_mem;
+
+// Runs the unprefixed Z80 instruction set on MpmCpu's registers, keeping
+// the last flag-producing ALU operation (kind, operands, result) instead
+// of F. F is only built when something reads it: conditional jumps,
+// calls and returns (which build just the one flag they test), PUSH AF,
+// ADC/SBC/INC/DEC and the rotates that carry flags through, and anything
+// handed to qkz80.
+//
+// CB/DD/ED/FD prefixes, EX AF,AF', EXX and HALT go to qkz80 unchanged
+// with F materialised first, so qkz80 stays the reference for the whole
+// instruction set and for every flag this core computes.
+//
+// Superinstructions: a table built at construction marks opcodes that
+// start a common nucleus sequence; after one of them step() looks at the
+// following opcodes and runs the whole sequence in one fused handler
+// (DEC r/CP n/OR A with the JP or RET cc on them, the BDOS byte move,
+// LD HL,(nn) with EX DE,HL, PL/M's 16-bit add and subtract, LD r,(HL)/
+// LD (HL),r with INC HL, POP runs, CALL through the XIOS jump table into
+// the stub's LD A,func; JR). The set comes from --profile-pairs runs, see
+// the table in fast_core.cpp. Fusion never runs into the stop address, so
+// PC-based traps still see every instruction they look for.
+//
+// Z80 thread only. Outside step(), regs.AF's low byte is stale until
+// sync_flags() is called.
+class FastCore {
+public:
+    FastCore(MpmCpu* cpu, qkz80_cpu_mem* mem);
+
+    // Execute one instruction, or a fused sequence of them (same contract
+    // as qkz80::execute). Returns the number of instructions executed.
+    unsigned step();
+
+    // Kill switch for fused sequences
+    void set_superinstructions(bool on) { super_ = on; }
+    // Fusion stops before this address (0 = none)
+    void set_stop_pc(uint16_t pc) { stop_pc_ = pc; }
+
+    // Count executed opcode pairs (turns fusion off so every pair is seen)
+    void enable_pair_profile();
+    // Most frequent pairs, one per line, to path
+    bool write_pair_profile(const std::string& path, size_t top) const;
+
+    // Check every instruction against qkz80: run it here, undo its
+    // register and memory changes, run it again on qkz80 and log any
+    // difference. qkz80's result is kept; IN and OUT run on qkz80 alone.
+    // Turns fusion off.
+    void enable_lockstep();
+
+    // Write pending flags into regs.AF
+    void sync_flags() { if (op_ != FlagOp::NONE) materialise(); }
+
+    // Instructions handed to qkz80
+    uint64_t fallbacks() const { return fallbacks_; }
+    // Instructions on which the cores differed in lockstep mode
+    uint64_t mismatches() const { return mismatches_; }
+
+private:
+    enum class FlagOp : uint8_t {
+        NONE,       // F is in regs.AF
+        ADD,        // ADD/ADC: a_ + b_ (+ carry) = res_
+        SUB,        // SUB/SBC: a_ - b_ (- carry) = res_
+        CP,         // As SUB, but X/Y come from b_
+        AND,
+        OR,         // OR and XOR
+        INC,        // res_ = a_ + 1, carry_ kept
+        DEC         // res_ = a_ - 1, carry_ kept
+    };
+
+    void materialise();
+    bool flag_z() const;
+    bool flag_c() const;
+    bool flag_s() const;
+    bool condition(int cc);
+
+    uint8_t fetch8();
+    uint16_t fetch16();
+    uint8_t read8(uint16_t addr);
+    void write8(uint16_t addr, uint8_t value);
+    uint16_t read16(uint16_t addr);
+    void write16(uint16_t addr, uint16_t value);
+    void push(uint16_t value);
+    uint16_t pop();
+
+    uint8_t get_r(int r);
+    void set_r(int r, uint8_t value);
+    uint16_t get_rp(int rp);
+    void set_rp(int rp, uint16_t value);
+
+    void alu(int op, uint8_t value);
+    uint8_t inc8(uint8_t value);
+    uint8_t dec8(uint8_t value);
+    void fallback();
+    unsigned step_lockstep();
+
+    // Fusion families, by first opcode
+    enum Fuse : uint8_t {
+        FUSE_NONE,
+        FUSE_BRANCH,        // DEC r, CP n or OR A, then JP cc / RET cc
+        FUSE_MOVE,          // LD A,(DE); LD (HL),A; INC DE; INC HL
+        FUSE_XCHG,          // LD HL,(nn) and EX DE,HL, either order
+        FUSE_ARITH16,       // PL/M's 16-bit add and subtract through A
+        FUSE_HL_STEP,       // LD r,(HL) or LD (HL),r, then INC HL
+        FUSE_POP,           // POP runs
+        FUSE_CALL           // CALL nn into [JP nn;] LD A,n; JR e
+    };
+    unsigned fuse(uint8_t first, unsigned& t);
+    unsigned fuse_branch(unsigned& t);
+    bool next_ops(const uint8_t* ops, unsigned n, unsigned offset = 0);
+    bool next_op(uint8_t& op);
+
+    MpmCpu* cpu_;
+    qkz80_cpu_mem* mem_;
+
+    FlagOp op_ = FlagOp::NONE;
+    uint8_t a_ = 0;
+    uint8_t b_ = 0;
+    uint16_t res_ = 0;
+    bool carry_ = false;
+
+    uint64_t fallbacks_ = 0;
+
+    bool super_ = true;
+    uint16_t stop_pc_ = 0;
+    uint8_t fuse_kind_[256];
+
+    bool lockstep_ = false;
+    bool recording_ = false;
+    std::vector<std::pair<uint16_t, uint8_t>> undo_;   // Address, old byte
+    uint64_t mismatches_ = 0;
+
+    std::unique_ptr<uint64_t[]> pair_counts_;   // [prev << 8 | op]
+    uint8_t prev_op_ = 0;
+};
+
+#endif // FAST_CORE_H
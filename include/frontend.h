@@ -0,0 +1,116 @@
+// frontend.h - SSH front-end process and its shared-memory console link
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef FRONTEND_H
+#define FRONTEND_H
+
+#include "console.h"
+#include "spsc_ring.h"
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/types.h>
+
+// Shared console segment (memfd) between the emulator and the front end.
+// Per console: a keyboard ring (front end -> emulator), a display ring
+// (emulator -> front end) and the attach state, which the front end owns.
+constexpr uint32_t CONSOLE_SHM_MAGIC   = 0x324D504D;  // "MPM2"
+constexpr uint32_t CONSOLE_SHM_VERSION = 2;
+
+enum ConsoleShmState : uint32_t {
+    SHM_CONSOLE_FREE     = 0,
+    SHM_CONSOLE_ATTACHED = 1,
+    SHM_CONSOLE_DETACHED = 2
+};
+
+struct ConsoleShmSlot {
+    SpscRing<4096> to_core;         // Keyboard input
+    SpscRing<16384> to_frontend;    // Display output
+
+    // Attach state - seqlock: odd while the writer is updating
+    std::atomic<uint32_t> state_seq;
+    std::atomic<uint32_t> state;
+    char owner[32];
+    char key[72];                   // Owner's public key fingerprint
+};
+
+struct ConsoleShm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t consoles;
+    std::atomic<int32_t> frontend_pid;
+    ConsoleShmSlot slots[MAX_CONSOLES];
+};
+
+// Emulator side: owns the segment, runs the front-end process (restarting
+// it if it exits) and mirrors the local consoles into the rings
+class FrontendHost {
+public:
+    FrontendHost();
+    ~FrontendHost();
+
+    // Create the segment and start the front end as: exe args... --frontend-fd FDS
+    bool start(const std::string& exe, const std::vector<std::string>& args);
+    void stop();
+
+    bool is_running() const { return running_.load(); }
+
+private:
+    void supervisor_func();
+    void bridge_func();
+    pid_t spawn();
+    void apply_state(int id, Console* con, ConsoleShmSlot& slot);
+
+    std::string exe_;
+    std::vector<std::string> args_;
+
+    int shm_fd_;
+    int core_bell_;         // Rung by the front end and local consoles
+    int frontend_bell_;     // Rung by us for the front end
+    ConsoleShm* shm_;
+
+    uint32_t applied_seq_[MAX_CONSOLES];
+    std::vector<uint8_t> replay_[MAX_CONSOLES];  // Scrollback to send on reattach
+
+    std::atomic<pid_t> pid_;
+    std::thread supervisor_;
+    std::thread bridge_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stop_requested_;
+};
+
+// Front-end side: maps the segment and mirrors its consoles into the
+// local ConsoleManager, so SSHSession works exactly as in-process
+class FrontendClient {
+public:
+    FrontendClient();
+    ~FrontendClient();
+
+    // Attach to the segment, fds = "SHM:COREBELL:FRONTENDBELL"
+    bool open(const std::string& fds);
+
+    void start();
+    void stop();
+
+private:
+    void bridge_func();
+    bool sync(bool& rang_core);
+    void publish_state(int id, uint32_t state, const std::string& owner,
+                       const std::string& key);
+
+    int shm_fd_;
+    int core_bell_;
+    int frontend_bell_;
+    ConsoleShm* shm_;
+
+    uint32_t last_state_[MAX_CONSOLES];
+    std::string last_owner_[MAX_CONSOLES];
+    std::string last_key_[MAX_CONSOLES];
+
+    std::thread bridge_;
+    std::atomic<bool> stop_requested_;
+};
+
+#endif // FRONTEND_H
@@ -0,0 +1,38 @@
+// futex.h - Futex wait/wake on shared-memory words
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Shared (not PRIVATE) futexes, so they work across processes mapping
+// the same segment
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t), "futex word must be 32 bits");
+
+// Sleep while *word == expected, at most timeout_ms
+inline void futex_wait(std::atomic<uint32_t>* word, uint32_t expected, int timeout_ms) {
+    struct timespec ts;
+    ts.tv_sec = timeout_ms / 1000;
+    ts.tv_nsec = (timeout_ms % 1000) * 1000000L;
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+}
+
+// Wake every sleeper on word
+inline void futex_wake(std::atomic<uint32_t>* word) {
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, INT32_MAX, nullptr, nullptr, 0);
+}
+
+// Doorbell: bump the word, and only make the syscall if someone sleeps on it
+inline void futex_ring(std::atomic<uint32_t>* word, std::atomic<uint32_t>* waiting) {
+    word->fetch_add(1);
+    if (waiting->load()) futex_wake(word);
+}
+
+#endif // FUTEX_H
@@ -0,0 +1,87 @@
+// interrupt_controller.h - Pending interrupt lines and the clock timer
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef INTERRUPT_CONTROLLER_H
+#define INTERRUPT_CONTROLLER_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+// Interrupt sources. Each raises one bit in a shared pending word from
+// its own thread; the Z80 thread checks that word between instructions
+// and services what is set, so no source is polled.
+enum IrqLine : uint8_t {
+    IRQ_TICK    = 0,    // Clock timer (timerfd thread)
+    IRQ_CONSOLE = 1,    // Console input queued while the console was empty
+    IRQ_DISK    = 2,    // Disk request completed
+    IRQ_AUX     = 3,    // READER data/EOF arrived or PUNCH space freed
+    IRQ_LINES   = 4
+};
+
+constexpr uint32_t irq_bit(IrqLine line) { return 1u << line; }
+
+// Guest view (port 0xE3, see MpmPorts::IRQ_CONTROL):
+//   OUT: bits 1-3 enable the console, disk and AUX lines for the guest.
+//        The tick line follows STARTCLOCK/STOPCLOCK and ignores bit 0.
+//   IN:  lines taken by IM 0/1 interrupts since the last read (cleared
+//        by the read), so a single RST 38H handler can tell them apart.
+// In IM 2 each line has its own vector: the handler address is read
+// from I * 256 + line * 2, one line per interrupt, lowest line first.
+class InterruptController {
+public:
+    static InterruptController& instance();
+
+    // Any thread: set a line, waking the Z80 thread if it sleeps
+    void raise(IrqLine line);
+
+    // Z80 thread: one load per instruction, then take what is set
+    uint32_t pending() const { return pending_.load(std::memory_order_acquire); }
+    uint32_t take_all() { return pending_.exchange(0, std::memory_order_acq_rel); }
+
+    // Sleep until a line is pending, at most timeout_ms
+    void wait(int timeout_ms);
+
+    // Clock timer thread: raises IRQ_TICK every interval
+    bool start_timer(std::chrono::microseconds interval);
+    void stop_timer();
+    // Timer expirations since the last call (IRQ_TICK may cover several)
+    unsigned take_ticks() { return ticks_.exchange(0); }
+    // Count the next expiration now; false if one is already borrowed
+    bool borrow_tick() { return !borrowed_.exchange(true); }
+
+    // Guest enable mask and IM 0/1 source register (port 0xE3)
+    uint32_t guest_mask() const { return guest_mask_.load(std::memory_order_relaxed); }
+    void set_guest_mask(uint8_t mask) { guest_mask_.store(mask & ~irq_bit(IRQ_TICK) & 0x0F); }
+    void acknowledge(uint32_t lines) { in_service_ |= lines; }
+    uint8_t take_in_service() {
+        uint8_t lines = static_cast<uint8_t>(in_service_);
+        in_service_ = 0;
+        return lines;
+    }
+
+    // IM 2 vector offset of a line
+    static uint8_t vector(IrqLine line) { return static_cast<uint8_t>(line * 2); }
+
+private:
+    InterruptController();
+    ~InterruptController();
+
+    void timer_func();
+
+    std::atomic<uint32_t> pending_;
+    std::atomic<uint32_t> waiting_;     // Z80 thread sleeps in wait()
+
+    int timer_fd_;
+    std::thread timer_;
+    std::atomic<bool> timer_running_;
+    std::atomic<unsigned> ticks_;
+    std::atomic<bool> borrowed_;
+
+    std::atomic<uint32_t> guest_mask_;
+    uint32_t in_service_;               // Z80 thread only
+};
+
+#endif // INTERRUPT_CONTROLLER_H
@@ -0,0 +1,58 @@
+// line_editor.h - Host-side line discipline for BDOS Read Console Buffer
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef LINE_EDITOR_H
+#define LINE_EDITOR_H
+
+#include <cstdint>
+#include <string>
+
+class Console;
+
+// Edits one BDOS function 10 line in the host, following the CP/M 2
+// conventions of the MP/M II console BDOS: CR/LF end the line, ^H backs
+// up one character, DEL erases and echoes it, ^E is a physical end of
+// line, ^X erases the line, ^U restarts it and ^R retypes it. Control
+// characters echo as ^X and tabs expand to the next multiple of 8.
+//
+// ^C, ^D and ^P need the BDOS (abort, detach, list echo): the editor
+// erases its echo and pushes the partial line back so the BDOS reads
+// and handles it all. ^S and ^Q have nothing to stop and are dropped.
+//
+// State persists while the caller waits for more input. Z80 thread only.
+class LineEditor {
+public:
+    enum class Status {
+        WAITING,    // Input queue drained, line not finished
+        DONE,       // line() holds the finished line
+        HANDOFF     // Partial line pushed back for the BDOS
+    };
+
+    LineEditor() : active_(false), buf_(0), max_(0), start_col_(0) {}
+
+    // True while editing a line for the buffer at buf
+    bool active_for(uint16_t buf) const { return active_ && buf_ == buf; }
+
+    void begin(uint16_t buf, uint8_t max, int start_col);
+    void reset();
+
+    // Consume queued input for the console, echoing as the BDOS would
+    Status feed(Console& con);
+
+    const std::string& line() const { return line_; }
+
+private:
+    void echo(Console& con, uint8_t ch);
+    void backup_to(Console& con, int col);
+    void restart(Console& con);
+    int end_column() const;
+
+    bool active_;
+    uint16_t buf_;
+    uint8_t max_;
+    int start_col_;
+    std::string line_;
+};
+
+#endif // LINE_EDITOR_H
@@ -0,0 +1,117 @@
+// local_console.h - Shared-memory console transport for local clients
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef LOCAL_CONSOLE_H
+#define LOCAL_CONSOLE_H
+
+#include "console.h"
+#include "spsc_ring.h"
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <thread>
+
+// Named POSIX shared-memory segment (default /mpm2-consoles) giving local
+// processes - test harnesses, a GUI terminal - direct access to consoles
+// without SSH. Per console: a keyboard ring, a display ring and futex
+// doorbells, which are only syscalls when the other side is asleep.
+//
+// A client claims a slot by writing its pid; the emulator grants it if
+// the console is free (it then counts as attached to user "local") or
+// marks it busy. Clearing the pid, or the client dying, releases it.
+constexpr uint32_t LOCAL_CONSOLE_MAGIC   = 0x4C4D504D;  // "MPML"
+constexpr uint32_t LOCAL_CONSOLE_VERSION = 1;
+constexpr const char* LOCAL_CONSOLE_DEFAULT_NAME = "/mpm2-consoles";
+
+enum LocalSlotState : uint32_t {
+    LOCAL_SLOT_IDLE    = 0,     // Unclaimed, or claim not yet seen
+    LOCAL_SLOT_GRANTED = 1,
+    LOCAL_SLOT_BUSY    = 2      // Console in use, or not yet back at the prompt
+};
+
+struct LocalConsoleSlot {
+    SpscRing<4096> input;       // Client -> emulator (keyboard)
+    SpscRing<65536> output;     // Emulator -> client (display)
+
+    std::atomic<int32_t> client_pid;        // Written by the client
+    std::atomic<uint32_t> state;            // LocalSlotState, written by the emulator
+
+    // Client doorbell: output arrived, input drained or state changed
+    std::atomic<uint32_t> client_bell;
+    std::atomic<uint32_t> client_waiting;
+};
+
+struct LocalConsoleShm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t consoles;
+    std::atomic<int32_t> emulator_pid;
+
+    // Emulator doorbell: input written, output drained or slot claimed
+    std::atomic<uint32_t> host_bell;
+    std::atomic<uint32_t> host_waiting;
+
+    LocalConsoleSlot slots[MAX_CONSOLES];
+};
+
+// Emulator side: creates the segment and moves bytes between the rings
+// and the consoles granted to local clients
+class LocalConsoleHost {
+public:
+    LocalConsoleHost();
+    ~LocalConsoleHost();
+
+    bool start(const std::string& name);
+    void stop();
+
+private:
+    void bridge_func();
+    bool service(int id, LocalConsoleSlot& slot, bool check_alive);
+    void grant(int id, LocalConsoleSlot& slot);
+    void release(int id, LocalConsoleSlot& slot);
+
+    std::string name_;
+    LocalConsoleShm* shm_;
+    bool granted_[MAX_CONSOLES];
+
+    std::thread bridge_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stop_requested_;
+};
+
+// Client library (libmpm2_console): one console of a running emulator.
+// read/write never block and copy straight to and from the shared rings.
+class LocalConsoleClient {
+public:
+    LocalConsoleClient();
+    ~LocalConsoleClient();
+
+    // Claim a console; false if the segment is missing, the console is
+    // in use or the emulator did not answer within timeout_ms
+    bool open(int console, const std::string& name = LOCAL_CONSOLE_DEFAULT_NAME,
+              int timeout_ms = 1000);
+    void close();
+    bool is_open() const { return slot_ != nullptr; }
+
+    // Keyboard input: returns the bytes queued (0 when the ring is full)
+    size_t write(const uint8_t* data, size_t len);
+    // Queue all of data, waiting for room; false if the emulator went away
+    bool write_all(const uint8_t* data, size_t len);
+
+    // Display output: returns the bytes copied (0 when none waiting)
+    size_t read(uint8_t* data, size_t max_len);
+    size_t available() const;
+
+    // Sleep until output is waiting (true) or timeout_ms passes (false)
+    bool wait_readable(int timeout_ms);
+
+private:
+    void wait_bell(int timeout_ms);
+    void ring_host();
+
+    LocalConsoleShm* shm_;
+    LocalConsoleSlot* slot_;
+};
+
+#endif // LOCAL_CONSOLE_H
@@ -0,0 +1,155 @@
+// log.h - Asynchronous leveled logging
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef LOG_H
+#define LOG_H
+
+#include "spsc_ring.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class LogLevel : uint8_t {
+    TRACE = 0,
+    DEBUG = 1,
+    INFO  = 2,
+    WARN  = 3,
+    ERROR = 4,
+    OFF   = 5
+};
+
+enum class LogFormat {
+    TEXT,       // 2026-01-02T03:04:05.678901 INFO  [SSH] message
+    JSON        // One journald-style object per line (journalctl -o json)
+};
+
+// Parse "trace", "debug", "info", "warn", "error" or "off"
+bool parse_log_level(const char* name, LogLevel& level);
+
+// Logging never waits: each thread appends records to its own lock-free
+// ring and a background thread formats and writes them, in time order,
+// to stderr or a file. A full ring drops the record and counts it.
+// Guest console output never goes through here.
+class Logger {
+public:
+    static Logger& instance();
+
+    void set_level(LogLevel level) { level_.store(level, std::memory_order_relaxed); }
+    bool enabled(LogLevel level) const {
+        return level >= level_.load(std::memory_order_relaxed);
+    }
+
+    // Start the writer; path empty or "-" for stderr. Records logged
+    // before start() are kept and written once it runs.
+    bool start(const std::string& path, LogFormat format);
+    void stop();    // Flushes everything logged so far
+
+    void write(LogLevel level, const char* category, const std::string& msg);
+
+    uint64_t dropped() const { return dropped_.load(); }
+
+private:
+    Logger();
+    ~Logger();
+
+    // Ring record: level, category length, message length (16 bits),
+    // thread number (32 bits), wall-clock microseconds (64 bits), then
+    // category and message text
+    static constexpr size_t RECORD_HEADER = 16;
+    static constexpr size_t MAX_MESSAGE = 4000;
+
+    struct ThreadQueue {
+        SpscRing<32768> ring;
+        uint32_t thread_num = 0;
+        std::atomic<bool> retired{false};   // Owning thread has exited
+    };
+
+    struct Record {
+        uint64_t t_us;
+        uint32_t thread_num;
+        LogLevel level;
+        std::string category;
+        std::string message;
+    };
+
+    friend struct LogThreadHandle;
+    ThreadQueue* queue_for_thread();
+
+    void writer_func();
+    bool drain(std::vector<Record>& out);
+    void emit(const Record& rec);
+    void flush_batch();
+
+    std::atomic<LogLevel> level_;
+    LogFormat format_;
+    int out_fd_;            // O_APPEND, so processes sharing a file don't tear lines
+
+    std::mutex queues_mutex_;
+    std::vector<std::unique_ptr<ThreadQueue>> queues_;
+    uint32_t next_thread_num_;
+
+    std::thread writer_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stop_requested_;
+    std::atomic<uint64_t> dropped_;
+    std::string batch_;     // Formatted lines, written with one write()
+};
+
+// One log statement: collects the message, submits it on destruction
+class LogLine {
+public:
+    LogLine(LogLevel level, const char* category) : level_(level), category_(category) {}
+    ~LogLine() { Logger::instance().write(level_, category_, stream_.str()); }
+
+    template<typename T>
+    LogLine& operator<<(const T& value) {
+        stream_ << value;
+        return *this;
+    }
+    LogLine& operator<<(std::ostream& (*manip)(std::ostream&)) {
+        stream_ << manip;
+        return *this;
+    }
+
+private:
+    LogLevel level_;
+    const char* category_;
+    std::ostringstream stream_;
+};
+
+inline bool log_enabled(LogLevel level) {
+    return Logger::instance().enabled(level);
+}
+
+// Hex dump for log messages: "C3 00 F2 ..." of byte_at(0 .. count-1)
+template<typename ByteAt>
+std::string log_hex(int count, ByteAt byte_at) {
+    static const char digits[] = "0123456789ABCDEF";
+    std::string out;
+    for (int i = 0; i < count; i++) {
+        uint8_t b = static_cast<uint8_t>(byte_at(i));
+        if (i > 0) out += ' ';
+        out += digits[b >> 4];
+        out += digits[b & 0x0F];
+    }
+    return out;
+}
+
+// LOG_INFO("SSH") << "Console " << id << " attached";
+// Arguments are not evaluated when the level is disabled.
+#define LOG_AT(level, category) \
+    if (!log_enabled(level)) {} else LogLine(level, category)
+
+#define LOG_TRACE(category) LOG_AT(LogLevel::TRACE, category)
+#define LOG_DEBUG(category) LOG_AT(LogLevel::DEBUG, category)
+#define LOG_INFO(category)  LOG_AT(LogLevel::INFO, category)
+#define LOG_WARN(category)  LOG_AT(LogLevel::WARN, category)
+#define LOG_ERROR(category) LOG_AT(LogLevel::ERROR, category)
+
+#endif // LOG_H
@@ -6,6 +6,7 @@
 #define MPM_CPU_H
 
 #include "qkz80.h"
+#include <atomic>
 #include <cstdint>
 
 class BankedMemory;
@@ -17,8 +18,16 @@ namespace MpmPorts {
     constexpr uint8_t XIOS_DISPATCH = 0xE0;  // XIOS dispatch (B = function offset)
     constexpr uint8_t BANK_SELECT   = 0xE1;  // Bank select (A = bank number)
     constexpr uint8_t SIGNAL        = 0xE2;  // Signal/status port
+    constexpr uint8_t IRQ_CONTROL   = 0xE3;  // Interrupt enable mask / IM 1 source
+    constexpr uint8_t PERF          = 0xE4;  // Performance counters (see below)
 }
 
+// Performance counter port (MpmPorts::PERF):
+//   OUT (0E4H),A  latch a snapshot and rewind the read pointer
+//   IN A,(0E4H)   next snapshot byte; 24 bytes, each field little-endian:
+//                 +0 cycles, +8 instructions, +16 host monotonic time (us)
+// Guest benchmarks (asm/bench) time themselves with it.
+
 // Extended Z80 CPU with MP/M II I/O port support
 // Overrides port_in/port_out to route I/O through XIOS handler
 class MpmCpu : public qkz80 {
@@ -31,6 +40,9 @@ public:
     // Set banked memory for bank switching
     void set_banked_mem(BankedMemory* mem) { banked_mem_ = mem; }
 
+    // Instruction counter reported through the PERF port
+    void set_instruction_counter(const std::atomic<uint64_t>* count) { instructions_ = count; }
+
     // Override port I/O - routes through emulator handlers
     void port_out(qkz80_uint8 port, qkz80_uint8 value) override;
     qkz80_uint8 port_in(qkz80_uint8 port) override;
@@ -53,6 +65,11 @@ private:
     BankedMemory* banked_mem_ = nullptr;
     bool halted_ = false;
 
+    const std::atomic<uint64_t>* instructions_ = nullptr;
+    uint8_t perf_snapshot_[24] = {};
+    uint8_t perf_pos_ = 0;
+    void latch_perf();
+
     // Handle XIOS dispatch via port 0xE0
     void handle_xios_dispatch();
 
@@ -0,0 +1,87 @@
+// output_broadcast.h - Shared console output fan-out for read-only viewers
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef OUTPUT_BROADCAST_H
+#define OUTPUT_BROADCAST_H
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Fan-out of one console's output to any number of viewers.
+// The session draining the console publishes each batch once as an
+// immutable reference-counted chunk; every viewer keeps its own sequence
+// number and shares the same chunk. The producer never waits: a viewer
+// that falls a whole ring behind is told it lagged and is dropped.
+class OutputBroadcast {
+public:
+    using Chunk = std::shared_ptr<const std::vector<uint8_t>>;
+
+    static constexpr size_t RING_CHUNKS = 256;
+
+    enum class Fetch { OK, EMPTY, LAGGED };
+
+    OutputBroadcast() = default;
+
+    // Non-copyable
+    OutputBroadcast(const OutputBroadcast&) = delete;
+    OutputBroadcast& operator=(const OutputBroadcast&) = delete;
+
+    // Producer: publish a batch of output (no-op without viewers)
+    void publish(const uint8_t* data, size_t len) {
+        if (len == 0 || subscribers_.load() == 0) return;
+        Chunk chunk = std::make_shared<const std::vector<uint8_t>>(data, data + len);
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            ring_[next_seq_ % RING_CHUNKS] = std::move(chunk);
+            next_seq_++;
+        }
+        cv_.notify_all();
+    }
+
+    // Viewer: register and get the sequence number to start reading at
+    uint64_t subscribe() {
+        std::lock_guard<std::mutex> lock(mtx_);
+        subscribers_.fetch_add(1);
+        return next_seq_;
+    }
+
+    void unsubscribe() {
+        if (subscribers_.fetch_sub(1) == 1) {
+            // Last viewer gone - release the retained chunks
+            std::lock_guard<std::mutex> lock(mtx_);
+            for (auto& c : ring_) c.reset();
+        }
+    }
+
+    int subscribers() const { return subscribers_.load(); }
+
+    // Viewer: get the chunk at seq (advancing seq), waiting up to timeout_ms
+    Fetch fetch(uint64_t& seq, Chunk& out, unsigned timeout_ms = 0) {
+        std::unique_lock<std::mutex> lock(mtx_);
+        if (seq == next_seq_ && timeout_ms > 0) {
+            cv_.wait_for(lock, std::chrono::milliseconds(timeout_ms),
+                         [this, seq] { return next_seq_ != seq; });
+        }
+        if (seq == next_seq_) return Fetch::EMPTY;
+        if (next_seq_ - seq > RING_CHUNKS) return Fetch::LAGGED;
+        out = ring_[seq % RING_CHUNKS];
+        seq++;
+        return Fetch::OK;
+    }
+
+private:
+    mutable std::mutex mtx_;
+    std::condition_variable cv_;
+    std::array<Chunk, RING_CHUNKS> ring_;
+    uint64_t next_seq_ = 0;
+    std::atomic<int> subscribers_{0};
+};
+
+#endif // OUTPUT_BROADCAST_H
@@ -0,0 +1,67 @@
+// rate_limiter.h - Token bucket for shaping console output
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+// Token bucket: refills at rate tokens/second up to burst tokens.
+// A rate of 0 disables limiting. Not thread-safe - owned by one thread.
+class TokenBucket {
+public:
+    TokenBucket() : rate_(0), burst_(0), tokens_(0) {}
+
+    void configure(uint32_t rate, uint32_t burst) {
+        rate_ = rate;
+        burst_ = std::max<uint32_t>(burst, 1);
+        tokens_ = burst_;
+        last_ = std::chrono::steady_clock::now();
+    }
+
+    bool enabled() const { return rate_ > 0; }
+    uint32_t rate() const { return static_cast<uint32_t>(rate_); }
+
+    // True if n tokens are available now
+    bool can_take(uint32_t n = 1) {
+        if (!enabled()) return true;
+        refill();
+        return tokens_ >= n;
+    }
+
+    // Take n tokens if available
+    bool try_take(uint32_t n = 1) {
+        if (!enabled()) return true;
+        refill();
+        if (tokens_ < n) return false;
+        tokens_ -= n;
+        return true;
+    }
+
+    // Take up to n tokens, returns how many were taken
+    uint32_t take_up_to(uint32_t n) {
+        if (!enabled()) return n;
+        refill();
+        uint32_t granted = std::min(n, static_cast<uint32_t>(tokens_));
+        tokens_ -= granted;
+        return granted;
+    }
+
+private:
+    void refill() {
+        auto now = std::chrono::steady_clock::now();
+        double elapsed = std::chrono::duration<double>(now - last_).count();
+        last_ = now;
+        tokens_ = std::min(burst_, tokens_ + elapsed * rate_);
+    }
+
+    double rate_;
+    double burst_;
+    double tokens_;
+    std::chrono::steady_clock::time_point last_;
+};
+
+#endif // RATE_LIMITER_H
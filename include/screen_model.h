@@ -0,0 +1,113 @@
+// screen_model.h - Host-side terminal screen model for console output
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef SCREEN_MODEL_H
+#define SCREEN_MODEL_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Interprets the guest's output stream (ADM-3A, VT52 and VT100 subsets)
+// into a character/attribute grid. The network side renders only what
+// changed since the last frame, as VT100 sequences, so repaint-heavy
+// full-screen programs cost a fraction of the raw byte stream.
+//
+// Not thread-safe: fed and rendered by the session owning the console.
+class ScreenModel {
+public:
+    ScreenModel(int width = 80, int height = 24);
+
+    int width() const { return width_; }
+    int height() const { return height_; }
+
+    // Resize the grid (contents are cleared, next render is a full redraw)
+    void resize(int width, int height);
+
+    // Interpret guest output bytes
+    void feed(const uint8_t* data, size_t len);
+
+    // Append VT100 output bringing the client from the last rendered frame
+    // to the current screen. Returns false if there was nothing to send.
+    bool render_diff(std::string& out);
+
+    // Append a complete redraw of the screen
+    void render_full(std::string& out);
+
+    // Force the next render_diff() to redraw everything (e.g. on reattach)
+    void invalidate() { full_redraw_ = true; }
+
+    // True if render_diff() would produce output
+    bool dirty() const { return dirty_ || full_redraw_; }
+
+private:
+    // Cell attributes (match SGR 1/4/7)
+    static constexpr uint8_t ATTR_BOLD      = 0x01;
+    static constexpr uint8_t ATTR_UNDERLINE = 0x02;
+    static constexpr uint8_t ATTR_REVERSE   = 0x04;
+
+    struct Cell {
+        uint8_t ch;
+        uint8_t attr;
+        bool operator==(const Cell& o) const { return ch == o.ch && attr == o.attr; }
+        bool operator!=(const Cell& o) const { return !(*this == o); }
+    };
+
+    enum class State {
+        GROUND,
+        ESCAPE,         // After ESC
+        CSI,            // ESC [ parameters
+        CURSOR_ROW,     // ESC = / ESC Y: row byte next
+        CURSOR_COL,     // Column byte next
+        SKIP_ONE        // Swallow one byte (ESC ( x, ESC ) x, ...)
+    };
+
+    Cell blank() const { return Cell{' ', 0}; }
+    Cell& at(int row, int col) { return cells_[row * width_ + col]; }
+
+    void put_char(uint8_t ch);
+    void control(uint8_t ch);
+    void escape(uint8_t ch);
+    void csi_dispatch(uint8_t final);
+    int csi_param(size_t index, int def) const;
+
+    void line_feed();
+    void reverse_line_feed();
+    void scroll_up(int top, int bottom, int count);
+    void scroll_down(int top, int bottom, int count);
+    void erase(int row, int from_col, int to_col);
+    void erase_display(int mode);
+    void erase_line(int mode);
+    void move_to(int row, int col);
+
+    void emit_attr(std::string& out, uint8_t attr);
+    void emit_cursor(std::string& out, int row, int col);
+
+    int width_;
+    int height_;
+    std::vector<Cell> cells_;   // Current screen
+    std::vector<Cell> shown_;   // What the client is displaying
+
+    int row_;
+    int col_;
+    uint8_t attr_;
+    bool wrap_pending_;         // Cursor sits past the last column
+
+    State state_;
+    std::vector<int> params_;
+    bool csi_private_;
+    int addr_row_;
+
+    // Client-side state tracked while rendering
+    int shown_row_;
+    int shown_col_;
+    uint8_t shown_attr_;
+    int pending_scroll_;        // Full-screen scrolls not yet sent
+    int bells_;                 // BEL characters not yet sent
+    bool dirty_;
+    bool full_redraw_;
+};
+
+#endif // SCREEN_MODEL_H
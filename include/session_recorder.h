@@ -0,0 +1,92 @@
+// session_recorder.h - Console session recording in asciicast v2 format
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef SESSION_RECORDER_H
+#define SESSION_RECORDER_H
+
+#include "console.h"
+#include "spsc_ring.h"
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <thread>
+
+// Records what each SSH session sent to (and optionally received from)
+// its client as asciicast v2 files, one per session:
+//   DIR/con<N>-<YYYYmmdd-HHMMSS>-<user>.cast
+//
+// Session threads only copy events into a per-console lock-free ring and
+// never wait; a full ring drops the event and counts it. A background
+// thread formats the JSON lines, rotates files past the size limit and,
+// when built with zlib, compresses finished files.
+class SessionRecorder {
+public:
+    static SessionRecorder& instance();
+
+    // Configure before start()
+    void set_record_input(bool on) { record_input_ = on; }
+    void set_rotate_bytes(uint64_t bytes) { rotate_bytes_ = bytes; }
+    void set_compress(bool on) { compress_ = on; }
+
+    bool start(const std::string& dir);
+    void stop();
+    bool enabled() const { return running_.load(); }
+
+    // Producer side - called by the session owning the console
+    void begin(int console, int width, int height,
+               const std::string& user, const std::string& term);
+    void output(int console, const uint8_t* data, size_t len);
+    void input(int console, const uint8_t* data, size_t len);
+    void end(int console);
+
+    uint64_t dropped() const { return dropped_.load(); }
+
+private:
+    SessionRecorder();
+
+    // Ring record: kind, 16-bit length, 64-bit steady_clock microseconds,
+    // then the payload - written with a single ring write
+    static constexpr size_t RECORD_HEADER = 11;
+    static constexpr size_t MAX_PAYLOAD = 512;
+
+    struct Channel {
+        SpscRing<65536> ring;
+    };
+
+    // Writer-thread state for one console
+    struct Cast {
+        FILE* file = nullptr;
+        std::string path;
+        std::string base;       // Path without extension, for rotation
+        std::string header;     // JSON header line (reused when rotating)
+        uint64_t start_us = 0;
+        uint64_t bytes = 0;
+        int part = 0;
+    };
+
+    void put(int console, char kind, const uint8_t* data, size_t len);
+    void writer_func();
+    bool drain(int console);
+    void open_cast(int console, const std::string& info, uint64_t t_us);
+    void open_part(Cast& cast);
+    void close_cast(Cast& cast);
+    void compress_file(const std::string& path);
+
+    std::string dir_;
+    bool record_input_;
+    uint64_t rotate_bytes_;
+    bool compress_;
+
+    std::unique_ptr<Channel[]> channels_;
+    Cast casts_[MAX_CONSOLES];
+
+    std::thread writer_;
+    std::atomic<bool> running_;
+    std::atomic<bool> stop_requested_;
+    std::atomic<uint64_t> dropped_;
+};
+
+#endif // SESSION_RECORDER_H
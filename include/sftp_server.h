@@ -0,0 +1,105 @@
+// sftp_server.h - SFTP subsystem presenting the CP/M drives
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef SFTP_SERVER_H
+#define SFTP_SERVER_H
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+// SFTP access to mounted drives
+enum class SftpAccess {
+    OFF,
+    READ_ONLY,
+    READ_WRITE
+};
+
+// Parse "off", "ro" or "rw"
+bool parse_sftp_access(const char* name, SftpAccess& access);
+
+// SFTP protocol version 3 server, transport independent: feed it the
+// channel's bytes and send back what it replies.
+//
+// Namespace:  /            mounted drives A..P
+//             /A           user areas 0..15
+//             /A/0         files in user area 0
+//             /A/0/X.COM   a file
+//
+// Files are read whole on open and written whole on close through CpmFs,
+// so each transfer takes the drive lock only briefly.
+class SftpServer {
+public:
+    explicit SftpServer(bool writable);
+
+    // Consume client bytes; replies to every complete request are
+    // appended to reply. Returns false on a malformed stream.
+    bool feed(const uint8_t* data, size_t len, std::string& reply);
+
+private:
+    struct Attrs {
+        bool valid = false;
+        bool dir = false;
+        bool read_only = false;
+        uint64_t size = 0;
+    };
+
+    struct DirEntry {
+        std::string name;
+        Attrs attrs;
+    };
+
+    struct Handle {
+        bool dir = false;
+        // Directory
+        std::vector<DirEntry> entries;
+        size_t pos = 0;
+        // File
+        int drive = -1;
+        uint8_t user = 0;
+        std::string name;
+        std::vector<uint8_t> data;
+        bool write = false;
+        bool dirty = false;
+    };
+
+    // Parsed path: depth 0 root, 1 drive, 2 user area, 3 file
+    struct Path {
+        int depth = 0;
+        int drive = -1;
+        uint8_t user = 0;
+        std::string name;
+    };
+
+    void handle_packet(const uint8_t* p, size_t len, std::string& reply);
+
+    bool parse_path(const std::string& in, Path& path) const;
+    static std::string path_string(const Path& path);
+    bool lookup(const Path& path, Attrs& attrs);
+
+    void do_open(uint32_t id, const std::string& p, uint32_t pflags, std::string& reply);
+    void do_opendir(uint32_t id, const std::string& p, std::string& reply);
+    void do_readdir(uint32_t id, const std::string& h, std::string& reply);
+    void do_close(uint32_t id, const std::string& h, std::string& reply);
+
+    // Reply builders
+    static void put_u32(std::string& out, uint32_t v);
+    static void put_u64(std::string& out, uint64_t v);
+    static void put_string(std::string& out, const std::string& s);
+    void put_attrs(std::string& out, const Attrs& a) const;
+    static void send_packet(std::string& reply, uint8_t type, const std::string& body);
+    static void send_status(std::string& reply, uint32_t id, uint32_t code,
+                            const std::string& msg);
+    void send_name(std::string& reply, uint32_t id, const std::vector<DirEntry>& names);
+
+    Handle* find_handle(const std::string& h);
+
+    bool writable_;
+    std::string in_;
+    std::map<std::string, Handle> handles_;
+    uint32_t next_handle_;
+};
+
+#endif // SFTP_SERVER_H
@@ -0,0 +1,77 @@
+// spsc_ring.h - Lock-free single-producer/single-consumer byte ring
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Fixed-capacity byte ring for exactly one producer and one consumer.
+// Standard layout with no pointers, so it can live in shared memory and
+// be used across processes; all-zero memory is a valid empty ring.
+template<size_t CAPACITY>
+class SpscRing {
+    static_assert((CAPACITY & (CAPACITY - 1)) == 0, "capacity must be a power of two");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring needs lock-free atomics");
+
+public:
+    static constexpr size_t capacity() { return CAPACITY; }
+
+    // Bytes waiting to be read
+    size_t available() const {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+
+    // Room for writing
+    size_t space() const { return CAPACITY - available(); }
+
+    // Producer: copy in as much as fits, returns count written
+    size_t write(const uint8_t* data, size_t len) {
+        uint32_t head = head_.load(std::memory_order_relaxed);
+        uint32_t tail = tail_.load(std::memory_order_acquire);
+        size_t n = std::min(len, CAPACITY - static_cast<size_t>(head - tail));
+        if (n == 0) return 0;
+
+        size_t pos = head & (CAPACITY - 1);
+        size_t first = std::min(n, CAPACITY - pos);
+        std::memcpy(data_ + pos, data, first);
+        std::memcpy(data_, data + first, n - first);
+
+        head_.store(head + static_cast<uint32_t>(n), std::memory_order_release);
+        return n;
+    }
+
+    // Consumer: copy out up to max_len bytes, returns count read
+    size_t read(uint8_t* data, size_t max_len) {
+        uint32_t tail = tail_.load(std::memory_order_relaxed);
+        uint32_t head = head_.load(std::memory_order_acquire);
+        size_t n = std::min(max_len, static_cast<size_t>(head - tail));
+        if (n == 0) return 0;
+
+        size_t pos = tail & (CAPACITY - 1);
+        size_t first = std::min(n, CAPACITY - pos);
+        std::memcpy(data, data_ + pos, first);
+        std::memcpy(data + first, data_, n - first);
+
+        tail_.store(tail + static_cast<uint32_t>(n), std::memory_order_release);
+        return n;
+    }
+
+    // Consumer: drop everything currently queued
+    void discard() {
+        tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release);
+    }
+
+private:
+    // Free-running counters on separate cache lines
+    alignas(64) std::atomic<uint32_t> head_;
+    alignas(64) std::atomic<uint32_t> tail_;
+    alignas(64) uint8_t data_[CAPACITY];
+};
+
+#endif // SPSC_RING_H
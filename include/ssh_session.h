@@ -9,10 +9,16 @@
 
 #include <thread>
 #include <atomic>
+#include <chrono>
+#include <deque>
 #include <string>
 #include <vector>
 #include <memory>
+#include <mutex>
 #include <functional>
+#include <utility>
+
+#include "sftp_server.h"
 
 // Forward declarations for wolfSSH types
 struct WOLFSSH_CTX;
@@ -28,7 +34,16 @@ class Console;
 // SSH session - handles one SSH connection
 class SSHSession {
 public:
-    SSHSession(int console_id, WOLFSSH* ssh, int fd);
+    enum class Mode {
+        ATTACH,     // Interactive, fresh console
+        REATTACH,   // Interactive, console detached earlier by this user
+        VIEW,       // Read-only viewer of another session's console
+        EXEC,       // Batch: type one command, stream its output, exit
+        SFTP        // SFTP subsystem on the drives, no console
+    };
+
+    SSHSession(int console_id, WOLFSSH* ssh, int fd, Mode mode = Mode::ATTACH,
+               const std::string& command = "");
     ~SSHSession();
 
     // Start the session thread
@@ -46,10 +61,26 @@ public:
     // Get console ID
     int console_id() const { return console_id_; }
 
+    // SFTP sessions: allow changes to the drives (call before start)
+    void set_sftp_writable(bool writable) { sftp_writable_ = writable; }
+
 private:
     void thread_func();
+    void view_loop(Console* con);
+
+    // Exec request: returns the exit status, or -1 if the client went away
+    int exec_loop(Console* con);
+
+    void sftp_loop();
+
+    // Send a whole buffer, retrying partial writes; false on connection error
+    bool send_all(const uint8_t* data, size_t len);
 
     int console_id_;
+    Mode mode_;
+    std::string command_;
+    bool sftp_writable_;
+    bool recording_;        // Output goes to the SessionRecorder
     WOLFSSH* ssh_;
     int fd_;
     std::thread thread_;
@@ -72,13 +103,18 @@ public:
     using AuthCallback = std::function<bool(const std::string&, const std::string&)>;
     void set_auth_callback(AuthCallback cb) { auth_callback_ = cb; }
 
-    // Start listening on port
+    // Number of acceptor threads, each with its own SO_REUSEPORT sockets
+    // (call before listen)
+    void set_acceptors(int n) { acceptors_ = n > 0 ? n : 1; }
+
+    // Start listening on port (IPv4 and, where available, IPv6)
     bool listen(int port);
 
     // Stop the server
     void stop();
 
-    // Accept loop - call from main thread or spawn a thread
+    // Accept loop - call from main thread or spawn a thread.
+    // Runs the extra acceptor threads and returns when they are done.
     void accept_loop();
 
     // Check if running
@@ -87,20 +123,98 @@ public:
     // Get number of active sessions
     size_t session_count() const;
 
+    // Allow read-only viewers (SSH user "viewN" watches console N). Only
+    // clients that sign in with one of the viewer keys (fingerprints as
+    // "ssh-keygen -l" prints them, "SHA256:...") are let in.
+    void set_allow_shadow(bool allow) { allow_shadow_ = allow; }
+    void set_viewer_keys(const std::vector<std::string>& keys) { viewer_keys_ = keys; }
+
+    // SFTP subsystem access to the drives
+    void set_sftp_access(SftpAccess access) { sftp_access_ = access; }
+
+    // Connections allowed to wait for a console (0 = reject when full)
+    void set_queue_limit(size_t n) { queue_limit_ = n; }
+
+    // Get number of connections waiting for a console
+    size_t waiting_count() const;
+
 private:
+    // One acceptor's listening sockets
+    struct Listener {
+        int fd4 = -1;
+        int fd6 = -1;
+    };
+
+    // Handshakes run on their own threads; past the limit new connections
+    // are dropped. A handshake that has not finished by the timeout fails.
+    static constexpr int MAX_HANDSHAKES = 64;
+    static constexpr std::chrono::seconds HANDSHAKE_TIMEOUT{30};
+
+    // Connection waiting in the admission queue
+    struct Waiter {
+        WOLFSSH* ssh;
+        int fd;
+        std::string user;
+        std::chrono::steady_clock::time_point since;
+        size_t told_position;   // Last position sent to the user
+        std::string command;    // Exec request, empty for a shell
+        std::string key;        // Public key fingerprint, empty if none
+    };
+
+    // Waiter given a console, to greet and start once the lock is released
+    struct Admission {
+        Waiter waiter;
+        Console* console;
+    };
+
+    static int open_listener(int family, int port);
+    void acceptor_func(int index);
+    void handle_connection(int client_fd);
+
+    // Start a session for an authenticated connection or queue it
+    // (sessions_mutex_ held). False if refused, with notice set to the
+    // message to send before hanging up, if any.
+    bool place_connection(WOLFSSH* ssh, int fd, const std::string& user,
+                          const std::string& key, bool subsystem,
+                          const std::string& command, const char*& notice);
+
+    // Start the session on con, already attached to the user
+    // (sessions_mutex_ held)
+    void start_session(WOLFSSH* ssh, int fd, const std::string& user,
+                       Console* con, bool reattach, const std::string& command);
+
+    // Admission queue (sessions_mutex_ held). Fills admitted and the
+    // position notices; the caller sends them after releasing the lock.
+    void admit_waiting(std::vector<Admission>& admitted,
+                       std::vector<std::pair<WOLFSSH*, std::string>>& notices);
+    std::string position_notice(Waiter& w, size_t position);
+
     // Cleanup finished sessions
     void cleanup_sessions();
 
     // wolfSSH callbacks
     static int user_auth_callback(byte auth_type, WS_UserAuthData* auth_data, void* ctx);
     static int channel_shell_callback(WOLFSSH_CHANNEL* channel, void* ctx);
+    static int channel_exec_callback(WOLFSSH_CHANNEL* channel, void* ctx);
+    static int channel_subsys_callback(WOLFSSH_CHANNEL* channel, void* ctx);
 
     WOLFSSH_CTX* ctx_;
-    int listen_fd_;
+    std::vector<Listener> listeners_;
     int port_;
+    int acceptors_;
 
+    // Guards sessions_ and console allocation across acceptors
+    mutable std::mutex sessions_mutex_;
     std::vector<std::unique_ptr<SSHSession>> sessions_;
+    std::deque<Waiter> waiting_;
+    size_t queue_limit_;
+    double admit_interval_;     // Smoothed seconds between admissions, 0 = unknown
+    std::chrono::steady_clock::time_point last_admit_;
     AuthCallback auth_callback_;
+    bool allow_shadow_;
+    std::vector<std::string> viewer_keys_;
+    SftpAccess sftp_access_;
+    std::atomic<int> handshakes_;
 
     std::atomic<bool> running_;
     std::atomic<bool> stop_requested_;
@@ -0,0 +1,87 @@
+// term_translate.h - Console output translation between terminal types
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef TERM_TRANSLATE_H
+#define TERM_TRANSLATE_H
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+
+// Terminal the guest software was configured for
+enum class GuestTerminal {
+    RAW,        // No sequence translation
+    ADM3A,      // Lear Siegler ADM-3A
+    KAYPRO,     // Kaypro II/4/10 (ADM-3A superset)
+    TELEVIDEO,  // Televideo 910/925/950
+    VT52        // DEC VT52
+};
+
+// What to do with bit 7 of guest output
+enum class ParityMode {
+    KEEP,       // Pass through unchanged
+    STRIP,      // Clear bit 7
+    HIGHLIGHT   // Clear bit 7 and show those characters bold (WordStar style)
+};
+
+// Parse "raw", "adm3a", "kaypro", "tvi"/"televideo", "vt52"
+bool parse_guest_terminal(const std::string& name, GuestTerminal& out);
+// Parse "keep", "strip", "highlight"
+bool parse_parity_mode(const std::string& name, ParityMode& out);
+
+// Rewrites guest terminal sequences into ANSI/VT100 for the client.
+// Plain text is located with a SIMD scan and copied in bulk; only
+// control characters, ESC sequences and high-bit bytes take the slow path.
+class OutputTranslator {
+public:
+    OutputTranslator();
+
+    void set_guest(GuestTerminal guest) { guest_ = guest; }
+    void set_parity(ParityMode mode) { parity_ = mode; }
+    GuestTerminal guest() const { return guest_; }
+    ParityMode parity() const { return parity_; }
+
+    // Select client terminal type (from the SSH pty request).
+    // Clients that natively speak the guest's codes get a pass-through.
+    void set_client(const std::string& term_type);
+
+    // True if translate() may change the stream
+    bool active() const { return map_sequences_ || parity_ != ParityMode::KEEP; }
+
+    // Translate guest output, appending to out
+    void translate(const uint8_t* data, size_t len, std::string& out);
+
+    // Forget any partial escape sequence
+    void reset();
+
+private:
+    enum class State {
+        GROUND,
+        ESCAPE,
+        ADDR_ROW,
+        ADDR_COL,
+        KAYPRO_ATTR_ON,
+        KAYPRO_ATTR_OFF,
+        TVI_ATTR
+    };
+
+    // Number of leading bytes that can be copied unchanged
+    size_t scan_plain(const uint8_t* data, size_t len) const;
+
+    void translate_byte(uint8_t ch, std::string& out);
+    void control(uint8_t ch, std::string& out);
+    void escape(uint8_t ch, std::string& out);
+    void kaypro_attr(uint8_t ch, bool on, std::string& out);
+    void tvi_attr(uint8_t ch, std::string& out);
+
+    GuestTerminal guest_;
+    ParityMode parity_;
+    bool map_sequences_;
+
+    State state_;
+    uint8_t addr_row_;
+    bool highlighted_;      // Inside a HIGHLIGHT run of bit-7 characters
+};
+
+#endif // TERM_TRANSLATE_H
@@ -51,6 +51,41 @@ constexpr uint8_t XIOS_PDISP       = 0x54;  // Process dispatcher
 constexpr uint8_t XIOS_XDOSENT     = 0x57;  // XDOS entry
 constexpr uint8_t XIOS_SYSDAT      = 0x5A;  // System data pointer (2-byte DW)
 
+// Port-XIOS internal routines (not in the jump table)
+constexpr uint8_t XIOS_POLLALL     = 0xED;  // Readiness of every device in one trap
+constexpr uint8_t XIOS_CINRDY      = 0xF1;  // Console input ready bytes (data)
+constexpr uint8_t XIOS_POLLRET     = 0xFA;  // POP DE; POP BC; RET after XDOS poll
+
+// POLLDEVICE device numbers
+constexpr uint8_t POLL_PRINTER     = 0;     // List device
+constexpr uint8_t POLL_CONOUT_BASE = 1;     // Console output 0-7 (devices 01H-08H)
+constexpr uint8_t POLL_READER      = 0x10;  // AUX reader input
+constexpr uint8_t POLL_PUNCH       = 0x11;  // AUX punch output
+constexpr uint8_t POLL_CONIN_BASE  = 0x18;  // Console input 0-7 (devices 18H-1FH)
+
+// MP/M II system data
+constexpr uint16_t SYSDAT_BASE     = 0xFF00;
+constexpr uint8_t SYSDAT_RESBDOS   = 8;     // Resident BDOS base page
+constexpr uint8_t SYSDAT_TICKS     = 122;   // Ticks per second (GENSYS)
+constexpr uint8_t SYSDAT_XDOS      = 245;   // BDOS/XDOS entry address (word)
+constexpr uint8_t SYSDAT_DATAPG    = 252;   // XDOS data page address (word)
+constexpr uint8_t XDOS_POLL        = 131;   // XDOS poll device function
+constexpr uint8_t XDOS_DISPATCH    = 142;   // XDOS dispatch function
+constexpr uint8_t BDOS_READ_BUFFER = 10;    // Read console buffer
+
+// XDOS data page and process descriptor offsets
+constexpr uint8_t DATAPG_TOD       = 0;     // Day (word), hour, min, sec (BCD)
+constexpr uint8_t DATAPG_RLR       = 5;     // Ready list root (running PD)
+constexpr uint8_t DATAPG_DLR       = 7;     // Delay list root
+constexpr uint8_t DATAPG_PLR       = 11;    // Poll list root
+constexpr uint8_t DATAPG_CNSATT    = 20;    // Console attached PD table (words)
+constexpr uint8_t DATAPG_MSEGTBL   = 150;   // Memory segment table (4 bytes each)
+constexpr uint8_t RESBDOS_SWTUSER  = 0x0C;  // JMP SWITCH$USER in the resident BDOS
+constexpr uint8_t PD_LINK          = 0;     // Next PD on the same list
+constexpr uint8_t PD_NAME          = 6;     // Name, f0' set = raw console
+constexpr uint8_t PD_CONSOLE       = 0x0E;  // Console number (low nibble)
+constexpr uint8_t PD_POLL_DEVICE   = 0x10;  // Device polled (on the poll list)
+
 // MP/M II flags (set by interrupt handlers)
 constexpr uint8_t FLAG_TICK     = 1;   // System tick (16.67ms)
 constexpr uint8_t FLAG_SECOND   = 2;   // One-second flag
@@ -92,9 +127,44 @@ public:
     // Timer tick - called from interrupt handler
     void tick();
 
-    // One-second tick
+    // BDOS/XDOS entry from SYSDAT (0 until the XDOS is loaded)
+    uint16_t bdos_entry() const;
+
+    // Bank of the BDOS caller's memory segment - what DRI's SWTUSER
+    // restores for the DMA transfer (0 for resident processes)
+    uint8_t user_bank() const;
+
+    // Host line discipline: called with PC at the BDOS entry and C = 10.
+    // Returns true if the call was taken over (line delivered and returned,
+    // or caller parked until more input), false to let the BDOS run it.
+    bool read_console_buffer();
+
+    // Copy the console input bitmap into the stub's CINRDY bytes, which
+    // POLLDEVICE reads without trapping. Runs on every trap and tick.
+    void refresh_poll_mirror();
+
+    // One-second tick (every ticks_per_second_ host ticks). The guest's
+    // interrupt handler sets flag #2 from its own tick count; a handler
+    // that reloads that count with a constant 60 is patched to the rate.
     void one_second_tick();
 
+    // Tickless operation: false while only Idle is ready, no delay is
+    // queued and no device on the poll list is ready, i.e. a tick would
+    // only run the nucleus tick handler for nothing
+    bool tick_needed();
+    // True if a process on the poll list is waiting for a ready device
+    bool poll_list_ready();
+    // Tick rate the host delivers, written to SYSDAT at boot
+    void set_ticks_per_second(uint8_t hz) { ticks_per_second_ = hz; }
+    // Write host local time into the XDOS time of day
+    void set_tod_from_host();
+    // True once after the Idle process called XIOS IDLE
+    bool take_idle() {
+        bool idle = idle_;
+        idle_ = false;
+        return idle;
+    }
+
     // Clock control (STARTCLOCK/STOPCLOCK)
     bool clock_enabled() const { return tick_enabled_.load(); }
 
@@ -102,6 +172,15 @@ public:
     bool is_preempted() const { return preempted_.load(); }
     void set_preempted(bool p) { preempted_.store(p); }
 
+    // Jump requested by a port-dispatch handler, applied by the Z80 thread
+    // once the OUT instruction has completed
+    bool take_redirect(uint16_t& pc) {
+        if (!redirect_) return false;
+        redirect_ = false;
+        pc = redirect_pc_;
+        return true;
+    }
+
 private:
     // BIOS-compatible entries
     void do_boot();
@@ -131,6 +210,8 @@ private:
     void do_maxconsole();
     void do_systeminit();
     void do_idle();
+    void do_pollall();
+    uint8_t poll_device(uint8_t device);   // 0xFF if ready
 
     // Commonbase entries
     void do_swtuser();   // Switch to user bank
@@ -145,6 +226,18 @@ private:
     // Simulate RET instruction
     void do_ret();
 
+    // Park the calling process on the XDOS poll list until device is ready,
+    // then re-enter XIOS function retry_func with the same BC/DE.
+    // Returns false if the XDOS is not available (boot phase).
+    bool park_on_poll(uint8_t device, uint8_t retry_func);
+    // Same for a BDOS call intercepted at the entry: the caller re-enters
+    // the BDOS with its BC/DE once the device is ready
+    void park_bdos_call(uint8_t device);
+    // Make the current XIOS call run again (when it cannot park), after
+    // waiting briefly for an interrupt line
+    void retry_call();
+    void push_word(uint16_t value);
+
     qkz80* cpu_;
     BankedMemory* mem_;
     uint16_t xios_base_;
@@ -166,6 +259,19 @@ private:
 
     // Cached BNKXIOS address (set by patch_bnkxios)
     uint16_t bnkxios_addr_ = 0;
+
+    // Set by IDLE (see take_idle)
+    bool idle_ = false;
+    uint8_t ticks_per_second_ = 60;
+    bool second_checked_ = false;   // Guest one-second reload looked at
+
+    // Last bitmap written to CINRDY (stub installed when live)
+    bool mirror_live_ = false;
+    uint32_t mirror_mask_ = 0;
+
+    // Pending PC change (see take_redirect)
+    bool redirect_ = false;
+    uint16_t redirect_pc_ = 0;
 };
 
 #endif // XIOS_H
@@ -9,9 +9,11 @@
 #include <atomic>
 #include <chrono>
 #include <memory>
+#include <string>
 
 class qkz80;
 class MpmCpu;
+class FastCore;
 class BankedMemory;
 class XIOS;
 
@@ -42,31 +44,75 @@ public:
     // Interrupt control
     void enable_interrupts(bool enable);
 
+    // Host-side line editing for BDOS function 10 (set before start)
+    void set_line_edit(bool on) { line_edit_ = on; }
+
+    // Skip ticks while the machine is idle (set before start)
+    void set_tickless(bool on) { tickless_ = on; }
+
+    // Clock interrupt rate in Hz (set before start)
+    void set_tick_rate(int hz);
+    int tick_rate() const { return ticks_per_second_; }
+
+    // Interactive boost: when input arrives for a process waiting on the
+    // poll list, deliver the next tick at once instead of at its slot
+    void set_boost(bool on) { boost_ = on; }
+
+    // Run the lazy-flag core instead of qkz80 (set after init, before start)
+    void set_fast_core(bool on);
+    // Fast core options: fused instruction sequences, and an opcode pair
+    // profile written to path when the thread stops (turns fusion off)
+    void set_superinstructions(bool on);
+    void set_pair_profile(const std::string& path);
+    // Check the fast core against qkz80 instruction by instruction
+    void set_lockstep(bool on);
+
     // Statistics
     uint64_t cycles() const;
     uint64_t instructions() const { return instruction_count_.load(); }
 
 private:
     void thread_func();
+    void dump_boot_memory();    // Debug log of the nucleus areas at boot
 
-    // Timer interrupt delivery
-    void deliver_tick_interrupt();
+    // Interrupt lines from the InterruptController
+    void service_irqs();
+    void clock_tick(unsigned count);
+    void deliver_interrupt();
+
+    // Tickless: sleep in IDLE until something needs the dispatcher
+    void idle_sleep();
+    void second_elapsed();
 
     std::unique_ptr<MpmCpu> cpu_;
     std::unique_ptr<BankedMemory> memory_;
     std::unique_ptr<XIOS> xios_;
+    std::unique_ptr<FastCore> fast_;
 
     std::thread thread_;
     std::atomic<bool> running_;
     std::atomic<bool> stop_requested_;
 
     // Timing
-    std::chrono::steady_clock::time_point next_tick_;
-    static constexpr auto TICK_INTERVAL = std::chrono::microseconds(16667);  // 60Hz
+    std::chrono::microseconds tick_interval_{16667};  // 60Hz
+    int ticks_per_second_ = 60;
 
     // Counters
     std::atomic<uint64_t> instruction_count_;
-    int tick_count_;  // Counts to 60 for one-second flag
+    int tick_count_;  // Counts to ticks_per_second_ for one-second flag
+
+    // Line editing: BDOS entry, re-read from SYSDAT every tick
+    bool line_edit_ = false;
+    uint16_t bdos_entry_ = 0;
+
+    bool tickless_ = false;
+    bool boost_ = false;
+
+    std::string pair_profile_;
+    bool lockstep_ = false;
+
+    // Lines latched for the guest, taken once IFF1 is set
+    uint32_t guest_irq_ = 0;
 };
 
 #endif // Z80_THREAD_H
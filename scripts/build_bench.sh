@@ -0,0 +1,50 @@
+#!/bin/bash
+# build_bench.sh - Assemble the benchmark programs and build their disk
+# Part of MP/M II Emulator
+# SPDX-License-Identifier: GPL-3.0-or-later
+#
+# The programs in asm/bench time themselves through the emulator's
+# performance counter port (0xE4) and print cycles, instructions and
+# host microseconds per phase. Mount the disk next to the system disk:
+#   mpm2_emu -d A:disks/system.img -d B:disks/bench.img ...
+# then run them from B: (SIEVE, MEMCPY, CONOUT, SEQIO, RNDIO, DIRIO).
+
+set -e
+
+SCRIPT_DIR="$(cd "$(dirname "$0")" && pwd)"
+PROJECT_DIR="$(dirname "$SCRIPT_DIR")"
+BENCH_DIR="$PROJECT_DIR/asm/bench"
+BUILD_DIR="$PROJECT_DIR/build"
+DISKS_DIR="$PROJECT_DIR/disks"
+OUT_DIR="$BUILD_DIR/bench"
+
+PROGRAMS="sieve memcpy conout seqio rndio dirio"
+
+if ! command -v z80asm &>/dev/null; then
+    echo "Error: z80asm not found"
+    exit 1
+fi
+
+if [ ! -x "$BUILD_DIR/mkdisk" ]; then
+    echo "Error: $BUILD_DIR/mkdisk not found; build the tools first"
+    exit 1
+fi
+
+mkdir -p "$OUT_DIR"
+mkdir -p "$DISKS_DIR"
+
+echo "Assembling benchmarks..."
+cd "$BENCH_DIR"
+FILES=""
+for prog in $PROGRAMS; do
+    com="$OUT_DIR/$(echo "$prog" | tr 'a-z' 'A-Z').COM"
+    z80asm -o "$com" "$prog.asm"
+    echo "  $(basename "$com")"
+    FILES="$FILES $com"
+done
+
+echo "Creating benchmark disk..."
+"$BUILD_DIR/mkdisk" -o "$DISKS_DIR/bench.img" $FILES
+
+echo ""
+echo "Benchmark disk: $DISKS_DIR/bench.img"
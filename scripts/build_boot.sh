@@ -33,7 +33,7 @@ make -j$(nproc)
 echo ""
 echo "Creating boot image..."
 "$BUILD_DIR/mkboot" \
-    -l "$ASM_DIR/ldrbios.bin" \
+    -l "$ASM_DIR/ldrbios_hd1k.bin" \
     -x "$ASM_DIR/xios.bin" \
     -m "$EXTERNAL_DIR/mpm2dist/MPMLDR.COM" \
     -o "$DISKS_DIR/boot.img"
@@ -45,7 +45,7 @@ make -j$(nproc)
 echo ""
 echo "Step 3: Creating boot image..."
 "$BUILD_DIR/mkboot" \
-    -l "$ASM_DIR/ldrbios.bin" \
+    -l "$ASM_DIR/ldrbios_hd1k.bin" \
     -x "$ASM_DIR/xios.bin" \
     -m "$DIST_DIR/MPMLDR.COM" \
     -o "$DISKS_DIR/boot.img"
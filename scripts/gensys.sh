@@ -68,21 +68,23 @@ echo "Running GENSYS.COM..."
 echo ""
 echo "IMPORTANT: For this emulator, use these settings:"
 echo "  Top page of operating system: FF"
-echo "  Number of consoles: 4"
+echo "  Number of TMPs (consoles): 8"
 echo "  Number of printers: 1"
 echo "  Breakpoint RST: 6"
 echo "  Add system call user stacks: Y"
 echo "  Z80 CPU: Y"
-echo "  Number of ticks/second: 60"
-echo "  Bank switched memory: N (emulator handles this)"
-echo "  Number of memory segments: 1"
+echo "  Bank switched memory: Y"
+echo "  Number of user memory segments: 1"
+echo "  Common memory base page: C0"
+echo "This puts the XIOSJMP TBL at FB00H, where the emulator installs its XIOS."
 echo ""
 
 # Create input file for GENSYS
-# Non-bank-switched configuration (simpler, emulator handles banking)
+# Bank-switched configuration: the emulator's banks are 48K below a
+# common base of C000H, and the XIOSJMP TBL must land on FB00H
 # Prompts sequence:
 # 1. Top page (ff)
-# 2. Number of consoles (4)
+# 2. Number of TMPs (8) - with user stacks this puts XIOSJMP TBL at FB00H
 # 3. Number of printers (1)
 # 4. Breakpoint RST (6)
 # 5. Compatibility attributes (n)
@@ -90,17 +92,16 @@ echo ""
 # 7. Z80 CPU (y)
 # 8-14. Defaults (7 blanks): ticks, sys drive, temp drive, max locked, total locked, max open, total open
 # 15. Bank switched memory (y)
-# 16. Common base page (80 for 8000H)
-# 17. Bank select mask and pattern (blank = hardware handles)
-# 18. Number of memory segments (1)
-# 19. Dayfile logging (blank for Y)
-# 20. Accept system data page entries (blank for Y)
-# 21-24. RSP selections (4 n's for no RSPs)
-# 25. Memory segment base,size,attrib (blank for default)
+# 16. Number of user memory segments (1)
+# 17. Common memory base page (c0 for C000H)
+# 18. Dayfile logging (blank for Y)
+# 19. Accept system data page entries (blank for Y)
+# 20-23. RSP selections (4 n's for no RSPs)
+# 24-25. Memory segment base,size,attrib,bank (blank for defaults)
 # 26. Accept memory segment table (blank for Y)
 cat > gensys_input.txt << 'EOF'
 ff
-4
+8
 1
 6
 n
@@ -115,7 +116,7 @@ y
 
 y
 1
-80
+c0
 
 
 n
@@ -125,9 +126,6 @@ n
 
 
 
-
-
-
 EOF
 
 echo "Running GENSYS.COM with automated input..."
@@ -0,0 +1,451 @@
+// aux_device.cpp - Host bridge for the READER/PUNCH auxiliary devices
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "aux_device.h"
+#include "interrupt_controller.h"
+#include "log.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <sys/eventfd.h>
+#include <poll.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <cstring>
+#include <cstdlib>
+
+AuxDevice::AuxDevice(const char* name, Direction dir)
+    : name_(name)
+    , dir_(dir)
+    , endpoint_(AuxEndpoint::NONE)
+    , port_(0)
+    , fd_(-1)
+    , listen_fd_(-1)
+    , pending_pos_(0)
+    , doorbell_(-1)
+    , io_waiting_(false)
+    , host_eof_(false)
+    , eof_(false)
+    , bytes_(0)
+{
+    pending_.reserve(BUFFER_SIZE);
+}
+
+AuxDevice::~AuxDevice() {
+    close();
+}
+
+bool AuxDevice::configure(const std::string& spec) {
+    close();
+
+    size_t colon = spec.find(':');
+    if (colon == std::string::npos) {
+        LOG_ERROR("AUX") << name_ << ": invalid spec '" << spec
+                         << "' (expected file:PATH, fifo:PATH or tcp:[HOST:]PORT)";
+        return false;
+    }
+
+    std::string kind = spec.substr(0, colon);
+    std::string arg = spec.substr(colon + 1);
+
+    if (kind == "file") {
+        endpoint_ = AuxEndpoint::FILE;
+        path_ = arg;
+    } else if (kind == "fifo") {
+        endpoint_ = AuxEndpoint::FIFO;
+        path_ = arg;
+        // Create the named pipe if it does not exist yet
+        struct stat st;
+        if (stat(path_.c_str(), &st) != 0) {
+            if (mkfifo(path_.c_str(), 0660) != 0) {
+                LOG_ERROR("AUX") << name_ << ": mkfifo " << path_
+                                 << " failed: " << strerror(errno);
+                endpoint_ = AuxEndpoint::NONE;
+                return false;
+            }
+        } else if (!S_ISFIFO(st.st_mode)) {
+            LOG_ERROR("AUX") << name_ << ": " << path_ << " is not a FIFO";
+            endpoint_ = AuxEndpoint::NONE;
+            return false;
+        }
+    } else if (kind == "tcp") {
+        endpoint_ = AuxEndpoint::TCP;
+        size_t port_colon = arg.rfind(':');
+        host_ = (port_colon == std::string::npos) ? "127.0.0.1" : arg.substr(0, port_colon);
+        port_ = std::atoi(arg.c_str() + (port_colon == std::string::npos ? 0 : port_colon + 1));
+        if (port_ <= 0 || port_ > 65535) {
+            LOG_ERROR("AUX") << name_ << ": invalid TCP port in '" << spec << "'";
+            endpoint_ = AuxEndpoint::NONE;
+            return false;
+        }
+    } else {
+        LOG_ERROR("AUX") << name_ << ": unknown endpoint type '" << kind << "'";
+        return false;
+    }
+
+    if (!open_endpoint()) {
+        endpoint_ = AuxEndpoint::NONE;
+        return false;
+    }
+    return true;
+}
+
+bool AuxDevice::open_endpoint() {
+    switch (endpoint_) {
+        case AuxEndpoint::FILE: {
+            int flags = (dir_ == Direction::INPUT)
+                ? O_RDONLY
+                : (O_WRONLY | O_CREAT | O_APPEND);
+            fd_ = ::open(path_.c_str(), flags | O_NONBLOCK | O_CLOEXEC, 0644);
+            if (fd_ < 0) {
+                LOG_ERROR("AUX") << name_ << ": cannot open " << path_
+                                 << ": " << strerror(errno);
+                return false;
+            }
+            return true;
+        }
+
+        case AuxEndpoint::FIFO:
+            // Reader side always opens; writer side opens once a reader exists
+            // (retry_open() keeps trying from the I/O thread)
+            retry_open();
+            return dir_ == Direction::OUTPUT || fd_ >= 0;
+
+        case AuxEndpoint::TCP: {
+            listen_fd_ = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+            if (listen_fd_ < 0) return false;
+
+            int opt = 1;
+            setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+            struct sockaddr_in addr;
+            memset(&addr, 0, sizeof(addr));
+            addr.sin_family = AF_INET;
+            addr.sin_port = htons(port_);
+            if (inet_pton(AF_INET, host_.c_str(), &addr.sin_addr) != 1) {
+                LOG_ERROR("AUX") << name_ << ": invalid address " << host_;
+                ::close(listen_fd_);
+                listen_fd_ = -1;
+                return false;
+            }
+
+            if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0 ||
+                ::listen(listen_fd_, 1) < 0) {
+                LOG_ERROR("AUX") << name_ << ": cannot listen on " << host_ << ":"
+                                 << port_ << ": " << strerror(errno);
+                ::close(listen_fd_);
+                listen_fd_ = -1;
+                return false;
+            }
+            return true;
+        }
+
+        case AuxEndpoint::NONE:
+            break;
+    }
+    return false;
+}
+
+void AuxDevice::retry_open() {
+    if (endpoint_ != AuxEndpoint::FIFO || fd_ >= 0) return;
+
+    int flags = (dir_ == Direction::INPUT) ? O_RDONLY : O_WRONLY;
+    fd_ = ::open(path_.c_str(), flags | O_NONBLOCK | O_CLOEXEC);
+    // ENXIO on the writer side just means no reader yet - try again later
+}
+
+void AuxDevice::close_data_fd() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
+
+void AuxDevice::close() {
+    close_data_fd();
+    if (listen_fd_ >= 0) {
+        ::close(listen_fd_);
+        listen_fd_ = -1;
+    }
+    endpoint_ = AuxEndpoint::NONE;
+    queue_.clear();
+    pending_.clear();
+    pending_pos_ = 0;
+    host_eof_ = false;
+    eof_.store(false);
+}
+
+int AuxDevice::read_byte(unsigned timeout_ms) {
+    int ch = (timeout_ms == 0) ? queue_.try_read() : queue_.read(timeout_ms);
+    if (ch >= 0) {
+        bytes_++;
+        // Held bytes go in as soon as half the queue is free
+        if (io_waiting_.load() && queue_.space() >= BUFFER_SIZE / 2 && io_waiting_.exchange(false)) {
+            ring_io();
+        }
+    }
+    return ch;
+}
+
+bool AuxDevice::take_eof() {
+    if (!eof_.load() || !queue_.empty()) return false;
+    // A file has ended for good; pipes and sockets can deliver another session
+    if (endpoint_ != AuxEndpoint::FILE) eof_.store(false);
+    return true;
+}
+
+bool AuxDevice::write_byte(uint8_t ch, unsigned timeout_ms) {
+    // Unconfigured punch behaves like a bit bucket
+    if (endpoint_ == AuxEndpoint::NONE) return true;
+
+    bool ok = (timeout_ms == 0) ? queue_.try_write(ch) : queue_.write(ch, timeout_ms);
+    if (ok) {
+        bytes_++;
+        if (io_waiting_.load() && io_waiting_.exchange(false)) ring_io();
+    }
+    return ok;
+}
+
+void AuxDevice::ring_io() {
+    if (doorbell_ < 0) return;
+    uint64_t one = 1;
+    ssize_t n = ::write(doorbell_, &one, sizeof(one));
+    (void)n;
+}
+
+bool AuxDevice::input_ready() const {
+    // EOF counts as ready: READER returns ^Z without waiting
+    return !queue_.empty() || eof_.load() || endpoint_ == AuxEndpoint::NONE;
+}
+
+bool AuxDevice::output_ready() const {
+    return !queue_.full();
+}
+
+int AuxDevice::poll_fd() const {
+    if (fd_ >= 0) return fd_;
+    return listen_fd_;
+}
+
+short AuxDevice::poll_events() const {
+    if (fd_ < 0) {
+        // Waiting for a TCP client
+        return listen_fd_ >= 0 ? POLLIN : 0;
+    }
+    if (dir_ == Direction::INPUT) {
+        // Backpressure: stop reading while the I/O thread still holds data
+        return pending_pos_ < pending_.size() ? 0 : POLLIN;
+    }
+    bool have_data = pending_pos_ < pending_.size() || !queue_.empty();
+    return have_data ? POLLOUT : 0;
+}
+
+void AuxDevice::service(short revents) {
+    // Accept a new TCP client if we don't have one
+    if (fd_ < 0 && listen_fd_ >= 0 && (revents & POLLIN)) {
+        fd_ = accept4(listen_fd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd_ >= 0) {
+            LOG_INFO("AUX") << name_ << ": client connected on port " << port_;
+        }
+        return;
+    }
+
+    if (fd_ < 0) return;
+
+    if (dir_ == Direction::INPUT) {
+        if (revents & (POLLIN | POLLHUP | POLLERR)) {
+            fill_from_host();
+        }
+        // Move held bytes into the queue as the Z80 side frees space.
+        // Ask for the doorbell first, so space freed after write_some()
+        // is not missed.
+        if (pending_pos_ < pending_.size()) {
+            io_waiting_.store(true);
+            size_t n = queue_.write_some(pending_.data() + pending_pos_,
+                                         pending_.size() - pending_pos_);
+            pending_pos_ += n;
+            if (pending_pos_ >= pending_.size()) io_waiting_.store(false);
+            if (n > 0) InterruptController::instance().raise(IRQ_AUX);
+        }
+        if (host_eof_ && pending_pos_ >= pending_.size()) {
+            host_eof_ = false;
+            eof_.store(true);
+            InterruptController::instance().raise(IRQ_AUX);
+        }
+    } else {
+        if (revents & (POLLHUP | POLLERR)) {
+            handle_eof();
+            return;
+        }
+        if (revents & POLLOUT) {
+            bool was_full = queue_.full();
+            drain_to_host();
+            if (was_full && !queue_.full()) InterruptController::instance().raise(IRQ_AUX);
+        }
+        // Nothing held: the next byte queued rings us (poll_events() looks
+        // at the queue after this, so one queued before is seen there)
+        if (pending_pos_ >= pending_.size()) io_waiting_.store(true);
+    }
+}
+
+void AuxDevice::fill_from_host() {
+    if (pending_pos_ < pending_.size()) return;
+
+    pending_.resize(BUFFER_SIZE);
+    ssize_t n = ::read(fd_, pending_.data(), pending_.size());
+    if (n > 0) {
+        pending_.resize(static_cast<size_t>(n));
+        pending_pos_ = 0;
+        return;
+    }
+
+    pending_.clear();
+    pending_pos_ = 0;
+    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+        handle_eof();
+    }
+}
+
+void AuxDevice::drain_to_host() {
+    if (pending_pos_ >= pending_.size()) {
+        pending_.resize(BUFFER_SIZE);
+        size_t count = queue_.read_some(pending_.data(), pending_.size());
+        pending_.resize(count);
+        pending_pos_ = 0;
+        if (count == 0) return;
+    }
+
+    // A peer that went away is an EOF, not a SIGPIPE
+    const uint8_t* data = pending_.data() + pending_pos_;
+    size_t length = pending_.size() - pending_pos_;
+    ssize_t n = endpoint_ == AuxEndpoint::TCP ? ::send(fd_, data, length, MSG_NOSIGNAL)
+                                              : ::write(fd_, data, length);
+    if (n > 0) {
+        pending_pos_ += static_cast<size_t>(n);
+    } else if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+        handle_eof();
+    }
+}
+
+void AuxDevice::handle_eof() {
+    close_data_fd();
+
+    if (dir_ == Direction::INPUT) {
+        host_eof_ = true;
+    }
+
+    switch (endpoint_) {
+        case AuxEndpoint::FIFO:
+            // Reopen so the next writer/reader can attach
+            retry_open();
+            break;
+        case AuxEndpoint::TCP:
+            LOG_INFO("AUX") << name_ << ": client disconnected";
+            break;
+        default:
+            break;
+    }
+}
+
+// AuxSystem implementation
+
+AuxSystem& AuxSystem::instance() {
+    static AuxSystem instance;
+    return instance;
+}
+
+AuxSystem::AuxSystem()
+    : reader_("READER", AuxDevice::Direction::INPUT)
+    , punch_("PUNCH", AuxDevice::Direction::OUTPUT)
+    , doorbell_(-1)
+    , running_(false)
+    , stop_requested_(false)
+{
+}
+
+AuxSystem::~AuxSystem() {
+    stop();
+    if (doorbell_ >= 0) ::close(doorbell_);
+}
+
+void AuxSystem::start() {
+    if (running_.load()) return;
+    if (!reader_.is_configured() && !punch_.is_configured()) return;
+
+    if (doorbell_ < 0) {
+        doorbell_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (doorbell_ < 0) {
+            LOG_WARN("AUX") << "Cannot create eventfd: " << strerror(errno);
+        }
+        reader_.set_doorbell(doorbell_);
+        punch_.set_doorbell(doorbell_);
+    }
+
+    stop_requested_.store(false);
+    running_.store(true);
+    thread_ = std::thread(&AuxSystem::thread_func, this);
+}
+
+void AuxSystem::stop() {
+    stop_requested_.store(true);
+    if (thread_.joinable()) {
+        thread_.join();
+    }
+    running_.store(false);
+}
+
+void AuxSystem::thread_func() {
+    AuxDevice* devices[] = { &reader_, &punch_ };
+
+    while (!stop_requested_.load()) {
+        struct pollfd fds[3];
+        AuxDevice* polled[3];
+        nfds_t nfds = 0;
+
+        if (doorbell_ >= 0) {
+            fds[nfds].fd = doorbell_;
+            fds[nfds].events = POLLIN;
+            fds[nfds].revents = 0;
+            polled[nfds++] = nullptr;
+        }
+
+        for (AuxDevice* dev : devices) {
+            if (!dev->is_configured()) continue;
+            dev->retry_open();
+
+            int fd = dev->poll_fd();
+            short events = dev->poll_events();
+            if (fd >= 0 && events != 0) {
+                fds[nfds].fd = fd;
+                fds[nfds].events = events;
+                fds[nfds].revents = 0;
+                polled[nfds++] = dev;
+            }
+        }
+
+        // The doorbell brings new punch data and reader queue space; the
+        // 10ms timeout retries FIFO opens
+        int ret = poll(fds, nfds, 10);
+        if (ret < 0 && errno != EINTR) break;
+        if (doorbell_ >= 0 && (fds[0].revents & POLLIN)) {
+            uint64_t value;
+            ssize_t n = ::read(doorbell_, &value, sizeof(value));
+            (void)n;
+        }
+
+        for (AuxDevice* dev : devices) {
+            if (!dev->is_configured()) continue;
+            short revents = 0;
+            for (nfds_t i = 0; i < nfds; i++) {
+                if (polled[i] == dev) revents = fds[i].revents;
+            }
+            dev->service(revents);
+        }
+    }
+
+    running_.store(false);
+}
@@ -3,37 +3,258 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "console.h"
+#include "log.h"
+#include "futex.h"
+#include <algorithm>
+#include <chrono>
 #include <iostream>
+#include <unistd.h>
+
+static int64_t steady_ms() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
 
 Console::Console(int id)
     : id_(id)
     , connected_(false)
     , local_mode_(false)
+    , detached_(false)
+    , detached_at_(0)
     , term_width_(80)
     , term_height_(24)
     , term_type_("vt100")
+    , screen_fps_(0)
+    , doorbell_fd_(-1)
+    , doorbell_armed_(true)
+    , doorbell_word_(nullptr)
+    , doorbell_waiting_(nullptr)
+    , bytes_out_(0)
+    , throttled_(0)
+    , has_unread_(false)
+    , unread_stale_(false)
+    , column_(0)
+    , at_prompt_(true)
+    , prompt_line_()
+    , prompt_len_(0)
+    , staged_pos_(0)
+    , scrollback_head_(0)
+    , scrollback_count_(0)
 {
 }
 
+size_t Console::put_input(const uint8_t* data, size_t len) {
+    size_t count = push_input(data, len);
+    if (count > 0) ring_doorbell();
+    return count;
+}
+
+size_t Console::push_input(const uint8_t* data, size_t len) {
+    size_t count = input_queue_.write_some(data, len);
+    if (count > 0) ConsoleManager::instance().set_input_ready(id_, true);
+    return count;
+}
+
+void Console::sync_input_ready() {
+    // Clear first, then re-check: a producer that queued in between has
+    // either set the bit after us or is seen by empty()
+    ConsoleManager& mgr = ConsoleManager::instance();
+    mgr.set_input_ready(id_, false);
+    if (has_unread_.load() || !input_queue_.empty()) mgr.set_input_ready(id_, true);
+}
+
+void Console::stage_input(const uint8_t* data, size_t len) {
+    std::lock_guard<std::mutex> lock(staged_mutex_);
+    staged_.append(reinterpret_cast<const char*>(data), len);
+}
+
+size_t Console::feed_input() {
+    std::lock_guard<std::mutex> lock(staged_mutex_);
+    size_t pending = staged_.size() - staged_pos_;
+    if (pending == 0) return 0;
+
+    size_t n = std::min(pending, input_queue_.space());
+    if (paste_pacer_.enabled()) {
+        n = paste_pacer_.take_up_to(static_cast<uint32_t>(n));
+    }
+    n = put_input(reinterpret_cast<const uint8_t*>(staged_.data()) + staged_pos_, n);
+    staged_pos_ += n;
+
+    // Reclaim the consumed front once it dominates
+    if (staged_pos_ == staged_.size()) {
+        staged_.clear();
+        staged_pos_ = 0;
+    } else if (staged_pos_ > 4096 && staged_pos_ * 2 > staged_.size()) {
+        staged_.erase(0, staged_pos_);
+        staged_pos_ = 0;
+    }
+    return n;
+}
+
+size_t Console::staged_input() const {
+    std::lock_guard<std::mutex> lock(staged_mutex_);
+    return staged_.size() - staged_pos_;
+}
+
+void Console::set_paste_pace(uint32_t cps, uint32_t burst) {
+    std::lock_guard<std::mutex> lock(staged_mutex_);
+    paste_pacer_.configure(cps, burst);
+}
+
+void Console::ring_doorbell() {
+    std::atomic<uint32_t>* word = doorbell_word_.load();
+    if ((doorbell_fd_ < 0 && !word) || !doorbell_armed_.exchange(false)) return;
+    if (word) {
+        futex_ring(word, doorbell_waiting_);
+        return;
+    }
+    uint64_t one = 1;
+    ssize_t n = write(doorbell_fd_, &one, sizeof(one));
+    (void)n;
+}
+
+bool Console::output_ready() {
+    // Local, detached and unconnected output never backs up
+    if (local_mode_.load() || detached_.load() || !connected_.load()) return true;
+    return !output_queue_.full() && shaper_.can_take();
+}
+
+void Console::attach(const std::string& user, const std::string& key) {
+    {
+        std::lock_guard<std::mutex> lock(term_mutex_);
+        owner_ = user;
+        key_ = key;
+    }
+    detached_.store(false);
+    detached_at_.store(0);
+    connected_.store(true);
+}
+
+void Console::detach() {
+    // Order matters: write_char checks detached_ before connected_
+    detached_at_.store(steady_ms());
+    detached_.store(true);
+    connected_.store(false);
+    input_queue_.clear();
+    sync_input_ready();
+    clear_staged();
+
+    // Output the session did not get to send goes to the scrollback
+    uint8_t buf[256];
+    size_t count;
+    while ((count = output_queue_.read_some(buf, sizeof(buf))) > 0) {
+        for (size_t i = 0; i < count; i++) scrollback_put(buf[i]);
+    }
+}
+
+void Console::clear_staged() {
+    std::lock_guard<std::mutex> lock(staged_mutex_);
+    staged_.clear();
+    staged_pos_ = 0;
+}
+
+int64_t Console::detached_ms() const {
+    if (!detached_.load()) return 0;
+    return steady_ms() - detached_at_.load();
+}
+
+void Console::scrollback_put(uint8_t ch) {
+    std::lock_guard<std::mutex> lock(scrollback_mutex_);
+    if (scrollback_.empty()) scrollback_.resize(SCROLLBACK_SIZE);
+    size_t tail = (scrollback_head_ + scrollback_count_) % SCROLLBACK_SIZE;
+    scrollback_[tail] = ch;
+    if (scrollback_count_ < SCROLLBACK_SIZE) {
+        scrollback_count_++;
+    } else {
+        scrollback_head_ = (scrollback_head_ + 1) % SCROLLBACK_SIZE;
+    }
+}
+
+size_t Console::take_scrollback(std::vector<uint8_t>& out) {
+    std::lock_guard<std::mutex> lock(scrollback_mutex_);
+    out.clear();
+    out.reserve(scrollback_count_);
+    for (size_t i = 0; i < scrollback_count_; i++) {
+        out.push_back(scrollback_[(scrollback_head_ + i) % SCROLLBACK_SIZE]);
+    }
+    scrollback_head_ = 0;
+    scrollback_count_ = 0;
+    return out.size();
+}
+
+void Console::enable_screen_model(int fps) {
+    screen_fps_ = fps;
+    if (fps > 0) {
+        screen_ = std::make_unique<ScreenModel>(term_width_.load(), term_height_.load());
+    } else {
+        screen_.reset();
+    }
+}
+
 uint8_t Console::const_status() {
     // Check if input available - works for both connected and local mode
     if (!connected_.load() && !local_mode_.load()) return 0x00;
-    return input_queue_.available() > 0 ? 0xFF : 0x00;
+    return (ConsoleManager::instance().input_ready_mask() >> id_) & 1 ? 0xFF : 0x00;
 }
 
-uint8_t Console::read_char() {
-    // For non-connected, non-local consoles, return 0x00 (no input)
-    // MP/M should use CONST to poll first; CONIN returning 0 means no char
-    if (!connected_.load() && !local_mode_.load()) return 0x00;
+int Console::read_char() {
+    // Never waits: the XIOS parks the calling process on POLLDEVICE
+    // instead of holding up the Z80 thread
+    if (!connected_.load() && !local_mode_.load()) return -1;
+    if (unread_stale_.exchange(false)) unread_.clear();
+    if (!unread_.empty()) {
+        int ch = static_cast<uint8_t>(unread_.front());
+        unread_.erase(0, 1);
+        if (unread_.empty()) {
+            has_unread_.store(false);
+            sync_input_ready();
+        }
+        return ch;
+    }
+    int ch = input_queue_.try_read();
+    if (ch < 0 || input_queue_.empty()) sync_input_ready();
+    return ch;
+}
+
+void Console::unread(const uint8_t* data, size_t len) {
+    if (len == 0) return;
+    if (unread_stale_.exchange(false)) unread_.clear();
+    unread_.insert(0, reinterpret_cast<const char*>(data), len);
+    has_unread_.store(true);
+    ConsoleManager::instance().set_input_ready(id_, true);
+}
 
-    // Brief wait - MP/M should poll with CONST first
-    int ch = input_queue_.read(10);  // 10ms timeout
-    if (ch < 0) return 0x00;  // No character available
+void Console::track_output(uint8_t ch) {
+    ch &= 0x7F;
+    if (ch == '\r' || ch == '\n') {
+        prompt_len_ = 0;
+        at_prompt_.store(false);
+        return;
+    }
+    if (ch < 0x20 || ch == 0x7F || prompt_len_ == sizeof(prompt_line_)) return;
+    prompt_line_[prompt_len_++] = static_cast<char>(ch);
+    if (ch != '>' || prompt_len_ < 2) return;
 
-    return static_cast<uint8_t>(ch);
+    // Optional user number, drive letter, '>'
+    size_t i = 0;
+    while (i < prompt_len_ - 2 && prompt_line_[i] >= '0' && prompt_line_[i] <= '9') i++;
+    char drive = prompt_line_[prompt_len_ - 2];
+    if (i == prompt_len_ - 2 && drive >= 'A' && drive <= 'P') at_prompt_.store(true);
 }
 
 void Console::write_char(uint8_t ch) {
+    bytes_out_++;
+
+    // Track the cursor for the line editor
+    if (ch >= 0x20 && ch != 0x7F) {
+        column_++;
+    } else if (ch == '\r') {
+        column_ = 0;
+    } else if (ch == '\b' && column_ > 0) {
+        column_--;
+    }
+    track_output(ch);
+
     if (local_mode_.load()) {
         // Local mode - output directly to stdout
         std::cout.put(static_cast<char>(ch));
@@ -41,9 +262,14 @@ void Console::write_char(uint8_t ch) {
         return;
     }
 
-    if (connected_.load()) {
+    if (detached_.load()) {
+        // Owner dropped the connection - keep output for reattach
+        scrollback_put(ch);
+    } else if (connected_.load()) {
         // Connected - queue for SSH transmission
+        shaper_.try_take();
         output_queue_.try_write(ch);
+        ring_doorbell();
     } else if (id_ == 0) {
         // Console 0 not connected - output to stdout for boot messages
         std::cout.put(static_cast<char>(ch));
@@ -54,13 +280,29 @@ void Console::write_char(uint8_t ch) {
 
 void Console::reset() {
     connected_.store(false);
+    detached_.store(false);
+    detached_at_.store(0);
+    // unread_ belongs to the Z80 thread, which drops it on its next read
+    unread_stale_.store(true);
+    has_unread_.store(false);
     input_queue_.clear();
+    sync_input_ready();
+    clear_staged();
     output_queue_.clear();
     term_width_.store(80);
     term_height_.store(24);
+    if (screen_) screen_->resize(80, 24);
+    translator_.reset();
     {
         std::lock_guard<std::mutex> lock(term_mutex_);
         term_type_ = "vt100";
+        owner_.clear();
+        key_.clear();
+    }
+    {
+        std::lock_guard<std::mutex> lock(scrollback_mutex_);
+        scrollback_head_ = 0;
+        scrollback_count_ = 0;
     }
 }
 
@@ -87,13 +329,51 @@ Console* ConsoleManager::get(int id) {
 
 Console* ConsoleManager::find_free() {
     for (auto& con : consoles_) {
-        if (con && !con->is_connected()) {
+        if (con && !con->is_connected() && !con->is_detached() && con->at_prompt()) {
+            return con.get();
+        }
+    }
+    return nullptr;
+}
+
+bool ConsoleManager::try_claim(int id, const std::string& owner, const std::string& key,
+                               bool at_prompt) {
+    Console* con = get(id);
+    if (!con) return false;
+    std::lock_guard<std::mutex> lock(claim_mutex_);
+    if (con->is_connected() || con->is_detached()) return false;
+    if (at_prompt && !con->at_prompt()) return false;
+    con->attach(owner, key);
+    return true;
+}
+
+Console* ConsoleManager::find_detached(const std::string& user, const std::string& key) {
+    // The user name alone is whatever the client claims
+    if (key.empty()) return nullptr;
+    for (auto& con : consoles_) {
+        if (con && con->is_detached() && con->owner() == user && con->key() == key) {
             return con.get();
         }
     }
     return nullptr;
 }
 
+int ConsoleManager::reap_idle() {
+    if (detach_timeout_ <= 0) return 0;
+
+    int reaped = 0;
+    for (auto& con : consoles_) {
+        if (con && con->is_detached() &&
+            con->detached_ms() >= static_cast<int64_t>(detach_timeout_) * 1000) {
+            LOG_INFO("CONSOLE") << "Reaping idle console " << con->id()
+                                << " (user " << con->owner() << ")";
+            con->reset();
+            reaped++;
+        }
+    }
+    return reaped;
+}
+
 int ConsoleManager::connected_count() const {
     int count = 0;
     for (const auto& con : consoles_) {
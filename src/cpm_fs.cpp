@@ -0,0 +1,388 @@
+// cpm_fs.cpp - Host-side access to files on CP/M disk images
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "cpm_fs.h"
+#include "disk.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <map>
+#include <mutex>
+
+CpmFs::CpmFs(Disk* disk)
+    : disk_(disk)
+{
+    const DiskParameterBlock& dpb = disk->dpb();
+    spt_ = dpb.spt;
+    bsh_ = dpb.bsh;
+    exm_ = dpb.exm;
+    dsm_ = dpb.dsm;
+    drm_ = dpb.drm;
+    off_ = dpb.off;
+    dir_alloc_ = static_cast<uint16_t>((dpb.al0 << 8) | dpb.al1);
+    big_ = dsm_ > 255;
+}
+
+const char* CpmFs::result_string(Result r) {
+    switch (r) {
+        case Result::OK:        return "OK";
+        case Result::NOT_FOUND: return "No such file";
+        case Result::EXISTS:    return "File exists";
+        case Result::READ_ONLY: return "Read-only";
+        case Result::IN_USE:    return "Drive is logged in by the guest";
+        case Result::DISK_FULL: return "Disk full";
+        case Result::DIR_FULL:  return "Directory full";
+        case Result::BAD_NAME:  return "Not a valid CP/M file name";
+        case Result::IO_ERROR:  return "Disk I/O error";
+    }
+    return "Unknown error";
+}
+
+bool CpmFs::make_name(const std::string& name, uint8_t fcb[11]) {
+    static const char bad[] = "<>.,;:=?*[]|()/\\\"";
+
+    size_t dot = name.find('.');
+    std::string base = name.substr(0, dot);
+    std::string ext = dot == std::string::npos ? "" : name.substr(dot + 1);
+    if (base.empty() || base.size() > 8 || ext.size() > 3) return false;
+
+    std::memset(fcb, ' ', 11);
+    for (size_t i = 0; i < base.size() + ext.size(); i++) {
+        char c = i < base.size() ? base[i] : ext[i - base.size()];
+        if (c <= ' ' || c > '~' || std::strchr(bad, c)) return false;
+        fcb[i < base.size() ? i : 8 + i - base.size()] =
+            static_cast<uint8_t>(std::toupper(static_cast<unsigned char>(c)));
+    }
+    return true;
+}
+
+// "NAME    EXT" (attribute bits stripped) to "NAME.EXT"
+static std::string display_name(const uint8_t* fcb) {
+    std::string base, ext;
+    for (int i = 0; i < 8; i++) base += static_cast<char>(fcb[i] & 0x7F);
+    for (int i = 8; i < 11; i++) ext += static_cast<char>(fcb[i] & 0x7F);
+    base.erase(base.find_last_not_of(' ') + 1);
+    ext.erase(ext.find_last_not_of(' ') + 1);
+    return ext.empty() ? base : base + "." + ext;
+}
+
+uint32_t CpmFs::dir_blocks() const {
+    uint32_t count = 0;
+    for (int i = 0; i < 16; i++) {
+        if (dir_alloc_ & (0x8000 >> i)) count++;
+    }
+    return count;
+}
+
+int CpmFs::read_block_record(uint32_t block, uint32_t record, uint8_t* buf) {
+    uint32_t abs = block * records_per_block() + record;
+    return disk_->read_record(static_cast<uint16_t>(off_ + abs / spt_),
+                              static_cast<uint16_t>(abs % spt_), buf);
+}
+
+int CpmFs::write_block_record(uint32_t block, uint32_t record, const uint8_t* buf) {
+    uint32_t abs = block * records_per_block() + record;
+    return disk_->write_record(static_cast<uint16_t>(off_ + abs / spt_),
+                               static_cast<uint16_t>(abs % spt_), buf);
+}
+
+bool CpmFs::load_dir() {
+    size_t entries = static_cast<size_t>(drm_) + 1;
+    dir_.assign(entries * ENTRY_SIZE, DELETED);
+
+    // Directory starts at block 0, four entries per record
+    for (size_t r = 0; r * 4 < entries; r++) {
+        if (read_block_record(static_cast<uint32_t>(r / records_per_block()),
+                              static_cast<uint32_t>(r % records_per_block()),
+                              &dir_[r * 128]) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool CpmFs::store_dir_entry(size_t index) {
+    size_t r = index / 4;
+    return write_block_record(static_cast<uint32_t>(r / records_per_block()),
+                              static_cast<uint32_t>(r % records_per_block()),
+                              &dir_[r * 128]) == 0;
+}
+
+bool CpmFs::matches(size_t index, uint8_t user, const uint8_t fcb[11]) const {
+    const uint8_t* e = &dir_[index * ENTRY_SIZE];
+    if (e[0] != user) return false;
+    for (int i = 0; i < 11; i++) {
+        if ((e[1 + i] & 0x7F) != fcb[i]) return false;
+    }
+    return true;
+}
+
+uint32_t CpmFs::block_at(size_t index, int slot) const {
+    const uint8_t* e = &dir_[index * ENTRY_SIZE];
+    if (big_) return e[16 + 2 * slot] | (e[17 + 2 * slot] << 8);
+    return e[16 + slot];
+}
+
+void CpmFs::set_block(size_t index, int slot, uint32_t block) {
+    uint8_t* e = entry(index);
+    if (big_) {
+        e[16 + 2 * slot] = block & 0xFF;
+        e[17 + 2 * slot] = (block >> 8) & 0xFF;
+    } else {
+        e[16 + slot] = block & 0xFF;
+    }
+}
+
+// Logical extent number: EX (low 5 bits) and S2
+uint32_t CpmFs::extent_number(const uint8_t* e) {
+    return (e[12] & 0x1F) | (static_cast<uint32_t>(e[14]) << 5);
+}
+
+std::vector<size_t> CpmFs::file_entries(uint8_t user, const uint8_t fcb[11]) const {
+    std::vector<size_t> entries;
+    for (size_t i = 0; i <= drm_; i++) {
+        if (matches(i, user, fcb)) entries.push_back(i);
+    }
+    std::sort(entries.begin(), entries.end(), [this](size_t a, size_t b) {
+        return extent_number(&dir_[a * ENTRY_SIZE]) < extent_number(&dir_[b * ENTRY_SIZE]);
+    });
+    return entries;
+}
+
+uint32_t CpmFs::file_records(const std::vector<size_t>& entries) const {
+    if (entries.empty()) return 0;
+    const uint8_t* e = &dir_[entries.back() * ENTRY_SIZE];
+    uint32_t ext = extent_number(e);
+    return (ext / (exm_ + 1)) * records_per_entry() + (ext % (exm_ + 1)) * 128 + e[15];
+}
+
+std::vector<bool> CpmFs::used_blocks() const {
+    std::vector<bool> used(static_cast<size_t>(dsm_) + 1, false);
+    for (uint32_t b = 0; b < dir_blocks() && b <= dsm_; b++) used[b] = true;
+
+    for (size_t i = 0; i <= drm_; i++) {
+        const uint8_t* e = &dir_[i * ENTRY_SIZE];
+        if (e[0] == DELETED || e[0] >= 0x20) continue;  // Labels/stamps hold no blocks
+        for (int s = 0; s < pointers_per_entry(); s++) {
+            uint32_t b = block_at(i, s);
+            if (b != 0 && b <= dsm_) used[b] = true;
+        }
+    }
+    return used;
+}
+
+CpmFs::Result CpmFs::list(std::vector<CpmFileInfo>& files) {
+    std::lock_guard<std::mutex> lock(disk_->mutex());
+    files.clear();
+    if (!load_dir()) return Result::IO_ERROR;
+
+    // One listing entry per (user, name), sized from its last extent
+    std::map<std::string, CpmFileInfo> found;
+    for (size_t i = 0; i <= drm_; i++) {
+        const uint8_t* e = &dir_[i * ENTRY_SIZE];
+        if (e[0] > 15) continue;
+
+        std::string key(1, static_cast<char>(e[0]));
+        for (int k = 1; k < 12; k++) key += static_cast<char>(e[k] & 0x7F);
+        auto it = found.find(key);
+        if (it != found.end()) continue;
+
+        uint8_t fcb[11];
+        for (int k = 0; k < 11; k++) fcb[k] = e[1 + k] & 0x7F;
+        std::vector<size_t> entries = file_entries(e[0], fcb);
+
+        CpmFileInfo info;
+        info.user = e[0];
+        info.name = display_name(fcb);
+        info.size = file_records(entries) * 128;
+        info.read_only = (dir_[entries.front() * ENTRY_SIZE + 9] & 0x80) != 0;
+        info.system = (dir_[entries.front() * ENTRY_SIZE + 10] & 0x80) != 0;
+        found[key] = info;
+    }
+
+    for (auto& f : found) files.push_back(f.second);
+    return Result::OK;
+}
+
+CpmFs::Result CpmFs::stat(uint8_t user, const std::string& name, CpmFileInfo& info) {
+    uint8_t fcb[11];
+    if (!make_name(name, fcb)) return Result::BAD_NAME;
+
+    std::lock_guard<std::mutex> lock(disk_->mutex());
+    if (!load_dir()) return Result::IO_ERROR;
+
+    std::vector<size_t> entries = file_entries(user, fcb);
+    if (entries.empty()) return Result::NOT_FOUND;
+
+    const uint8_t* first = &dir_[entries.front() * ENTRY_SIZE];
+    info.user = user;
+    info.name = display_name(fcb);
+    info.size = file_records(entries) * 128;
+    info.read_only = (first[9] & 0x80) != 0;
+    info.system = (first[10] & 0x80) != 0;
+    return Result::OK;
+}
+
+CpmFs::Result CpmFs::read_file(uint8_t user, const std::string& name,
+                               std::vector<uint8_t>& data) {
+    uint8_t fcb[11];
+    if (!make_name(name, fcb)) return Result::BAD_NAME;
+
+    std::lock_guard<std::mutex> lock(disk_->mutex());
+    if (!load_dir()) return Result::IO_ERROR;
+
+    std::vector<size_t> entries = file_entries(user, fcb);
+    if (entries.empty()) return Result::NOT_FOUND;
+
+    data.assign(static_cast<size_t>(file_records(entries)) * 128, 0);
+    for (size_t index : entries) {
+        const uint8_t* e = &dir_[index * ENTRY_SIZE];
+        uint32_t ext = extent_number(e);
+        uint32_t base = (ext / (exm_ + 1)) * records_per_entry();
+        uint32_t records = (ext % (exm_ + 1)) * 128 + e[15];
+
+        for (uint32_t r = 0; r < records; r++) {
+            uint32_t block = block_at(index, static_cast<int>(r / records_per_block()));
+            if (block == 0) continue;  // Sparse - stays zero
+            if (read_block_record(block, r % records_per_block(),
+                                  &data[static_cast<size_t>(base + r) * 128]) != 0) {
+                return Result::IO_ERROR;
+            }
+        }
+    }
+    return Result::OK;
+}
+
+CpmFs::Result CpmFs::write_file(uint8_t user, const std::string& name,
+                                const std::vector<uint8_t>& data) {
+    uint8_t fcb[11];
+    if (!make_name(name, fcb) || user > 15) return Result::BAD_NAME;
+    if (disk_->is_read_only()) return Result::READ_ONLY;
+
+    std::lock_guard<std::mutex> lock(disk_->mutex());
+    if (disk_->guest_logged_in()) return Result::IN_USE;
+    if (!load_dir()) return Result::IO_ERROR;
+
+    // Replace: free the old file's entries and blocks
+    std::vector<size_t> touched = file_entries(user, fcb);
+    for (size_t index : touched) {
+        if (entry(index)[9] & 0x80) return Result::READ_ONLY;
+    }
+    for (size_t index : touched) entry(index)[0] = DELETED;
+
+    uint32_t records = static_cast<uint32_t>((data.size() + 127) / 128);
+    uint32_t nblocks = (records + records_per_block() - 1) / records_per_block();
+    uint32_t nentries = std::max<uint32_t>(1, (records + records_per_entry() - 1) /
+                                              records_per_entry());
+
+    std::vector<size_t> slots;
+    for (size_t i = 0; i <= drm_ && slots.size() < nentries; i++) {
+        if (dir_[i * ENTRY_SIZE] == DELETED) slots.push_back(i);
+    }
+    if (slots.size() < nentries) return Result::DIR_FULL;
+
+    // Highest free blocks first
+    std::vector<bool> used = used_blocks();
+    std::vector<uint32_t> blocks;
+    for (int b = dsm_; b >= 0 && blocks.size() < nblocks; b--) {
+        if (!used[b]) blocks.push_back(static_cast<uint32_t>(b));
+    }
+    if (blocks.size() < nblocks) return Result::DISK_FULL;
+
+    // Data first, directory last
+    uint8_t rec[128];
+    for (uint32_t r = 0; r < records; r++) {
+        size_t pos = static_cast<size_t>(r) * 128;
+        size_t n = std::min<size_t>(128, data.size() - pos);
+        std::memcpy(rec, &data[pos], n);
+        std::memset(rec + n, 0x1A, 128 - n);  // ^Z pads the last record
+        if (write_block_record(blocks[r / records_per_block()],
+                               r % records_per_block(), rec) != 0) {
+            return Result::IO_ERROR;
+        }
+    }
+
+    uint32_t blocks_per_entry = records_per_entry() / records_per_block();
+    for (uint32_t j = 0; j < nentries; j++) {
+        uint8_t* e = entry(slots[j]);
+        uint32_t in_entry = std::min(records_per_entry(), records - j * records_per_entry());
+        uint32_t last = in_entry ? (in_entry - 1) / 128 : 0;
+        uint32_t ext = j * (exm_ + 1) + last;
+
+        std::memset(e, 0, ENTRY_SIZE);
+        e[0] = user;
+        std::memcpy(e + 1, fcb, 11);
+        e[12] = ext & 0x1F;
+        e[14] = static_cast<uint8_t>(ext >> 5);
+        e[15] = static_cast<uint8_t>(in_entry - last * 128);
+
+        uint32_t used_here = (in_entry + records_per_block() - 1) / records_per_block();
+        for (uint32_t k = 0; k < used_here; k++) {
+            set_block(slots[j], static_cast<int>(k), blocks[j * blocks_per_entry + k]);
+        }
+        touched.push_back(slots[j]);
+    }
+
+    for (size_t index : touched) {
+        if (!store_dir_entry(index)) return Result::IO_ERROR;
+    }
+    return Result::OK;
+}
+
+CpmFs::Result CpmFs::remove(uint8_t user, const std::string& name) {
+    uint8_t fcb[11];
+    if (!make_name(name, fcb)) return Result::BAD_NAME;
+    if (disk_->is_read_only()) return Result::READ_ONLY;
+
+    std::lock_guard<std::mutex> lock(disk_->mutex());
+    if (disk_->guest_logged_in()) return Result::IN_USE;
+    if (!load_dir()) return Result::IO_ERROR;
+
+    std::vector<size_t> entries = file_entries(user, fcb);
+    if (entries.empty()) return Result::NOT_FOUND;
+    if (entry(entries.front())[9] & 0x80) return Result::READ_ONLY;
+
+    for (size_t index : entries) entry(index)[0] = DELETED;
+    for (size_t index : entries) {
+        if (!store_dir_entry(index)) return Result::IO_ERROR;
+    }
+    return Result::OK;
+}
+
+CpmFs::Result CpmFs::rename(uint8_t user, const std::string& from, const std::string& to) {
+    uint8_t old_fcb[11], new_fcb[11];
+    if (!make_name(from, old_fcb) || !make_name(to, new_fcb)) return Result::BAD_NAME;
+    if (disk_->is_read_only()) return Result::READ_ONLY;
+
+    std::lock_guard<std::mutex> lock(disk_->mutex());
+    if (disk_->guest_logged_in()) return Result::IN_USE;
+    if (!load_dir()) return Result::IO_ERROR;
+
+    std::vector<size_t> entries = file_entries(user, old_fcb);
+    if (entries.empty()) return Result::NOT_FOUND;
+    if (!file_entries(user, new_fcb).empty()) return Result::EXISTS;
+    if (entry(entries.front())[9] & 0x80) return Result::READ_ONLY;
+
+    // Keep the attribute bits
+    for (size_t index : entries) {
+        uint8_t* e = entry(index);
+        for (int k = 0; k < 11; k++) {
+            e[1 + k] = static_cast<uint8_t>(new_fcb[k] | (e[1 + k] & 0x80));
+        }
+    }
+    for (size_t index : entries) {
+        if (!store_dir_entry(index)) return Result::IO_ERROR;
+    }
+    return Result::OK;
+}
+
+uint32_t CpmFs::free_bytes() {
+    std::lock_guard<std::mutex> lock(disk_->mutex());
+    if (!load_dir()) return 0;
+
+    std::vector<bool> used = used_blocks();
+    uint32_t free_blocks = static_cast<uint32_t>(std::count(used.begin(), used.end(), false));
+    return free_blocks * records_per_block() * 128;
+}
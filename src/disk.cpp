@@ -3,10 +3,10 @@
 // SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "disk.h"
+#include "disk_journal.h"
 #include "banked_mem.h"
+#include "log.h"
 #include <cstring>
-#include <iostream>
-#include <iomanip>
 
 Disk::Disk()
     : read_only_(false)
@@ -45,10 +45,28 @@ bool Disk::open(const std::string& path, bool read_only) {
         }
     }
 
+    // Finish writes a crash left in the journal before anything reads
+    // the image. A read-only mount sees the last checkpoint instead.
+    if (file_.is_open() && !read_only_ && !DiskJournal::recover(path)) {
+        file_.close();
+    }
+
     return file_.is_open();
 }
 
+bool Disk::enable_journal() {
+    if (!file_.is_open() || read_only_) return false;
+    if (journal_) return true;
+
+    auto journal = std::make_unique<DiskJournal>(path_);
+    if (!journal->open()) return false;
+    journal_ = std::move(journal);
+    return true;
+}
+
 void Disk::close() {
+    // Checkpoint before the image goes away
+    journal_.reset();
     if (file_.is_open()) {
         file_.close();
     }
@@ -170,6 +188,8 @@ int Disk::read_sector(uint8_t* buffer) {
     if (!file_.is_open()) return 1;
 
     size_t offset = sector_offset();
+    if (journal_ && journal_->lookup(offset, buffer, sector_size_)) return 0;
+
     file_.seekg(offset, std::ios::beg);
 
     if (!file_.good()) {
@@ -193,6 +213,8 @@ int Disk::write_sector(const uint8_t* buffer) {
     if (read_only_) return 1;
 
     size_t offset = sector_offset();
+    if (journal_) return journal_->write(offset, buffer, sector_size_) ? 0 : 1;
+
     file_.seekp(offset, std::ios::beg);
     file_.write(reinterpret_cast<const char*>(buffer), sector_size_);
     file_.flush();
@@ -200,6 +222,69 @@ int Disk::write_sector(const uint8_t* buffer) {
     return file_.good() ? 0 : 1;
 }
 
+size_t Disk::record_offset(uint16_t track, uint16_t sector) const {
+    // Physical sectors hold sector_size_/128 records
+    uint16_t records_per_phys = sector_size_ / 128;
+    uint16_t translated = translate(sector);
+    size_t phys = static_cast<size_t>(track) * sectors_per_track_ +
+                  translated / records_per_phys;
+    return phys * sector_size_ + (translated % records_per_phys) * 128;
+}
+
+void Disk::read_image(size_t offset, uint8_t* buffer, size_t length) {
+    file_.clear();
+    file_.seekg(offset, std::ios::beg);
+    file_.read(reinterpret_cast<char*>(buffer), length);
+    size_t got = static_cast<size_t>(file_.gcount());
+    if (got < length) {
+        // Beyond end of file - empty
+        std::memset(buffer + got, 0xE5, length - got);
+    }
+    file_.clear();
+}
+
+int Disk::read_record(uint16_t track, uint16_t sector, uint8_t* buffer) {
+    if (!file_.is_open()) return 1;
+
+    size_t offset = record_offset(track, sector);
+    if (journal_) {
+        // The journal holds whole physical sectors
+        uint8_t phys[1024];
+        size_t base = offset - offset % sector_size_;
+        if (journal_->lookup(base, phys, sector_size_)) {
+            std::memcpy(buffer, phys + (offset - base), 128);
+            return 0;
+        }
+    }
+
+    read_image(offset, buffer, 128);
+    return 0;
+}
+
+int Disk::write_record(uint16_t track, uint16_t sector, const uint8_t* buffer) {
+    if (!file_.is_open()) return 1;
+    if (read_only_) return 1;
+
+    size_t offset = record_offset(track, sector);
+    if (journal_) {
+        // Merge the record into its physical sector and journal that
+        uint8_t phys[1024];
+        size_t base = offset - offset % sector_size_;
+        if (!journal_->lookup(base, phys, sector_size_)) {
+            read_image(base, phys, sector_size_);
+        }
+        std::memcpy(phys + (offset - base), buffer, 128);
+        return journal_->write(base, phys, sector_size_) ? 0 : 1;
+    }
+
+    file_.clear();
+    file_.seekp(offset, std::ios::beg);
+    file_.write(reinterpret_cast<const char*>(buffer), 128);
+    file_.flush();
+
+    return file_.good() ? 0 : 1;
+}
+
 // DiskSystem implementation
 
 DiskSystem& DiskSystem::instance() {
@@ -210,6 +295,7 @@ DiskSystem& DiskSystem::instance() {
 DiskSystem::DiskSystem()
     : current_drive_(0)
     , dma_addr_(0x0080)
+    , journal_(false)
 {
 }
 
@@ -221,6 +307,10 @@ bool DiskSystem::mount(int drive, const std::string& path, bool read_only) {
         disks_[drive].reset();
         return false;
     }
+    if (journal_ && !disks_[drive]->is_read_only() && !disks_[drive]->enable_journal()) {
+        disks_[drive].reset();
+        return false;
+    }
 
     // Auto-detect and set disk format
     DiskFormat format = disks_[drive]->detect_format();
@@ -261,6 +351,7 @@ void DiskSystem::set_sector(uint16_t sector) {
 int DiskSystem::read(BankedMemory* mem) {
     Disk* disk = get(current_drive_);
     if (!disk || !disk->is_open()) return 1;
+    std::lock_guard<std::mutex> lock(disk->mutex());
 
     // CP/M BIOS operates with 128-byte logical sectors
     // For hd1k: 64 logical sectors/track (128 bytes each) = 8KB/track
@@ -303,33 +394,21 @@ int DiskSystem::read(BankedMemory* mem) {
 
         // Trace key addresses
         if (trace_this || trace_dir) {
-            std::cerr << "[DISK READ] trk=" << std::dec << track
-                      << " logsec=" << logical_sector
-                      << " xlat=" << translated_sector
-                      << " physec=" << phys_sector
-                      << " off=" << offset_in_phys
-                      << " dma=0x" << std::hex << dma_addr_
-                      << " first bytes: ";
-            for (int i = 0; i < 8; i++) {
-                std::cerr << std::hex << std::setw(2) << std::setfill('0')
-                          << (int)buffer[offset_in_phys + i] << " ";
-            }
-            std::cerr << std::dec << std::endl;
+            LOG_DEBUG("DISK") << "read trk=" << track
+                              << " logsec=" << logical_sector
+                              << " xlat=" << translated_sector
+                              << " physec=" << phys_sector
+                              << " off=" << offset_in_phys
+                              << " dma=0x" << std::hex << dma_addr_
+                              << " first bytes: "
+                              << log_hex(8, [&](int i) { return buffer[offset_in_phys + i]; });
             // Verify the data was actually written
-            std::cerr << "[DISK READ] Verifying at 0x" << std::hex << dma_addr_ << " after store: ";
-            for (int i = 0; i < 8; i++) {
-                std::cerr << std::hex << std::setw(2) << std::setfill('0')
-                          << (int)mem->fetch_mem(dma_addr_ + i) << " ";
-            }
-            std::cerr << std::dec << std::endl;
+            LOG_DEBUG("DISK") << "read verify at 0x" << std::hex << dma_addr_ << " after store: "
+                              << log_hex(8, [&](int i) { return mem->fetch_mem(dma_addr_ + i); });
             // Also show MPM.SYS entry position (32 bytes in)
             if (trace_dir) {
-                std::cerr << "[DISK READ] MPM.SYS should be at offset 32: ";
-                for (int i = 0; i < 16; i++) {
-                    std::cerr << std::hex << std::setw(2) << std::setfill('0')
-                              << (int)buffer[offset_in_phys + 32 + i] << " ";
-                }
-                std::cerr << std::dec << std::endl;
+                LOG_DEBUG("DISK") << "MPM.SYS should be at offset 32: "
+                                  << log_hex(16, [&](int i) { return buffer[offset_in_phys + 32 + i]; });
             }
         }
     }
@@ -340,6 +419,7 @@ int DiskSystem::read(BankedMemory* mem) {
 int DiskSystem::write(BankedMemory* mem) {
     Disk* disk = get(current_drive_);
     if (!disk || !disk->is_open()) return 1;
+    std::lock_guard<std::mutex> lock(disk->mutex());
 
     // CP/M BIOS operates with 128-byte logical sectors
     // For writes, we need to read-modify-write the physical sector
@@ -391,14 +471,10 @@ static const uint8_t skew_phys_to_log[26] = {
     0, 13, 9, 22, 5, 18, 1, 14, 10, 23, 6, 19, 2, 15, 11, 24, 7, 20, 3, 16, 12, 25, 8, 21, 4, 17
 };
 
-uint16_t DiskSystem::translate(uint16_t logical_sector, uint16_t track) {
-    // Check disk format - skew only applies to ibm-3740 (SSSD_8)
-    Disk* disk = get(current_drive_);
-    if (!disk) return logical_sector;
-
+uint16_t Disk::translate(uint16_t logical_sector) const {
     // Only apply skew for ibm-3740 format
     // The MPMII_1.img disk image stores sectors in PHYSICAL order with skew
-    if (disk->format() == DiskFormat::SSSD_8) {
+    if (format_ == DiskFormat::SSSD_8) {
         // ibm-3740 uses skew factor 6
         // log_to_phys[L] = physical position where logical sector L is stored
         if (logical_sector < 26) {
@@ -406,7 +482,15 @@ uint16_t DiskSystem::translate(uint16_t logical_sector, uint16_t track) {
         }
     }
 
-    (void)track;
     (void)skew_phys_to_log;  // Kept for reference
     return logical_sector;
 }
+
+uint16_t DiskSystem::translate(uint16_t logical_sector, uint16_t track) {
+    // Check disk format - skew only applies to ibm-3740 (SSSD_8)
+    Disk* disk = get(current_drive_);
+    if (!disk) return logical_sector;
+
+    (void)track;
+    return disk->translate(logical_sector);
+}
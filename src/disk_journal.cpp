@@ -0,0 +1,379 @@
+// disk_journal.cpp - Write-ahead journal for disk images
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "disk_journal.h"
+#include "log.h"
+
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <algorithm>
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace {
+
+constexpr uint32_t RECORD_MAGIC = 0x314A504D;   // "MPJ1"
+constexpr uint32_t MAX_RECORD = 65536;
+
+// Journal record header, followed by length bytes of sector data
+struct RecordHeader {
+    uint32_t magic;
+    uint32_t length;
+    uint64_t offset;    // Image offset of the sector
+    uint64_t seq;       // Strictly increasing within a journal
+    uint32_t crc;       // CRC-32 of the header (crc = 0) and the data
+    uint32_t reserved;
+};
+static_assert(sizeof(RecordHeader) == 32, "journal record header layout");
+
+uint32_t crc32(uint32_t crc, const uint8_t* data, size_t length) {
+    static const std::array<uint32_t, 256> table = [] {
+        std::array<uint32_t, 256> t;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+uint32_t record_crc(RecordHeader header, const uint8_t* data) {
+    header.crc = 0;
+    uint32_t crc = crc32(0, reinterpret_cast<const uint8_t*>(&header), sizeof(header));
+    return crc32(crc, data, header.length);
+}
+
+bool pwrite_all(int fd, const uint8_t* data, size_t length, off_t offset) {
+    while (length > 0) {
+        ssize_t n = ::pwrite(fd, data, length, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        data += n;
+        length -= n;
+        offset += n;
+    }
+    return true;
+}
+
+} // namespace
+
+DiskJournal::DiskJournal(const std::string& image_path)
+    : image_path_(image_path)
+    , journal_path_(journal_path(image_path))
+    , old_path_(old_journal_path(image_path))
+    , image_fd_(-1)
+    , journal_fd_(-1)
+    , running_(false)
+    , failed_(false)
+    , next_seq_(1)
+    , appended_(0)
+    , durable_(0)
+    , journal_bytes_(0)
+{
+}
+
+DiskJournal::~DiskJournal() {
+    close();
+}
+
+std::string DiskJournal::journal_path(const std::string& image_path) {
+    return image_path + ".journal";
+}
+
+std::string DiskJournal::old_journal_path(const std::string& image_path) {
+    return image_path + ".journal.old";
+}
+
+// Make a create, rename or unlink next to path durable
+bool DiskJournal::sync_dir(const std::string& path) {
+    size_t slash = path.rfind('/');
+    std::string dir = slash == std::string::npos ? "." : slash == 0 ? "/" : path.substr(0, slash);
+    int fd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0 || ::fsync(fd) < 0) {
+        LOG_ERROR("DISK") << dir << ": sync failed: " << strerror(errno);
+        if (fd >= 0) ::close(fd);
+        return false;
+    }
+    ::close(fd);
+    return true;
+}
+
+bool DiskJournal::open() {
+    if (!recover(image_path_)) return false;
+
+    image_fd_ = ::open(image_path_.c_str(), O_RDWR | O_CLOEXEC);
+    if (image_fd_ < 0) {
+        LOG_ERROR("DISK") << image_path_ << ": " << strerror(errno);
+        return false;
+    }
+    journal_fd_ = ::open(journal_path_.c_str(),
+                         O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+    // Synced records are no use if the journal itself is not found
+    if (journal_fd_ < 0 || !sync_dir(journal_path_)) {
+        if (journal_fd_ < 0) {
+            LOG_ERROR("DISK") << journal_path_ << ": " << strerror(errno);
+        } else {
+            ::close(journal_fd_);
+        }
+        ::close(image_fd_);
+        journal_fd_ = -1;
+        image_fd_ = -1;
+        return false;
+    }
+
+    running_ = true;
+    thread_ = std::thread(&DiskJournal::commit_func, this);
+    return true;
+}
+
+void DiskJournal::close() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!running_) return;
+        running_ = false;
+    }
+    commit_cv_.notify_one();
+    if (thread_.joinable()) thread_.join();
+
+    // The commit thread is gone, so the checkpoint has the journal to itself
+    bool clean = !failed_ && checkpoint();
+    std::lock_guard<std::mutex> lock(mutex_);
+    ::close(journal_fd_);
+    ::close(image_fd_);
+    journal_fd_ = -1;
+    image_fd_ = -1;
+    // A journal that could not be applied stays for replay at next mount
+    if (clean) {
+        ::unlink(journal_path_.c_str());
+        sync_dir(journal_path_);
+    }
+}
+
+bool DiskJournal::write(size_t offset, const uint8_t* data, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!running_ || failed_) return false;
+
+    RecordHeader header = {};
+    header.magic = RECORD_MAGIC;
+    header.length = static_cast<uint32_t>(length);
+    header.offset = offset;
+    header.seq = next_seq_;
+    header.crc = record_crc(header, data);
+
+    struct iovec iov[2];
+    iov[0].iov_base = &header;
+    iov[0].iov_len = sizeof(header);
+    iov[1].iov_base = const_cast<uint8_t*>(data);
+    iov[1].iov_len = length;
+    ssize_t n;
+    do {
+        n = ::writev(journal_fd_, iov, 2);
+    } while (n < 0 && errno == EINTR);
+    if (n != static_cast<ssize_t>(sizeof(header) + length)) {
+        LOG_ERROR("DISK") << journal_path_ << ": append failed: "
+                          << (n < 0 ? strerror(errno) : "short write");
+        failed_ = true;
+        return false;
+    }
+
+    sectors_[offset].assign(data, data + length);
+    appended_ = next_seq_++;
+    journal_bytes_ += n;
+
+    commit_cv_.notify_one();
+    return true;
+}
+
+bool DiskJournal::lookup(size_t offset, uint8_t* data, size_t length) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = sectors_.find(offset);
+    if (it == sectors_.end()) {
+        // Maybe not in the image yet either
+        it = checkpointing_.find(offset);
+        if (it == checkpointing_.end()) return false;
+    }
+    std::memcpy(data, it->second.data(), std::min(length, it->second.size()));
+    return true;
+}
+
+void DiskJournal::commit_func() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (running_) {
+        commit_cv_.wait(lock, [this] { return !running_ || (appended_ > durable_ && !failed_); });
+        if (!running_) break;
+
+        // Let the batch fill before paying for the sync
+        commit_cv_.wait_for(lock, COMMIT_WINDOW, [this] { return !running_; });
+
+        // Appends go on while the journal syncs. Only this thread replaces
+        // journal_fd_ (at checkpoint), so it stays valid meanwhile.
+        uint64_t target = appended_;
+        int fd = journal_fd_;
+        lock.unlock();
+        int rc = ::fdatasync(fd);
+        lock.lock();
+        if (rc < 0) {
+            LOG_ERROR("DISK") << journal_path_ << ": sync failed: " << strerror(errno);
+            failed_ = true;
+            continue;
+        }
+        durable_ = target;
+
+        if (journal_bytes_ >= CHECKPOINT_BYTES) {
+            lock.unlock();
+            bool ok = checkpoint();
+            lock.lock();
+            if (!ok) failed_ = true;
+        }
+    }
+}
+
+// Called without mutex_, from the commit thread or from close()
+bool DiskJournal::checkpoint() {
+    int old_fd;
+    uint64_t last;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (sectors_.empty() && journal_bytes_ == 0) return true;
+
+        // Writes go on in a fresh journal while this one is applied
+        if (::rename(journal_path_.c_str(), old_path_.c_str()) < 0) {
+            LOG_ERROR("DISK") << journal_path_ << ": rename failed: " << strerror(errno);
+            return false;
+        }
+        int fd = ::open(journal_path_.c_str(),
+                        O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            LOG_ERROR("DISK") << journal_path_ << ": " << strerror(errno);
+            ::rename(old_path_.c_str(), journal_path_.c_str());
+            return false;
+        }
+        old_fd = journal_fd_;
+        journal_fd_ = fd;
+        checkpointing_.swap(sectors_);
+        last = appended_;
+        journal_bytes_ = 0;
+    }
+
+    // Everything copied to the image must be in the synced journal first,
+    // and both journals must be found under their names after a crash
+    if (::fdatasync(old_fd) < 0) {
+        LOG_ERROR("DISK") << old_path_ << ": sync failed: " << strerror(errno);
+        ::close(old_fd);
+        return false;
+    }
+    ::close(old_fd);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        durable_ = std::max(durable_, last);
+    }
+    if (!sync_dir(image_path_)) return false;
+
+    for (const auto& entry : checkpointing_) {
+        const std::vector<uint8_t>& data = entry.second;
+        if (!pwrite_all(image_fd_, data.data(), data.size(), entry.first)) {
+            LOG_ERROR("DISK") << image_path_ << ": checkpoint write failed: " << strerror(errno);
+            return false;
+        }
+    }
+    if (::fdatasync(image_fd_) < 0) {
+        LOG_ERROR("DISK") << image_path_ << ": sync failed: " << strerror(errno);
+        return false;
+    }
+
+    LOG_DEBUG("DISK") << image_path_ << ": checkpointed " << checkpointing_.size() << " sectors";
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        checkpointing_.clear();
+    }
+    ::unlink(old_path_.c_str());
+    sync_dir(old_path_);
+    return true;
+}
+
+bool DiskJournal::recover(const std::string& image_path) {
+    // An interrupted checkpoint leaves the older journal under .old
+    std::string old_path = old_journal_path(image_path);
+    std::string path = journal_path(image_path);
+    struct stat st;
+    bool have_old = ::stat(old_path.c_str(), &st) == 0;
+    bool have_new = ::stat(path.c_str(), &st) == 0;
+    if (!have_old && !have_new) return true;
+
+    int image_fd = ::open(image_path.c_str(), O_RDWR | O_CLOEXEC);
+    if (image_fd < 0) {
+        LOG_ERROR("DISK") << "Cannot replay journal of " << image_path << ": " << strerror(errno);
+        return false;
+    }
+    bool ok = (!have_old || replay_file(image_fd, old_path)) &&
+              (!have_new || replay_file(image_fd, path));
+    ::close(image_fd);
+
+    if (ok) {
+        if (have_old) ::unlink(old_path.c_str());
+        if (have_new) ::unlink(path.c_str());
+        sync_dir(path);
+    }
+    return ok;
+}
+
+bool DiskJournal::replay_file(int image_fd, const std::string& path) {
+    int journal_fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (journal_fd < 0) {
+        LOG_ERROR("DISK") << "Cannot replay " << path << ": " << strerror(errno);
+        return false;
+    }
+    bool ok = replay(image_fd, journal_fd, path);
+    ::close(journal_fd);
+    return ok;
+}
+
+bool DiskJournal::replay(int image_fd, int journal_fd, const std::string& path) {
+    std::vector<uint8_t> data;
+    off_t pos = 0;
+    uint64_t last_seq = 0;
+    size_t applied = 0;
+
+    for (;;) {
+        RecordHeader header;
+        if (::pread(journal_fd, &header, sizeof(header), pos) != sizeof(header)) break;
+        if (header.magic != RECORD_MAGIC || header.length == 0 ||
+            header.length > MAX_RECORD || header.seq <= last_seq) {
+            break;
+        }
+        data.resize(header.length);
+        if (::pread(journal_fd, data.data(), header.length, pos + sizeof(header)) !=
+            static_cast<ssize_t>(header.length)) {
+            break;
+        }
+        // A torn tail ends the valid run
+        if (record_crc(header, data.data()) != header.crc) break;
+
+        if (!pwrite_all(image_fd, data.data(), data.size(), header.offset)) {
+            LOG_ERROR("DISK") << "Replay of " << path << " failed: " << strerror(errno);
+            return false;
+        }
+        last_seq = header.seq;
+        pos += sizeof(header) + header.length;
+        applied++;
+    }
+
+    if (::fdatasync(image_fd) < 0) {
+        LOG_ERROR("DISK") << "Replay of " << path << " failed: " << strerror(errno);
+        return false;
+    }
+    if (applied > 0) {
+        LOG_INFO("DISK") << "Replayed " << applied << " sector writes from " << path;
+    }
+    return true;
+}
@@ -0,0 +1,972 @@
+// fast_core.cpp - Z80 interpreter with lazily evaluated condition flags
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "fast_core.h"
+#include "mpm_cpu.h"
+#include "log.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+namespace {
+constexpr uint8_t FLAG_C = 0x01;
+constexpr uint8_t FLAG_N = 0x02;
+constexpr uint8_t FLAG_P = 0x04;    // Parity / overflow
+constexpr uint8_t FLAG_X = 0x08;
+constexpr uint8_t FLAG_H = 0x10;
+constexpr uint8_t FLAG_Y = 0x20;
+constexpr uint8_t FLAG_Z = 0x40;
+constexpr uint8_t FLAG_S = 0x80;
+constexpr uint8_t FLAGS_SZP = FLAG_S | FLAG_Z | FLAG_P;
+
+// S, Z, Y, X and parity of each byte value
+struct FlagTables {
+    uint8_t szyx[256];
+    uint8_t szyxp[256];
+    constexpr FlagTables() : szyx(), szyxp() {
+        for (int v = 0; v < 256; v++) {
+            int bits = 0;
+            for (int b = 0; b < 8; b++) bits += (v >> b) & 1;
+            szyx[v] = static_cast<uint8_t>((v & (FLAG_S | FLAG_Y | FLAG_X)) | (v == 0 ? FLAG_Z : 0));
+            szyxp[v] = static_cast<uint8_t>(szyx[v] | ((bits & 1) ? 0 : FLAG_P));
+        }
+    }
+};
+constexpr FlagTables tables;
+
+// T-states of the unprefixed opcodes, conditional ones not taken
+constexpr uint8_t cycles[256] = {
+     4, 10,  7,  6,  4,  4,  7,  4,  4, 11,  7,  6,  4,  4,  7,  4,
+     8, 10,  7,  6,  4,  4,  7,  4, 12, 11,  7,  6,  4,  4,  7,  4,
+     7, 10, 16,  6,  4,  4,  7,  4,  7, 11, 16,  6,  4,  4,  7,  4,
+     7, 10, 13,  6, 11, 11, 10,  4,  7, 11, 13,  6,  4,  4,  7,  4,
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+     7,  7,  7,  7,  7,  7,  4,  7,  4,  4,  4,  4,  4,  4,  7,  4,
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+     4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,
+     5, 10, 10, 10, 10, 11,  7, 11,  5, 10, 10,  0, 10, 17,  7, 11,
+     5, 10, 10, 11, 10, 11,  7, 11,  5,  4, 10, 11, 10,  0,  7, 11,
+     5, 10, 10, 19, 10, 11,  7, 11,  5,  4, 10,  4, 10,  0,  7, 11,
+     5, 10, 10,  4, 10, 11,  7, 11,  5,  6, 10,  4, 10,  0,  7, 11,
+};
+}
+
+FastCore::FastCore(MpmCpu* cpu, qkz80_cpu_mem* mem)
+    : cpu_(cpu)
+    , mem_(mem)
+{
+    // Fused families, from --profile-pairs over a boot, an interactive
+    // session (DIR, STAT, SDIR, TYPE, PIP, ASM, ERA) and the bench.img
+    // programs, with --tickless so the idle loop stays out. Percent of
+    // executed pairs, boot / interactive / batch:
+    //   05 C2  DEC B; JP NZ             2.37 /  -   / 1.57
+    //   FE CA  CP n; JP Z               0.41 / 0.39 / 2.98  (and CA FE chains)
+    //   B7 CA  OR A; JP Z               0.48 /  -   / 1.05
+    //   0D C8  DEC C; RET Z             0.49 /  -   / 0.48
+    //   1A 77, 77 13, 13 23             (BDOS move)  0.60 / 0.74 int/batch
+    //   2A EB, EB 2A  LD HL,(nn)/EX DE,HL  0.87 / - / 1.15, 0.76 / - / 0.83
+    //   7B 95 5F 7A 9C 57  DE := DE-HL  0.56 / 0.83 / 0.49
+    //   7D 93 6F 7C 9A 67  HL := HL-DE   -   / 0.80 /  -
+    //   85 6F 3E 8C 67  HL := HL+A      0.79 / 1.00 / 0.42
+    //   7E 23, 5E 23 56, 73 23 72       0.68 / 0.79 / 0.57 and ~0.4 each
+    //   CD C3, C3 3E, 3E 18  XIOS call  0.98 / 0.80 / 0.50
+    //   D1 C1  POP runs                 0.38 /  -   /  -
+    // The nucleus is 8080 code: DEC BC; LD A,B; OR C; JR NZ and PUSH
+    // runs never made the top 64, so they are not fused.
+    for (int op = 0; op < 256; op++) {
+        Fuse kind = FUSE_NONE;
+        int y = (op >> 3) & 7;
+        int z = op & 7;
+        if (((op & 0xC7) == 0x05 && op != 0x35) || op == 0xFE || op == 0xB7) {
+            kind = FUSE_BRANCH;                 // DEC r / CP n / OR A
+        } else if (op == 0x1A) {
+            kind = FUSE_MOVE;
+        } else if (op == 0x2A || op == 0xEB) {
+            kind = FUSE_XCHG;
+        } else if (op == 0x7B || op == 0x7D || op == 0x85) {
+            kind = FUSE_ARITH16;
+        } else if ((op & 0xC7) == 0x46 && y != 6 && y != 4 && y != 5) {
+            kind = FUSE_HL_STEP;                // LD r,(HL), r not H/L
+        } else if ((op & 0xF8) == 0x70 && op != 0x76 && z != 4 && z != 5) {
+            kind = FUSE_HL_STEP;                // LD (HL),r, r not H/L
+        } else if ((op & 0xCF) == 0xC1) {
+            kind = FUSE_POP;
+        } else if (op == 0xCD) {
+            kind = FUSE_CALL;
+        }
+        fuse_kind_[op] = kind;
+    }
+}
+
+void FastCore::enable_pair_profile() {
+    pair_counts_.reset(new uint64_t[65536]());
+    super_ = false;
+}
+
+void FastCore::enable_lockstep() {
+    lockstep_ = true;
+    super_ = false;
+}
+
+bool FastCore::write_pair_profile(const std::string& path, size_t top) const {
+    if (!pair_counts_) return false;
+
+    uint64_t total = 0;
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < 65536; i++) {
+        total += pair_counts_[i];
+        if (pair_counts_[i]) order.push_back(i);
+    }
+    top = std::min(top, order.size());
+    std::partial_sort(order.begin(), order.begin() + top, order.end(),
+                      [this](uint32_t a, uint32_t b) { return pair_counts_[a] > pair_counts_[b]; });
+
+    FILE* f = fopen(path.c_str(), "w");
+    if (!f) {
+        LOG_ERROR("CPU") << "Cannot write " << path;
+        return false;
+    }
+    fprintf(f, "# opcode pairs, %llu instructions\n# first second count percent\n",
+            static_cast<unsigned long long>(total));
+    for (size_t i = 0; i < top; i++) {
+        uint32_t pair = order[i];
+        fprintf(f, "%02X %02X %llu %.2f\n", pair >> 8, pair & 0xFF,
+                static_cast<unsigned long long>(pair_counts_[pair]),
+                total ? 100.0 * pair_counts_[pair] / total : 0.0);
+    }
+    fclose(f);
+    return true;
+}
+
+// Flags
+
+void FastCore::materialise() {
+    uint8_t r = static_cast<uint8_t>(res_);
+    uint8_t f = 0;
+
+    switch (op_) {
+        case FlagOp::NONE:
+            return;
+        case FlagOp::ADD:
+            f = tables.szyx[r] | ((a_ ^ b_ ^ res_) & FLAG_H) |
+                (((a_ ^ res_) & (b_ ^ res_) & 0x80) ? FLAG_P : 0) | ((res_ >> 8) & FLAG_C);
+            break;
+        case FlagOp::SUB:
+            f = tables.szyx[r] | ((a_ ^ b_ ^ res_) & FLAG_H) |
+                (((a_ ^ b_) & (a_ ^ res_) & 0x80) ? FLAG_P : 0) | ((res_ >> 8) & FLAG_C) | FLAG_N;
+            break;
+        case FlagOp::CP:
+            f = (tables.szyx[r] & (FLAG_S | FLAG_Z)) | (b_ & (FLAG_Y | FLAG_X)) |
+                ((a_ ^ b_ ^ res_) & FLAG_H) | (((a_ ^ b_) & (a_ ^ res_) & 0x80) ? FLAG_P : 0) |
+                ((res_ >> 8) & FLAG_C) | FLAG_N;
+            break;
+        case FlagOp::AND:
+            f = tables.szyxp[r] | FLAG_H;
+            break;
+        case FlagOp::OR:
+            f = tables.szyxp[r];
+            break;
+        case FlagOp::INC:
+            f = tables.szyx[r] | ((r & 0x0F) == 0 ? FLAG_H : 0) | (r == 0x80 ? FLAG_P : 0) |
+                (carry_ ? FLAG_C : 0);
+            break;
+        case FlagOp::DEC:
+            f = tables.szyx[r] | ((a_ & 0x0F) == 0 ? FLAG_H : 0) | (a_ == 0x80 ? FLAG_P : 0) |
+                (carry_ ? FLAG_C : 0) | FLAG_N;
+            break;
+    }
+
+    cpu_->regs.AF.set_low(f);
+    op_ = FlagOp::NONE;
+}
+
+bool FastCore::flag_z() const {
+    if (op_ == FlagOp::NONE) return cpu_->regs.AF.get_low() & FLAG_Z;
+    return (res_ & 0xFF) == 0;
+}
+
+bool FastCore::flag_c() const {
+    switch (op_) {
+        case FlagOp::NONE: return cpu_->regs.AF.get_low() & FLAG_C;
+        case FlagOp::ADD:
+        case FlagOp::SUB:
+        case FlagOp::CP:   return res_ & 0x100;
+        case FlagOp::INC:
+        case FlagOp::DEC:  return carry_;
+        default:           return false;
+    }
+}
+
+bool FastCore::flag_s() const {
+    if (op_ == FlagOp::NONE) return cpu_->regs.AF.get_low() & FLAG_S;
+    return res_ & 0x80;
+}
+
+bool FastCore::condition(int cc) {
+    switch (cc) {
+        case 0: return !flag_z();   // NZ
+        case 1: return flag_z();    // Z
+        case 2: return !flag_c();   // NC
+        case 3: return flag_c();    // C
+        case 4:                     // PO
+        case 5:                     // PE
+            materialise();
+            return ((cpu_->regs.AF.get_low() & FLAG_P) != 0) == (cc == 5);
+        case 6: return !flag_s();   // P
+        default: return flag_s();   // M
+    }
+}
+
+// Memory and registers
+
+uint8_t FastCore::fetch8() {
+    uint16_t pc = cpu_->regs.PC.get_pair16();
+    cpu_->regs.PC.set_pair16(pc + 1);
+    return mem_->fetch_mem(pc, true);
+}
+
+uint16_t FastCore::fetch16() {
+    uint8_t lo = fetch8();
+    return lo | (fetch8() << 8);
+}
+
+uint8_t FastCore::read8(uint16_t addr) {
+    return mem_->fetch_mem(addr);
+}
+
+void FastCore::write8(uint16_t addr, uint8_t value) {
+    if (recording_) undo_.emplace_back(addr, mem_->fetch_mem(addr));
+    mem_->store_mem(addr, value);
+}
+
+uint16_t FastCore::read16(uint16_t addr) {
+    return mem_->fetch_mem(addr) | (mem_->fetch_mem(static_cast<uint16_t>(addr + 1)) << 8);
+}
+
+void FastCore::write16(uint16_t addr, uint16_t value) {
+    write8(addr, value & 0xFF);
+    write8(static_cast<uint16_t>(addr + 1), value >> 8);
+}
+
+void FastCore::push(uint16_t value) {
+    uint16_t sp = cpu_->regs.SP.get_pair16() - 2;
+    cpu_->regs.SP.set_pair16(sp);
+    write16(sp, value);
+}
+
+uint16_t FastCore::pop() {
+    uint16_t sp = cpu_->regs.SP.get_pair16();
+    cpu_->regs.SP.set_pair16(sp + 2);
+    return read16(sp);
+}
+
+// r: B C D E H L (HL) A
+uint8_t FastCore::get_r(int r) {
+    qkz80_regs& regs = cpu_->regs;
+    switch (r) {
+        case 0: return regs.BC.get_high();
+        case 1: return regs.BC.get_low();
+        case 2: return regs.DE.get_high();
+        case 3: return regs.DE.get_low();
+        case 4: return regs.HL.get_high();
+        case 5: return regs.HL.get_low();
+        case 6: return read8(regs.HL.get_pair16());
+        default: return regs.AF.get_high();
+    }
+}
+
+void FastCore::set_r(int r, uint8_t value) {
+    qkz80_regs& regs = cpu_->regs;
+    switch (r) {
+        case 0: regs.BC.set_high(value); break;
+        case 1: regs.BC.set_low(value); break;
+        case 2: regs.DE.set_high(value); break;
+        case 3: regs.DE.set_low(value); break;
+        case 4: regs.HL.set_high(value); break;
+        case 5: regs.HL.set_low(value); break;
+        case 6: write8(regs.HL.get_pair16(), value); break;
+        default: regs.AF.set_high(value); break;
+    }
+}
+
+// rp: BC DE HL SP
+uint16_t FastCore::get_rp(int rp) {
+    qkz80_regs& regs = cpu_->regs;
+    switch (rp) {
+        case 0: return regs.BC.get_pair16();
+        case 1: return regs.DE.get_pair16();
+        case 2: return regs.HL.get_pair16();
+        default: return regs.SP.get_pair16();
+    }
+}
+
+void FastCore::set_rp(int rp, uint16_t value) {
+    qkz80_regs& regs = cpu_->regs;
+    switch (rp) {
+        case 0: regs.BC.set_pair16(value); break;
+        case 1: regs.DE.set_pair16(value); break;
+        case 2: regs.HL.set_pair16(value); break;
+        default: regs.SP.set_pair16(value); break;
+    }
+}
+
+// ALU
+
+// op: ADD ADC SUB SBC AND XOR OR CP
+void FastCore::alu(int op, uint8_t value) {
+    uint8_t a = cpu_->regs.AF.get_high();
+    unsigned carry = 0;
+    if (op == 1 || op == 3) carry = flag_c() ? 1 : 0;
+
+    switch (op) {
+        case 0:
+        case 1:
+            op_ = FlagOp::ADD;
+            res_ = static_cast<uint16_t>(a + value + carry);
+            break;
+        case 2:
+        case 3:
+        case 7:
+            op_ = op == 7 ? FlagOp::CP : FlagOp::SUB;
+            res_ = static_cast<uint16_t>(a - value - carry) & 0x1FF;
+            break;
+        case 4:
+            op_ = FlagOp::AND;
+            res_ = a & value;
+            break;
+        case 5:
+            op_ = FlagOp::OR;
+            res_ = a ^ value;
+            break;
+        default:
+            op_ = FlagOp::OR;
+            res_ = a | value;
+            break;
+    }
+    a_ = a;
+    b_ = value;
+    if (op != 7) cpu_->regs.AF.set_high(static_cast<uint8_t>(res_));
+}
+
+uint8_t FastCore::inc8(uint8_t value) {
+    carry_ = flag_c();
+    op_ = FlagOp::INC;
+    a_ = value;
+    res_ = static_cast<uint8_t>(value + 1);
+    return static_cast<uint8_t>(res_);
+}
+
+uint8_t FastCore::dec8(uint8_t value) {
+    carry_ = flag_c();
+    op_ = FlagOp::DEC;
+    a_ = value;
+    res_ = static_cast<uint8_t>(value - 1);
+    return static_cast<uint8_t>(res_);
+}
+
+void FastCore::fallback() {
+    materialise();
+    fallbacks_++;
+    cpu_->execute();
+}
+
+// Execution
+
+unsigned FastCore::step() {
+    if (lockstep_) return step_lockstep();
+
+    qkz80_regs& regs = cpu_->regs;
+    uint16_t pc = regs.PC.get_pair16();
+    uint8_t opcode = mem_->fetch_mem(pc, true);
+
+    if (pair_counts_) {
+        pair_counts_[(prev_op_ << 8) | opcode]++;
+        prev_op_ = opcode;
+    }
+
+    switch (opcode) {
+        case 0x08: case 0x76: case 0xCB: case 0xD9:
+        case 0xDD: case 0xED: case 0xFD:
+            fallback();
+            return 1;
+        default:
+            break;
+    }
+
+    regs.PC.set_pair16(pc + 1);
+    unsigned t = cycles[opcode];
+    int y = (opcode >> 3) & 7;
+    int z = opcode & 7;
+
+    switch (opcode >> 6) {
+        case 1:
+            // LD r,r'
+            set_r(y, get_r(z));
+            break;
+
+        case 2:
+            // ALU A,r
+            alu(y, get_r(z));
+            break;
+
+        case 0:
+            switch (z) {
+                case 0:
+                    if (opcode == 0x10) {
+                        // DJNZ e
+                        int8_t e = static_cast<int8_t>(fetch8());
+                        uint8_t b = regs.BC.get_high() - 1;
+                        regs.BC.set_high(b);
+                        if (b != 0) {
+                            regs.PC.set_pair16(regs.PC.get_pair16() + e);
+                            t += 5;
+                        }
+                    } else if (opcode == 0x18) {
+                        // JR e
+                        int8_t e = static_cast<int8_t>(fetch8());
+                        regs.PC.set_pair16(regs.PC.get_pair16() + e);
+                    } else if (opcode >= 0x20) {
+                        // JR cc,e
+                        int8_t e = static_cast<int8_t>(fetch8());
+                        if (condition(y - 4)) {
+                            regs.PC.set_pair16(regs.PC.get_pair16() + e);
+                            t += 5;
+                        }
+                    }
+                    break;
+
+                case 1:
+                    if (opcode & 0x08) {
+                        // ADD HL,rr
+                        materialise();
+                        uint16_t hl = regs.HL.get_pair16();
+                        uint16_t rr = get_rp(y >> 1);
+                        uint32_t r = hl + rr;
+                        uint8_t f = regs.AF.get_low() & FLAGS_SZP;
+                        f |= ((r >> 8) & (FLAG_Y | FLAG_X)) | (((hl ^ rr ^ r) >> 8) & FLAG_H) |
+                             ((r >> 16) & FLAG_C);
+                        regs.AF.set_low(f);
+                        regs.HL.set_pair16(static_cast<uint16_t>(r));
+                    } else {
+                        // LD rr,nn
+                        set_rp(y >> 1, fetch16());
+                    }
+                    break;
+
+                case 2:
+                    switch (y) {
+                        case 0: write8(regs.BC.get_pair16(), regs.AF.get_high()); break;
+                        case 1: regs.AF.set_high(read8(regs.BC.get_pair16())); break;
+                        case 2: write8(regs.DE.get_pair16(), regs.AF.get_high()); break;
+                        case 3: regs.AF.set_high(read8(regs.DE.get_pair16())); break;
+                        case 4: write16(fetch16(), regs.HL.get_pair16()); break;
+                        case 5: regs.HL.set_pair16(read16(fetch16())); break;
+                        case 6: write8(fetch16(), regs.AF.get_high()); break;
+                        default: regs.AF.set_high(read8(fetch16())); break;
+                    }
+                    break;
+
+                case 3:
+                    // INC rr / DEC rr
+                    set_rp(y >> 1, get_rp(y >> 1) + ((y & 1) ? -1 : 1));
+                    break;
+
+                case 4:
+                    set_r(y, inc8(get_r(y)));
+                    break;
+
+                case 5:
+                    set_r(y, dec8(get_r(y)));
+                    break;
+
+                case 6:
+                    set_r(y, fetch8());
+                    break;
+
+                default: {
+                    // Accumulator rotates and flag operations
+                    materialise();
+                    uint8_t a = regs.AF.get_high();
+                    uint8_t f = regs.AF.get_low();
+                    switch (y) {
+                        case 0:     // RLCA
+                            a = static_cast<uint8_t>((a << 1) | (a >> 7));
+                            f = (f & FLAGS_SZP) | (a & FLAG_C);
+                            break;
+                        case 1:     // RRCA
+                            f = (f & FLAGS_SZP) | (a & FLAG_C);
+                            a = static_cast<uint8_t>((a >> 1) | (a << 7));
+                            break;
+                        case 2: {   // RLA
+                            uint8_t c = a >> 7;
+                            a = static_cast<uint8_t>((a << 1) | (f & FLAG_C));
+                            f = (f & FLAGS_SZP) | c;
+                            break;
+                        }
+                        case 3: {   // RRA
+                            uint8_t c = a & 1;
+                            a = static_cast<uint8_t>((a >> 1) | ((f & FLAG_C) << 7));
+                            f = (f & FLAGS_SZP) | c;
+                            break;
+                        }
+                        case 4: {   // DAA
+                            uint8_t diff = 0;
+                            uint8_t c = 0;
+                            if ((f & FLAG_H) || (a & 0x0F) > 9) diff |= 0x06;
+                            if ((f & FLAG_C) || a > 0x99) {
+                                diff |= 0x60;
+                                c = FLAG_C;
+                            }
+                            uint8_t h;
+                            if (f & FLAG_N) {
+                                h = ((f & FLAG_H) && (a & 0x0F) < 6) ? FLAG_H : 0;
+                                a = static_cast<uint8_t>(a - diff);
+                            } else {
+                                h = (a & 0x0F) > 9 ? FLAG_H : 0;
+                                a = static_cast<uint8_t>(a + diff);
+                            }
+                            f = tables.szyxp[a] | (f & FLAG_N) | c | h;
+                            break;
+                        }
+                        case 5:     // CPL
+                            a = static_cast<uint8_t>(~a);
+                            f = (f & (FLAGS_SZP | FLAG_C)) | FLAG_H | FLAG_N;
+                            break;
+                        case 6:     // SCF
+                            f = (f & FLAGS_SZP) | FLAG_C;
+                            break;
+                        default:    // CCF
+                            f = (f & FLAGS_SZP) | ((f & FLAG_C) ? FLAG_H : FLAG_C);
+                            break;
+                    }
+                    if (y != 4) f = (f & ~(FLAG_Y | FLAG_X)) | (a & (FLAG_Y | FLAG_X));
+                    regs.AF.set_high(a);
+                    regs.AF.set_low(f);
+                    break;
+                }
+            }
+            break;
+
+        default:
+            switch (z) {
+                case 0:
+                    // RET cc
+                    if (condition(y)) {
+                        regs.PC.set_pair16(pop());
+                        t += 6;
+                    }
+                    break;
+
+                case 1:
+                    switch (y) {
+                        case 1: regs.PC.set_pair16(pop()); break;                   // RET
+                        case 5: regs.PC.set_pair16(regs.HL.get_pair16()); break;    // JP (HL)
+                        case 7: regs.SP.set_pair16(regs.HL.get_pair16()); break;    // LD SP,HL
+                        case 6:
+                            // POP AF replaces any pending flags
+                            op_ = FlagOp::NONE;
+                            regs.AF.set_pair16(pop());
+                            break;
+                        default: set_rp(y >> 1, pop()); break;                     // POP rr
+                    }
+                    break;
+
+                case 2: {
+                    // JP cc,nn
+                    uint16_t nn = fetch16();
+                    if (condition(y)) regs.PC.set_pair16(nn);
+                    break;
+                }
+
+                case 3:
+                    switch (y) {
+                        case 0:     // JP nn
+                            regs.PC.set_pair16(fetch16());
+                            break;
+                        case 2: {   // OUT (n),A
+                            uint8_t port = fetch8();
+                            materialise();
+                            cpu_->port_out(port, regs.AF.get_high());
+                            break;
+                        }
+                        case 3: {   // IN A,(n)
+                            uint8_t port = fetch8();
+                            materialise();
+                            regs.AF.set_high(cpu_->port_in(port));
+                            break;
+                        }
+                        case 4: {   // EX (SP),HL
+                            uint16_t sp = regs.SP.get_pair16();
+                            uint16_t hl = regs.HL.get_pair16();
+                            regs.HL.set_pair16(read16(sp));
+                            write16(sp, hl);
+                            break;
+                        }
+                        case 5: {   // EX DE,HL
+                            uint16_t de = regs.DE.get_pair16();
+                            regs.DE.set_pair16(regs.HL.get_pair16());
+                            regs.HL.set_pair16(de);
+                            break;
+                        }
+                        case 6:     // DI
+                            regs.IFF1 = regs.IFF2 = 0;
+                            break;
+                        case 7:     // EI
+                            regs.IFF1 = regs.IFF2 = 1;
+                            break;
+                        default:    // CB prefix, handled above
+                            break;
+                    }
+                    break;
+
+                case 4: {
+                    // CALL cc,nn
+                    uint16_t nn = fetch16();
+                    if (condition(y)) {
+                        push(regs.PC.get_pair16());
+                        regs.PC.set_pair16(nn);
+                        t += 7;
+                    }
+                    break;
+                }
+
+                case 5:
+                    if (y == 1) {
+                        // CALL nn
+                        uint16_t nn = fetch16();
+                        push(regs.PC.get_pair16());
+                        regs.PC.set_pair16(nn);
+                    } else if (y == 6) {
+                        // PUSH AF
+                        materialise();
+                        push(regs.AF.get_pair16());
+                    } else if (!(y & 1)) {
+                        push(get_rp(y >> 1));
+                    }
+                    break;
+
+                case 6:
+                    // ALU A,n
+                    alu(y, fetch8());
+                    break;
+
+                default:
+                    // RST
+                    push(regs.PC.get_pair16());
+                    regs.PC.set_pair16(y * 8);
+                    break;
+            }
+            break;
+    }
+
+    unsigned count = 1;
+    if (super_ && fuse_kind_[opcode] != FUSE_NONE) count += fuse(opcode, t);
+
+    cpu_->cycles += t;
+    return count;
+}
+
+// Lockstep
+
+namespace {
+void log_regs(const char* core, qkz80_regs& r) {
+    char line[96];
+    snprintf(line, sizeof(line), "AF=%04X BC=%04X DE=%04X HL=%04X SP=%04X PC=%04X IFF=%d%d",
+             r.AF.get_pair16(), r.BC.get_pair16(), r.DE.get_pair16(), r.HL.get_pair16(),
+             r.SP.get_pair16(), r.PC.get_pair16(), r.IFF1 ? 1 : 0, r.IFF2 ? 1 : 0);
+    LOG_ERROR("CPU") << "  " << core << ": " << line;
+}
+
+bool same_regs(qkz80_regs& a, qkz80_regs& b) {
+    return a.AF.get_pair16() == b.AF.get_pair16() && a.BC.get_pair16() == b.BC.get_pair16() &&
+           a.DE.get_pair16() == b.DE.get_pair16() && a.HL.get_pair16() == b.HL.get_pair16() &&
+           a.SP.get_pair16() == b.SP.get_pair16() && a.PC.get_pair16() == b.PC.get_pair16() &&
+           !a.IFF1 == !b.IFF1 && !a.IFF2 == !b.IFF2;
+}
+}
+
+unsigned FastCore::step_lockstep() {
+    constexpr uint64_t MAX_REPORTS = 16;
+    qkz80_regs& regs = cpu_->regs;
+    uint16_t pc = regs.PC.get_pair16();
+    uint8_t opcode = mem_->fetch_mem(pc, true);
+
+    switch (opcode) {
+        // Already qkz80's, or port I/O, which cannot be run twice
+        case 0x08: case 0x76: case 0xCB: case 0xD9:
+        case 0xDD: case 0xED: case 0xFD:
+        case 0xD3: case 0xDB:
+            fallback();
+            return 1;
+        default:
+            break;
+    }
+
+    qkz80_regs before = regs;
+    const unsigned long long cycles = cpu_->cycles;
+
+    undo_.clear();
+    lockstep_ = false;
+    recording_ = true;
+    unsigned count = step();
+    recording_ = false;
+    lockstep_ = true;
+    materialise();
+    qkz80_regs fast = regs;
+
+    // What this core stored, then the memory as it was, newest write last
+    std::vector<std::pair<uint16_t, uint8_t>> stored;
+    stored.reserve(undo_.size());
+    for (const auto& w : undo_) stored.emplace_back(w.first, mem_->fetch_mem(w.first));
+    for (auto it = undo_.rbegin(); it != undo_.rend(); ++it) mem_->store_mem(it->first, it->second);
+
+    regs = before;
+    cpu_->cycles = cycles;
+    for (unsigned i = 0; i < count; i++) cpu_->execute();
+
+    bool same = same_regs(fast, regs);
+    for (const auto& w : stored) {
+        if (mem_->fetch_mem(w.first) != w.second) same = false;
+    }
+    if (same) return count;
+
+    if (++mismatches_ <= MAX_REPORTS) {
+        char line[64];
+        snprintf(line, sizeof(line), "Lockstep mismatch at %04X, opcode %02X", pc, opcode);
+        LOG_ERROR("CPU") << line;
+        log_regs("before", before);
+        log_regs("fast  ", fast);
+        log_regs("qkz80 ", regs);
+        for (const auto& w : stored) {
+            uint8_t ref = mem_->fetch_mem(w.first);
+            if (ref == w.second) continue;
+            snprintf(line, sizeof(line), "  (%04X): fast %02X, qkz80 %02X", w.first, w.second, ref);
+            LOG_ERROR("CPU") << line;
+        }
+    }
+    return count;
+}
+
+// Superinstructions. Each returns how many instructions it added after
+// the one step() already ran, and adds their T-states to t.
+
+bool FastCore::next_op(uint8_t& op) {
+    uint16_t pc = cpu_->regs.PC.get_pair16();
+    if (pc == stop_pc_) return false;
+    op = mem_->fetch_mem(pc, true);
+    return true;
+}
+
+// The n one-byte opcodes at PC + offset are ops, none at the stop address
+bool FastCore::next_ops(const uint8_t* ops, unsigned n, unsigned offset) {
+    uint16_t pc = static_cast<uint16_t>(cpu_->regs.PC.get_pair16() + offset);
+    for (unsigned i = 0; i < n; i++, pc++) {
+        if (pc == stop_pc_ || mem_->fetch_mem(pc, true) != ops[i]) return false;
+    }
+    return true;
+}
+
+unsigned FastCore::fuse(uint8_t first, unsigned& t) {
+    qkz80_regs& regs = cpu_->regs;
+    uint8_t op;
+    if (!next_op(op)) return 0;
+
+    switch (fuse_kind_[first]) {
+        case FUSE_BRANCH: {
+            if (first != 0xFE) return fuse_branch(t);
+            // CP 'x'; JP Z,a; CP 'y'; JP Z,b ... character dispatch
+            unsigned n = 0;
+            for (int i = 0; i < 4; i++) {
+                uint16_t pc = regs.PC.get_pair16();
+                unsigned taken = fuse_branch(t);
+                n += taken;
+                if (!taken || regs.PC.get_pair16() != pc + 3 || !next_op(op) || op != 0xFE) break;
+                regs.PC.set_pair16(regs.PC.get_pair16() + 1);
+                alu(7, fetch8());
+                t += 7;
+                n++;
+            }
+            return n;
+        }
+
+        case FUSE_MOVE: {
+            // LD A,(DE); LD (HL),A; INC DE; INC HL - the BDOS's move loop
+            static const uint8_t move[] = {0x77, 0x13, 0x23};
+            if (!next_ops(move, 3)) return 0;
+            uint16_t hl = regs.HL.get_pair16();
+            write8(hl, regs.AF.get_high());
+            regs.DE.set_pair16(regs.DE.get_pair16() + 1);
+            regs.HL.set_pair16(hl + 1);
+            regs.PC.set_pair16(regs.PC.get_pair16() + 3);
+            t += 7 + 6 + 6;
+            return 3;
+        }
+
+        case FUSE_XCHG: {
+            if (first == 0x2A) {
+                // LD HL,(nn); EX DE,HL
+                if (op != 0xEB) return 0;
+                uint16_t de = regs.DE.get_pair16();
+                regs.DE.set_pair16(regs.HL.get_pair16());
+                regs.HL.set_pair16(de);
+                regs.PC.set_pair16(regs.PC.get_pair16() + 1);
+                t += 4;
+                return 1;
+            }
+            // EX DE,HL; LD HL,(nn)
+            if (op != 0x2A) return 0;
+            regs.PC.set_pair16(regs.PC.get_pair16() + 1);
+            regs.HL.set_pair16(read16(fetch16()));
+            t += 16;
+            return 1;
+        }
+
+        case FUSE_ARITH16: {
+            // PL/M's word arithmetic: the ALU ops run in order, so the
+            // flags are those of the final ADC/SBC
+            static const uint8_t sub_de[] = {0x95, 0x5F, 0x7A, 0x9C, 0x57};   // DE := DE - HL
+            static const uint8_t sub_hl[] = {0x93, 0x6F, 0x7C, 0x9A, 0x67};   // HL := HL - DE
+            static const uint8_t add_hi[] = {0x8C, 0x67};                     // ..ADC A,H; LD H,A
+            if (first == 0x7B || first == 0x7D) {
+                bool de = first == 0x7B;
+                if (!next_ops(de ? sub_de : sub_hl, 5)) return 0;
+                alu(2, de ? regs.HL.get_low() : regs.DE.get_low());
+                uint8_t lo = regs.AF.get_high();
+                regs.AF.set_high(de ? regs.DE.get_high() : regs.HL.get_high());
+                alu(3, de ? regs.HL.get_high() : regs.DE.get_high());
+                if (de) {
+                    regs.DE.set_pair16(static_cast<uint16_t>((regs.AF.get_high() << 8) | lo));
+                } else {
+                    regs.HL.set_pair16(static_cast<uint16_t>((regs.AF.get_high() << 8) | lo));
+                }
+                regs.PC.set_pair16(regs.PC.get_pair16() + 5);
+                t += 5 * 4;
+                return 5;
+            }
+            // ADD A,L; LD L,A; LD A,n; ADC A,H; LD H,A
+            static const uint8_t add_lo[] = {0x6F, 0x3E};
+            if (!next_ops(add_lo, 2) || !next_ops(add_hi, 2, 3)) return 0;
+            regs.HL.set_low(regs.AF.get_high());
+            uint16_t pc = regs.PC.get_pair16();
+            regs.AF.set_high(mem_->fetch_mem(static_cast<uint16_t>(pc + 2), true));
+            alu(1, regs.HL.get_high());
+            regs.HL.set_high(regs.AF.get_high());
+            regs.PC.set_pair16(static_cast<uint16_t>(pc + 5));
+            t += 4 + 7 + 4 + 4;
+            return 4;
+        }
+
+        case FUSE_HL_STEP: {
+            // LD E,(HL); INC HL; LD D,(HL) - a word through HL - and the
+            // matching stores
+            if (op != 0x23) return 0;
+            uint16_t hl = regs.HL.get_pair16() + 1;
+            regs.HL.set_pair16(hl);
+            regs.PC.set_pair16(regs.PC.get_pair16() + 1);
+            t += 6;
+
+            uint8_t pair_op = 0;
+            switch (first) {
+                case 0x4E: pair_op = 0x46; break;   // LD C,(HL) .. LD B,(HL)
+                case 0x5E: pair_op = 0x56; break;   // LD E,(HL) .. LD D,(HL)
+                case 0x71: pair_op = 0x70; break;   // LD (HL),C .. LD (HL),B
+                case 0x73: pair_op = 0x72; break;   // LD (HL),E .. LD (HL),D
+                default: return 1;
+            }
+            if (!next_op(op) || op != pair_op) return 1;
+            int y = (op >> 3) & 7;
+            if (first & 0x20) {
+                write8(hl, get_r(op & 7));
+            } else {
+                set_r(y, read8(hl));
+            }
+            regs.PC.set_pair16(regs.PC.get_pair16() + 1);
+            t += 7;
+            return 2;
+        }
+
+        case FUSE_POP: {
+            unsigned n = 0;
+            while (n < 3 && (op & 0xCF) == 0xC1) {
+                int rp = (op >> 4) & 3;
+                if (rp == 3) {
+                    op_ = FlagOp::NONE;
+                    regs.AF.set_pair16(pop());
+                } else {
+                    set_rp(rp, pop());
+                }
+                regs.PC.set_pair16(regs.PC.get_pair16() + 1);
+                t += 10;
+                n++;
+                if (!next_op(op)) break;
+            }
+            return n;
+        }
+
+        case FUSE_CALL: {
+            // XIOS stub: JP DO_func in the jump table, then LD A,func;
+            // JR DISPATCH (stops at the OUT)
+            uint16_t pc = regs.PC.get_pair16();
+            unsigned n = 0;
+            if (op == 0xC3) {
+                pc = read16(static_cast<uint16_t>(pc + 1));
+                if (pc == stop_pc_) {
+                    regs.PC.set_pair16(pc);
+                    t += 10;
+                    return 1;
+                }
+                op = mem_->fetch_mem(pc, true);
+                n = 1;
+            }
+            if (op != 0x3E || mem_->fetch_mem(static_cast<uint16_t>(pc + 2), true) != 0x18) {
+                if (n) {
+                    regs.PC.set_pair16(pc);
+                    t += 10;
+                }
+                return n;
+            }
+            regs.AF.set_high(mem_->fetch_mem(static_cast<uint16_t>(pc + 1), true));
+            int8_t e = static_cast<int8_t>(mem_->fetch_mem(static_cast<uint16_t>(pc + 3), true));
+            regs.PC.set_pair16(static_cast<uint16_t>(pc + 4 + e));
+            t += (n ? 10 : 0) + 7 + 12;
+            return n + 2;
+        }
+
+        default:
+            return 0;
+    }
+}
+
+// DEC r, CP n or OR A was just run: the JP cc or RET cc that tests it
+unsigned FastCore::fuse_branch(unsigned& t) {
+    qkz80_regs& regs = cpu_->regs;
+    uint8_t op;
+    if (!next_op(op)) return 0;
+    uint16_t pc = regs.PC.get_pair16();
+    int cc = (op >> 3) & 7;
+
+    if ((op & 0xC7) == 0xC2) {
+        // JP cc,nn
+        uint16_t nn = read16(static_cast<uint16_t>(pc + 1));
+        regs.PC.set_pair16(condition(cc) ? nn : static_cast<uint16_t>(pc + 3));
+        t += 10;
+        return 1;
+    }
+    if ((op & 0xC7) == 0xC0) {
+        // RET cc
+        regs.PC.set_pair16(static_cast<uint16_t>(pc + 1));
+        t += 5;
+        if (condition(cc)) {
+            regs.PC.set_pair16(pop());
+            t += 6;
+        }
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,456 @@
+// frontend.cpp - SSH front-end process and shared-memory console link
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "frontend.h"
+#include "log.h"
+
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <chrono>
+#include <new>
+
+static void ring_bell(int fd) {
+    uint64_t one = 1;
+    ssize_t n = write(fd, &one, sizeof(one));
+    (void)n;
+}
+
+// Wait up to 10ms for the bell, then clear it
+static void wait_bell(int fd) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll(&pfd, 1, 10) > 0) {
+        uint64_t value;
+        ssize_t n = read(fd, &value, sizeof(value));
+        (void)n;
+    }
+}
+
+// FrontendHost implementation
+
+FrontendHost::FrontendHost()
+    : shm_fd_(-1)
+    , core_bell_(-1)
+    , frontend_bell_(-1)
+    , shm_(nullptr)
+    , pid_(0)
+    , running_(false)
+    , stop_requested_(false)
+{
+    for (auto& seq : applied_seq_) seq = 0;
+}
+
+FrontendHost::~FrontendHost() {
+    stop();
+}
+
+bool FrontendHost::start(const std::string& exe, const std::vector<std::string>& args) {
+    if (running_.load()) return true;
+    exe_ = exe;
+    args_ = args;
+
+    // Descriptors are inherited by the front end, so no CLOEXEC
+    shm_fd_ = memfd_create("mpm2-consoles", 0);
+    if (shm_fd_ < 0 || ftruncate(shm_fd_, sizeof(ConsoleShm)) < 0) {
+        LOG_ERROR("FRONTEND") << "Cannot create console segment: " << strerror(errno);
+        return false;
+    }
+    void* mem = mmap(nullptr, sizeof(ConsoleShm), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, shm_fd_, 0);
+    if (mem == MAP_FAILED) {
+        LOG_ERROR("FRONTEND") << "Cannot map console segment: " << strerror(errno);
+        return false;
+    }
+    shm_ = new (mem) ConsoleShm();
+    shm_->magic = CONSOLE_SHM_MAGIC;
+    shm_->version = CONSOLE_SHM_VERSION;
+    shm_->consoles = MAX_CONSOLES;
+
+    core_bell_ = eventfd(0, EFD_NONBLOCK);
+    frontend_bell_ = eventfd(0, EFD_NONBLOCK);
+    if (core_bell_ < 0 || frontend_bell_ < 0) {
+        LOG_ERROR("FRONTEND") << "Cannot create eventfd: " << strerror(errno);
+        return false;
+    }
+
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        ConsoleManager::instance().get(i)->set_doorbell(core_bell_);
+    }
+
+    stop_requested_.store(false);
+    running_.store(true);
+    bridge_ = std::thread(&FrontendHost::bridge_func, this);
+    supervisor_ = std::thread(&FrontendHost::supervisor_func, this);
+    return true;
+}
+
+void FrontendHost::stop() {
+    if (!running_.load()) return;
+    stop_requested_.store(true);
+
+    pid_t pid = pid_.load();
+    if (pid > 0) kill(pid, SIGTERM);
+
+    if (supervisor_.joinable()) supervisor_.join();
+    if (bridge_.joinable()) bridge_.join();
+
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        ConsoleManager::instance().get(i)->set_doorbell(-1);
+    }
+
+    if (shm_) munmap(shm_, sizeof(ConsoleShm));
+    shm_ = nullptr;
+    if (shm_fd_ >= 0) close(shm_fd_);
+    if (core_bell_ >= 0) close(core_bell_);
+    if (frontend_bell_ >= 0) close(frontend_bell_);
+    shm_fd_ = core_bell_ = frontend_bell_ = -1;
+
+    running_.store(false);
+}
+
+pid_t FrontendHost::spawn() {
+    // Build argv before fork - nothing but exec in the child
+    std::string fds = std::to_string(shm_fd_) + ":" + std::to_string(core_bell_) +
+                      ":" + std::to_string(frontend_bell_);
+    std::vector<std::string> strings;
+    strings.push_back(exe_);
+    strings.insert(strings.end(), args_.begin(), args_.end());
+    strings.push_back("--frontend-fd");
+    strings.push_back(fds);
+
+    std::vector<char*> argv;
+    for (auto& s : strings) argv.push_back(&s[0]);
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        // Own process group (terminal ^C goes to the emulator only), and
+        // never outlive the emulator
+        setpgid(0, 0);
+        prctl(PR_SET_PDEATHSIG, SIGTERM);
+        execv(exe_.c_str(), argv.data());
+        _exit(127);
+    }
+    return pid;
+}
+
+void FrontendHost::supervisor_func() {
+    while (!stop_requested_.load()) {
+        pid_t pid = spawn();
+        if (pid < 0) {
+            LOG_ERROR("FRONTEND") << "fork failed: " << strerror(errno);
+        } else {
+            pid_.store(pid);
+            shm_->frontend_pid.store(pid);
+            LOG_INFO("FRONTEND") << "SSH front end started, pid " << pid;
+
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {}
+            pid_.store(0);
+            shm_->frontend_pid.store(0);
+            if (stop_requested_.load()) break;
+
+            if (WIFSIGNALED(status)) {
+                LOG_WARN("FRONTEND") << "Front end killed by signal " << WTERMSIG(status)
+                                     << ", restarting";
+            } else {
+                LOG_WARN("FRONTEND") << "Front end exited with status " << WEXITSTATUS(status)
+                                     << ", restarting";
+            }
+
+            // Its connections are gone. As on a disconnect, key logins keep
+            // their consoles if persistence is on; the rest are reset. The
+            // front end is dead, so we are the only writer.
+            bool persist = ConsoleManager::instance().detach_timeout() > 0;
+            for (int i = 0; i < MAX_CONSOLES; i++) {
+                ConsoleShmSlot& slot = shm_->slots[i];
+                if (slot.state.load() != SHM_CONSOLE_ATTACHED) continue;
+                uint32_t seq = slot.state_seq.load();
+                slot.state_seq.store(seq + 1);
+                if (persist && slot.key[0] != '\0') {
+                    slot.state.store(SHM_CONSOLE_DETACHED);
+                } else {
+                    std::memset(slot.owner, 0, sizeof(slot.owner));
+                    std::memset(slot.key, 0, sizeof(slot.key));
+                    slot.state.store(SHM_CONSOLE_FREE);
+                }
+                slot.state_seq.store(seq + 2, std::memory_order_release);
+            }
+            ring_bell(core_bell_);
+        }
+
+        // Back off before restarting
+        auto resume = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+        while (!stop_requested_.load() && std::chrono::steady_clock::now() < resume) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+    }
+}
+
+void FrontendHost::apply_state(int id, Console* con, ConsoleShmSlot& slot) {
+    uint32_t seq = slot.state_seq.load(std::memory_order_acquire);
+    if (seq & 1) return;  // Being written - pick it up next pass
+
+    uint32_t state = slot.state.load(std::memory_order_relaxed);
+    char owner[sizeof(slot.owner)];
+    std::memcpy(owner, slot.owner, sizeof(owner));
+    owner[sizeof(owner) - 1] = '\0';
+    char key[sizeof(slot.key)];
+    std::memcpy(key, slot.key, sizeof(key));
+    key[sizeof(key) - 1] = '\0';
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.state_seq.load(std::memory_order_relaxed) != seq) return;
+    applied_seq_[id] = seq;
+
+    switch (state) {
+        case SHM_CONSOLE_ATTACHED:
+            if (con->is_detached()) {
+                // Output kept while away goes to the front end first
+                std::vector<uint8_t> kept;
+                con->take_scrollback(kept);
+                replay_[id].insert(replay_[id].end(), kept.begin(), kept.end());
+                con->attach(owner, key);
+            } else if (!ConsoleManager::instance().try_claim(id, owner, key)) {
+                // Already attached: nothing but the front end hands out
+                // consoles here (-L is refused with -F), so follow its owner
+                con->attach(owner, key);
+            }
+            break;
+
+        case SHM_CONSOLE_DETACHED:
+            // First seen by this process
+            ConsoleManager::instance().try_claim(id, owner, key);
+            if (!con->is_detached()) con->detach();
+            break;
+
+        default:
+            if (con->is_connected() || con->is_detached()) con->reset();
+            replay_[id].clear();
+            slot.to_core.discard();
+            break;
+    }
+}
+
+void FrontendHost::bridge_func() {
+    uint8_t buf[512];
+
+    while (!stop_requested_.load()) {
+        wait_bell(core_bell_);
+        bool rang = false;
+
+        for (int i = 0; i < MAX_CONSOLES; i++) {
+            Console* con = ConsoleManager::instance().get(i);
+            ConsoleShmSlot& slot = shm_->slots[i];
+
+            // Re-arm first so output queued while we drain rings again
+            con->arm_doorbell();
+
+            if (slot.state_seq.load(std::memory_order_acquire) != applied_seq_[i]) {
+                apply_state(i, con, slot);
+            }
+
+            // Keyboard: ring -> input queue
+            size_t room, n;
+            while ((room = con->input_queue().space()) > 0 &&
+                   (n = slot.to_core.read(buf, std::min(room, sizeof(buf)))) > 0) {
+                con->push_input(buf, n);
+                rang = true;  // Front end may have been waiting for ring space
+            }
+
+            // Display: scrollback replay, then the output queue -> ring
+            std::vector<uint8_t>& replay = replay_[i];
+            if (!replay.empty()) {
+                n = slot.to_frontend.write(replay.data(), replay.size());
+                replay.erase(replay.begin(), replay.begin() + n);
+                if (n > 0) rang = true;
+            }
+            if (replay.empty()) {
+                while ((room = slot.to_frontend.space()) > 0 &&
+                       (n = con->output_queue().read_some(buf, std::min(room, sizeof(buf)))) > 0) {
+                    slot.to_frontend.write(buf, n);
+                    rang = true;
+                }
+            }
+        }
+
+        if (rang) ring_bell(frontend_bell_);
+    }
+}
+
+// FrontendClient implementation
+
+FrontendClient::FrontendClient()
+    : shm_fd_(-1)
+    , core_bell_(-1)
+    , frontend_bell_(-1)
+    , shm_(nullptr)
+    , stop_requested_(false)
+{
+    for (auto& state : last_state_) state = SHM_CONSOLE_FREE;
+}
+
+FrontendClient::~FrontendClient() {
+    stop();
+    if (shm_) munmap(shm_, sizeof(ConsoleShm));
+    if (shm_fd_ >= 0) close(shm_fd_);
+}
+
+bool FrontendClient::open(const std::string& fds) {
+    if (sscanf(fds.c_str(), "%d:%d:%d", &shm_fd_, &core_bell_, &frontend_bell_) != 3) {
+        LOG_ERROR("FRONTEND") << "Invalid descriptor list: " << fds;
+        return false;
+    }
+
+    void* mem = mmap(nullptr, sizeof(ConsoleShm), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, shm_fd_, 0);
+    if (mem == MAP_FAILED) {
+        LOG_ERROR("FRONTEND") << "Cannot map console segment: " << strerror(errno);
+        return false;
+    }
+    shm_ = static_cast<ConsoleShm*>(mem);
+
+    if (shm_->magic != CONSOLE_SHM_MAGIC || shm_->version != CONSOLE_SHM_VERSION ||
+        shm_->consoles != static_cast<uint32_t>(MAX_CONSOLES)) {
+        LOG_ERROR("FRONTEND") << "Console segment layout mismatch";
+        return false;
+    }
+    return true;
+}
+
+void FrontendClient::start() {
+    // Pick up consoles left detached by a previous front end
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        Console* con = ConsoleManager::instance().get(i);
+        ConsoleShmSlot& slot = shm_->slots[i];
+        con->set_doorbell(frontend_bell_);
+
+        uint32_t state = slot.state.load(std::memory_order_acquire);
+        if (state == SHM_CONSOLE_FREE) continue;
+
+        char owner[sizeof(slot.owner)];
+        std::memcpy(owner, slot.owner, sizeof(owner));
+        owner[sizeof(owner) - 1] = '\0';
+        char key[sizeof(slot.key)];
+        std::memcpy(key, slot.key, sizeof(key));
+        key[sizeof(key) - 1] = '\0';
+        if (key[0] == '\0' || ConsoleManager::instance().detach_timeout() <= 0) {
+            // Nothing can reattach to it: reset, as a disconnect would
+            con->reset();
+            publish_state(i, SHM_CONSOLE_FREE, "", "");
+            LOG_INFO("FRONTEND") << "Console " << i << " of user " << owner << " reset";
+            continue;
+        }
+        con->attach(owner, key);
+        con->detach();
+        last_state_[i] = SHM_CONSOLE_DETACHED;
+        last_owner_[i] = owner;
+        last_key_[i] = key;
+        if (state != SHM_CONSOLE_DETACHED) {
+            publish_state(i, SHM_CONSOLE_DETACHED, owner, key);
+        }
+        LOG_INFO("FRONTEND") << "Console " << i << " held for user " << owner;
+    }
+
+    stop_requested_.store(false);
+    bridge_ = std::thread(&FrontendClient::bridge_func, this);
+}
+
+void FrontendClient::stop() {
+    stop_requested_.store(true);
+    if (bridge_.joinable()) {
+        bridge_.join();
+
+        // Final pass so the emulator sees sessions detached at shutdown
+        bool rang = false;
+        sync(rang);
+        ring_bell(core_bell_);
+    }
+}
+
+void FrontendClient::publish_state(int id, uint32_t state, const std::string& owner,
+                                   const std::string& key) {
+    ConsoleShmSlot& slot = shm_->slots[id];
+    uint32_t seq = slot.state_seq.load(std::memory_order_relaxed);
+    slot.state_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    std::memset(slot.owner, 0, sizeof(slot.owner));
+    std::strncpy(slot.owner, owner.c_str(), sizeof(slot.owner) - 1);
+    std::memset(slot.key, 0, sizeof(slot.key));
+    std::strncpy(slot.key, key.c_str(), sizeof(slot.key) - 1);
+    slot.state.store(state, std::memory_order_relaxed);
+
+    slot.state_seq.store(seq + 2, std::memory_order_release);
+    last_state_[id] = state;
+    last_owner_[id] = owner;
+    last_key_[id] = key;
+}
+
+bool FrontendClient::sync(bool& rang_core) {
+    uint8_t buf[512];
+    bool moved = false;
+
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        Console* con = ConsoleManager::instance().get(i);
+        ConsoleShmSlot& slot = shm_->slots[i];
+
+        con->arm_doorbell();
+
+        uint32_t state = con->is_connected() ? SHM_CONSOLE_ATTACHED
+                       : con->is_detached()  ? SHM_CONSOLE_DETACHED
+                                             : SHM_CONSOLE_FREE;
+        std::string owner = con->owner();
+        std::string key = con->key();
+        if (state != last_state_[i] || owner != last_owner_[i] || key != last_key_[i]) {
+            publish_state(i, state, owner, key);
+            rang_core = true;
+        }
+
+        // Keyboard: input queue -> ring
+        size_t room, n;
+        while ((room = slot.to_core.space()) > 0 &&
+               (n = con->input_queue().read_some(buf, std::min(room, sizeof(buf)))) > 0) {
+            slot.to_core.write(buf, n);
+            rang_core = true;
+            moved = true;
+        }
+
+        // Display: ring -> output queue (dropped for free consoles, but
+        // still watched for the prompt so find_free knows when it is idle)
+        if (state == SHM_CONSOLE_FREE) {
+            while ((n = slot.to_frontend.read(buf, sizeof(buf))) > 0) {
+                for (size_t k = 0; k < n; k++) con->track_output(buf[k]);
+            }
+            continue;
+        }
+        while ((room = con->output_queue().space()) > 0 &&
+               (n = slot.to_frontend.read(buf, std::min(room, sizeof(buf)))) > 0) {
+            for (size_t k = 0; k < n; k++) con->track_output(buf[k]);
+            con->output_queue().write_some(buf, n);
+            rang_core = true;  // Emulator may have been waiting for ring space
+            moved = true;
+        }
+    }
+    return moved;
+}
+
+void FrontendClient::bridge_func() {
+    while (!stop_requested_.load()) {
+        wait_bell(frontend_bell_);
+        bool rang = false;
+        sync(rang);
+        if (rang) ring_bell(core_bell_);
+    }
+}
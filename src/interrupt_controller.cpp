@@ -0,0 +1,99 @@
+// interrupt_controller.cpp - Pending interrupt lines and the clock timer
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "interrupt_controller.h"
+#include "futex.h"
+#include "log.h"
+
+#include <sys/timerfd.h>
+#include <cerrno>
+#include <cstring>
+#include <unistd.h>
+
+InterruptController& InterruptController::instance() {
+    static InterruptController instance;
+    return instance;
+}
+
+InterruptController::InterruptController()
+    : pending_(0)
+    , waiting_(0)
+    , timer_fd_(-1)
+    , timer_running_(false)
+    , ticks_(0)
+    , borrowed_(false)
+    , guest_mask_(0)
+    , in_service_(0)
+{
+}
+
+InterruptController::~InterruptController() {
+    stop_timer();
+}
+
+void InterruptController::raise(IrqLine line) {
+    uint32_t was = pending_.fetch_or(irq_bit(line), std::memory_order_acq_rel);
+    if (was == 0 && waiting_.load()) futex_wake(&pending_);
+}
+
+void InterruptController::wait(int timeout_ms) {
+    waiting_.store(1);
+    if (pending_.load() == 0) futex_wait(&pending_, 0, timeout_ms);
+    waiting_.store(0);
+}
+
+bool InterruptController::start_timer(std::chrono::microseconds interval) {
+    if (timer_running_.load()) return true;
+
+    timer_fd_ = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    if (timer_fd_ < 0) {
+        LOG_ERROR("IRQ") << "timerfd_create: " << strerror(errno);
+        return false;
+    }
+
+    struct itimerspec its;
+    its.it_interval.tv_sec = interval.count() / 1000000;
+    its.it_interval.tv_nsec = (interval.count() % 1000000) * 1000;
+    its.it_value = its.it_interval;
+    if (timerfd_settime(timer_fd_, 0, &its, nullptr) < 0) {
+        LOG_ERROR("IRQ") << "timerfd_settime: " << strerror(errno);
+        ::close(timer_fd_);
+        timer_fd_ = -1;
+        return false;
+    }
+
+    ticks_.store(0);
+    borrowed_.store(false);
+    timer_running_.store(true);
+    timer_ = std::thread(&InterruptController::timer_func, this);
+    return true;
+}
+
+void InterruptController::stop_timer() {
+    if (!timer_running_.load()) return;
+    // The thread sees this at its next expiration
+    timer_running_.store(false);
+    if (timer_.joinable()) timer_.join();
+    ::close(timer_fd_);
+    timer_fd_ = -1;
+}
+
+void InterruptController::timer_func() {
+    while (timer_running_.load()) {
+        uint64_t expirations;
+        ssize_t n = ::read(timer_fd_, &expirations, sizeof(expirations));
+        if (n != sizeof(expirations)) {
+            if (n < 0 && errno == EINTR) continue;
+            LOG_ERROR("IRQ") << "timerfd read: " << strerror(errno);
+            break;
+        }
+
+        // A borrowed tick was already delivered ahead of this slot
+        if (borrowed_.exchange(false)) expirations--;
+        if (expirations == 0) continue;
+
+        ticks_.fetch_add(static_cast<unsigned>(expirations));
+        raise(IRQ_TICK);
+    }
+}
@@ -0,0 +1,153 @@
+// line_editor.cpp - Host-side line discipline for BDOS Read Console Buffer
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "line_editor.h"
+#include "console.h"
+
+namespace {
+constexpr uint8_t CTL_C = 0x03;
+constexpr uint8_t CTL_D = 0x04;
+constexpr uint8_t CTL_E = 0x05;
+constexpr uint8_t CTL_H = 0x08;
+constexpr uint8_t TAB   = 0x09;
+constexpr uint8_t LF    = 0x0A;
+constexpr uint8_t CR    = 0x0D;
+constexpr uint8_t CTL_P = 0x10;
+constexpr uint8_t CTL_Q = 0x11;
+constexpr uint8_t CTL_R = 0x12;
+constexpr uint8_t CTL_S = 0x13;
+constexpr uint8_t CTL_U = 0x15;
+constexpr uint8_t CTL_X = 0x18;
+constexpr uint8_t DEL   = 0x7F;
+
+// Column after echoing ch at col (see LineEditor::echo)
+int advance(int col, uint8_t ch) {
+    if (ch == TAB) return (col | 7) + 1;
+    return col + (ch < 0x20 ? 2 : 1);
+}
+}
+
+void LineEditor::begin(uint16_t buf, uint8_t max, int start_col) {
+    active_ = true;
+    buf_ = buf;
+    max_ = max;
+    start_col_ = start_col;
+    line_.clear();
+}
+
+void LineEditor::reset() {
+    active_ = false;
+    line_.clear();
+}
+
+LineEditor::Status LineEditor::feed(Console& con) {
+    for (;;) {
+        int c = con.read_char();
+        if (c < 0) return Status::WAITING;
+        uint8_t ch = static_cast<uint8_t>(c) & 0x7F;
+
+        switch (ch) {
+            case CR:
+            case LF:
+                con.write_char(CR);
+                return Status::DONE;
+
+            case CTL_C:
+            case CTL_D:
+            case CTL_P: {
+                backup_to(con, start_col_);
+                std::string back = line_;
+                back += static_cast<char>(ch);
+                con.unread(reinterpret_cast<const uint8_t*>(back.data()), back.size());
+                reset();
+                return Status::HANDOFF;
+            }
+
+            case CTL_S:
+            case CTL_Q:
+                break;
+
+            case CTL_H:
+                if (!line_.empty()) {
+                    line_.pop_back();
+                    backup_to(con, end_column());
+                }
+                break;
+
+            case DEL:
+                // CP/M rubout: drop the character and echo it again
+                if (!line_.empty()) {
+                    uint8_t last = static_cast<uint8_t>(line_.back());
+                    line_.pop_back();
+                    echo(con, last);
+                }
+                break;
+
+            case CTL_E:
+                con.write_char(CR);
+                con.write_char(LF);
+                start_col_ = 0;
+                break;
+
+            case CTL_X:
+                backup_to(con, start_col_);
+                line_.clear();
+                break;
+
+            case CTL_U:
+                restart(con);
+                line_.clear();
+                break;
+
+            case CTL_R:
+                restart(con);
+                for (char l : line_) echo(con, static_cast<uint8_t>(l));
+                break;
+
+            default:
+                line_ += static_cast<char>(ch);
+                echo(con, ch);
+                if (line_.size() >= max_) {
+                    con.write_char(CR);
+                    return Status::DONE;
+                }
+                break;
+        }
+    }
+}
+
+void LineEditor::echo(Console& con, uint8_t ch) {
+    if (ch == TAB) {
+        do {
+            con.write_char(' ');
+        } while (con.column() & 7);
+    } else if (ch < 0x20) {
+        con.write_char('^');
+        con.write_char(ch | 0x40);
+    } else {
+        con.write_char(ch);
+    }
+}
+
+void LineEditor::backup_to(Console& con, int col) {
+    while (con.column() > col) {
+        con.write_char(CTL_H);
+        con.write_char(' ');
+        con.write_char(CTL_H);
+    }
+}
+
+void LineEditor::restart(Console& con) {
+    // '#', new line, then back out to where the line started
+    con.write_char('#');
+    con.write_char(CR);
+    con.write_char(LF);
+    while (con.column() < start_col_) con.write_char(' ');
+}
+
+int LineEditor::end_column() const {
+    int col = start_col_;
+    for (char l : line_) col = advance(col, static_cast<uint8_t>(l));
+    return col;
+}
@@ -0,0 +1,193 @@
+// local_console.cpp - Emulator side of the local shared-memory consoles
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "local_console.h"
+#include "futex.h"
+#include "log.h"
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <chrono>
+#include <new>
+
+static const char* LOCAL_USER = "local";
+
+LocalConsoleHost::LocalConsoleHost()
+    : shm_(nullptr)
+    , running_(false)
+    , stop_requested_(false)
+{
+    for (auto& g : granted_) g = false;
+}
+
+LocalConsoleHost::~LocalConsoleHost() {
+    stop();
+}
+
+bool LocalConsoleHost::start(const std::string& name) {
+    if (running_.load()) return true;
+    name_ = name;
+
+    // A segment left by a crashed emulator has stale claims - start fresh
+    shm_unlink(name_.c_str());
+    int fd = shm_open(name_.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 || ftruncate(fd, sizeof(LocalConsoleShm)) < 0) {
+        LOG_ERROR("LOCAL") << "Cannot create " << name_ << ": " << strerror(errno);
+        if (fd >= 0) close(fd);
+        return false;
+    }
+    void* mem = mmap(nullptr, sizeof(LocalConsoleShm), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        LOG_ERROR("LOCAL") << "Cannot map " << name_ << ": " << strerror(errno);
+        shm_unlink(name_.c_str());
+        return false;
+    }
+
+    shm_ = new (mem) LocalConsoleShm();
+    shm_->consoles = MAX_CONSOLES;
+    shm_->version = LOCAL_CONSOLE_VERSION;
+    shm_->emulator_pid.store(getpid());
+    // Magic last: clients treat the segment as ready once they see it
+    std::atomic_thread_fence(std::memory_order_release);
+    shm_->magic = LOCAL_CONSOLE_MAGIC;
+
+    stop_requested_.store(false);
+    running_.store(true);
+    bridge_ = std::thread(&LocalConsoleHost::bridge_func, this);
+    return true;
+}
+
+void LocalConsoleHost::stop() {
+    if (!running_.load()) return;
+    stop_requested_.store(true);
+    futex_wake(&shm_->host_bell);
+    if (bridge_.joinable()) bridge_.join();
+
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        if (granted_[i]) release(i, shm_->slots[i]);
+    }
+
+    // Clients still mapped see the emulator gone via emulator_pid
+    shm_->emulator_pid.store(0);
+    munmap(shm_, sizeof(LocalConsoleShm));
+    shm_ = nullptr;
+    shm_unlink(name_.c_str());
+    running_.store(false);
+}
+
+void LocalConsoleHost::grant(int id, LocalConsoleSlot& slot) {
+    Console* con = ConsoleManager::instance().get(id);
+    // Only once the last user's program is gone, as for SSH logins
+    if (!ConsoleManager::instance().try_claim(id, LOCAL_USER, std::string(), true)) {
+        slot.state.store(LOCAL_SLOT_BUSY);
+        futex_ring(&slot.client_bell, &slot.client_waiting);
+        return;
+    }
+
+    slot.input.discard();
+    slot.output.discard();
+    con->set_doorbell_futex(&shm_->host_bell, &shm_->host_waiting);
+    con->arm_doorbell();
+    granted_[id] = true;
+
+    slot.state.store(LOCAL_SLOT_GRANTED);
+    futex_ring(&slot.client_bell, &slot.client_waiting);
+    LOG_INFO("LOCAL") << "Console " << id << " attached (pid "
+                      << slot.client_pid.load() << ")";
+}
+
+void LocalConsoleHost::release(int id, LocalConsoleSlot& slot) {
+    Console* con = ConsoleManager::instance().get(id);
+    con->set_doorbell_futex(nullptr, nullptr);
+    con->reset();
+    granted_[id] = false;
+    slot.state.store(LOCAL_SLOT_IDLE);
+    futex_ring(&slot.client_bell, &slot.client_waiting);
+    LOG_INFO("LOCAL") << "Console " << id << " released";
+}
+
+// One pass over a slot; returns true if any bytes moved
+bool LocalConsoleHost::service(int id, LocalConsoleSlot& slot, bool check_alive) {
+    int32_t pid = slot.client_pid.load();
+    uint32_t state = slot.state.load();
+
+    if (pid != 0 && check_alive && kill(pid, 0) < 0 && errno == ESRCH) {
+        // Client died without closing - free its claim
+        slot.client_pid.compare_exchange_strong(pid, 0);
+        pid = 0;
+    }
+
+    if (pid == 0) {
+        if (granted_[id]) {
+            release(id, slot);
+        } else if (state != LOCAL_SLOT_IDLE) {
+            slot.state.store(LOCAL_SLOT_IDLE);
+        }
+        return false;
+    }
+    if (state == LOCAL_SLOT_IDLE) grant(id, slot);
+    if (!granted_[id]) return false;
+
+    Console* con = ConsoleManager::instance().get(id);
+    uint8_t buf[512];
+    bool moved = false;
+
+    // Re-arm first so output queued while we drain rings again
+    con->arm_doorbell();
+
+    // Keyboard: ring -> input queue
+    size_t room, n;
+    while ((room = con->input_queue().space()) > 0 &&
+           (n = slot.input.read(buf, std::min(room, sizeof(buf)))) > 0) {
+        con->push_input(buf, n);
+        moved = true;
+    }
+
+    // Display: output queue -> ring
+    while ((room = slot.output.space()) > 0 &&
+           (n = con->output_queue().read_some(buf, std::min(room, sizeof(buf)))) > 0) {
+        slot.output.write(buf, n);
+        moved = true;
+    }
+
+    if (moved) futex_ring(&slot.client_bell, &slot.client_waiting);
+    return moved;
+}
+
+void LocalConsoleHost::bridge_func() {
+    auto last_check = std::chrono::steady_clock::now();
+    bool moved = false;
+
+    while (!stop_requested_.load()) {
+        // Sleep unless the last pass did work; a client or console bumps
+        // host_bell, so the check below can't miss a wakeup
+        if (!moved) {
+            shm_->host_waiting.fetch_add(1);
+            uint32_t seq = shm_->host_bell.load();
+            bool pending = false;
+            for (int i = 0; i < MAX_CONSOLES && !pending; i++) {
+                pending = granted_[i] && shm_->slots[i].input.available() > 0;
+            }
+            if (!pending) futex_wait(&shm_->host_bell, seq, 10);  // 10ms
+            shm_->host_waiting.fetch_sub(1);
+        }
+
+        // Reap claims of dead clients about once a second
+        auto now = std::chrono::steady_clock::now();
+        bool check_alive = now - last_check >= std::chrono::seconds(1);
+        if (check_alive) last_check = now;
+
+        moved = false;
+        for (int i = 0; i < MAX_CONSOLES; i++) {
+            moved |= service(i, shm_->slots[i], check_alive);
+        }
+    }
+}
@@ -0,0 +1,139 @@
+// local_console_client.cpp - Client library for the local shared-memory consoles
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "local_console.h"
+#include "futex.h"
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+
+LocalConsoleClient::LocalConsoleClient()
+    : shm_(nullptr)
+    , slot_(nullptr)
+{
+}
+
+LocalConsoleClient::~LocalConsoleClient() {
+    close();
+}
+
+bool LocalConsoleClient::open(int console, const std::string& name, int timeout_ms) {
+    close();
+    if (console < 0 || console >= MAX_CONSOLES) return false;
+
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if (fd < 0) return false;
+    void* mem = mmap(nullptr, sizeof(LocalConsoleShm), PROT_READ | PROT_WRITE,
+                     MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (mem == MAP_FAILED) return false;
+
+    shm_ = static_cast<LocalConsoleShm*>(mem);
+    if (shm_->magic != LOCAL_CONSOLE_MAGIC || shm_->version != LOCAL_CONSOLE_VERSION ||
+        shm_->consoles != static_cast<uint32_t>(MAX_CONSOLES) ||
+        shm_->emulator_pid.load() == 0) {
+        munmap(shm_, sizeof(LocalConsoleShm));
+        shm_ = nullptr;
+        return false;
+    }
+
+    LocalConsoleSlot* slot = &shm_->slots[console];
+    int32_t none = 0;
+    if (!slot->client_pid.compare_exchange_strong(none, getpid())) {
+        munmap(shm_, sizeof(LocalConsoleShm));
+        shm_ = nullptr;
+        return false;  // Another client has it
+    }
+    slot_ = slot;
+    ring_host();
+
+    // Wait for the emulator to grant or refuse the claim
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    while (slot_->state.load() == LOCAL_SLOT_IDLE &&
+           std::chrono::steady_clock::now() < deadline) {
+        wait_bell(10);
+    }
+    if (slot_->state.load() != LOCAL_SLOT_GRANTED) {
+        close();
+        return false;
+    }
+    return true;
+}
+
+void LocalConsoleClient::close() {
+    if (slot_) {
+        slot_->client_pid.store(0);
+        ring_host();
+
+        // Let the emulator reset the console before anyone reclaims it
+        for (int i = 0; i < 10 && slot_->state.load() != LOCAL_SLOT_IDLE &&
+                        shm_->emulator_pid.load() != 0; i++) {
+            wait_bell(10);
+        }
+        slot_ = nullptr;
+    }
+    if (shm_) {
+        munmap(shm_, sizeof(LocalConsoleShm));
+        shm_ = nullptr;
+    }
+}
+
+void LocalConsoleClient::ring_host() {
+    futex_ring(&shm_->host_bell, &shm_->host_waiting);
+}
+
+// Sleep on the slot's bell; callers re-check their condition afterwards
+void LocalConsoleClient::wait_bell(int timeout_ms) {
+    slot_->client_waiting.fetch_add(1);
+    futex_wait(&slot_->client_bell, slot_->client_bell.load(), timeout_ms);
+    slot_->client_waiting.fetch_sub(1);
+}
+
+size_t LocalConsoleClient::write(const uint8_t* data, size_t len) {
+    if (!slot_) return 0;
+    size_t n = slot_->input.write(data, len);
+    if (n > 0) ring_host();
+    return n;
+}
+
+bool LocalConsoleClient::write_all(const uint8_t* data, size_t len) {
+    while (slot_ && len > 0) {
+        if (slot_->state.load() != LOCAL_SLOT_GRANTED || shm_->emulator_pid.load() == 0) {
+            return false;
+        }
+        slot_->client_waiting.fetch_add(1);
+        uint32_t seq = slot_->client_bell.load();
+        size_t n = write(data, len);
+        if (n == 0) futex_wait(&slot_->client_bell, seq, 10);  // Ring full
+        slot_->client_waiting.fetch_sub(1);
+        data += n;
+        len -= n;
+    }
+    return slot_ != nullptr;
+}
+
+size_t LocalConsoleClient::read(uint8_t* data, size_t max_len) {
+    if (!slot_) return 0;
+    bool was_full = slot_->output.space() == 0;
+    size_t n = slot_->output.read(data, max_len);
+    if (n > 0 && was_full) ring_host();  // Emulator may be waiting for room
+    return n;
+}
+
+size_t LocalConsoleClient::available() const {
+    return slot_ ? slot_->output.available() : 0;
+}
+
+bool LocalConsoleClient::wait_readable(int timeout_ms) {
+    if (!slot_) return false;
+    slot_->client_waiting.fetch_add(1);
+    uint32_t seq = slot_->client_bell.load();
+    if (slot_->output.available() == 0) {
+        futex_wait(&slot_->client_bell, seq, timeout_ms);
+    }
+    slot_->client_waiting.fetch_sub(1);
+    return slot_->output.available() > 0;
+}
@@ -0,0 +1,274 @@
+// log.cpp - Asynchronous leveled logging
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "log.h"
+
+#include <fcntl.h>
+#include <strings.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <iostream>
+
+static const char* const LEVEL_NAMES[] = {"TRACE", "DEBUG", "INFO", "WARN", "ERROR"};
+// syslog priorities for journald's PRIORITY field
+static const int LEVEL_PRIORITY[] = {7, 7, 6, 4, 3};
+
+bool parse_log_level(const char* name, LogLevel& level) {
+    static const struct {
+        const char* name;
+        LogLevel level;
+    } levels[] = {
+        {"trace", LogLevel::TRACE},
+        {"debug", LogLevel::DEBUG},
+        {"info",  LogLevel::INFO},
+        {"warn",  LogLevel::WARN},
+        {"error", LogLevel::ERROR},
+        {"off",   LogLevel::OFF},
+    };
+    for (const auto& l : levels) {
+        if (strcasecmp(name, l.name) == 0) {
+            level = l.level;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Marks the thread's queue retired when the thread exits, so the writer
+// can free it once drained
+struct LogThreadHandle {
+    Logger::ThreadQueue* queue = nullptr;
+    ~LogThreadHandle() {
+        if (queue) queue->retired.store(true, std::memory_order_release);
+    }
+};
+
+static thread_local LogThreadHandle t_log_handle;
+
+Logger& Logger::instance() {
+    static Logger instance;
+    return instance;
+}
+
+Logger::Logger()
+    : level_(LogLevel::INFO)
+    , format_(LogFormat::TEXT)
+    , out_fd_(STDERR_FILENO)
+    , next_thread_num_(1)
+    , running_(false)
+    , stop_requested_(false)
+    , dropped_(0)
+{
+}
+
+Logger::~Logger() {
+    stop();
+}
+
+Logger::ThreadQueue* Logger::queue_for_thread() {
+    if (!t_log_handle.queue) {
+        std::lock_guard<std::mutex> lock(queues_mutex_);
+        queues_.emplace_back(new ThreadQueue());
+        queues_.back()->thread_num = next_thread_num_++;
+        t_log_handle.queue = queues_.back().get();
+    }
+    return t_log_handle.queue;
+}
+
+void Logger::write(LogLevel level, const char* category, const std::string& msg) {
+    // Statements often end in std::endl or "\n" - records are lines
+    size_t len = msg.size();
+    while (len > 0 && (msg[len - 1] == '\n' || msg[len - 1] == '\r')) len--;
+    len = std::min(len, MAX_MESSAGE);
+    size_t cat_len = std::min<size_t>(strlen(category), 255);
+
+    uint64_t t = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    ThreadQueue* queue = queue_for_thread();
+
+    uint8_t rec[RECORD_HEADER + 255 + MAX_MESSAGE];
+    rec[0] = static_cast<uint8_t>(level);
+    rec[1] = static_cast<uint8_t>(cat_len);
+    rec[2] = len & 0xFF;
+    rec[3] = (len >> 8) & 0xFF;
+    for (int i = 0; i < 4; i++) rec[4 + i] = (queue->thread_num >> (8 * i)) & 0xFF;
+    for (int i = 0; i < 8; i++) rec[8 + i] = (t >> (8 * i)) & 0xFF;
+    std::memcpy(rec + RECORD_HEADER, category, cat_len);
+    std::memcpy(rec + RECORD_HEADER + cat_len, msg.data(), len);
+
+    // Whole records only - never wait for the writer
+    size_t total = RECORD_HEADER + cat_len + len;
+    if (queue->ring.space() < total) {
+        dropped_++;
+        return;
+    }
+    queue->ring.write(rec, total);
+}
+
+bool Logger::start(const std::string& path, LogFormat format) {
+    if (running_.load()) return true;
+    format_ = format;
+
+    if (!path.empty() && path != "-") {
+        int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            std::cerr << "Cannot open log file " << path << ": " << strerror(errno) << "\n";
+            return false;
+        }
+        out_fd_ = fd;
+    }
+
+    stop_requested_.store(false);
+    running_.store(true);
+    writer_ = std::thread(&Logger::writer_func, this);
+    return true;
+}
+
+void Logger::stop() {
+    if (running_.load()) {
+        stop_requested_.store(true);
+        if (writer_.joinable()) writer_.join();
+        running_.store(false);
+    }
+
+    // Whatever is left (or everything, if never started) goes out now
+    std::vector<Record> records;
+    drain(records);
+    for (const auto& rec : records) emit(rec);
+    uint64_t dropped = dropped_.exchange(0);
+    if (dropped > 0) {
+        Record rec{};
+        rec.t_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        rec.level = LogLevel::WARN;
+        rec.category = "LOG";
+        rec.message = std::to_string(dropped) + " records dropped (writer behind)";
+        emit(rec);
+    }
+    flush_batch();
+
+    if (out_fd_ != STDERR_FILENO) {
+        close(out_fd_);
+        out_fd_ = STDERR_FILENO;
+    }
+}
+
+// Collect complete records from every thread, oldest first
+bool Logger::drain(std::vector<Record>& out) {
+    uint8_t hdr[RECORD_HEADER];
+    char text[255 + MAX_MESSAGE];
+    size_t before = out.size();
+
+    std::lock_guard<std::mutex> lock(queues_mutex_);
+    for (auto it = queues_.begin(); it != queues_.end();) {
+        ThreadQueue& q = **it;
+        // Retired is read before draining: a retired queue gets no more writes
+        bool retired = q.retired.load(std::memory_order_acquire);
+
+        while (q.ring.available() >= RECORD_HEADER) {
+            q.ring.read(hdr, RECORD_HEADER);
+            size_t cat_len = hdr[1];
+            size_t len = hdr[2] | (hdr[3] << 8);
+            q.ring.read(reinterpret_cast<uint8_t*>(text), cat_len + len);
+
+            Record rec;
+            rec.level = static_cast<LogLevel>(hdr[0]);
+            rec.thread_num = 0;
+            for (int i = 0; i < 4; i++) rec.thread_num |= static_cast<uint32_t>(hdr[4 + i]) << (8 * i);
+            rec.t_us = 0;
+            for (int i = 0; i < 8; i++) rec.t_us |= static_cast<uint64_t>(hdr[8 + i]) << (8 * i);
+            rec.category.assign(text, cat_len);
+            rec.message.assign(text + cat_len, len);
+            out.push_back(std::move(rec));
+        }
+
+        if (retired) {
+            it = queues_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    std::stable_sort(out.begin() + before, out.end(),
+                     [](const Record& a, const Record& b) { return a.t_us < b.t_us; });
+    return out.size() > before;
+}
+
+static void json_string(std::string& out, const std::string& s) {
+    char esc[8];
+    out += '"';
+    for (unsigned char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c < 0x20 || c >= 0x7F) {
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+    out += '"';
+}
+
+void Logger::emit(const Record& rec) {
+    int lvl = std::min(static_cast<int>(rec.level), 4);
+
+    if (format_ == LogFormat::JSON) {
+        char num[64];
+        snprintf(num, sizeof(num), "{\"__REALTIME_TIMESTAMP\":\"%llu\",\"PRIORITY\":\"%d\",",
+                 static_cast<unsigned long long>(rec.t_us), LEVEL_PRIORITY[lvl]);
+        batch_ += num;
+        batch_ += "\"SYSLOG_IDENTIFIER\":\"mpm2\",\"LEVEL\":\"";
+        batch_ += LEVEL_NAMES[lvl];
+        batch_ += "\",\"CATEGORY\":";
+        json_string(batch_, rec.category);
+        snprintf(num, sizeof(num), ",\"TID\":%u,\"MESSAGE\":", rec.thread_num);
+        batch_ += num;
+        json_string(batch_, rec.message);
+        batch_ += "}\n";
+    } else {
+        time_t secs = static_cast<time_t>(rec.t_us / 1000000);
+        struct tm tm_local;
+        localtime_r(&secs, &tm_local);
+        char stamp[64];
+        size_t n = strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%S", &tm_local);
+        snprintf(stamp + n, sizeof(stamp) - n, ".%06u %-5s [",
+                 static_cast<unsigned>(rec.t_us % 1000000), LEVEL_NAMES[lvl]);
+        batch_ += stamp;
+        batch_ += rec.category;
+        batch_ += "] ";
+        batch_ += rec.message;
+        batch_ += '\n';
+    }
+}
+
+void Logger::flush_batch() {
+    size_t done = 0;
+    while (done < batch_.size()) {
+        ssize_t n = ::write(out_fd_, batch_.data() + done, batch_.size() - done);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;  // Nowhere to log to - drop
+        done += n;
+    }
+    batch_.clear();
+}
+
+void Logger::writer_func() {
+    std::vector<Record> records;
+    while (!stop_requested_.load()) {
+        records.clear();
+        if (drain(records)) {
+            for (const auto& rec : records) emit(rec);
+            flush_batch();
+        } else {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+}
@@ -5,13 +5,21 @@
 #include "console.h"
 #include "z80_thread.h"
 #include "disk.h"
+#include "aux_device.h"
+#include "frontend.h"
+#include "sftp_server.h"
+#include "session_recorder.h"
+#include "local_console.h"
+#include "log.h"
 
 #ifdef HAVE_WOLFSSH
 #include "ssh_session.h"
 #endif
 
+#include <algorithm>
 #include <iostream>
 #include <string>
+#include <thread>
 #include <vector>
 #include <csignal>
 #include <cstdlib>
@@ -65,6 +73,41 @@ static bool setup_raw_terminal() {
     return true;
 }
 
+#ifdef HAVE_WOLFSSH
+// Front-end process: serve SSH for the consoles of the parent emulator
+static int run_frontend(const std::string& fds, const std::string& host_key,
+                        int ssh_port, int acceptors, int queue_limit,
+                        bool allow_shadow, const std::vector<std::string>& viewer_keys) {
+    FrontendClient client;
+    if (!client.open(fds)) {
+        return 1;
+    }
+
+    SSHServer ssh_server;
+    ssh_server.set_acceptors(acceptors);
+    ssh_server.set_queue_limit(queue_limit);
+    ssh_server.set_sftp_access(SftpAccess::OFF);  // Drives live in the emulator process
+    if (!ssh_server.init(host_key) || !ssh_server.listen(ssh_port)) {
+        LOG_ERROR("FRONTEND") << "Failed to start SSH server on port " << ssh_port;
+        return 1;
+    }
+    ssh_server.set_allow_shadow(allow_shadow);
+    ssh_server.set_viewer_keys(viewer_keys);
+
+    client.start();
+    std::thread acceptor(&SSHServer::accept_loop, &ssh_server);
+    while (!g_shutdown_requested) {
+        usleep(10000);  // 10ms
+    }
+
+    ssh_server.stop();
+    acceptor.join();
+    client.stop();
+    SessionRecorder::instance().stop();
+    return 0;
+}
+#endif
+
 void print_usage(const char* prog) {
     std::cerr << "Usage: " << prog << " [options]\n"
               << "\n"
@@ -75,6 +118,58 @@ void print_usage(const char* prog) {
               << "  -b, --boot FILE       Boot image file (MPMLDR + MPM.SYS)\n"
               << "  -x, --xios ADDR       XIOS base address in hex (default: FC00)\n"
               << "  -l, --local           Enable local console (output to stdout)\n"
+              << "  -r, --reader SPEC     Attach READER to file:PATH, fifo:PATH or tcp:[HOST:]PORT\n"
+              << "  -P, --punch SPEC      Attach PUNCH to file:PATH, fifo:PATH or tcp:[HOST:]PORT\n"
+              << "  -S, --screen-fps FPS  Send console output as screen diffs at up to FPS frames/s\n"
+              << "  -g, --guest-term TYPE Guest terminal codes to translate: raw, adm3a, kaypro,\n"
+              << "                        tvi or vt52 (default: raw)\n"
+              << "  -H, --high-bit MODE   Bit 7 of console output: keep, strip or highlight\n"
+              << "                        (default: keep)\n"
+              << "  -D, --detach-timeout SECS\n"
+              << "                        Keep a dropped user's console for reattach with\n"
+              << "                        the same public key; password logins are reset\n"
+              << "                        (default: 900, 0 = reset on disconnect)\n"
+              << "  -V, --allow-shadow    Allow read-only viewers (SSH user viewN watches console N)\n"
+              << "      --viewer-key FP   Public key allowed to view, as ssh-keygen -l prints it\n"
+              << "                        (SHA256:...); repeat for more keys. With -V, viewers\n"
+              << "                        must sign in with a listed key\n"
+              << "  -R, --con-rate BPS[:BURST]\n"
+              << "                        Limit each SSH console to BPS bytes/s (burst BURST)\n"
+              << "  -I, --paste-cps CPS[:BURST]\n"
+              << "                        Pace keyboard input to CPS chars/s for slow programs\n"
+              << "  -A, --acceptors N     Accept SSH connections on N threads (default: 1)\n"
+              << "  -Q, --queue N         Let N users wait for a free console (default: 32,\n"
+              << "                        0 = reject when all are in use)\n"
+              << "  -T, --sftp MODE       SFTP access to the drives: off, ro or rw (default: off)\n"
+              << "                        (rw only writes drives the guest has not logged in)\n"
+              << "  -C, --record DIR      Record SSH console sessions to DIR as asciicast files\n"
+              << "      --record-input    Include keyboard input in recordings\n"
+              << "      --record-rotate MB\n"
+              << "                        Start a new recording file every MB megabytes\n"
+              << "      --record-gzip     Compress finished recordings (needs zlib)\n"
+              << "      --line-edit       Edit BDOS console line input (function 10) in the\n"
+              << "                        host instead of in emulated BDOS code\n"
+              << "      --tickless        Stop clock ticks while the system is idle; the\n"
+              << "                        time of day then follows host time\n"
+              << "      --tick-rate HZ    Clock interrupt rate: 50, 60, 100 or 250 (default: 60)\n"
+              << "      --boost           Tick early when input arrives for a waiting process\n"
+              << "      --cpu-core CORE   Z80 core: qkz80 (reference) or fast (lazy flags,\n"
+              << "                        falls back to qkz80 for prefixed opcodes); lockstep\n"
+              << "                        runs both and logs where they differ\n"
+              << "      --no-superinstructions\n"
+              << "                        Fast core: run common sequences one by one\n"
+              << "      --profile-pairs FILE\n"
+              << "                        Fast core: write the most frequent opcode pairs to\n"
+              << "                        FILE on exit (disables superinstructions)\n"
+              << "      --journal         Journal disk writes in IMAGE.journal and sync them in\n"
+              << "                        batches instead of flushing every sector\n"
+              << "  -L, --local-shm NAME  Offer consoles to local clients (mpm2con) through\n"
+              << "                        shared memory NAME, e.g. /mpm2-consoles\n"
+              << "      --log FILE        Write the log to FILE instead of stderr\n"
+              << "      --log-level LEVEL trace, debug, info, warn, error or off (default: info)\n"
+              << "      --log-json        Log as journald-style JSON, one object per line\n"
+              << "  -F, --frontend-process\n"
+              << "                        Serve SSH from a separate front-end process\n"
               << "  -h, --help            Show this help\n"
               << "\n"
               << "Examples:\n"
@@ -92,6 +187,43 @@ int main(int argc, char* argv[]) {
     uint16_t xios_base = 0x8800;
     bool local_console = false;
     std::vector<std::pair<int, std::string>> disk_mounts;
+    std::string reader_spec;
+    std::string punch_spec;
+    int screen_fps = 0;
+    GuestTerminal guest_term = GuestTerminal::RAW;
+    ParityMode parity_mode = ParityMode::KEEP;
+    int detach_timeout = 900;
+    bool allow_shadow = false;
+    std::vector<std::string> viewer_keys;
+    uint32_t con_rate = 0;
+    uint32_t con_burst = 0;
+    uint32_t paste_cps = 0;
+    uint32_t paste_burst = 0;
+    int acceptors = 1;
+    int queue_limit = 32;
+    SftpAccess sftp_access = SftpAccess::OFF;
+    std::string record_dir;
+    bool record_input = false;
+    uint64_t record_rotate_mb = 0;
+    bool record_gzip = false;
+    bool line_edit = false;
+    bool tickless = false;
+    int tick_rate = 60;
+    bool boost = false;
+    bool fast_core = false;
+    bool lockstep = false;
+    bool superinstructions = true;
+    std::string profile_pairs;
+    bool journal = false;
+    std::string local_shm;
+    std::string log_file;
+    LogLevel log_level = LogLevel::INFO;
+    bool log_json = false;
+    bool frontend_process = false;
+    std::string frontend_fd;
+
+    // Arguments for the front-end process (getopt reorders argv)
+    std::vector<std::string> frontend_args(argv + 1, argv + argc);
 
     // Parse command line options
     static struct option long_options[] = {
@@ -101,12 +233,43 @@ int main(int argc, char* argv[]) {
         {"boot",  required_argument, nullptr, 'b'},
         {"xios",  required_argument, nullptr, 'x'},
         {"local", no_argument,       nullptr, 'l'},
+        {"reader", required_argument, nullptr, 'r'},
+        {"punch", required_argument, nullptr, 'P'},
+        {"screen-fps", required_argument, nullptr, 'S'},
+        {"guest-term", required_argument, nullptr, 'g'},
+        {"high-bit", required_argument, nullptr, 'H'},
+        {"detach-timeout", required_argument, nullptr, 'D'},
+        {"allow-shadow", no_argument, nullptr, 'V'},
+        {"con-rate", required_argument, nullptr, 'R'},
+        {"paste-cps", required_argument, nullptr, 'I'},
+        {"acceptors", required_argument, nullptr, 'A'},
+        {"queue", required_argument, nullptr, 'Q'},
+        {"sftp", required_argument, nullptr, 'T'},
+        {"record", required_argument, nullptr, 'C'},
+        {"record-input", no_argument, nullptr, 257},
+        {"record-rotate", required_argument, nullptr, 258},
+        {"record-gzip", no_argument, nullptr, 259},
+        {"line-edit", no_argument, nullptr, 263},
+        {"tickless", no_argument, nullptr, 264},
+        {"tick-rate", required_argument, nullptr, 265},
+        {"boost", no_argument, nullptr, 266},
+        {"cpu-core", required_argument, nullptr, 267},
+        {"no-superinstructions", no_argument, nullptr, 268},
+        {"profile-pairs", required_argument, nullptr, 269},
+        {"journal", no_argument, nullptr, 270},
+        {"viewer-key", required_argument, nullptr, 271},
+        {"local-shm", required_argument, nullptr, 'L'},
+        {"log", required_argument, nullptr, 260},
+        {"log-level", required_argument, nullptr, 261},
+        {"log-json", no_argument, nullptr, 262},
+        {"frontend-process", no_argument, nullptr, 'F'},
+        {"frontend-fd", required_argument, nullptr, 256},  // Internal
         {"help",  no_argument,       nullptr, 'h'},
         {nullptr, 0,                 nullptr, 0}
     };
 
     int opt;
-    while ((opt = getopt_long(argc, argv, "p:k:d:b:x:lh", long_options, nullptr)) != -1) {
+    while ((opt = getopt_long(argc, argv, "p:k:d:b:x:lr:P:S:g:H:D:VR:I:A:Q:T:C:L:Fh", long_options, nullptr)) != -1) {
         switch (opt) {
             case 'p':
                 ssh_port = std::atoi(optarg);
@@ -145,6 +308,133 @@ int main(int argc, char* argv[]) {
             case 'l':
                 local_console = true;
                 break;
+            case 'r':
+                reader_spec = optarg;
+                break;
+            case 'P':
+                punch_spec = optarg;
+                break;
+            case 'S':
+                screen_fps = std::atoi(optarg);
+                break;
+            case 'g':
+                if (!parse_guest_terminal(optarg, guest_term)) {
+                    std::cerr << "Invalid guest terminal type: " << optarg << "\n";
+                    return 1;
+                }
+                break;
+            case 'H':
+                if (!parse_parity_mode(optarg, parity_mode)) {
+                    std::cerr << "Invalid high-bit mode: " << optarg << "\n";
+                    return 1;
+                }
+                break;
+            case 'D':
+                detach_timeout = std::atoi(optarg);
+                break;
+            case 'V':
+                allow_shadow = true;
+                break;
+            case 271:
+                viewer_keys.push_back(optarg);
+                break;
+            case 'R': {
+                // Format: BPS or BPS:BURST
+                char* end;
+                con_rate = std::strtoul(optarg, &end, 10);
+                con_burst = (*end == ':') ? std::strtoul(end + 1, nullptr, 10)
+                                          : std::max<uint32_t>(con_rate / 8, 128);
+                break;
+            }
+            case 'I': {
+                // Format: CPS or CPS:BURST
+                char* end;
+                paste_cps = std::strtoul(optarg, &end, 10);
+                paste_burst = (*end == ':') ? std::strtoul(end + 1, nullptr, 10)
+                                            : std::max<uint32_t>(paste_cps / 20, 1);
+                break;
+            }
+            case 'A':
+                acceptors = std::max(std::atoi(optarg), 1);
+                break;
+            case 'Q':
+                queue_limit = std::max(std::atoi(optarg), 0);
+                break;
+            case 'T':
+                if (!parse_sftp_access(optarg, sftp_access)) {
+                    std::cerr << "Invalid SFTP mode: " << optarg << "\n";
+                    return 1;
+                }
+                break;
+            case 'C':
+                record_dir = optarg;
+                break;
+            case 257:
+                record_input = true;
+                break;
+            case 258:
+                record_rotate_mb = std::strtoull(optarg, nullptr, 10);
+                break;
+            case 259:
+                record_gzip = true;
+                break;
+            case 263:
+                line_edit = true;
+                break;
+            case 264:
+                tickless = true;
+                break;
+            case 265:
+                tick_rate = std::atoi(optarg);
+                if (tick_rate != 50 && tick_rate != 60 && tick_rate != 100 && tick_rate != 250) {
+                    std::cerr << "Invalid tick rate: " << optarg << " (50, 60, 100 or 250)\n";
+                    return 1;
+                }
+                break;
+            case 266:
+                boost = true;
+                break;
+            case 267:
+                if (std::string(optarg) == "fast") {
+                    fast_core = true;
+                } else if (std::string(optarg) == "lockstep") {
+                    fast_core = true;
+                    lockstep = true;
+                } else if (std::string(optarg) != "qkz80") {
+                    std::cerr << "Invalid CPU core: " << optarg << " (qkz80, fast or lockstep)\n";
+                    return 1;
+                }
+                break;
+            case 268:
+                superinstructions = false;
+                break;
+            case 269:
+                profile_pairs = optarg;
+                break;
+            case 270:
+                journal = true;
+                break;
+            case 'L':
+                local_shm = optarg;
+                break;
+            case 260:
+                log_file = optarg;
+                break;
+            case 261:
+                if (!parse_log_level(optarg, log_level)) {
+                    std::cerr << "Invalid log level: " << optarg << "\n";
+                    return 1;
+                }
+                break;
+            case 262:
+                log_json = true;
+                break;
+            case 'F':
+                frontend_process = true;
+                break;
+            case 256:
+                frontend_fd = optarg;
+                break;
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -154,23 +444,92 @@ int main(int argc, char* argv[]) {
         }
     }
 
-    std::cerr << "[DEBUG] boot_image='" << boot_image << "'" << std::endl;
-
     // Set up signal handlers
     std::signal(SIGINT, signal_handler);
     std::signal(SIGTERM, signal_handler);
+    // Closed pipes and sockets show up as EPIPE where they are written
+    std::signal(SIGPIPE, SIG_IGN);
 
-    // Force unbuffered output for non-TTY environments
+    // Force unbuffered output for non-TTY environments. stdout carries
+    // guest console output only; everything else goes to the logger.
     std::ios::sync_with_stdio(true);
     std::cout.setf(std::ios::unitbuf);
-    std::cerr.setf(std::ios::unitbuf);
 
-    std::cout << "MP/M II Emulator\n";
-    std::cout << "================\n\n";
+    Logger::instance().set_level(log_level);
+    if (!Logger::instance().start(log_file, log_json ? LogFormat::JSON : LogFormat::TEXT)) {
+        return 1;
+    }
+
+    if (frontend_fd.empty()) {
+        LOG_INFO("MAIN") << "MP/M II Emulator";
+    }
+    LOG_DEBUG("MAIN") << "boot_image='" << boot_image << "'";
 
     // Initialize console manager
     ConsoleManager::instance().init();
-    std::cout << "Initialized " << MAX_CONSOLES << " consoles\n";
+    LOG_INFO("MAIN") << "Initialized " << MAX_CONSOLES << " consoles";
+    ConsoleManager::instance().set_detach_timeout(detach_timeout);
+    if (allow_shadow && viewer_keys.empty() && frontend_fd.empty()) {
+        LOG_WARN("MAIN") << "No --viewer-key given, viewers will be refused";
+    }
+
+    // Host-side screen model for SSH consoles
+    if (screen_fps > 0) {
+        for (int i = 0; i < MAX_CONSOLES; i++) {
+            ConsoleManager::instance().get(i)->enable_screen_model(screen_fps);
+        }
+        LOG_INFO("MAIN") << "Screen model enabled at " << screen_fps << " frames/s";
+    }
+
+    // Output translation from guest terminal codes to the SSH client's terminal
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        OutputTranslator& tr = ConsoleManager::instance().get(i)->output_translator();
+        tr.set_guest(guest_term);
+        tr.set_parity(parity_mode);
+    }
+
+    // Per-console output rate limit
+    if (con_rate > 0) {
+        for (int i = 0; i < MAX_CONSOLES; i++) {
+            ConsoleManager::instance().get(i)->output_shaper().configure(con_rate, con_burst);
+        }
+        LOG_INFO("MAIN") << "Console output limited to " << con_rate << " bytes/s (burst "
+                         << con_burst << ")";
+    }
+
+    // Paced keyboard input (pastes into programs that can't keep up)
+    if (paste_cps > 0) {
+        for (int i = 0; i < MAX_CONSOLES; i++) {
+            ConsoleManager::instance().get(i)->set_paste_pace(paste_cps, paste_burst);
+        }
+        LOG_INFO("MAIN") << "Keyboard input paced at " << paste_cps << " chars/s";
+    }
+
+    // Session recording, done by whichever process runs the SSH sessions
+    bool sessions_here = !frontend_process || !frontend_fd.empty();
+    if (!record_dir.empty() && sessions_here) {
+        SessionRecorder& recorder = SessionRecorder::instance();
+        recorder.set_record_input(record_input);
+        recorder.set_rotate_bytes(record_rotate_mb * 1024 * 1024);
+        recorder.set_compress(record_gzip);
+        if (!recorder.start(record_dir)) {
+            return 1;
+        }
+        LOG_INFO("MAIN") << "Recording sessions to " << record_dir;
+    }
+
+#ifdef HAVE_WOLFSSH
+    // Front-end process: no emulation here, just SSH
+    if (!frontend_fd.empty()) {
+        return run_frontend(frontend_fd, host_key, ssh_port, acceptors, queue_limit,
+                            allow_shadow, viewer_keys);
+    }
+#else
+    if (!frontend_fd.empty()) {
+        LOG_ERROR("MAIN") << "Front-end process requires SSH support";
+        return 1;
+    }
+#endif
 
     // Enable local console mode if requested
     // Enable on all consoles since MP/M II may use any console for boot output
@@ -181,10 +540,11 @@ int main(int argc, char* argv[]) {
                 con->set_local_mode(true);
             }
         }
-        std::cout << "Local console enabled on all " << MAX_CONSOLES << " consoles\n";
+        LOG_INFO("MAIN") << "Local console enabled on all " << MAX_CONSOLES << " consoles";
     }
 
     // Mount disks
+    DiskSystem::instance().set_journal(journal);
     for (const auto& mount : disk_mounts) {
         if (DiskSystem::instance().mount(mount.first, mount.second)) {
             Disk* disk = DiskSystem::instance().get(mount.first);
@@ -197,72 +557,141 @@ int main(int argc, char* argv[]) {
                     case DiskFormat::CUSTOM: fmt_name = "custom"; break;
                 }
             }
-            std::cout << "Mounted " << mount.second << " as drive "
-                      << static_cast<char>('A' + mount.first) << ": [" << fmt_name << "]\n";
+            LOG_INFO("MAIN") << "Mounted " << mount.second << " as drive "
+                             << static_cast<char>('A' + mount.first) << ": [" << fmt_name << "]"
+                             << (disk && disk->is_journaled() ? " journaled" : "");
         } else {
-            std::cerr << "Failed to mount " << mount.second << "\n";
+            LOG_ERROR("MAIN") << "Failed to mount " << mount.second;
+        }
+    }
+
+    // Attach AUX devices to host endpoints
+    if (!reader_spec.empty()) {
+        if (!AuxSystem::instance().reader().configure(reader_spec)) {
+            LOG_ERROR("MAIN") << "Failed to attach READER to " << reader_spec;
+            return 1;
         }
+        LOG_INFO("MAIN") << "READER attached to " << reader_spec;
     }
+    if (!punch_spec.empty()) {
+        if (!AuxSystem::instance().punch().configure(punch_spec)) {
+            LOG_ERROR("MAIN") << "Failed to attach PUNCH to " << punch_spec;
+            return 1;
+        }
+        LOG_INFO("MAIN") << "PUNCH attached to " << punch_spec;
+    }
+    AuxSystem::instance().start();
 
     // Initialize Z80 thread
     Z80Thread z80;
     if (!z80.init(boot_image)) {
-        std::cerr << "Failed to initialize Z80 emulator\n";
+        LOG_ERROR("MAIN") << "Failed to initialize Z80 emulator";
         if (!boot_image.empty()) {
-            std::cerr << "Could not load boot image: " << boot_image << "\n";
+            LOG_ERROR("MAIN") << "Could not load boot image: " << boot_image;
         }
         return 1;
     }
 
     z80.set_xios_base(xios_base);
-    std::cout << "XIOS base: 0x" << std::hex << xios_base << std::dec << "\n";
+    z80.set_line_edit(line_edit);
+    z80.set_tickless(tickless);
+    z80.set_tick_rate(tick_rate);
+    z80.set_boost(boost);
+    if (!profile_pairs.empty() && !fast_core) {
+        std::cerr << "--profile-pairs needs --cpu-core fast\n";
+        return 1;
+    }
+    z80.set_fast_core(fast_core);
+    z80.set_superinstructions(superinstructions);
+    z80.set_pair_profile(profile_pairs);
+    z80.set_lockstep(lockstep);
+    LOG_INFO("MAIN") << "XIOS base: 0x" << std::hex << xios_base;
+
+    // Consoles for local client processes over shared memory
+    LocalConsoleHost local_shm_host;
+    if (!local_shm.empty()) {
+        if (frontend_process) {
+            LOG_ERROR("MAIN") << "--local-shm cannot be combined with --frontend-process";
+            return 1;
+        }
+        if (!local_shm_host.start(local_shm)) {
+            return 1;
+        }
+        LOG_INFO("MAIN") << "Local consoles available at " << local_shm;
+    }
 
 #ifdef HAVE_WOLFSSH
     // Initialize SSH server (skip if only using local console)
     SSHServer ssh_server;
+    FrontendHost frontend;
     bool ssh_enabled = false;
-    if (!local_console) {
+    if (!local_console && frontend_process) {
+        // SSH runs in a child process; a crash there leaves the emulator
+        // and its consoles (detached) intact
+        if (!frontend.start("/proc/self/exe", frontend_args)) {
+            LOG_ERROR("MAIN") << "Failed to start SSH front-end process";
+            return 1;
+        }
+        LOG_INFO("MAIN") << "SSH front-end process serving port " << ssh_port;
+        LOG_INFO("MAIN") << "Connect with: ssh -p " << ssh_port << " user@localhost";
+    } else if (!local_console) {
+        ssh_server.set_acceptors(acceptors);
+        ssh_server.set_queue_limit(queue_limit);
+        ssh_server.set_sftp_access(sftp_access);
         if (!ssh_server.init(host_key)) {
-            std::cerr << "Failed to initialize SSH server\n";
-            std::cerr << "Make sure host key exists: " << host_key << "\n";
-            std::cerr << "Generate with: ssh-keygen -t rsa -f " << host_key << " -N ''\n";
+            LOG_ERROR("MAIN") << "Failed to initialize SSH server";
+            LOG_ERROR("MAIN") << "Make sure host key exists: " << host_key;
+            LOG_ERROR("MAIN") << "Generate with: ssh-keygen -t rsa -f " << host_key << " -N ''";
             return 1;
         }
 
         if (!ssh_server.listen(ssh_port)) {
-            std::cerr << "Failed to listen on port " << ssh_port << "\n";
+            LOG_ERROR("MAIN") << "Failed to listen on port " << ssh_port;
             return 1;
         }
 
+        ssh_server.set_allow_shadow(allow_shadow);
+        ssh_server.set_viewer_keys(viewer_keys);
         ssh_enabled = true;
-        std::cout << "SSH server listening on port " << ssh_port << "\n";
-        std::cout << "Connect with: ssh -p " << ssh_port << " user@localhost\n\n";
+        LOG_INFO("MAIN") << "SSH server listening on port " << ssh_port;
+        LOG_INFO("MAIN") << "Connect with: ssh -p " << ssh_port << " user@localhost";
     } else {
-        std::cout << "Running in local console mode (SSH disabled)\n\n";
+        LOG_INFO("MAIN") << "Running in local console mode (SSH disabled)";
     }
 #else
-    std::cout << "SSH support not available (wolfSSH not found)\n";
-    std::cout << "Running in local mode only\n\n";
+    LOG_INFO("MAIN") << "SSH support not available (wolfSSH not found)";
+    LOG_INFO("MAIN") << "Running in local mode only";
     (void)ssh_port;
     (void)host_key;
+    (void)allow_shadow;
+    (void)viewer_keys;
+    (void)acceptors;
+    (void)queue_limit;
+    (void)sftp_access;
+    (void)frontend_process;
 #endif
 
     // Start Z80 thread
     if (!boot_image.empty()) {
-        std::cout << "Starting Z80 CPU...\n";
+        LOG_INFO("MAIN") << "Starting Z80 CPU...";
         z80.start();
     } else {
-        std::cout << "No boot image specified - CPU not started\n";
-        std::cout << "Use -b option to specify boot image\n";
+        LOG_INFO("MAIN") << "No boot image specified - CPU not started";
+        LOG_INFO("MAIN") << "Use -b option to specify boot image";
     }
 
     // Main loop
-    std::cout << "\nPress Ctrl+C to shutdown\n\n";
+    LOG_INFO("MAIN") << "Press Ctrl+C to shutdown";
 
 #ifdef HAVE_WOLFSSH
     if (ssh_enabled) {
         // Run SSH accept loop in main thread (blocks until shutdown)
         ssh_server.accept_loop();
+    } else if (frontend.is_running()) {
+        // Front end does the SSH work - just wait for shutdown
+        while (!g_shutdown_requested) {
+            usleep(10000);  // 10ms
+        }
     } else {
         // Local console mode - read from stdin and broadcast to all local consoles
         if (setup_raw_terminal()) {
@@ -280,7 +709,8 @@ int main(int argc, char* argv[]) {
                     for (int i = 0; i < MAX_CONSOLES; i++) {
                         Console* con = ConsoleManager::instance().get(i);
                         if (con && con->is_local()) {
-                            con->input_queue().try_write(static_cast<uint8_t>(ch));
+                            uint8_t byte = static_cast<uint8_t>(ch);
+                            con->push_input(&byte, 1);
                         }
                     }
                 } else {
@@ -316,7 +746,8 @@ int main(int argc, char* argv[]) {
                 for (int i = 0; i < MAX_CONSOLES; i++) {
                     Console* con = ConsoleManager::instance().get(i);
                     if (con && con->is_local()) {
-                        con->input_queue().try_write(static_cast<uint8_t>(ch));
+                        uint8_t byte = static_cast<uint8_t>(ch);
+                        con->push_input(&byte, 1);
                     }
                 }
             } else {
@@ -336,18 +767,35 @@ int main(int argc, char* argv[]) {
     }
 #endif
 
-    std::cout << "\nShutting down...\n";
+    LOG_INFO("MAIN") << "Shutting down...";
 
     // Stop Z80
     z80.stop();
 
+    // Stop AUX I/O thread
+    AuxSystem::instance().stop();
+
+    // Release local clients (after the Z80 stops ringing their doorbells)
+    local_shm_host.stop();
+
 #ifdef HAVE_WOLFSSH
-    // Stop SSH server
+    // Stop SSH server and front end
     ssh_server.stop();
+    frontend.stop();
 #endif
+    SessionRecorder::instance().stop();
+
+    LOG_INFO("MAIN") << "Z80 executed " << z80.instructions() << " instructions";
 
-    std::cout << "Z80 executed " << z80.instructions() << " instructions\n";
-    std::cout << "Goodbye!\n";
+    // Per-console output statistics
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        Console* con = ConsoleManager::instance().get(i);
+        if (con->bytes_out() == 0) continue;
+        LOG_INFO("MAIN") << "Console " << i << ": " << con->bytes_out() << " bytes out, "
+                         << con->throttled() << " throttled";
+    }
+    LOG_INFO("MAIN") << "Goodbye!";
+    Logger::instance().stop();
 
     return 0;
 }
@@ -4,9 +4,10 @@
 
 #include "mpm_cpu.h"
 #include "xios.h"
+#include "interrupt_controller.h"
 #include "banked_mem.h"
-#include <iostream>
-#include <iomanip>
+#include "log.h"
+#include <chrono>
 
 MpmCpu::MpmCpu(qkz80_cpu_mem* memory)
     : qkz80(memory)
@@ -29,14 +30,23 @@ void MpmCpu::port_out(qkz80_uint8 port, qkz80_uint8 value) {
         case MpmPorts::SIGNAL:
             // Signal port - used for debug/status
             if (debug_io) {
-                std::cerr << "[SIGNAL] value=0x" << std::hex << (int)value << std::dec << std::endl;
+                LOG_DEBUG("SIGNAL") << "value=0x" << std::hex << (int)value;
             }
             break;
 
+        case MpmPorts::IRQ_CONTROL:
+            // Interrupt lines the guest takes besides the tick
+            InterruptController::instance().set_guest_mask(value);
+            break;
+
+        case MpmPorts::PERF:
+            latch_perf();
+            break;
+
         default:
             if (debug_io) {
-                std::cerr << "[OUT] port=0x" << std::hex << (int)port
-                          << " value=0x" << (int)value << std::dec << std::endl;
+                LOG_DEBUG("IO") << "OUT port=0x" << std::hex << (int)port
+                                << " value=0x" << (int)value;
             }
             break;
     }
@@ -51,9 +61,19 @@ qkz80_uint8 MpmCpu::port_in(qkz80_uint8 port) {
             value = 0x00;
             break;
 
+        case MpmPorts::IRQ_CONTROL:
+            // Lines behind the last RST 38H interrupts
+            value = InterruptController::instance().take_in_service();
+            break;
+
+        case MpmPorts::PERF:
+            value = perf_snapshot_[perf_pos_];
+            perf_pos_ = (perf_pos_ + 1) % sizeof(perf_snapshot_);
+            break;
+
         default:
             if (debug_io) {
-                std::cerr << "[IN] port=0x" << std::hex << (int)port << std::dec << std::endl;
+                LOG_DEBUG("IO") << "IN port=0x" << std::hex << (int)port;
             }
             break;
     }
@@ -61,9 +81,23 @@ qkz80_uint8 MpmCpu::port_in(qkz80_uint8 port) {
     return value;
 }
 
+void MpmCpu::latch_perf() {
+    uint64_t host_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    uint64_t fields[3] = {
+        static_cast<uint64_t>(cycles),
+        instructions_ ? instructions_->load(std::memory_order_relaxed) : 0,
+        host_us
+    };
+    for (int f = 0; f < 3; f++) {
+        for (int i = 0; i < 8; i++) perf_snapshot_[f * 8 + i] = (fields[f] >> (8 * i)) & 0xFF;
+    }
+    perf_pos_ = 0;
+}
+
 void MpmCpu::handle_xios_dispatch() {
     if (!xios_) {
-        std::cerr << "[XIOS DISPATCH] Error: no XIOS handler set" << std::endl;
+        LOG_ERROR("XIOS") << "Dispatch with no XIOS handler set";
         return;
     }
 
@@ -74,8 +108,7 @@ void MpmCpu::handle_xios_dispatch() {
 
     // Trace BOOT function calls
     if (func == 0x00) {
-        std::cerr << "[XIOS DISPATCH] BOOT called, PC=0x" << std::hex
-                  << regs.PC.get_pair16() << std::dec << std::endl;
+        LOG_DEBUG("XIOS") << "BOOT called, PC=0x" << std::hex << regs.PC.get_pair16();
     }
 
     // Debug trace - trace dispatches with unknown functions
@@ -87,19 +120,14 @@ void MpmCpu::handle_xios_dispatch() {
         func != 0x3C && func != 0x3F && func != 0x42 && func != 0x45 &&
         func != 0x48 && func != 0x4B && func != 0x4E && func != 0x51 &&
         func != 0x54 && func != 0x57) {
-        std::cerr << "[XIOS DISPATCH] Unknown func=0x" << std::hex << (int)func
-                  << " BC=0x" << regs.BC.get_pair16()
-                  << " DE=0x" << regs.DE.get_pair16()
-                  << " HL=0x" << regs.HL.get_pair16()
-                  << " PC=0x" << regs.PC.get_pair16()
-                  << std::dec << std::endl;
+        LOG_WARN("XIOS") << "Unknown func=0x" << std::hex << (int)func
+                         << " BC=0x" << regs.BC.get_pair16()
+                         << " DE=0x" << regs.DE.get_pair16()
+                         << " HL=0x" << regs.HL.get_pair16()
+                         << " PC=0x" << regs.PC.get_pair16();
         // Dump FC00-FC30 to see if xios_port code is still there
-        std::cerr << "FC00: ";
-        for (int i = 0; i < 16; i++) std::cerr << std::hex << (int)mem->fetch_mem(0xFC00 + i) << " ";
-        std::cerr << std::endl;
-        std::cerr << "FC7F: ";
-        for (int i = 0; i < 16; i++) std::cerr << std::hex << (int)mem->fetch_mem(0xFC7F + i) << " ";
-        std::cerr << std::endl;
+        LOG_DEBUG("XIOS") << "FC00: " << log_hex(16, [&](int i) { return mem->fetch_mem(0xFC00 + i); });
+        LOG_DEBUG("XIOS") << "FC7F: " << log_hex(16, [&](int i) { return mem->fetch_mem(0xFC7F + i); });
     }
 
     // Dispatch to XIOS handler
@@ -110,12 +138,12 @@ void MpmCpu::handle_xios_dispatch() {
 
 void MpmCpu::handle_bank_select(uint8_t bank) {
     if (!banked_mem_) {
-        std::cerr << "[BANK SELECT] Error: no banked memory set" << std::endl;
+        LOG_ERROR("BANK") << "Bank select with no banked memory set";
         return;
     }
 
     if (debug_io) {
-        std::cerr << "[BANK SELECT] bank=" << (int)bank << std::endl;
+        LOG_DEBUG("BANK") << "select bank=" << (int)bank;
     }
 
     banked_mem_->select_bank(bank);
@@ -124,38 +152,29 @@ void MpmCpu::handle_bank_select(uint8_t bank) {
 void MpmCpu::halt(void) {
     // Z80 HALT instruction - CPU waits for interrupt
     // In MP/M II context, this typically means system idle or error
-    std::cerr << "\n*** HALT instruction at PC=0x" << std::hex
-              << regs.PC.get_pair16() << std::dec << " ***\n";
-    std::cerr << "    Bank=" << (int)(banked_mem_ ? banked_mem_->current_bank() : 0)
-              << " SP=0x" << std::hex << regs.SP.get_pair16()
-              << " AF=0x" << regs.AF.get_pair16()
-              << " BC=0x" << regs.BC.get_pair16()
-              << " DE=0x" << regs.DE.get_pair16()
-              << " HL=0x" << regs.HL.get_pair16()
-              << std::dec << std::endl;
+    LOG_ERROR("Z80") << "HALT instruction at PC=0x" << std::hex << regs.PC.get_pair16()
+                     << std::dec << " Bank=" << (int)(banked_mem_ ? banked_mem_->current_bank() : 0)
+                     << std::hex
+                     << " SP=0x" << regs.SP.get_pair16()
+                     << " AF=0x" << regs.AF.get_pair16()
+                     << " BC=0x" << regs.BC.get_pair16()
+                     << " DE=0x" << regs.DE.get_pair16()
+                     << " HL=0x" << regs.HL.get_pair16();
     halted_ = true;
 }
 
 void MpmCpu::unimplemented_opcode(qkz80_uint8 opcode, qkz80_uint16 pc) {
     // Encountered an invalid or unimplemented Z80 opcode
-    std::cerr << "\n*** Unimplemented opcode 0x" << std::hex << (int)opcode
-              << " at PC=0x" << pc << std::dec << " ***\n";
-    std::cerr << "    Bank=" << (int)(banked_mem_ ? banked_mem_->current_bank() : 0)
-              << " SP=0x" << std::hex << regs.SP.get_pair16()
-              << " AF=0x" << regs.AF.get_pair16()
-              << std::dec << std::endl;
-
-    // Dump surrounding memory for context
-    std::cerr << "    Memory at PC: ";
-    for (int i = -2; i <= 5; i++) {
-        uint16_t addr = pc + i;
-        uint8_t byte = mem->fetch_mem(addr);
-        if (i == 0) std::cerr << "[";
-        std::cerr << std::hex << std::setfill('0') << std::setw(2) << (int)byte;
-        if (i == 0) std::cerr << "]";
-        std::cerr << " ";
-    }
-    std::cerr << std::dec << std::endl;
+    // Surrounding memory for context, the opcode at PC after the bar
+    LOG_ERROR("Z80") << "Unimplemented opcode 0x" << std::hex << (int)opcode
+                     << " at PC=0x" << pc
+                     << std::dec << " Bank=" << (int)(banked_mem_ ? banked_mem_->current_bank() : 0)
+                     << std::hex
+                     << " SP=0x" << regs.SP.get_pair16()
+                     << " AF=0x" << regs.AF.get_pair16()
+                     << " memory: "
+                     << log_hex(2, [&](int i) { return mem->fetch_mem(pc - 2 + i); }) << " | "
+                     << log_hex(6, [&](int i) { return mem->fetch_mem(pc + i); });
 
     halted_ = true;
 }
@@ -0,0 +1,455 @@
+// screen_model.cpp - Host-side terminal screen model implementation
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "screen_model.h"
+#include <algorithm>
+
+ScreenModel::ScreenModel(int width, int height)
+    : width_(0)
+    , height_(0)
+    , row_(0)
+    , col_(0)
+    , attr_(0)
+    , wrap_pending_(false)
+    , state_(State::GROUND)
+    , csi_private_(false)
+    , addr_row_(0)
+    , shown_row_(-1)
+    , shown_col_(-1)
+    , shown_attr_(0)
+    , pending_scroll_(0)
+    , bells_(0)
+    , dirty_(false)
+    , full_redraw_(true)
+{
+    resize(width, height);
+}
+
+void ScreenModel::resize(int width, int height) {
+    width_ = std::max(1, std::min(width, 255));
+    height_ = std::max(1, std::min(height, 255));
+    cells_.assign(width_ * height_, blank());
+    shown_.assign(width_ * height_, blank());
+    row_ = 0;
+    col_ = 0;
+    wrap_pending_ = false;
+    pending_scroll_ = 0;
+    full_redraw_ = true;
+}
+
+void ScreenModel::feed(const uint8_t* data, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint8_t ch = data[i] & 0x7F;  // Strip parity
+
+        switch (state_) {
+            case State::GROUND:
+                if (ch == 0x1B) {
+                    state_ = State::ESCAPE;
+                } else if (ch < 0x20 || ch == 0x7F) {
+                    control(ch);
+                } else {
+                    put_char(ch);
+                }
+                break;
+
+            case State::ESCAPE:
+                state_ = State::GROUND;
+                escape(ch);
+                break;
+
+            case State::CSI:
+                if (ch >= '0' && ch <= '9') {
+                    if (params_.empty()) params_.push_back(0);
+                    params_.back() = std::min(params_.back() * 10 + (ch - '0'), 9999);
+                } else if (ch == ';') {
+                    if (params_.empty()) params_.push_back(0);
+                    params_.push_back(0);
+                } else if (ch == '?') {
+                    csi_private_ = true;
+                } else if (ch >= 0x40 && ch <= 0x7E) {
+                    state_ = State::GROUND;
+                    csi_dispatch(ch);
+                } else if (ch < 0x20) {
+                    // VT100 executes controls embedded in a sequence
+                    control(ch);
+                }
+                break;
+
+            case State::CURSOR_ROW:
+                addr_row_ = ch - 0x20;
+                state_ = State::CURSOR_COL;
+                break;
+
+            case State::CURSOR_COL:
+                state_ = State::GROUND;
+                move_to(addr_row_, ch - 0x20);
+                break;
+
+            case State::SKIP_ONE:
+                state_ = State::GROUND;
+                break;
+        }
+    }
+}
+
+void ScreenModel::put_char(uint8_t ch) {
+    if (wrap_pending_) {
+        wrap_pending_ = false;
+        col_ = 0;
+        line_feed();
+    }
+
+    at(row_, col_) = Cell{ch, attr_};
+    if (col_ == width_ - 1) {
+        wrap_pending_ = true;
+    } else {
+        col_++;
+    }
+    dirty_ = true;
+}
+
+void ScreenModel::control(uint8_t ch) {
+    switch (ch) {
+        case 0x07:  // BEL
+            bells_++;
+            dirty_ = true;
+            break;
+        case 0x08:  // BS
+            if (col_ > 0) col_--;
+            wrap_pending_ = false;
+            break;
+        case 0x09:  // HT - tab stops every 8 columns
+            col_ = std::min(width_ - 1, (col_ / 8 + 1) * 8);
+            break;
+        case 0x0A:  // LF
+            line_feed();
+            break;
+        case 0x0B:  // VT - ADM-3A cursor up
+            if (row_ > 0) row_--;
+            break;
+        case 0x0C:  // FF - ADM-3A cursor right
+            if (col_ < width_ - 1) col_++;
+            break;
+        case 0x0D:  // CR
+            col_ = 0;
+            wrap_pending_ = false;
+            break;
+        case 0x1A:  // SUB - ADM-3A clear screen
+            erase_display(2);
+            move_to(0, 0);
+            break;
+        case 0x1E:  // RS - ADM-3A home
+            move_to(0, 0);
+            break;
+        default:
+            break;
+    }
+    dirty_ = true;
+}
+
+void ScreenModel::escape(uint8_t ch) {
+    switch (ch) {
+        case '[':
+            params_.clear();
+            csi_private_ = false;
+            state_ = State::CSI;
+            break;
+        case '=':   // ADM-3A / Televideo / Kaypro cursor address
+        case 'Y':   // VT52 cursor address (same row/col encoding)
+            state_ = State::CURSOR_ROW;
+            break;
+        case 'A': move_to(row_ - 1, col_); break;   // VT52 up
+        case 'B': move_to(row_ + 1, col_); break;   // VT52 down
+        case 'C': move_to(row_, col_ + 1); break;   // VT52 right
+        case 'D': move_to(row_, col_ - 1); break;   // VT52 left
+        case 'H': move_to(0, 0); break;             // VT52 home
+        case 'J': erase_display(0); break;          // VT52 erase to end of screen
+        case 'K':                                   // VT52 erase to end of line
+        case 'T':                                   // Televideo/Kaypro erase to EOL
+        case 't':
+            erase_line(0);
+            break;
+        case '*':   // Televideo clear screen
+        case '+':
+        case ':':
+        case ';':
+            erase_display(2);
+            move_to(0, 0);
+            break;
+        case 'R':   // Televideo delete line
+            scroll_up(row_, height_ - 1, 1);
+            break;
+        case 'I':   // VT52 reverse line feed
+        case 'M':   // VT100 reverse index
+            reverse_line_feed();
+            break;
+        case 'E':   // VT100 next line
+            col_ = 0;
+            line_feed();
+            break;
+        case 'c':   // Reset
+            attr_ = 0;
+            erase_display(2);
+            move_to(0, 0);
+            break;
+        case '(':   // Character set designation - ignore the set
+        case ')':
+            state_ = State::SKIP_ONE;
+            break;
+        default:
+            break;
+    }
+    dirty_ = true;
+}
+
+int ScreenModel::csi_param(size_t index, int def) const {
+    if (index >= params_.size() || params_[index] == 0) return def;
+    return params_[index];
+}
+
+void ScreenModel::csi_dispatch(uint8_t final) {
+    if (csi_private_) return;  // DEC private modes don't affect the grid
+
+    int n = csi_param(0, 1);
+    switch (final) {
+        case 'A': move_to(row_ - n, col_); break;
+        case 'B': move_to(row_ + n, col_); break;
+        case 'C': move_to(row_, col_ + n); break;
+        case 'D': move_to(row_, col_ - n); break;
+        case 'G': move_to(row_, n - 1); break;
+        case 'd': move_to(n - 1, col_); break;
+        case 'H':
+        case 'f':
+            move_to(csi_param(0, 1) - 1, csi_param(1, 1) - 1);
+            break;
+        case 'J':
+            erase_display(params_.empty() ? 0 : params_[0]);
+            break;
+        case 'K':
+            erase_line(params_.empty() ? 0 : params_[0]);
+            break;
+        case 'L':
+            scroll_down(row_, height_ - 1, n);
+            break;
+        case 'M':
+            scroll_up(row_, height_ - 1, n);
+            break;
+        case 'P': {
+            // Delete characters, shifting the rest of the line left
+            n = std::min(n, width_ - col_);
+            for (int c = col_; c < width_; c++) {
+                at(row_, c) = (c + n < width_) ? at(row_, c + n) : blank();
+            }
+            break;
+        }
+        case '@': {
+            // Insert blanks, shifting the rest of the line right
+            n = std::min(n, width_ - col_);
+            for (int c = width_ - 1; c >= col_; c--) {
+                at(row_, c) = (c - n >= col_) ? at(row_, c - n) : blank();
+            }
+            break;
+        }
+        case 'm':
+            if (params_.empty()) {
+                attr_ = 0;
+                break;
+            }
+            for (int p : params_) {
+                switch (p) {
+                    case 0:  attr_ = 0; break;
+                    case 1:  attr_ |= ATTR_BOLD; break;
+                    case 4:  attr_ |= ATTR_UNDERLINE; break;
+                    case 7:  attr_ |= ATTR_REVERSE; break;
+                    case 22: attr_ &= ~ATTR_BOLD; break;
+                    case 24: attr_ &= ~ATTR_UNDERLINE; break;
+                    case 27: attr_ &= ~ATTR_REVERSE; break;
+                    default: break;
+                }
+            }
+            break;
+        default:
+            break;
+    }
+    dirty_ = true;
+}
+
+void ScreenModel::move_to(int row, int col) {
+    row_ = std::max(0, std::min(row, height_ - 1));
+    col_ = std::max(0, std::min(col, width_ - 1));
+    wrap_pending_ = false;
+    dirty_ = true;
+}
+
+void ScreenModel::line_feed() {
+    if (row_ == height_ - 1) {
+        scroll_up(0, height_ - 1, 1);
+    } else {
+        row_++;
+    }
+}
+
+void ScreenModel::reverse_line_feed() {
+    if (row_ == 0) {
+        scroll_down(0, height_ - 1, 1);
+    } else {
+        row_--;
+    }
+}
+
+void ScreenModel::scroll_up(int top, int bottom, int count) {
+    count = std::min(count, bottom - top + 1);
+    for (int r = top; r <= bottom; r++) {
+        for (int c = 0; c < width_; c++) {
+            at(r, c) = (r + count <= bottom) ? at(r + count, c) : blank();
+        }
+    }
+    // Whole-screen scrolls are replayed on the client instead of repainted
+    if (top == 0 && bottom == height_ - 1) {
+        pending_scroll_ += count;
+    }
+    dirty_ = true;
+}
+
+void ScreenModel::scroll_down(int top, int bottom, int count) {
+    count = std::min(count, bottom - top + 1);
+    for (int r = bottom; r >= top; r--) {
+        for (int c = 0; c < width_; c++) {
+            at(r, c) = (r - count >= top) ? at(r - count, c) : blank();
+        }
+    }
+    dirty_ = true;
+}
+
+void ScreenModel::erase(int row, int from_col, int to_col) {
+    for (int c = from_col; c <= to_col; c++) {
+        at(row, c) = blank();
+    }
+}
+
+void ScreenModel::erase_display(int mode) {
+    switch (mode) {
+        case 0:  // Cursor to end of screen
+            erase(row_, col_, width_ - 1);
+            for (int r = row_ + 1; r < height_; r++) erase(r, 0, width_ - 1);
+            break;
+        case 1:  // Start of screen to cursor
+            for (int r = 0; r < row_; r++) erase(r, 0, width_ - 1);
+            erase(row_, 0, col_);
+            break;
+        default: // Entire screen
+            for (int r = 0; r < height_; r++) erase(r, 0, width_ - 1);
+            break;
+    }
+    dirty_ = true;
+}
+
+void ScreenModel::erase_line(int mode) {
+    switch (mode) {
+        case 0:  erase(row_, col_, width_ - 1); break;
+        case 1:  erase(row_, 0, col_); break;
+        default: erase(row_, 0, width_ - 1); break;
+    }
+    dirty_ = true;
+}
+
+// Rendering
+
+void ScreenModel::emit_attr(std::string& out, uint8_t attr) {
+    if (attr == shown_attr_) return;
+    out += "\x1b[0";
+    if (attr & ATTR_BOLD) out += ";1";
+    if (attr & ATTR_UNDERLINE) out += ";4";
+    if (attr & ATTR_REVERSE) out += ";7";
+    out += 'm';
+    shown_attr_ = attr;
+}
+
+void ScreenModel::emit_cursor(std::string& out, int row, int col) {
+    if (row == shown_row_ && col == shown_col_) return;
+    if (row == shown_row_ && col == 0) {
+        out += '\r';
+    } else {
+        out += "\x1b[" + std::to_string(row + 1) + ";" + std::to_string(col + 1) + "H";
+    }
+    shown_row_ = row;
+    shown_col_ = col;
+}
+
+void ScreenModel::render_full(std::string& out) {
+    out += "\x1b[0m\x1b[H\x1b[2J";
+    shown_attr_ = 0;
+    shown_row_ = 0;
+    shown_col_ = 0;
+    shown_.assign(width_ * height_, blank());
+    pending_scroll_ = 0;
+    full_redraw_ = false;
+    dirty_ = true;
+    render_diff(out);
+}
+
+bool ScreenModel::render_diff(std::string& out) {
+    if (full_redraw_ || pending_scroll_ >= height_) {
+        render_full(out);
+        return true;
+    }
+    if (!dirty_) return false;
+
+    size_t start_len = out.size();
+
+    // Replay full-screen scrolls with line feeds on the bottom row
+    if (pending_scroll_ > 0) {
+        emit_attr(out, 0);
+        emit_cursor(out, height_ - 1, 0);
+        out.append(pending_scroll_, '\n');
+        std::move(shown_.begin() + pending_scroll_ * width_, shown_.end(), shown_.begin());
+        std::fill(shown_.end() - pending_scroll_ * width_, shown_.end(), blank());
+        pending_scroll_ = 0;
+    }
+
+    for (int r = 0; r < height_; r++) {
+        const Cell* cur = &cells_[r * width_];
+        Cell* old = &shown_[r * width_];
+
+        int first = 0;
+        while (first < width_ && cur[first] == old[first]) first++;
+        if (first == width_) continue;
+
+        int last = width_ - 1;
+        while (last > first && cur[last] == old[last]) last--;
+
+        // Trailing blanks are cheaper as an erase-to-end-of-line
+        int last_text = width_ - 1;
+        while (last_text >= 0 && cur[last_text] == blank()) last_text--;
+
+        int write_to = std::min(last, last_text);
+        if (first <= write_to) {
+            emit_cursor(out, r, first);
+            for (int c = first; c <= write_to; c++) {
+                emit_attr(out, cur[c].attr);
+                out += static_cast<char>(cur[c].ch);
+            }
+            // Writing the last column leaves the client cursor in an
+            // implementation-defined wrap state; force explicit positioning
+            shown_col_ = (write_to == width_ - 1) ? -1 : write_to + 1;
+        }
+        if (last > last_text) {
+            emit_cursor(out, r, std::max(first, last_text + 1));
+            emit_attr(out, 0);
+            out += "\x1b[K";
+        }
+
+        std::copy(cur, cur + width_, old);
+    }
+
+    if (bells_ > 0) {
+        out.append(bells_, '\a');
+        bells_ = 0;
+    }
+
+    emit_cursor(out, row_, col_);
+
+    dirty_ = false;
+    return out.size() > start_len;
+}
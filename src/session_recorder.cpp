@@ -0,0 +1,308 @@
+// session_recorder.cpp - Console session recording in asciicast v2 format
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "session_recorder.h"
+#include "log.h"
+
+#include <sys/stat.h>
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <ctime>
+
+#ifdef HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+static uint64_t steady_us() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// Console bytes as a JSON string body. Bytes above 0x7F are taken as
+// Latin-1 so the line stays valid UTF-8 JSON.
+static void json_escape(const uint8_t* data, size_t len, std::string& out) {
+    char esc[8];
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = data[i];
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += static_cast<char>(c);
+        } else if (c == '\n') {
+            out += "\\n";
+        } else if (c == '\r') {
+            out += "\\r";
+        } else if (c < 0x20 || c >= 0x7F) {
+            snprintf(esc, sizeof(esc), "\\u%04x", c);
+            out += esc;
+        } else {
+            out += static_cast<char>(c);
+        }
+    }
+}
+
+SessionRecorder& SessionRecorder::instance() {
+    static SessionRecorder instance;
+    return instance;
+}
+
+SessionRecorder::SessionRecorder()
+    : record_input_(false)
+    , rotate_bytes_(0)
+    , compress_(false)
+    , running_(false)
+    , stop_requested_(false)
+    , dropped_(0)
+{
+}
+
+bool SessionRecorder::start(const std::string& dir) {
+    if (running_.load()) return true;
+
+    struct stat st;
+    if (stat(dir.c_str(), &st) != 0 && mkdir(dir.c_str(), 0755) != 0) {
+        LOG_ERROR("REC") << "Cannot create " << dir << ": " << strerror(errno);
+        return false;
+    }
+    dir_ = dir;
+
+#ifndef HAVE_ZLIB
+    if (compress_) {
+        LOG_WARN("REC") << "Built without zlib - recordings are not compressed";
+        compress_ = false;
+    }
+#endif
+
+    if (!channels_) channels_.reset(new Channel[MAX_CONSOLES]());
+    stop_requested_.store(false);
+    running_.store(true);
+    writer_ = std::thread(&SessionRecorder::writer_func, this);
+    return true;
+}
+
+void SessionRecorder::stop() {
+    if (!running_.load()) return;
+    running_.store(false);
+    stop_requested_.store(true);
+    if (writer_.joinable()) writer_.join();
+
+    if (dropped_.load() > 0) {
+        LOG_WARN("REC") << dropped_.load() << " events dropped (writer behind)";
+    }
+}
+
+void SessionRecorder::put(int console, char kind, const uint8_t* data, size_t len) {
+    if (!running_.load() || console < 0 || console >= MAX_CONSOLES) return;
+    SpscRing<65536>& ring = channels_[console].ring;
+
+    uint8_t rec[RECORD_HEADER + MAX_PAYLOAD];
+    do {
+        size_t n = std::min(len, MAX_PAYLOAD);
+        uint64_t t = steady_us();
+        rec[0] = static_cast<uint8_t>(kind);
+        rec[1] = n & 0xFF;
+        rec[2] = (n >> 8) & 0xFF;
+        for (int i = 0; i < 8; i++) rec[3 + i] = (t >> (8 * i)) & 0xFF;
+        if (n > 0) std::memcpy(rec + RECORD_HEADER, data, n);
+
+        // Whole records only - never wait for the writer
+        if (ring.space() < RECORD_HEADER + n) {
+            dropped_++;
+            return;
+        }
+        ring.write(rec, RECORD_HEADER + n);
+        data += n;
+        len -= n;
+    } while (len > 0);
+}
+
+void SessionRecorder::begin(int console, int width, int height,
+                            const std::string& user, const std::string& term) {
+    // Must fit one record: put() would split it, and the second 'S'
+    // record would start another recording. The client picks both
+    // strings, so cut them to fit.
+    std::string info = std::to_string(width) + " " + std::to_string(height) + " " +
+                       term.substr(0, 64) + "\n";
+    info += user.substr(0, MAX_PAYLOAD - info.size());
+    put(console, 'S', reinterpret_cast<const uint8_t*>(info.data()), info.size());
+}
+
+void SessionRecorder::output(int console, const uint8_t* data, size_t len) {
+    if (len > 0) put(console, 'o', data, len);
+}
+
+void SessionRecorder::input(int console, const uint8_t* data, size_t len) {
+    if (record_input_ && len > 0) put(console, 'i', data, len);
+}
+
+void SessionRecorder::end(int console) {
+    put(console, 'E', nullptr, 0);
+}
+
+void SessionRecorder::writer_func() {
+    while (!stop_requested_.load()) {
+        bool busy = false;
+        for (int i = 0; i < MAX_CONSOLES; i++) {
+            busy |= drain(i);
+        }
+        if (!busy) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+    }
+
+    // Flush what is left and finish open files
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        while (drain(i)) {}
+        close_cast(casts_[i]);
+    }
+}
+
+bool SessionRecorder::drain(int console) {
+    SpscRing<65536>& ring = channels_[console].ring;
+    Cast& cast = casts_[console];
+    uint8_t hdr[RECORD_HEADER];
+    uint8_t payload[MAX_PAYLOAD];
+    std::string line;
+    bool did = false;
+
+    // Bounded per pass so one busy console doesn't starve the others
+    for (int budget = 256; budget > 0 && ring.available() >= RECORD_HEADER; budget--) {
+        ring.read(hdr, RECORD_HEADER);
+        size_t len = hdr[1] | (hdr[2] << 8);
+        uint64_t t = 0;
+        for (int i = 0; i < 8; i++) t |= static_cast<uint64_t>(hdr[3 + i]) << (8 * i);
+        ring.read(payload, len);
+        did = true;
+
+        switch (hdr[0]) {
+            case 'S':
+                close_cast(cast);
+                open_cast(console, std::string(reinterpret_cast<char*>(payload), len), t);
+                break;
+
+            case 'E':
+                close_cast(cast);
+                break;
+
+            case 'o':
+            case 'i': {
+                if (!cast.file) break;
+                char stamp[48];
+                snprintf(stamp, sizeof(stamp), "[%.6f, \"%c\", \"",
+                         (t - cast.start_us) / 1e6, hdr[0]);
+                line = stamp;
+                json_escape(payload, len, line);
+                line += "\"]\n";
+                fwrite(line.data(), 1, line.size(), cast.file);
+                cast.bytes += line.size();
+
+                // Rotate: each part is a playable recording of its own
+                if (rotate_bytes_ > 0 && cast.bytes >= rotate_bytes_) {
+                    std::string done = cast.path;
+                    fclose(cast.file);
+                    cast.file = nullptr;
+                    if (compress_) compress_file(done);
+                    cast.part++;
+                    cast.start_us = t;
+                    open_part(cast);
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+    }
+    return did;
+}
+
+void SessionRecorder::open_cast(int console, const std::string& info, uint64_t t_us) {
+    Cast& cast = casts_[console];
+
+    int width = 80, height = 24;
+    char term[32] = "vt100";
+    sscanf(info.c_str(), "%d %d %31s", &width, &height, term);
+    size_t nl = info.find('\n');
+    std::string user = nl == std::string::npos ? "" : info.substr(nl + 1);
+
+    // File names keep only safe characters of the user name
+    std::string safe_user;
+    for (char c : user) {
+        if (isalnum(static_cast<unsigned char>(c)) || c == '_' || c == '-') safe_user += c;
+    }
+    if (safe_user.empty()) safe_user = "anonymous";
+
+    time_t now = time(nullptr);
+    struct tm tm_now;
+    localtime_r(&now, &tm_now);
+    char when[32];
+    strftime(when, sizeof(when), "%Y%m%d-%H%M%S", &tm_now);
+
+    cast.base = dir_ + "/con" + std::to_string(console) + "-" + when + "-" + safe_user;
+
+    std::string title;
+    json_escape(reinterpret_cast<const uint8_t*>(user.data()), user.size(), title);
+    char header[512];
+    snprintf(header, sizeof(header),
+             "{\"version\": 2, \"width\": %d, \"height\": %d, \"timestamp\": %lld, "
+             "\"title\": \"MP/M II console %d (%s)\", \"env\": {\"TERM\": \"%s\"}}\n",
+             width, height, static_cast<long long>(now), console, title.c_str(), term);
+    cast.header = header;
+    cast.start_us = t_us;
+    cast.part = 0;
+    open_part(cast);
+}
+
+void SessionRecorder::open_part(Cast& cast) {
+    cast.path = cast.base + (cast.part ? "-" + std::to_string(cast.part) : "") + ".cast";
+    cast.file = fopen(cast.path.c_str(), "w");
+    if (!cast.file) {
+        LOG_ERROR("REC") << "Cannot write " << cast.path << ": " << strerror(errno);
+        return;
+    }
+    fwrite(cast.header.data(), 1, cast.header.size(), cast.file);
+    cast.bytes = cast.header.size();
+}
+
+void SessionRecorder::close_cast(Cast& cast) {
+    if (!cast.file) return;
+    fclose(cast.file);
+    cast.file = nullptr;
+    if (compress_) compress_file(cast.path);
+}
+
+void SessionRecorder::compress_file(const std::string& path) {
+#ifdef HAVE_ZLIB
+    FILE* in = fopen(path.c_str(), "rb");
+    if (!in) return;
+    gzFile out = gzopen((path + ".gz").c_str(), "wb");
+    if (!out) {
+        fclose(in);
+        return;
+    }
+
+    char buf[16384];
+    size_t n;
+    bool ok = true;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (gzwrite(out, buf, static_cast<unsigned>(n)) != static_cast<int>(n)) {
+            ok = false;
+            break;
+        }
+    }
+    fclose(in);
+    if (gzclose(out) != Z_OK) ok = false;
+
+    if (ok) {
+        remove(path.c_str());
+    } else {
+        remove((path + ".gz").c_str());
+        LOG_WARN("REC") << "Compressing " << path << " failed, kept uncompressed";
+    }
+#else
+    (void)path;
+#endif
+}
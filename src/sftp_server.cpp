@@ -0,0 +1,623 @@
+// sftp_server.cpp - SFTP subsystem presenting the CP/M drives
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "sftp_server.h"
+#include "cpm_fs.h"
+#include "disk.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+// Packet types (draft-ietf-secsh-filexfer-02, protocol version 3)
+enum : uint8_t {
+    FXP_INIT = 1, FXP_VERSION = 2, FXP_OPEN = 3, FXP_CLOSE = 4, FXP_READ = 5,
+    FXP_WRITE = 6, FXP_LSTAT = 7, FXP_FSTAT = 8, FXP_SETSTAT = 9, FXP_FSETSTAT = 10,
+    FXP_OPENDIR = 11, FXP_READDIR = 12, FXP_REMOVE = 13, FXP_MKDIR = 14,
+    FXP_RMDIR = 15, FXP_REALPATH = 16, FXP_STAT = 17, FXP_RENAME = 18,
+    FXP_STATUS = 101, FXP_HANDLE = 102, FXP_DATA = 103, FXP_NAME = 104, FXP_ATTRS = 105
+};
+
+// Status codes
+enum : uint32_t {
+    FX_OK = 0, FX_EOF = 1, FX_NO_SUCH_FILE = 2, FX_PERMISSION_DENIED = 3,
+    FX_FAILURE = 4, FX_BAD_MESSAGE = 5, FX_OP_UNSUPPORTED = 8
+};
+
+// Attribute flags and open flags
+enum : uint32_t { ATTR_SIZE = 0x01, ATTR_PERMISSIONS = 0x04 };
+enum : uint32_t {
+    FXF_READ = 0x01, FXF_WRITE = 0x02, FXF_APPEND = 0x04,
+    FXF_CREAT = 0x08, FXF_TRUNC = 0x10, FXF_EXCL = 0x20
+};
+
+static constexpr size_t MAX_PACKET = 256 * 1024;
+static constexpr size_t MAX_READ = 32768;
+static constexpr size_t MAX_FILE = 16 * 1024 * 1024;   // Larger than any CP/M disk
+static constexpr size_t MAX_HANDLES = 16;               // Each file handle buffers its data
+
+bool parse_sftp_access(const char* name, SftpAccess& access) {
+    std::string n = name;
+    if (n == "off") {
+        access = SftpAccess::OFF;
+    } else if (n == "ro") {
+        access = SftpAccess::READ_ONLY;
+    } else if (n == "rw") {
+        access = SftpAccess::READ_WRITE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// Big-endian request reader; ok() goes false on a short packet
+class PacketReader {
+public:
+    PacketReader(const uint8_t* p, size_t len) : p_(p), len_(len), pos_(0), ok_(true) {}
+
+    bool ok() const { return ok_; }
+
+    uint32_t u32() {
+        if (!need(4)) return 0;
+        uint32_t v = (p_[pos_] << 24) | (p_[pos_ + 1] << 16) | (p_[pos_ + 2] << 8) | p_[pos_ + 3];
+        pos_ += 4;
+        return v;
+    }
+
+    uint64_t u64() {
+        uint64_t hi = u32();
+        return (hi << 32) | u32();
+    }
+
+    std::string str() {
+        uint32_t n = u32();
+        if (!need(n)) return "";
+        std::string s(reinterpret_cast<const char*>(p_ + pos_), n);
+        pos_ += n;
+        return s;
+    }
+
+private:
+    bool need(size_t n) {
+        if (ok_ && len_ - pos_ >= n) return true;
+        ok_ = false;
+        return false;
+    }
+
+    const uint8_t* p_;
+    size_t len_;
+    size_t pos_;
+    bool ok_;
+};
+
+static uint32_t status_for(CpmFs::Result r) {
+    switch (r) {
+        case CpmFs::Result::OK:        return FX_OK;
+        case CpmFs::Result::NOT_FOUND: return FX_NO_SUCH_FILE;
+        case CpmFs::Result::READ_ONLY: return FX_PERMISSION_DENIED;
+        case CpmFs::Result::IN_USE:    return FX_PERMISSION_DENIED;
+        default:                       return FX_FAILURE;
+    }
+}
+
+SftpServer::SftpServer(bool writable)
+    : writable_(writable)
+    , next_handle_(1)
+{
+}
+
+bool SftpServer::feed(const uint8_t* data, size_t len, std::string& reply) {
+    in_.append(reinterpret_cast<const char*>(data), len);
+
+    while (in_.size() >= 4) {
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(in_.data());
+        size_t plen = (static_cast<size_t>(p[0]) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+        if (plen == 0 || plen > MAX_PACKET) return false;
+        if (in_.size() < 4 + plen) break;
+
+        handle_packet(p + 4, plen, reply);
+        in_.erase(0, 4 + plen);
+    }
+    return true;
+}
+
+void SftpServer::put_u32(std::string& out, uint32_t v) {
+    out += static_cast<char>(v >> 24);
+    out += static_cast<char>(v >> 16);
+    out += static_cast<char>(v >> 8);
+    out += static_cast<char>(v);
+}
+
+void SftpServer::put_u64(std::string& out, uint64_t v) {
+    put_u32(out, static_cast<uint32_t>(v >> 32));
+    put_u32(out, static_cast<uint32_t>(v));
+}
+
+void SftpServer::put_string(std::string& out, const std::string& s) {
+    put_u32(out, static_cast<uint32_t>(s.size()));
+    out += s;
+}
+
+void SftpServer::put_attrs(std::string& out, const Attrs& a) const {
+    if (!a.valid) {
+        put_u32(out, 0);
+        return;
+    }
+    put_u32(out, ATTR_SIZE | ATTR_PERMISSIONS);
+    put_u64(out, a.size);
+    uint32_t mode = a.dir ? 040555 : 0100444;
+    if (!a.read_only) mode |= 0200;
+    put_u32(out, mode);
+}
+
+void SftpServer::send_packet(std::string& reply, uint8_t type, const std::string& body) {
+    put_u32(reply, static_cast<uint32_t>(body.size() + 1));
+    reply += static_cast<char>(type);
+    reply += body;
+}
+
+void SftpServer::send_status(std::string& reply, uint32_t id, uint32_t code,
+                             const std::string& msg) {
+    std::string body;
+    put_u32(body, id);
+    put_u32(body, code);
+    put_string(body, msg);
+    put_string(body, "");
+    send_packet(reply, FXP_STATUS, body);
+}
+
+void SftpServer::send_name(std::string& reply, uint32_t id,
+                           const std::vector<DirEntry>& names) {
+    std::string body;
+    put_u32(body, id);
+    put_u32(body, static_cast<uint32_t>(names.size()));
+    for (const auto& n : names) {
+        put_string(body, n.name);
+
+        // "ls -l" style line for clients that show it verbatim
+        char longname[128];
+        snprintf(longname, sizeof(longname), "%c%s 1 cpm cpm %8llu Jan  1  1980 %s",
+                 n.attrs.dir ? 'd' : '-',
+                 n.attrs.read_only ? "r-xr-xr-x" : "rw-r--r--",
+                 static_cast<unsigned long long>(n.attrs.size), n.name.c_str());
+        put_string(body, n.attrs.valid ? longname : n.name);
+        put_attrs(body, n.attrs);
+    }
+    send_packet(reply, FXP_NAME, body);
+}
+
+SftpServer::Handle* SftpServer::find_handle(const std::string& h) {
+    auto it = handles_.find(h);
+    return it == handles_.end() ? nullptr : &it->second;
+}
+
+bool SftpServer::parse_path(const std::string& in, Path& path) const {
+    // Resolve "." and ".." against the root
+    std::vector<std::string> parts;
+    size_t start = 0;
+    while (start <= in.size()) {
+        size_t end = in.find('/', start);
+        if (end == std::string::npos) end = in.size();
+        std::string part = in.substr(start, end - start);
+        if (part == "..") {
+            if (!parts.empty()) parts.pop_back();
+        } else if (!part.empty() && part != ".") {
+            parts.push_back(part);
+        }
+        start = end + 1;
+    }
+    if (parts.size() > 3) return false;
+
+    path = Path();
+    path.depth = static_cast<int>(parts.size());
+    if (path.depth >= 1) {
+        // "A" or "A:"
+        const std::string& d = parts[0];
+        if (d.empty() || d.size() > 2 || (d.size() == 2 && d[1] != ':')) return false;
+        int drive = std::toupper(static_cast<unsigned char>(d[0])) - 'A';
+        Disk* disk = DiskSystem::instance().get(drive);
+        if (!disk || !disk->is_open()) return false;
+        path.drive = drive;
+    }
+    if (path.depth >= 2) {
+        char* end;
+        long user = std::strtol(parts[1].c_str(), &end, 10);
+        if (parts[1].empty() || *end != '\0' || user < 0 || user > 15) return false;
+        path.user = static_cast<uint8_t>(user);
+    }
+    if (path.depth == 3) {
+        path.name = parts[2];
+        std::transform(path.name.begin(), path.name.end(), path.name.begin(),
+                       [](unsigned char c) { return static_cast<char>(std::toupper(c)); });
+    }
+    return true;
+}
+
+std::string SftpServer::path_string(const Path& path) {
+    std::string s;
+    if (path.depth >= 1) s += "/" + std::string(1, static_cast<char>('A' + path.drive));
+    if (path.depth >= 2) s += "/" + std::to_string(path.user);
+    if (path.depth >= 3) s += "/" + path.name;
+    return s.empty() ? "/" : s;
+}
+
+bool SftpServer::lookup(const Path& path, Attrs& attrs) {
+    attrs = Attrs();
+    attrs.valid = true;
+    Disk* disk = path.depth >= 1 ? DiskSystem::instance().get(path.drive) : nullptr;
+    attrs.read_only = !writable_ || (disk && (disk->is_read_only() || disk->guest_logged_in()));
+
+    if (path.depth < 3) {
+        attrs.dir = true;
+        return true;
+    }
+
+    CpmFileInfo info;
+    if (CpmFs(disk).stat(path.user, path.name, info) != CpmFs::Result::OK) return false;
+    attrs.size = info.size;
+    attrs.read_only = attrs.read_only || info.read_only;
+    return true;
+}
+
+void SftpServer::handle_packet(const uint8_t* p, size_t len, std::string& reply) {
+    uint8_t type = p[0];
+    PacketReader r(p + 1, len - 1);
+
+    if (type == FXP_INIT) {
+        std::string body;
+        put_u32(body, 3);
+        send_packet(reply, FXP_VERSION, body);
+        return;
+    }
+
+    uint32_t id = r.u32();
+    switch (type) {
+        case FXP_REALPATH: {
+            std::string p_in = r.str();
+            Path path;
+            if (!r.ok()) break;
+            if (!parse_path(p_in, path)) {
+                send_status(reply, id, FX_NO_SUCH_FILE, "No such file");
+                return;
+            }
+            DirEntry e;
+            e.name = path_string(path);
+            send_name(reply, id, {e});
+            return;
+        }
+
+        case FXP_STAT:
+        case FXP_LSTAT: {
+            std::string p_in = r.str();
+            if (!r.ok()) break;
+            Path path;
+            Attrs attrs;
+            if (!parse_path(p_in, path) || !lookup(path, attrs)) {
+                send_status(reply, id, FX_NO_SUCH_FILE, "No such file");
+                return;
+            }
+            std::string body;
+            put_u32(body, id);
+            put_attrs(body, attrs);
+            send_packet(reply, FXP_ATTRS, body);
+            return;
+        }
+
+        case FXP_FSTAT: {
+            Handle* h = find_handle(r.str());
+            if (!r.ok()) break;
+            if (!h) {
+                send_status(reply, id, FX_FAILURE, "Invalid handle");
+                return;
+            }
+            Attrs attrs;
+            attrs.valid = true;
+            attrs.dir = h->dir;
+            attrs.read_only = !h->write;
+            attrs.size = h->data.size();
+            std::string body;
+            put_u32(body, id);
+            put_attrs(body, attrs);
+            send_packet(reply, FXP_ATTRS, body);
+            return;
+        }
+
+        case FXP_OPEN: {
+            std::string p_in = r.str();
+            uint32_t pflags = r.u32();
+            if (!r.ok()) break;
+            do_open(id, p_in, pflags, reply);
+            return;
+        }
+
+        case FXP_CLOSE: {
+            std::string h = r.str();
+            if (!r.ok()) break;
+            do_close(id, h, reply);
+            return;
+        }
+
+        case FXP_READ: {
+            Handle* h = find_handle(r.str());
+            uint64_t offset = r.u64();
+            uint32_t want = r.u32();
+            if (!r.ok()) break;
+            if (!h || h->dir) {
+                send_status(reply, id, FX_FAILURE, "Invalid handle");
+                return;
+            }
+            if (offset >= h->data.size()) {
+                send_status(reply, id, FX_EOF, "End of file");
+                return;
+            }
+            size_t n = std::min<uint64_t>({want, h->data.size() - offset, MAX_READ});
+            std::string body;
+            put_u32(body, id);
+            put_string(body, std::string(reinterpret_cast<const char*>(&h->data[offset]), n));
+            send_packet(reply, FXP_DATA, body);
+            return;
+        }
+
+        case FXP_WRITE: {
+            Handle* h = find_handle(r.str());
+            uint64_t offset = r.u64();
+            std::string data = r.str();
+            if (!r.ok()) break;
+            if (!h || h->dir) {
+                send_status(reply, id, FX_FAILURE, "Invalid handle");
+                return;
+            }
+            if (!h->write) {
+                send_status(reply, id, FX_PERMISSION_DENIED, "Not open for writing");
+                return;
+            }
+            // Written so a client-chosen offset cannot wrap
+            if (offset > MAX_FILE || data.size() > MAX_FILE - offset) {
+                send_status(reply, id, FX_FAILURE, "File too large");
+                return;
+            }
+            if (h->data.size() < offset + data.size()) h->data.resize(offset + data.size());
+            std::memcpy(&h->data[offset], data.data(), data.size());
+            h->dirty = true;
+            send_status(reply, id, FX_OK, "");
+            return;
+        }
+
+        case FXP_OPENDIR: {
+            std::string p_in = r.str();
+            if (!r.ok()) break;
+            do_opendir(id, p_in, reply);
+            return;
+        }
+
+        case FXP_READDIR: {
+            std::string h = r.str();
+            if (!r.ok()) break;
+            do_readdir(id, h, reply);
+            return;
+        }
+
+        case FXP_REMOVE: {
+            std::string p_in = r.str();
+            if (!r.ok()) break;
+            Path path;
+            if (!parse_path(p_in, path) || path.depth != 3) {
+                send_status(reply, id, FX_NO_SUCH_FILE, "No such file");
+                return;
+            }
+            if (!writable_) {
+                send_status(reply, id, FX_PERMISSION_DENIED, "Read-only access");
+                return;
+            }
+            CpmFs::Result res = CpmFs(DiskSystem::instance().get(path.drive))
+                                    .remove(path.user, path.name);
+            send_status(reply, id, status_for(res), CpmFs::result_string(res));
+            return;
+        }
+
+        case FXP_RENAME: {
+            std::string from_in = r.str();
+            std::string to_in = r.str();
+            if (!r.ok()) break;
+            Path from, to;
+            if (!parse_path(from_in, from) || from.depth != 3) {
+                send_status(reply, id, FX_NO_SUCH_FILE, "No such file");
+                return;
+            }
+            if (!parse_path(to_in, to) || to.depth != 3 ||
+                to.drive != from.drive || to.user != from.user) {
+                send_status(reply, id, FX_OP_UNSUPPORTED,
+                            "Rename only within one drive and user area");
+                return;
+            }
+            if (!writable_) {
+                send_status(reply, id, FX_PERMISSION_DENIED, "Read-only access");
+                return;
+            }
+            CpmFs::Result res = CpmFs(DiskSystem::instance().get(from.drive))
+                                    .rename(from.user, from.name, to.name);
+            send_status(reply, id, status_for(res), CpmFs::result_string(res));
+            return;
+        }
+
+        case FXP_SETSTAT:
+        case FXP_FSETSTAT:
+            // Nothing to set on CP/M - accept so uploads don't fail
+            send_status(reply, id, FX_OK, "");
+            return;
+
+        case FXP_MKDIR:
+        case FXP_RMDIR:
+            send_status(reply, id, FX_OP_UNSUPPORTED, "CP/M has no directories");
+            return;
+
+        default:
+            send_status(reply, id, FX_OP_UNSUPPORTED, "Unsupported request");
+            return;
+    }
+
+    send_status(reply, id, FX_BAD_MESSAGE, "Malformed request");
+}
+
+void SftpServer::do_open(uint32_t id, const std::string& p, uint32_t pflags,
+                         std::string& reply) {
+    Path path;
+    if (!parse_path(p, path) || path.depth != 3) {
+        send_status(reply, id, FX_NO_SUCH_FILE, "No such file");
+        return;
+    }
+    if (handles_.size() >= MAX_HANDLES) {
+        send_status(reply, id, FX_FAILURE, "Too many open handles");
+        return;
+    }
+
+    Disk* disk = DiskSystem::instance().get(path.drive);
+    bool want_write = (pflags & (FXF_WRITE | FXF_APPEND | FXF_CREAT | FXF_TRUNC)) != 0;
+    if (want_write && (!writable_ || disk->is_read_only())) {
+        send_status(reply, id, FX_PERMISSION_DENIED, "Read-only access");
+        return;
+    }
+    if (want_write && disk->guest_logged_in()) {
+        send_status(reply, id, FX_PERMISSION_DENIED,
+                    CpmFs::result_string(CpmFs::Result::IN_USE));
+        return;
+    }
+
+    Handle h;
+    h.drive = path.drive;
+    h.user = path.user;
+    h.name = path.name;
+    h.write = want_write;
+
+    CpmFs fs(disk);
+    CpmFs::Result res = fs.read_file(path.user, path.name, h.data);
+    if (res == CpmFs::Result::NOT_FOUND && (pflags & FXF_CREAT)) {
+        uint8_t fcb[11];
+        if (!CpmFs::make_name(path.name, fcb)) {
+            send_status(reply, id, FX_FAILURE, CpmFs::result_string(CpmFs::Result::BAD_NAME));
+            return;
+        }
+        h.dirty = true;  // Created on close, even if empty
+    } else if (res != CpmFs::Result::OK) {
+        send_status(reply, id, status_for(res), CpmFs::result_string(res));
+        return;
+    } else if (want_write) {
+        if ((pflags & FXF_CREAT) && (pflags & FXF_EXCL)) {
+            send_status(reply, id, FX_FAILURE, "File exists");
+            return;
+        }
+        CpmFileInfo info;
+        if (fs.stat(path.user, path.name, info) == CpmFs::Result::OK && info.read_only) {
+            send_status(reply, id, FX_PERMISSION_DENIED, "File is read-only");
+            return;
+        }
+        if (pflags & FXF_TRUNC) {
+            h.data.clear();
+            h.dirty = true;
+        }
+    }
+
+    std::string handle = std::to_string(next_handle_++);
+    handles_[handle] = std::move(h);
+    std::string body;
+    put_u32(body, id);
+    put_string(body, handle);
+    send_packet(reply, FXP_HANDLE, body);
+}
+
+void SftpServer::do_opendir(uint32_t id, const std::string& p, std::string& reply) {
+    Path path;
+    if (!parse_path(p, path) || path.depth > 2) {
+        send_status(reply, id, FX_NO_SUCH_FILE, "No such directory");
+        return;
+    }
+    if (handles_.size() >= MAX_HANDLES) {
+        send_status(reply, id, FX_FAILURE, "Too many open handles");
+        return;
+    }
+
+    Handle h;
+    h.dir = true;
+    Attrs dir_attrs;
+    lookup(path, dir_attrs);
+
+    if (path.depth == 0) {
+        // Mounted drives
+        for (int d = 0; d < DiskSystem::MAX_DISKS; d++) {
+            Disk* disk = DiskSystem::instance().get(d);
+            if (!disk || !disk->is_open()) continue;
+            DirEntry e;
+            e.name = std::string(1, static_cast<char>('A' + d));
+            e.attrs = dir_attrs;
+            e.attrs.read_only = !writable_ || disk->is_read_only() || disk->guest_logged_in();
+            h.entries.push_back(e);
+        }
+    } else if (path.depth == 1) {
+        // User areas
+        for (int u = 0; u <= 15; u++) {
+            DirEntry e;
+            e.name = std::to_string(u);
+            e.attrs = dir_attrs;
+            h.entries.push_back(e);
+        }
+    } else {
+        std::vector<CpmFileInfo> files;
+        CpmFs::Result res = CpmFs(DiskSystem::instance().get(path.drive)).list(files);
+        if (res != CpmFs::Result::OK) {
+            send_status(reply, id, status_for(res), CpmFs::result_string(res));
+            return;
+        }
+        for (const auto& f : files) {
+            if (f.user != path.user) continue;
+            DirEntry e;
+            e.name = f.name;
+            e.attrs.valid = true;
+            e.attrs.size = f.size;
+            e.attrs.read_only = dir_attrs.read_only || f.read_only;
+            h.entries.push_back(e);
+        }
+    }
+
+    std::string handle = std::to_string(next_handle_++);
+    handles_[handle] = std::move(h);
+    std::string body;
+    put_u32(body, id);
+    put_string(body, handle);
+    send_packet(reply, FXP_HANDLE, body);
+}
+
+void SftpServer::do_readdir(uint32_t id, const std::string& handle, std::string& reply) {
+    Handle* h = find_handle(handle);
+    if (!h || !h->dir) {
+        send_status(reply, id, FX_FAILURE, "Invalid handle");
+        return;
+    }
+    if (h->pos >= h->entries.size()) {
+        send_status(reply, id, FX_EOF, "End of directory");
+        return;
+    }
+
+    size_t n = std::min<size_t>(64, h->entries.size() - h->pos);
+    std::vector<DirEntry> batch(h->entries.begin() + h->pos, h->entries.begin() + h->pos + n);
+    h->pos += n;
+    send_name(reply, id, batch);
+}
+
+void SftpServer::do_close(uint32_t id, const std::string& handle, std::string& reply) {
+    Handle* h = find_handle(handle);
+    if (!h) {
+        send_status(reply, id, FX_FAILURE, "Invalid handle");
+        return;
+    }
+
+    CpmFs::Result res = CpmFs::Result::OK;
+    if (!h->dir && h->dirty) {
+        res = CpmFs(DiskSystem::instance().get(h->drive)).write_file(h->user, h->name, h->data);
+    }
+    handles_.erase(handle);
+    send_status(reply, id, status_for(res),
+                res == CpmFs::Result::OK ? "" : CpmFs::result_string(res));
+}
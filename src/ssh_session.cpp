@@ -6,24 +6,36 @@
 
 #include "ssh_session.h"
 #include "console.h"
+#include "session_recorder.h"
+#include "log.h"
 
+#include <wolfssl/options.h>
+#include <wolfssl/wolfcrypt/sha256.h>
 #include <wolfssh/ssh.h>
 
 #include <sys/socket.h>
 #include <sys/select.h>
+#include <poll.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <cctype>
+#include <cstdio>
 #include <cstring>
 #include <fstream>
 #include <algorithm>
-#include <iostream>
+#include <chrono>
 
 // SSHSession implementation
 
-SSHSession::SSHSession(int console_id, WOLFSSH* ssh, int fd)
+SSHSession::SSHSession(int console_id, WOLFSSH* ssh, int fd, Mode mode,
+                       const std::string& command)
     : console_id_(console_id)
+    , mode_(mode)
+    , command_(command)
+    , sftp_writable_(false)
+    , recording_(false)
     , ssh_(ssh)
     , fd_(fd)
     , running_(false)
@@ -60,29 +72,121 @@ void SSHSession::join() {
     }
 }
 
+bool SSHSession::send_all(const uint8_t* data, size_t len) {
+    size_t sent = 0;
+    while (sent < len && !stop_requested_.load()) {
+        int n = wolfSSH_stream_send(ssh_, const_cast<byte*>(data + sent), len - sent);
+        if (n > 0) {
+            if (recording_) SessionRecorder::instance().output(console_id_, data + sent, n);
+            sent += n;
+            continue;
+        }
+        int err = wolfSSH_get_error(ssh_);
+        if (n != WS_WANT_WRITE && err != WS_WANT_WRITE && err != WS_WANT_READ) {
+            return false;
+        }
+        // Window full - wait for the socket to drain
+        fd_set wfds;
+        FD_ZERO(&wfds);
+        FD_SET(fd_, &wfds);
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 10000;
+        select(fd_ + 1, nullptr, &wfds, nullptr, &tv);
+    }
+    return sent == len;
+}
+
 void SSHSession::thread_func() {
+    if (mode_ == Mode::SFTP) {
+        sftp_loop();
+        running_.store(false);
+        return;
+    }
+
     Console* con = ConsoleManager::instance().get(console_id_);
     if (!con) {
         running_.store(false);
         return;
     }
 
-    con->set_connected(true);
+    if (mode_ == Mode::VIEW) {
+        view_loop(con);
+        running_.store(false);
+        return;
+    }
+
+    // Record what the owner of the console sees
+    SessionRecorder& recorder = SessionRecorder::instance();
+    recording_ = recorder.enabled();
+    if (recording_) {
+        recorder.begin(console_id_, con->term_width(), con->term_height(),
+                       con->owner(), con->term_type());
+    }
+
+    if (mode_ == Mode::EXEC) {
+        int status = exec_loop(con);
+        if (recording_) recorder.end(console_id_);
+        if (status >= 0) {
+            // Finished at the prompt - the console is clean for the next user
+            wolfSSH_stream_exit(ssh_, status);
+            con->reset();
+        } else if (ConsoleManager::instance().detach_timeout() > 0 &&
+                   !con->key().empty()) {
+            con->detach();  // Command still running, keep it for the user
+        } else {
+            con->reset();
+        }
+        running_.store(false);
+        return;
+    }
+
+    // accept_loop() has already attached the console to this user
+    std::vector<uint8_t> replay;
+    con->take_scrollback(replay);
 
     // Send banner
     char banner[128];
     snprintf(banner, sizeof(banner),
-             "\r\nMP/M II Console %d\r\n\r\n", console_id_);
+             mode_ == Mode::REATTACH ? "\r\nMP/M II Console %d (reattached)\r\n\r\n"
+                                     : "\r\nMP/M II Console %d\r\n\r\n", console_id_);
     wolfSSH_stream_send(ssh_, reinterpret_cast<byte*>(banner), strlen(banner));
 
     uint8_t buf[256];
 
+    // With a screen model, output is coalesced into frames at a bounded rate
+    ScreenModel* screen = con->screen_model();
+    std::string frame;
+    auto frame_interval = std::chrono::milliseconds(
+        screen ? 1000 / std::max(1, con->screen_fps()) : 0);
+    auto next_frame = std::chrono::steady_clock::now();
+
+    // Otherwise guest terminal codes are rewritten for the client terminal
+    OutputTranslator& translator = con->output_translator();
+    translator.set_client(con->term_type());
+    std::string translated;
+
+    // Replay what the guest printed while we were away. The screen model
+    // absorbs it and redraws the whole screen; raw output is resent.
+    if (screen) {
+        screen->feed(replay.data(), replay.size());
+        screen->invalidate();
+    } else if (!replay.empty()) {
+        translated.clear();
+        translator.translate(replay.data(), replay.size(), translated);
+        send_all(reinterpret_cast<const uint8_t*>(translated.data()), translated.size());
+    }
+
     while (!stop_requested_.load()) {
         fd_set rfds, wfds;
         FD_ZERO(&rfds);
         FD_ZERO(&wfds);
 
-        FD_SET(fd_, &rfds);
+        // Stop reading while a paste backlog is waiting - the unread data
+        // stays in the SSH window and the client pauses
+        if (!con->input_backlogged()) {
+            FD_SET(fd_, &rfds);
+        }
 
         // Check if we have output to send
         if (con->output_queue().available() > 0) {
@@ -96,6 +200,9 @@ void SSHSession::thread_func() {
         int ret = select(fd_ + 1, &rfds, &wfds, nullptr, &tv);
         if (ret < 0) break;
 
+        // Top up the input queue as the guest reads CONIN
+        con->feed_input();
+
         // Read from SSH -> input queue
         if (FD_ISSET(fd_, &rfds)) {
             int n = wolfSSH_stream_read(ssh_, buf, sizeof(buf));
@@ -112,32 +219,313 @@ void SSHSession::thread_func() {
 
             // Queue characters for MP/M
             for (int i = 0; i < n; i++) {
-                uint8_t ch = buf[i];
                 // Convert LF to CR for CP/M compatibility
-                if (ch == '\n') ch = '\r';
-                con->input_queue().try_write(ch);
+                if (buf[i] == '\n') buf[i] = '\r';
             }
+            con->stage_input(buf, n);
+            con->feed_input();
+            if (recording_) SessionRecorder::instance().input(console_id_, buf, n);
         }
 
         // Write from output queue -> SSH
-        if (FD_ISSET(fd_, &wfds)) {
+        if (screen) {
+            // Interpret everything queued, send at most one frame per interval
+            size_t count;
+            while ((count = con->output_queue().read_some(buf, sizeof(buf))) > 0) {
+                con->broadcast().publish(buf, count);
+                screen->feed(buf, count);
+            }
+            auto now = std::chrono::steady_clock::now();
+            if (screen->dirty() && now >= next_frame) {
+                frame.clear();
+                if (screen->render_diff(frame) &&
+                    !send_all(reinterpret_cast<const uint8_t*>(frame.data()), frame.size())) {
+                    break;
+                }
+                next_frame = now + frame_interval;
+            }
+        } else if (FD_ISSET(fd_, &wfds)) {
             size_t count = con->output_queue().read_some(buf, sizeof(buf));
             if (count > 0) {
-                wolfSSH_stream_send(ssh_, buf, count);
+                con->broadcast().publish(buf, count);
+                bool ok;
+                if (translator.active()) {
+                    translated.clear();
+                    translator.translate(buf, count, translated);
+                    ok = send_all(reinterpret_cast<const uint8_t*>(translated.data()),
+                                  translated.size());
+                } else {
+                    ok = send_all(buf, count);
+                }
+                if (!ok) break;
             }
         }
     }
 
-    con->reset();
+    if (recording_) recorder.end(console_id_);
+
+    // Keep the console (and the program running on it) for the owner
+    // unless persistence is off or nothing ties a later login to this one
+    if (ConsoleManager::instance().detach_timeout() > 0 && !con->key().empty()) {
+        LOG_INFO("SSH") << "Console " << console_id_ << " detached (user "
+                        << con->owner() << ")";
+        con->detach();
+    } else {
+        con->reset();
+    }
     running_.store(false);
 }
 
+// Read-only viewer: mirror the console's output, ignore keyboard input
+void SSHSession::view_loop(Console* con) {
+    char banner[128];
+    snprintf(banner, sizeof(banner),
+             "\r\nMP/M II Console %d (read-only view)\r\n\r\n", console_id_);
+    wolfSSH_stream_send(ssh_, reinterpret_cast<byte*>(banner), strlen(banner));
+
+    // Own translator: the guest codes match the console, the client may not
+    OutputTranslator translator;
+    translator.set_guest(con->output_translator().guest());
+    translator.set_parity(con->output_translator().parity());
+    translator.set_client(con->term_type());
+    std::string translated;
+
+    OutputBroadcast& bc = con->broadcast();
+    uint64_t seq = bc.subscribe();
+    uint8_t buf[256];
+
+    while (!stop_requested_.load()) {
+        // Drain (and discard) client input, notice disconnects
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(fd_, &rfds);
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 0;
+        if (select(fd_ + 1, &rfds, nullptr, nullptr, &tv) > 0) {
+            int n = wolfSSH_stream_read(ssh_, buf, sizeof(buf));
+            if (n <= 0) {
+                int err = wolfSSH_get_error(ssh_);
+                if (err == WS_EOF || n == WS_EOF) break;
+                if (err != WS_WANT_READ && err != WS_WANT_WRITE) break;
+            }
+        }
+
+        OutputBroadcast::Chunk chunk;
+        OutputBroadcast::Fetch f = bc.fetch(seq, chunk, 10);
+        if (f == OutputBroadcast::Fetch::EMPTY) continue;
+        if (f == OutputBroadcast::Fetch::LAGGED) {
+            static const char msg[] = "\r\n[Viewer too slow - disconnected]\r\n";
+            send_all(reinterpret_cast<const uint8_t*>(msg), sizeof(msg) - 1);
+            LOG_WARN("SSH") << "Dropped lagging viewer of console " << console_id_;
+            break;
+        }
+
+        translated.clear();
+        translator.translate(chunk->data(), chunk->size(), translated);
+        if (!send_all(reinterpret_cast<const uint8_t*>(translated.data()),
+                      translated.size())) {
+            break;
+        }
+    }
+
+    bc.unsubscribe();
+}
+
+// SFTP subsystem: relay the channel through the protocol handler
+void SSHSession::sftp_loop() {
+    SftpServer sftp(sftp_writable_);
+    uint8_t buf[4096];
+    std::string reply;
+
+    while (!stop_requested_.load()) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        FD_SET(fd_, &rfds);
+
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 10000;  // 10ms timeout
+
+        int ret = select(fd_ + 1, &rfds, nullptr, nullptr, &tv);
+        if (ret < 0) break;
+        if (ret == 0) continue;
+
+        int n = wolfSSH_stream_read(ssh_, buf, sizeof(buf));
+        if (n <= 0) {
+            int err = wolfSSH_get_error(ssh_);
+            if (err == WS_EOF || n == WS_EOF) {
+                break;  // Client disconnected
+            }
+            if (err != WS_WANT_READ && err != WS_WANT_WRITE) {
+                break;  // Error
+            }
+            continue;
+        }
+
+        reply.clear();
+        if (!sftp.feed(buf, n, reply)) {
+            LOG_WARN("SFTP") << "Malformed packet, closing";
+            break;
+        }
+        if (!reply.empty() &&
+            !send_all(reinterpret_cast<const uint8_t*>(reply.data()), reply.size())) {
+            break;
+        }
+    }
+}
+
+// CCP prompt line: optional user number, drive letter, '>' ("A>", "0A>",
+// "15B>"). With partial, also true for a line that could still become one.
+static bool is_prompt(const std::string& line, bool partial) {
+    size_t i = 0;
+    while (i < line.size() && i < 2 && line[i] >= '0' && line[i] <= '9') i++;
+    if (i == line.size()) return partial;
+    if (line[i] < 'A' || line[i] > 'P') return false;
+    if (++i == line.size()) return partial;
+    return line[i] == '>' && i + 1 == line.size();
+}
+
+// Batch command: wait for the CCP prompt, type the command, stream its
+// output until the prompt comes back and the console goes quiet.
+// CP/M programs have no exit code, so the status is inferred from the
+// output: 127 if the CCP did not know the command, 1 after a BDOS error.
+int SSHSession::exec_loop(Console* con) {
+    enum class Phase { PROMPT, ECHO, RUN };
+    const auto quiet = std::chrono::milliseconds(300);
+    const auto prompt_timeout = std::chrono::seconds(30);
+
+    std::string cmd = command_.substr(0, 127);  // CCP line buffer size
+    Phase phase = Phase::PROMPT;
+    std::string line;           // Current output line (CR dropped)
+    size_t line_sent = 0;       // Part of line already sent
+    std::string out;
+    std::string first_line;
+    bool first_done = false;
+    bool bdos_error = false;
+    bool stdin_open = true;
+    uint8_t buf[256];
+
+    // Ask for a fresh prompt to type at
+    static const uint8_t cr = '\r';
+    con->put_input(&cr, 1);
+    auto start = std::chrono::steady_clock::now();
+    auto last_output = start;
+
+    while (!stop_requested_.load()) {
+        fd_set rfds;
+        FD_ZERO(&rfds);
+        bool reading = phase == Phase::RUN && stdin_open && !con->input_backlogged();
+        if (reading) FD_SET(fd_, &rfds);
+
+        struct timeval tv;
+        tv.tv_sec = 0;
+        tv.tv_usec = 10000;  // 10ms timeout
+
+        int ret = select(fd_ + 1, &rfds, nullptr, nullptr, &tv);
+        if (ret < 0) return -1;
+
+        // Client stdin -> program, once the command is running
+        if (reading && FD_ISSET(fd_, &rfds)) {
+            int n = wolfSSH_stream_read(ssh_, buf, sizeof(buf));
+            if (n > 0) {
+                for (int i = 0; i < n; i++) {
+                    if (buf[i] == '\n') buf[i] = '\r';
+                }
+                con->stage_input(buf, n);
+                if (recording_) SessionRecorder::instance().input(console_id_, buf, n);
+            } else {
+                int err = wolfSSH_get_error(ssh_);
+                if (err == WS_EOF || n == WS_EOF) {
+                    stdin_open = false;  // End of input, not of the session
+                } else if (err != WS_WANT_READ && err != WS_WANT_WRITE) {
+                    return -1;
+                }
+            }
+        }
+
+        con->feed_input();
+
+        // Console output -> client, line by line
+        auto now = std::chrono::steady_clock::now();
+        size_t count;
+        while ((count = con->output_queue().read_some(buf, sizeof(buf))) > 0) {
+            con->broadcast().publish(buf, count);
+            last_output = now;
+            for (size_t i = 0; i < count; i++) {
+                char c = static_cast<char>(buf[i] & 0x7F);
+                if (c == '\r' || c == '\0') continue;
+                if (c != '\n') {
+                    line += c;
+                    continue;
+                }
+                if (phase == Phase::RUN) {
+                    out.append(line, line_sent, std::string::npos);
+                    out += '\n';
+                    if (!first_done) {
+                        first_line = line;
+                        first_done = true;
+                    }
+                    if (line.find("Bdos Err") != std::string::npos) bdos_error = true;
+                } else if (phase == Phase::ECHO) {
+                    phase = Phase::RUN;  // That was our command line
+                }
+                line.clear();
+                line_sent = 0;
+            }
+        }
+
+        // Send partial lines too, unless they may be the closing prompt
+        if (phase == Phase::RUN && !is_prompt(line, true)) {
+            out.append(line, line_sent, std::string::npos);
+            line_sent = line.size();
+        }
+        if (!out.empty()) {
+            if (!send_all(reinterpret_cast<const uint8_t*>(out.data()), out.size())) {
+                return -1;
+            }
+            out.clear();
+        }
+
+        bool at_prompt = is_prompt(line, false) && now - last_output >= quiet;
+        if (phase == Phase::PROMPT) {
+            if (at_prompt) {
+                cmd += '\r';
+                con->put_input(reinterpret_cast<const uint8_t*>(cmd.data()), cmd.size());
+                phase = Phase::ECHO;
+                line.clear();
+            } else if (now - start >= prompt_timeout) {
+                static const char msg[] = "No CCP prompt on console - command not run\n";
+                send_all(reinterpret_cast<const uint8_t*>(msg), sizeof(msg) - 1);
+                return 255;
+            }
+        } else if (phase == Phase::RUN && at_prompt &&
+                   con->input_queue().available() == 0 && con->staged_input() == 0) {
+            break;
+        }
+    }
+    if (stop_requested_.load()) return -1;
+
+    // The CCP answers an unknown command with "NAME?"
+    std::string name = cmd.substr(0, cmd.find_first_of(" \r"));
+    std::transform(name.begin(), name.end(), name.begin(),
+                   [](unsigned char c) { return static_cast<char>(toupper(c)); });
+    while (!first_line.empty() && first_line.back() == ' ') first_line.pop_back();
+    if (first_line == name + "?") return 127;
+    return bdos_error ? 1 : 0;
+}
+
 // SSHServer implementation
 
 SSHServer::SSHServer()
     : ctx_(nullptr)
-    , listen_fd_(-1)
     , port_(0)
+    , acceptors_(1)
+    , queue_limit_(32)
+    , admit_interval_(0)
+    , allow_shadow_(false)
+    , sftp_access_(SftpAccess::OFF)
+    , handshakes_(0)
     , running_(false)
     , stop_requested_(false)
 {
@@ -153,11 +541,18 @@ SSHServer::~SSHServer() {
     }
     sessions_.clear();
 
+    for (auto& w : waiting_) {
+        wolfSSH_free(w.ssh);
+        close(w.fd);
+    }
+    waiting_.clear();
+
     if (ctx_) {
         wolfSSH_CTX_free(ctx_);
     }
-    if (listen_fd_ >= 0) {
-        close(listen_fd_);
+    for (auto& l : listeners_) {
+        if (l.fd4 >= 0) close(l.fd4);
+        if (l.fd6 >= 0) close(l.fd6);
     }
 
     wolfSSH_Cleanup();
@@ -167,21 +562,21 @@ bool SSHServer::init(const std::string& host_key_path,
                      const std::string& /* authorized_keys_path */) {
     // Initialize wolfSSH
     if (wolfSSH_Init() != WS_SUCCESS) {
-        std::cerr << "wolfSSH_Init failed\n";
+        LOG_ERROR("SSH") << "wolfSSH_Init failed";
         return false;
     }
 
     // Create context
     ctx_ = wolfSSH_CTX_new(WOLFSSH_ENDPOINT_SERVER, nullptr);
     if (!ctx_) {
-        std::cerr << "wolfSSH_CTX_new failed\n";
+        LOG_ERROR("SSH") << "wolfSSH_CTX_new failed";
         return false;
     }
 
     // Load host key
     std::ifstream key_file(host_key_path, std::ios::binary);
     if (!key_file) {
-        std::cerr << "Cannot open key file: " << host_key_path << "\n";
+        LOG_ERROR("SSH") << "Cannot open key file: " << host_key_path;
         return false;
     }
 
@@ -199,7 +594,7 @@ bool SSHServer::init(const std::string& host_key_path,
         ret = wolfSSH_CTX_UsePrivateKey_buffer(ctx_, key_data.data(), key_size,
                                                 WOLFSSH_FORMAT_PEM);
         if (ret != WS_SUCCESS) {
-            std::cerr << "wolfSSH_CTX_UsePrivateKey_buffer failed: " << ret << "\n";
+            LOG_ERROR("SSH") << "wolfSSH_CTX_UsePrivateKey_buffer failed: " << ret;
             return false;
         }
     }
@@ -207,118 +602,439 @@ bool SSHServer::init(const std::string& host_key_path,
     // Set up authentication callback
     wolfSSH_SetUserAuth(ctx_, user_auth_callback);
 
-    // Set up channel shell request callback
+    // Set up channel shell and exec request callbacks
     wolfSSH_CTX_SetChannelReqShellCb(ctx_, channel_shell_callback);
+    wolfSSH_CTX_SetChannelReqExecCb(ctx_, channel_exec_callback);
+    wolfSSH_CTX_SetChannelReqSubsysCb(ctx_, channel_subsys_callback);
 
     return true;
 }
 
-bool SSHServer::listen(int port) {
-    port_ = port;
-
-    listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
-    if (listen_fd_ < 0) {
-        return false;
+int SSHServer::open_listener(int family, int port) {
+    int fd = socket(family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
     }
 
+    // Every acceptor binds the same port; the kernel spreads connections
     int opt = 1;
-    setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    struct sockaddr_in addr;
-    memset(&addr, 0, sizeof(addr));
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = INADDR_ANY;
-    addr.sin_port = htons(port);
-
-    if (bind(listen_fd_, reinterpret_cast<struct sockaddr*>(&addr),
-             sizeof(addr)) < 0) {
-        close(listen_fd_);
-        listen_fd_ = -1;
-        return false;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+
+    int ret;
+    if (family == AF_INET6) {
+        // Separate IPv4 socket, so this one must not claim v4-mapped addresses
+        setsockopt(fd, IPPROTO_IPV6, IPV6_V6ONLY, &opt, sizeof(opt));
+
+        struct sockaddr_in6 addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin6_family = AF_INET6;
+        addr.sin6_addr = in6addr_any;
+        addr.sin6_port = htons(port);
+        ret = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
+    } else {
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = INADDR_ANY;
+        addr.sin_port = htons(port);
+        ret = bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr));
     }
 
-    if (::listen(listen_fd_, 5) < 0) {
-        close(listen_fd_);
-        listen_fd_ = -1;
-        return false;
+    if (ret < 0 || ::listen(fd, SOMAXCONN) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+bool SSHServer::listen(int port) {
+    port_ = port;
+
+    for (int i = 0; i < acceptors_; i++) {
+        Listener l;
+        l.fd4 = open_listener(AF_INET, port);
+        l.fd6 = open_listener(AF_INET6, port);  // Optional - host may lack IPv6
+        if (l.fd4 < 0 && l.fd6 < 0) {
+            for (auto& open : listeners_) {
+                if (open.fd4 >= 0) close(open.fd4);
+                if (open.fd6 >= 0) close(open.fd6);
+            }
+            listeners_.clear();
+            return false;
+        }
+        listeners_.push_back(l);
     }
 
+    if (acceptors_ > 1) {
+        LOG_INFO("SSH") << acceptors_ << " acceptor threads on port " << port;
+    }
     return true;
 }
 
 void SSHServer::stop() {
     stop_requested_.store(true);
-    if (listen_fd_ >= 0) {
-        shutdown(listen_fd_, SHUT_RDWR);
+    for (auto& l : listeners_) {
+        if (l.fd4 >= 0) shutdown(l.fd4, SHUT_RDWR);
+        if (l.fd6 >= 0) shutdown(l.fd6, SHUT_RDWR);
     }
 }
 
 void SSHServer::accept_loop() {
     running_.store(true);
 
+    std::vector<std::thread> extra;
+    for (size_t i = 1; i < listeners_.size(); i++) {
+        extra.emplace_back(&SSHServer::acceptor_func, this, static_cast<int>(i));
+    }
+    acceptor_func(0);
+    for (auto& t : extra) {
+        t.join();
+    }
+
+    // Handshakes in flight see stop_requested_ within a read timeout
+    while (handshakes_.load() > 0) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    running_.store(false);
+}
+
+void SSHServer::acceptor_func(int index) {
+    const Listener& l = listeners_[index];
+
     while (!stop_requested_.load()) {
-        // Clean up finished sessions
-        cleanup_sessions();
+        bool queued = false;
+        if (index == 0) {
+            // Clean up finished sessions, return abandoned consoles to the
+            // pool and hand them to waiting users
+            std::vector<Admission> admitted;
+            std::vector<std::pair<WOLFSSH*, std::string>> notices;
+            {
+                std::lock_guard<std::mutex> lock(sessions_mutex_);
+                cleanup_sessions();
+                ConsoleManager::instance().reap_idle();
+                admit_waiting(admitted, notices);
+                queued = !waiting_.empty();
+            }
+
+            // Network writes go out with the lock released. Only this
+            // thread removes waiters, so their connections stay valid.
+            for (auto& n : notices) {
+                wolfSSH_stream_send(n.first, reinterpret_cast<byte*>(&n.second[0]),
+                                    static_cast<word32>(n.second.size()));
+            }
+            for (auto& a : admitted) {
+                if (a.waiter.command.empty()) {
+                    static const char msg[] = "\r\nConsole available - connecting\r\n";
+                    wolfSSH_stream_send(a.waiter.ssh,
+                                        reinterpret_cast<byte*>(const_cast<char*>(msg)),
+                                        sizeof(msg) - 1);
+                }
+                std::lock_guard<std::mutex> lock(sessions_mutex_);
+                start_session(a.waiter.ssh, a.waiter.fd, a.waiter.user, a.console, false,
+                              a.waiter.command);
+            }
+        }
 
         // Set up for select with timeout
         fd_set rfds;
         FD_ZERO(&rfds);
-        FD_SET(listen_fd_, &rfds);
+        int max_fd = -1;
+        for (int fd : {l.fd4, l.fd6}) {
+            if (fd < 0) continue;
+            FD_SET(fd, &rfds);
+            max_fd = std::max(max_fd, fd);
+        }
 
+        // Look at the queue more often while users are waiting
         struct timeval tv;
-        tv.tv_sec = 1;
-        tv.tv_usec = 0;
+        tv.tv_sec = queued ? 0 : 1;
+        tv.tv_usec = queued ? 200000 : 0;
 
-        int ret = select(listen_fd_ + 1, &rfds, nullptr, nullptr, &tv);
+        int ret = select(max_fd + 1, &rfds, nullptr, nullptr, &tv);
         if (ret <= 0) continue;
 
-        // Accept connection
-        struct sockaddr_in client_addr;
-        socklen_t client_len = sizeof(client_addr);
-        int client_fd = accept(listen_fd_,
-                               reinterpret_cast<struct sockaddr*>(&client_addr),
-                               &client_len);
-        if (client_fd < 0) continue;
-
-        // Find a free console
-        Console* con = ConsoleManager::instance().find_free();
-        if (!con) {
-            // No free console - reject connection
-            close(client_fd);
-            continue;
+        for (int fd : {l.fd4, l.fd6}) {
+            if (fd < 0 || !FD_ISSET(fd, &rfds)) continue;
+
+            // Accept connection
+            struct sockaddr_storage client_addr;
+            socklen_t client_len = sizeof(client_addr);
+            int client_fd = accept(fd, reinterpret_cast<struct sockaddr*>(&client_addr),
+                                   &client_len);
+            if (client_fd < 0) continue;
+
+            // Handshake on a thread of its own so a slow client doesn't
+            // hold up the listener (or the admission queue)
+            if (handshakes_.load() >= MAX_HANDSHAKES) {
+                LOG_WARN("SSH") << "Too many handshakes in progress, connection dropped";
+                close(client_fd);
+                continue;
+            }
+            handshakes_++;
+            std::thread([this, client_fd] {
+                handle_connection(client_fd);
+                handshakes_--;
+            }).detach();
         }
+    }
+}
 
-        // Create SSH session
-        WOLFSSH* ssh = wolfSSH_new(ctx_);
-        if (!ssh) {
-            close(client_fd);
-            continue;
-        }
+void SSHServer::handle_connection(int client_fd) {
+    // Create SSH session
+    WOLFSSH* ssh = wolfSSH_new(ctx_);
+    if (!ssh) {
+        close(client_fd);
+        return;
+    }
 
-        wolfSSH_set_fd(ssh, client_fd);
+    wolfSSH_set_fd(ssh, client_fd);
+
+    // Fingerprint of the public key the client signed with, if it logged
+    // in that way
+    std::string key;
+    wolfSSH_SetUserAuthCtx(ssh, &key);
+
+    // Perform SSH handshake (authenticates the user). Reads time out once
+    // a second so a silent client is dropped at the deadline or on stop.
+    struct timeval tv = {1, 0};
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    auto deadline = std::chrono::steady_clock::now() + HANDSHAKE_TIMEOUT;
+    int accept_ret;
+    do {
+        accept_ret = wolfSSH_accept(ssh);
+    } while ((accept_ret == WS_WANT_READ || accept_ret == WS_WANT_WRITE) &&
+             !stop_requested_.load() && std::chrono::steady_clock::now() < deadline);
+    wolfSSH_SetUserAuthCtx(ssh, nullptr);
+    tv.tv_sec = 0;
+    setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    if (accept_ret == WS_SUCCESS && !key.empty()) {
+        const char* login = wolfSSH_GetUsername(ssh);
+        LOG_INFO("SSH") << "User " << (login ? login : "") << " signed in with key " << key;
+    }
 
-        // Perform SSH handshake
-        int accept_ret;
-        do {
-            accept_ret = wolfSSH_accept(ssh);
-        } while (accept_ret == WS_WANT_READ || accept_ret == WS_WANT_WRITE);
+    if (accept_ret != WS_SUCCESS) {
+        wolfSSH_free(ssh);
+        close(client_fd);
+        return;
+    }
 
-        if (accept_ret != WS_SUCCESS) {
-            wolfSSH_free(ssh);
-            close(client_fd);
-            continue;
+    const char* name = wolfSSH_GetUsername(ssh);
+    std::string user = name ? name : "";
+
+    // "ssh host COMMAND" runs COMMAND on a console of its own
+    std::string command;
+    WS_SessionType type = wolfSSH_GetSessionType(ssh);
+    if (type == WOLFSSH_SESSION_EXEC || type == WOLFSSH_SESSION_SUBSYSTEM) {
+        const char* cmd = wolfSSH_GetSessionCommand(ssh);
+        command = cmd ? cmd : "";
+    }
+
+    const char* notice = nullptr;
+    bool placed;
+    {
+        std::lock_guard<std::mutex> lock(sessions_mutex_);
+        placed = place_connection(ssh, client_fd, user, key,
+                                  type == WOLFSSH_SESSION_SUBSYSTEM, command, notice);
+    }
+
+    // Refused: say why and hang up, without holding up other connections
+    if (!placed) {
+        if (notice) {
+            wolfSSH_stream_send(ssh, reinterpret_cast<byte*>(const_cast<char*>(notice)),
+                                static_cast<word32>(strlen(notice)));
+        }
+        wolfSSH_shutdown(ssh);
+        wolfSSH_free(ssh);
+        close(client_fd);
+    }
+}
+
+bool SSHServer::place_connection(WOLFSSH* ssh, int fd, const std::string& user,
+                                 const std::string& key, bool subsystem,
+                                 const std::string& command, const char*& notice) {
+    // File transfer works on the drives directly, no console needed
+    if (subsystem) {
+        if (command != "sftp" || sftp_access_ == SftpAccess::OFF) {
+            LOG_WARN("SSH") << "Refused subsystem " << command;
+            return false;
         }
+        LOG_INFO("SSH") << "SFTP session for " << (user.empty() ? "user" : user);
+        auto session = std::make_unique<SSHSession>(-1, ssh, fd, SSHSession::Mode::SFTP);
+        session->set_sftp_writable(sftp_access_ == SftpAccess::READ_WRITE);
+        session->start();
+        sessions_.push_back(std::move(session));
+        return true;
+    }
 
-        // Create and start session
-        auto session = std::make_unique<SSHSession>(con->id(), ssh, client_fd);
+    // Viewers don't take a console of their own
+    int view_id;
+    char extra;
+    if (allow_shadow_ && command.empty() &&
+        sscanf(user.c_str(), "view%d%c", &view_id, &extra) == 1 &&
+        ConsoleManager::instance().get(view_id)) {
+        // Watching someone else's console takes a listed key
+        if (key.empty() ||
+            std::find(viewer_keys_.begin(), viewer_keys_.end(), key) == viewer_keys_.end()) {
+            LOG_WARN("SSH") << "Refused viewer of console " << view_id
+                            << (key.empty() ? " (no public key)" : " with key " + key);
+            return false;
+        }
+        LOG_INFO("SSH") << "Viewer attached to console " << view_id;
+        auto session = std::make_unique<SSHSession>(view_id, ssh, fd, SSHSession::Mode::VIEW);
         session->start();
         sessions_.push_back(std::move(session));
+        return true;
     }
 
-    running_.store(false);
+    // Reattach to this user's detached console, else take a free one
+    ConsoleManager& consoles = ConsoleManager::instance();
+    Console* con = (user.empty() || !command.empty())
+                       ? nullptr : consoles.find_detached(user, key);
+    bool reattach = con != nullptr;
+    if (reattach) {
+        con->attach(user, key);
+    } else if (waiting_.empty()) {
+        // A local client may claim the same console between the two calls
+        while ((con = consoles.find_free()) && !consoles.try_claim(con->id(), user, key)) {
+        }
+    }
+    if (con) {
+        start_session(ssh, fd, user, con, reattach, command);
+        return true;
+    }
+
+    if (waiting_.size() >= queue_limit_) {
+        // Queue full too - reject connection
+        notice = "\r\nAll MP/M II consoles are in use\r\n";
+        return false;
+    }
+
+    // Hold the connection until a console frees up. The next admission
+    // pass tells the user where they stand.
+    waiting_.push_back({ssh, fd, user, std::chrono::steady_clock::now(), 0, command, key});
+    return true;
+}
+
+void SSHServer::start_session(WOLFSSH* ssh, int fd, const std::string& user,
+                              Console* con, bool reattach, const std::string& command) {
+    if (reattach) {
+        LOG_INFO("SSH") << "User " << user << " reattached to console "
+                        << con->id();
+    }
+    if (!command.empty()) {
+        LOG_INFO("SSH") << "Exec on console " << con->id() << ": " << command;
+    }
+
+    // Create and start session
+    SSHSession::Mode mode = !command.empty() ? SSHSession::Mode::EXEC
+                          : reattach         ? SSHSession::Mode::REATTACH
+                                             : SSHSession::Mode::ATTACH;
+    auto session = std::make_unique<SSHSession>(con->id(), ssh, fd, mode, command);
+    session->start();
+    sessions_.push_back(std::move(session));
+}
+
+// Nothing reads a waiter's socket, so anything it sent before hanging up
+// is still buffered: ask for the hangup itself rather than peeking for EOF.
+static bool peer_gone(int fd) {
+    struct pollfd pfd = {};
+    pfd.fd = fd;
+#ifdef POLLRDHUP
+    pfd.events = POLLRDHUP;
+    return poll(&pfd, 1, 0) > 0;
+#else
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 0) <= 0) return false;
+    if (pfd.revents & (POLLHUP | POLLERR | POLLNVAL)) return true;
+    char c;
+    return recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0;
+#endif
+}
+
+void SSHServer::admit_waiting(std::vector<Admission>& admitted,
+                              std::vector<std::pair<WOLFSSH*, std::string>>& notices) {
+    // Drop users who gave up
+    for (auto it = waiting_.begin(); it != waiting_.end();) {
+        if (peer_gone(it->fd)) {
+            wolfSSH_free(it->ssh);
+            close(it->fd);
+            it = waiting_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    // First come, first served
+    ConsoleManager& consoles = ConsoleManager::instance();
+    while (!waiting_.empty()) {
+        Console* con = consoles.find_free();
+        if (!con) break;
+        // A console must not go to someone who left since the sweep
+        if (peer_gone(waiting_.front().fd)) {
+            wolfSSH_free(waiting_.front().ssh);
+            close(waiting_.front().fd);
+            waiting_.pop_front();
+            continue;
+        }
+        // Hold the console while the greeting goes out
+        if (!consoles.try_claim(con->id(), waiting_.front().user, waiting_.front().key)) {
+            continue;
+        }
+
+        Waiter w = waiting_.front();
+        waiting_.pop_front();
+
+        // Admission rate drives the wait estimate
+        auto now = std::chrono::steady_clock::now();
+        if (last_admit_.time_since_epoch().count() != 0) {
+            double gap = std::chrono::duration<double>(now - last_admit_).count();
+            admit_interval_ = admit_interval_ > 0 ? 0.7 * admit_interval_ + 0.3 * gap : gap;
+        }
+        last_admit_ = now;
+
+        LOG_INFO("SSH") << "Admitted " << (w.user.empty() ? "user" : w.user)
+                        << " to console " << con->id() << " after "
+                        << std::chrono::duration_cast<std::chrono::seconds>(now - w.since).count()
+                        << "s in queue";
+        admitted.push_back({w, con});
+    }
+
+    // Tell the rest where they stand
+    size_t position = 1;
+    for (auto& w : waiting_) {
+        std::string msg = position_notice(w, position++);
+        if (!msg.empty()) notices.emplace_back(w.ssh, msg);
+    }
+}
+
+std::string SSHServer::position_notice(Waiter& w, size_t position) {
+    // Exec output goes to scripts - keep it clean
+    if (position == w.told_position || !w.command.empty()) return std::string();
+    w.told_position = position;
+
+    char msg[128];
+    if (admit_interval_ > 0) {
+        int minutes = static_cast<int>(position * admit_interval_ / 60.0 + 0.5);
+        snprintf(msg, sizeof(msg),
+                 "\r\nAll MP/M II consoles are in use - you are number %zu in line "
+                 "(about %d min)\r\n", position, std::max(minutes, 1));
+    } else {
+        snprintf(msg, sizeof(msg),
+                 "\r\nAll MP/M II consoles are in use - you are number %zu in line\r\n",
+                 position);
+    }
+    return msg;
+}
+
+size_t SSHServer::waiting_count() const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
+    return waiting_.size();
 }
 
 size_t SSHServer::session_count() const {
+    std::lock_guard<std::mutex> lock(sessions_mutex_);
     size_t count = 0;
     for (const auto& session : sessions_) {
         if (session->is_running()) count++;
@@ -326,6 +1042,7 @@ size_t SSHServer::session_count() const {
     return count;
 }
 
+// Caller holds sessions_mutex_
 void SSHServer::cleanup_sessions() {
     sessions_.erase(
         std::remove_if(sessions_.begin(), sessions_.end(),
@@ -335,35 +1052,63 @@ void SSHServer::cleanup_sessions() {
         sessions_.end());
 }
 
+// SHA-256 of the public key blob, written the way "ssh-keygen -l" shows
+// it: "SHA256:" and unpadded base64
+static std::string key_fingerprint(const byte* blob, word32 size) {
+    byte hash[WC_SHA256_DIGEST_SIZE];
+    if (!blob || wc_Sha256Hash(blob, size, hash) != 0) return std::string();
+    static const char b64[] =
+        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    std::string out = "SHA256:";
+    uint32_t bits = 0;
+    int nbits = 0;
+    for (byte b : hash) {
+        bits = (bits << 8) | b;
+        nbits += 8;
+        while (nbits >= 6) {
+            nbits -= 6;
+            out += b64[(bits >> nbits) & 0x3F];
+        }
+    }
+    if (nbits > 0) out += b64[(bits << (6 - nbits)) & 0x3F];
+    return out;
+}
+
 int SSHServer::user_auth_callback(byte auth_type, WS_UserAuthData* auth_data, void* ctx) {
-    (void)ctx;  // Unused for now
+    // Only the method that finally succeeds counts
+    std::string* key = static_cast<std::string*>(ctx);
+    if (key) key->clear();
 
-    std::cerr << "[SSH AUTH] auth_type=" << (int)auth_type;
-    if (auth_data) {
-        std::cerr << " user=" << std::string(reinterpret_cast<const char*>(auth_data->username),
-                                              auth_data->usernameSz);
-    }
-    std::cerr << "\n";
+    LOG_DEBUG("SSH") << "auth_type=" << (int)auth_type << " user="
+                     << (auth_data ? std::string(reinterpret_cast<const char*>(auth_data->username),
+                                                 auth_data->usernameSz)
+                                   : std::string());
 
     // Accept public key authentication
     if (auth_type == WOLFSSH_USERAUTH_PUBLICKEY) {
-        std::cerr << "[SSH AUTH] Accepting public key auth\n";
+        LOG_DEBUG("SSH") << "Accepting public key auth";
+        // wolfSSH checks the signature after this returns, and fails the
+        // login if it is bad; the unsigned probe proves nothing
+        if (key && auth_data && auth_data->sf.publicKey.hasSignature) {
+            *key = key_fingerprint(auth_data->sf.publicKey.publicKey,
+                                   auth_data->sf.publicKey.publicKeySz);
+        }
         return WOLFSSH_USERAUTH_SUCCESS;
     }
 
     // Accept password authentication - any password is accepted
     if (auth_type == WOLFSSH_USERAUTH_PASSWORD) {
-        std::cerr << "[SSH AUTH] Accepting password auth\n";
+        LOG_DEBUG("SSH") << "Accepting password auth";
         return WOLFSSH_USERAUTH_SUCCESS;
     }
 
     // Accept none auth type for simple access
     if (auth_type == WOLFSSH_USERAUTH_NONE) {
-        std::cerr << "[SSH AUTH] Accepting none auth\n";
+        LOG_DEBUG("SSH") << "Accepting none auth";
         return WOLFSSH_USERAUTH_SUCCESS;
     }
 
-    std::cerr << "[SSH AUTH] Invalid auth type\n";
+    LOG_WARN("SSH") << "Invalid auth type";
     return WOLFSSH_USERAUTH_INVALID_AUTHTYPE;
 }
 
@@ -374,4 +1119,18 @@ int SSHServer::channel_shell_callback(WOLFSSH_CHANNEL* channel, void* ctx) {
     return WS_SUCCESS;
 }
 
+int SSHServer::channel_exec_callback(WOLFSSH_CHANNEL* channel, void* ctx) {
+    (void)channel;
+    (void)ctx;
+    // Accept exec request - the command is picked up after the handshake
+    return WS_SUCCESS;
+}
+
+int SSHServer::channel_subsys_callback(WOLFSSH_CHANNEL* channel, void* ctx) {
+    (void)channel;
+    (void)ctx;
+    // Accept subsystem request - only "sftp" is served, checked after the handshake
+    return WS_SUCCESS;
+}
+
 #endif // HAVE_WOLFSSH
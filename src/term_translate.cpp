@@ -0,0 +1,297 @@
+// term_translate.cpp - Console output translation implementation
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "term_translate.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+bool parse_guest_terminal(const std::string& name, GuestTerminal& out) {
+    if (name == "raw") out = GuestTerminal::RAW;
+    else if (name == "adm3a") out = GuestTerminal::ADM3A;
+    else if (name == "kaypro") out = GuestTerminal::KAYPRO;
+    else if (name == "tvi" || name == "televideo") out = GuestTerminal::TELEVIDEO;
+    else if (name == "vt52") out = GuestTerminal::VT52;
+    else return false;
+    return true;
+}
+
+bool parse_parity_mode(const std::string& name, ParityMode& out) {
+    if (name == "keep") out = ParityMode::KEEP;
+    else if (name == "strip") out = ParityMode::STRIP;
+    else if (name == "highlight") out = ParityMode::HIGHLIGHT;
+    else return false;
+    return true;
+}
+
+OutputTranslator::OutputTranslator()
+    : guest_(GuestTerminal::RAW)
+    , parity_(ParityMode::KEEP)
+    , map_sequences_(false)
+    , state_(State::GROUND)
+    , addr_row_(0)
+    , highlighted_(false)
+{
+}
+
+void OutputTranslator::set_client(const std::string& term_type) {
+    // Client terminals (or emulators) that understand the guest codes
+    // directly need no sequence rewriting
+    bool native = false;
+    switch (guest_) {
+        case GuestTerminal::RAW:
+            native = true;
+            break;
+        case GuestTerminal::ADM3A:
+            native = term_type.compare(0, 5, "adm3a") == 0;
+            break;
+        case GuestTerminal::KAYPRO:
+            native = term_type.compare(0, 6, "kaypro") == 0;
+            break;
+        case GuestTerminal::TELEVIDEO:
+            native = term_type.compare(0, 3, "tvi") == 0;
+            break;
+        case GuestTerminal::VT52:
+            native = term_type.compare(0, 4, "vt52") == 0;
+            break;
+    }
+    map_sequences_ = !native;
+    reset();
+}
+
+void OutputTranslator::reset() {
+    state_ = State::GROUND;
+    addr_row_ = 0;
+    highlighted_ = false;
+}
+
+// Bytes needing attention are C0 controls, DEL and anything with bit 7
+// set. As signed bytes, 0x80-0xFF are negative, so a single signed
+// compare against 0x20 catches both controls and high-bit bytes.
+size_t OutputTranslator::scan_plain(const uint8_t* data, size_t len) const {
+    if (state_ != State::GROUND || highlighted_) return 0;
+
+    size_t i = 0;
+#if defined(__SSE2__)
+    const __m128i space = _mm_set1_epi8(0x20);
+    const __m128i del = _mm_set1_epi8(0x7F);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        __m128i special = _mm_or_si128(_mm_cmplt_epi8(v, space),
+                                       _mm_cmpeq_epi8(v, del));
+        int mask = _mm_movemask_epi8(special);
+        if (mask != 0) {
+            return i + __builtin_ctz(static_cast<unsigned>(mask));
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        uint8_t ch = data[i];
+        if (ch < 0x20 || ch >= 0x7F) break;
+    }
+    return i;
+}
+
+void OutputTranslator::translate(const uint8_t* data, size_t len, std::string& out) {
+    if (!active()) {
+        out.append(reinterpret_cast<const char*>(data), len);
+        return;
+    }
+
+    size_t i = 0;
+    while (i < len) {
+        size_t run = scan_plain(data + i, len - i);
+        if (run > 0) {
+            out.append(reinterpret_cast<const char*>(data + i), run);
+            i += run;
+            if (i >= len) break;
+        }
+        translate_byte(data[i++], out);
+    }
+}
+
+void OutputTranslator::translate_byte(uint8_t ch, std::string& out) {
+    if (parity_ != ParityMode::KEEP) {
+        bool high = (ch & 0x80) != 0;
+        ch &= 0x7F;
+        if (parity_ == ParityMode::HIGHLIGHT && state_ == State::GROUND && ch >= 0x20) {
+            if (high && !highlighted_) {
+                out += "\x1b[1m";
+                highlighted_ = true;
+            } else if (!high && highlighted_) {
+                out += "\x1b[22m";
+                highlighted_ = false;
+            }
+        }
+    }
+
+    if (!map_sequences_) {
+        out += static_cast<char>(ch);
+        return;
+    }
+
+    switch (state_) {
+        case State::GROUND:
+            if (ch < 0x20) {
+                control(ch, out);
+            } else {
+                out += static_cast<char>(ch);
+            }
+            break;
+
+        case State::ESCAPE:
+            state_ = State::GROUND;
+            escape(ch, out);
+            break;
+
+        case State::ADDR_ROW:
+            addr_row_ = ch;
+            state_ = State::ADDR_COL;
+            break;
+
+        case State::ADDR_COL: {
+            state_ = State::GROUND;
+            int row = addr_row_ >= 0x20 ? addr_row_ - 0x20 : 0;
+            int col = ch >= 0x20 ? ch - 0x20 : 0;
+            out += "\x1b[" + std::to_string(row + 1) + ";" + std::to_string(col + 1) + "H";
+            break;
+        }
+
+        case State::KAYPRO_ATTR_ON:
+        case State::KAYPRO_ATTR_OFF: {
+            bool on = state_ == State::KAYPRO_ATTR_ON;
+            state_ = State::GROUND;
+            kaypro_attr(ch, on, out);
+            break;
+        }
+
+        case State::TVI_ATTR:
+            state_ = State::GROUND;
+            tvi_attr(ch, out);
+            break;
+    }
+}
+
+void OutputTranslator::control(uint8_t ch, std::string& out) {
+    if (ch == 0x1B) {
+        state_ = State::ESCAPE;
+        return;
+    }
+
+    if (guest_ != GuestTerminal::VT52) {
+        // ADM-3A control set, shared by Kaypro and Televideo
+        switch (ch) {
+            case 0x0B: out += "\x1b[A"; return;             // ^K up
+            case 0x0C: out += "\x1b[C"; return;             // ^L right
+            case 0x1A: out += "\x1b[H\x1b[2J"; return;      // ^Z clear
+            case 0x1E: out += "\x1b[H"; return;             // ^^ home
+            default: break;
+        }
+    }
+
+    if (guest_ == GuestTerminal::KAYPRO) {
+        switch (ch) {
+            case 0x17: out += "\x1b[J"; return;             // ^W clear to end of screen
+            case 0x18: out += "\x1b[K"; return;             // ^X clear to end of line
+            default: break;
+        }
+    }
+
+    out += static_cast<char>(ch);
+}
+
+void OutputTranslator::escape(uint8_t ch, std::string& out) {
+    switch (guest_) {
+        case GuestTerminal::ADM3A:
+            if (ch == '=') {
+                state_ = State::ADDR_ROW;
+                return;
+            }
+            break;
+
+        case GuestTerminal::KAYPRO:
+            switch (ch) {
+                case '=': state_ = State::ADDR_ROW; return;
+                case 'R': out += "\x1b[M"; return;          // Delete line
+                case 'E': out += "\x1b[L"; return;          // Insert line
+                case 'T': out += "\x1b[K"; return;          // Clear to end of line
+                case 'Y': out += "\x1b[J"; return;          // Clear to end of screen
+                case '*': out += "\x1b[H\x1b[2J"; return;   // Clear screen
+                case 'B': state_ = State::KAYPRO_ATTR_ON; return;
+                case 'C': state_ = State::KAYPRO_ATTR_OFF; return;
+                default: break;
+            }
+            break;
+
+        case GuestTerminal::TELEVIDEO:
+            switch (ch) {
+                case '=': state_ = State::ADDR_ROW; return;
+                case 'R': out += "\x1b[M"; return;          // Delete line
+                case 'E': out += "\x1b[L"; return;          // Insert line
+                case 'W': out += "\x1b[P"; return;          // Delete character
+                case 'Q': out += "\x1b[@"; return;          // Insert character
+                case 'T':
+                case 't': out += "\x1b[K"; return;          // Clear to end of line
+                case 'Y':
+                case 'y': out += "\x1b[J"; return;          // Clear to end of screen
+                case '*':
+                case '+':
+                case ':':
+                case ';': out += "\x1b[H\x1b[2J"; return;   // Clear screen
+                case ')': out += "\x1b[2m"; return;         // Half intensity on
+                case '(': out += "\x1b[22m"; return;        // Half intensity off
+                case 'G': state_ = State::TVI_ATTR; return;
+                default: break;
+            }
+            break;
+
+        case GuestTerminal::VT52:
+            switch (ch) {
+                case 'A': out += "\x1b[A"; return;
+                case 'B': out += "\x1b[B"; return;
+                case 'C': out += "\x1b[C"; return;
+                case 'D': out += "\x1b[D"; return;
+                case 'H': out += "\x1b[H"; return;
+                case 'I': out += "\x1bM"; return;           // Reverse line feed
+                case 'J': out += "\x1b[J"; return;
+                case 'K': out += "\x1b[K"; return;
+                case 'Y': state_ = State::ADDR_ROW; return;
+                default: break;
+            }
+            break;
+
+        case GuestTerminal::RAW:
+            break;
+    }
+
+    // Unknown sequence - pass it through untouched
+    out += '\x1b';
+    out += static_cast<char>(ch);
+}
+
+// Kaypro ESC B n / ESC C n: 0 reverse, 1 half intensity, 2 blink, 3 underline
+void OutputTranslator::kaypro_attr(uint8_t ch, bool on, std::string& out) {
+    static const char* const on_sgr[] = { "7", "2", "5", "4" };
+    static const char* const off_sgr[] = { "27", "22", "25", "24" };
+
+    if (ch < '0' || ch > '3') return;  // Cursor/status line controls - no equivalent
+    out += "\x1b[";
+    out += on ? on_sgr[ch - '0'] : off_sgr[ch - '0'];
+    out += 'm';
+}
+
+// Televideo ESC G n: hex digit of attribute bits
+// 1 blank, 2 blink, 4 reverse, 8 underline
+void OutputTranslator::tvi_attr(uint8_t ch, std::string& out) {
+    if (ch < '0' || ch > '?') return;  // TVI uses :;<=>? for 10-15
+    int bits = ch - '0';
+
+    out += "\x1b[0";
+    if (bits & 0x01) out += ";8";
+    if (bits & 0x02) out += ";5";
+    if (bits & 0x04) out += ";7";
+    if (bits & 0x08) out += ";4";
+    out += 'm';
+}
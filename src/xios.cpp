@@ -6,8 +6,15 @@
 #include "console.h"
 #include "banked_mem.h"
 #include "disk.h"
+#include "aux_device.h"
+#include "interrupt_controller.h"
 #include "qkz80.h"
+#include "log.h"
+#include <chrono>
+#include <cmath>
+#include <ctime>
 #include <iostream>
+#include <thread>
 
 XIOS::XIOS(qkz80* cpu, BankedMemory* mem)
     : cpu_(cpu)
@@ -42,7 +49,7 @@ bool XIOS::is_xios_call(uint16_t pc) const {
         static int fc_trace = 0;
         if (offset == 0x80 && fc_trace++ < 3) {
             uint8_t byte = mem_->fetch_mem(pc);
-            fprintf(stderr, "[DEBUG] PC=%04X contains 0x%02X\n", pc, byte);
+            LOG_DEBUG("XIOS") << "PC=" << std::hex << pc << " contains 0x" << (int)byte;
         }
         return false;
     }
@@ -97,22 +104,20 @@ bool XIOS::handle_call(uint16_t pc) {
         uint16_t ret_lo = mem_->fetch_mem(sp);
         uint16_t ret_hi = mem_->fetch_mem(sp + 1);
         uint16_t ret_addr = ret_lo | (ret_hi << 8);
-        std::cout << (is_ldrbios ? "[LDRBIOS] " : "[XIOS] ")
-                  << (idx < 25 ? names[idx] : "???")
-                  << " @ 0x" << std::hex << pc
-                  << " SP=0x" << sp
-                  << " HL=0x" << hl
-                  << " stack[0]=0x" << ret_addr << std::dec << std::endl;
+        LOG_DEBUG(is_ldrbios ? "LDRBIOS" : "XIOS")
+            << (idx < 25 ? names[idx] : "???")
+            << " @ 0x" << std::hex << pc
+            << " SP=0x" << sp
+            << " HL=0x" << hl
+            << " stack[0]=0x" << ret_addr;
 
         // Show what's at the call site (before the CALL instruction pushed to stack)
         // CALL is at ret_addr - 3
         if (trace_count < 10) {
             uint16_t call_addr = ret_addr - 3;
-            uint8_t c0 = mem_->fetch_mem(call_addr);
-            uint8_t c1 = mem_->fetch_mem(call_addr + 1);
-            uint8_t c2 = mem_->fetch_mem(call_addr + 2);
-            fprintf(stderr, "[CALLSITE] at %04X: %02X %02X %02X (expect CD xx FC)\n",
-                    call_addr, c0, c1, c2);
+            LOG_DEBUG("XIOS") << "call site at " << std::hex << call_addr << ": "
+                              << log_hex(3, [&](int i) { return mem_->fetch_mem(call_addr + i); })
+                              << " (expect CD xx FC)";
         }
     }
 
@@ -120,13 +125,10 @@ bool XIOS::handle_call(uint16_t pc) {
     static bool dumped_bf80 = false;
     if (offset == XIOS_BOOT && !dumped_bf80) {
         dumped_bf80 = true;
-        fprintf(stderr, "[BOOT] Memory dump at BF80-BFA0 BEFORE first BOOT:\n");
+        LOG_DEBUG("BOOT") << "Memory dump at BF80-BFA0 BEFORE first BOOT:";
         for (uint16_t addr = 0xBF80; addr < 0xBFA0; addr += 16) {
-            fprintf(stderr, "[BOOT] %04X: ", addr);
-            for (int i = 0; i < 16; i++) {
-                fprintf(stderr, "%02X ", mem_->fetch_mem(addr + i));
-            }
-            fprintf(stderr, "\n");
+            LOG_DEBUG("BOOT") << std::hex << addr << ": "
+                              << log_hex(16, [&](int i) { return mem_->fetch_mem(addr + i); });
         }
     }
 
@@ -179,6 +181,7 @@ void XIOS::handle_port_dispatch(uint8_t func) {
 
     // Temporarily set skip_ret flag so handlers don't do RET
     skip_ret_ = true;
+    refresh_poll_mirror();
 
     switch (func) {
         case XIOS_BOOT:      do_boot(); break;
@@ -212,9 +215,10 @@ void XIOS::handle_port_dispatch(uint8_t func) {
         case XIOS_PDISP:      do_pdisp(); break;
         case XIOS_XDOSENT:    do_xdosent(); break;
         case XIOS_SYSDAT:     do_sysdat(); break;
+        case XIOS_POLLALL:    do_pollall(); break;
 
         default:
-            std::cerr << "[XIOS PORT] Unknown function 0x" << std::hex << (int)func << std::dec << std::endl;
+            LOG_WARN("XIOS") << "Unknown port function 0x" << std::hex << (int)func;
             break;
     }
 
@@ -234,18 +238,77 @@ void XIOS::do_ret() {
 
     // Debug: show return addresses in XIOS range (FB00 for NUCLEUS)
     if ((ret_addr >= 0xFB00 && ret_addr < 0xFC00)) {
-        fprintf(stderr, "[XIOS do_ret] SP=%04X returning to %04X\n", sp, ret_addr);
+        LOG_DEBUG("XIOS") << "do_ret SP=" << std::hex << sp << " returning to " << ret_addr;
     }
 
     // Trace instruction at return address (for BOOT debugging)
     static int ret_trace = 0;
     if (ret_addr >= 0xBF00 && ret_addr < 0xC000 && ret_trace++ < 5) {
-        uint8_t b0 = mem_->fetch_mem(ret_addr);
-        uint8_t b1 = mem_->fetch_mem(ret_addr + 1);
-        uint8_t b2 = mem_->fetch_mem(ret_addr + 2);
-        uint8_t b3 = mem_->fetch_mem(ret_addr + 3);
-        fprintf(stderr, "[do_ret trace] Instruction at %04X: %02X %02X %02X %02X\n",
-                ret_addr, b0, b1, b2, b3);
+        LOG_DEBUG("XIOS") << "do_ret instruction at " << std::hex << ret_addr << ": "
+                          << log_hex(4, [&](int i) { return mem_->fetch_mem(ret_addr + i); });
+    }
+}
+
+void XIOS::push_word(uint16_t value) {
+    uint16_t sp = cpu_->regs.SP.get_pair16() - 2;
+    mem_->store_mem(sp, value & 0xFF);
+    mem_->store_mem(sp + 1, value >> 8);
+    cpu_->regs.SP.set_pair16(sp);
+}
+
+bool XIOS::park_on_poll(uint8_t device, uint8_t retry_func) {
+    // Only for calls through the port-dispatch XIOS at FB00 once the XDOS
+    // is up; the loader's BIOS has no dispatcher to park on
+    uint16_t pc = cpu_->regs.PC.get_pair16();
+    if (!skip_ret_ || pc < 0xFB00 || pc >= 0xFC00) return false;
+
+    uint16_t xdos = bdos_entry();
+    if (xdos == 0) return false;
+
+    // Stack on entry to XDOS, top first:
+    //   POLLRET, saved DE, saved BC, retry entry, caller's return address
+    // XDOS returns to POLLRET, which restores DE/BC and RETs into the
+    // jump table entry so the XIOS function runs again.
+    push_word(0xFB00 + retry_func);
+    push_word(cpu_->regs.BC.get_pair16());
+    push_word(cpu_->regs.DE.get_pair16());
+    push_word(0xFB00 + XIOS_POLLRET);
+
+    cpu_->regs.BC.set_low(XDOS_POLL);
+    cpu_->regs.DE.set_low(device);
+    redirect_pc_ = xdos;
+    redirect_ = true;
+    return true;
+}
+
+void XIOS::park_bdos_call(uint8_t device) {
+    // As park_on_poll, with the BDOS entry itself as the retry address
+    push_word(cpu_->regs.PC.get_pair16());
+    push_word(cpu_->regs.BC.get_pair16());
+    push_word(cpu_->regs.DE.get_pair16());
+    push_word(0xFB00 + XIOS_POLLRET);
+
+    cpu_->regs.BC.set_low(XDOS_POLL);
+    cpu_->regs.DE.set_low(device);
+}
+
+void XIOS::retry_call() {
+    // No dispatcher to park on, but no need to spin either: sleep until an
+    // interrupt line is raised (console input raises one), 10 ms at most.
+    // A line already pending would end the wait at once, so just sleep.
+    InterruptController& irq = InterruptController::instance();
+    if (irq.pending() == 0) {
+        irq.wait(10);
+    } else {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    // Port dispatch: run the OUT (0xE0),A again next instruction (A still
+    // holds the function). PC-trapped calls never returned, so PC is
+    // still on the entry point and the trap fires again.
+    if (skip_ret_) {
+        redirect_pc_ = cpu_->regs.PC.get_pair16() - 2;
+        redirect_ = true;
     }
 }
 
@@ -266,11 +329,22 @@ void XIOS::do_conin() {
     uint8_t console = cpu_->regs.DE.get_high();  // D = console number
     Console* con = ConsoleManager::instance().get(console);
 
-    if (con) {
-        cpu_->regs.AF.set_high(con->read_char());
-    } else {
+    if (!con) {
         cpu_->regs.AF.set_high(0x1A);  // EOF
+        do_ret();
+        return;
+    }
+
+    int ch = con->read_char();
+    if (ch < 0) {
+        // Nothing typed yet: the process waits on POLLDEVICE and the
+        // dispatcher runs the others until the console has input
+        if (park_on_poll(POLL_CONIN_BASE + console, XIOS_CONIN)) return;
+        // Loader or pre-XDOS call: no dispatcher, reissue the call
+        retry_call();
+        return;
     }
+    cpu_->regs.AF.set_high(static_cast<uint8_t>(ch));
     do_ret();
 }
 
@@ -282,15 +356,22 @@ void XIOS::do_conout() {
     uint8_t console = (pc >= 0x8000) ? cpu_->regs.DE.get_high() : 0;
     uint8_t ch = cpu_->regs.BC.get_low();
 
+    // Get the specified console
+    Console* con = ConsoleManager::instance().get(console);
+
+    // Queue full or over its byte rate: let the dispatcher run other
+    // processes and come back here when POLLDEVICE reports ready
+    if (con && !con->output_ready()) {
+        con->count_throttle();
+        if (park_on_poll(POLL_CONOUT_BASE + console, XIOS_CONOUT)) return;
+    }
+
     // For local mode: output post-boot console characters to stdout
     // Only output from high memory (MP/M II kernel) to avoid double output
     if (pc >= 0x8000 && (ch >= 0x20 || ch == '\r' || ch == '\n')) {
         std::cout << (char)ch << std::flush;
     }
 
-    // Get the specified console
-    Console* con = ConsoleManager::instance().get(console);
-
     if (con) {
         con->write_char(ch);
     }
@@ -303,13 +384,39 @@ void XIOS::do_list() {
 }
 
 void XIOS::do_punch() {
-    // Punch device - not implemented
+    // C = character. The I/O thread drains the buffer to the host endpoint.
+    uint8_t ch = cpu_->regs.BC.get_low();
+    AuxDevice& punch = AuxSystem::instance().punch();
+
+    // Buffer full (host side slow or not connected): wait on POLLDEVICE
+    // like CONOUT instead of holding up the Z80 thread
+    if (!punch.output_ready() && park_on_poll(POLL_PUNCH, XIOS_PUNCH)) return;
+
+    // Brief wait only on the loader path, which cannot park
+    if (!punch.write_byte(ch, 10)) {
+        LOG_WARN("PUNCH") << "Buffer full, character dropped";
+    }
     do_ret();
 }
 
 void XIOS::do_reader() {
-    // Reader device - return EOF
-    cpu_->regs.AF.set_high(0x1A);
+    // Return next buffered byte, or ^Z at end of the host source
+    AuxDevice& reader = AuxSystem::instance().reader();
+    uint8_t result = 0x1A;
+
+    // Wait on POLLDEVICE rather than in the Z80 thread
+    if (reader.is_configured() && !reader.input_ready() &&
+        park_on_poll(POLL_READER, XIOS_READER)) {
+        return;
+    }
+
+    if (reader.is_configured() && !reader.take_eof()) {
+        // Brief wait only on the loader path, which cannot park
+        int ch = reader.read_byte(10);
+        if (ch >= 0) result = static_cast<uint8_t>(ch);
+    }
+
+    cpu_->regs.AF.set_high(result);
     do_ret();
 }
 
@@ -329,31 +436,48 @@ void XIOS::do_seldsk() {
     uint8_t disk = cpu_->regs.BC.get_low();  // C = disk number
 
     // Debug: trace disk selection
-    std::cout << "[SELDSK] disk=" << (int)disk << " (" << (char)('A' + disk) << ":)" << std::endl;
+    LOG_DEBUG("DISK") << "SELDSK disk=" << (int)disk << " (" << (char)('A' + disk) << ":)";
+
+    // The loader BIOS keeps its own DPH tables; calls through the XIOS
+    // dispatcher at FB00 (and PC-trapped calls) get theirs built here
+    uint16_t pc = cpu_->regs.PC.get_pair16();
+    bool loader = skip_ret_ && (pc < 0xFB00 || pc >= 0xFC00);
 
     // Check if disk is valid (mounted)
     if (!DiskSystem::instance().select(disk)) {
-        std::cout << "[SELDSK] disk " << (char)('A' + disk) << ": not mounted, returning error" << std::endl;
-        if (!skip_ret_) {
-            cpu_->regs.HL.set_pair16(0x0000);  // Error - no such disk (only for PC-based)
+        LOG_DEBUG("DISK") << "SELDSK " << (char)('A' + disk) << ": not mounted, returning error";
+        if (!loader) {
+            cpu_->regs.HL.set_pair16(0x0000);  // Error - no such disk
         }
         do_ret();
         return;
     }
 
     current_disk_ = disk;
+    {
+        // Under the drive lock, so a host write already under way finishes
+        // before the BDOS can scan the directory
+        Disk* d = DiskSystem::instance().get(disk);
+        std::lock_guard<std::mutex> lock(d->mutex());
+        d->mark_guest_login();
+    }
 
-    // For port dispatch (LDRBIOS), don't modify HL - caller has its own DPH tables
-    if (skip_ret_) {
-        return;  // Just track disk selection, LDRBIOS calculates its own DPH
+    // LDRBIOS calculates its own DPH, so just track the selection
+    if (loader) {
+        return;
     }
 
     // Set up DPH and DPB structures in memory
-    // DPH table is at XIOS_BASE + 0x100 (0xFD00 by default)
+    // DPH table is at XIOS_BASE + 0x100 (0x8900 by default)
     // Each DPH is 16 bytes, DPB is 15 bytes
-    uint16_t dph_addr = xios_base_ + 0x100 + (disk * 32);  // 32 bytes per disk (DPH+DPB)
+    // With a banked system the resident BDOS reads DIRBUF, and programs
+    // read the DPB, with the user's bank selected, so both must be in
+    // common memory: the BNKXIOS stub reserves DIRBUF at +80H and the
+    // DPH table at +100H
+    uint16_t tables = bnkxios_addr_ >= BankedMemory::COMMON_BASE ? bnkxios_addr_ : xios_base_;
+    uint16_t dph_addr = tables + 0x100 + (disk * 32);  // 32 bytes per disk (DPH+DPB)
     uint16_t dpb_addr = dph_addr + 16;
-    uint16_t dirbuf_addr = xios_base_ + 0x80;  // Common directory buffer
+    uint16_t dirbuf_addr = tables + 0x80;  // Common directory buffer
 
     // Get disk parameters
     Disk* dsk = DiskSystem::instance().get(disk);
@@ -367,24 +491,29 @@ void XIOS::do_seldsk() {
     // +0: XLT (sector translation table, 0 = no translation)
     mem_->store_mem(dph_addr + 0, 0x00);
     mem_->store_mem(dph_addr + 1, 0x00);
-    // +2: scratch (6 bytes)
-    for (int i = 2; i < 8; i++) mem_->store_mem(dph_addr + i, 0x00);
+    // +2: scratch (6 bytes) - the BDOS keeps the drive's directory high
+    // water mark there, so only clear it on a first select (E bit 0 = 0)
+    if (!(cpu_->regs.DE.get_low() & 1)) {
+        for (int i = 2; i < 8; i++) mem_->store_mem(dph_addr + i, 0x00);
+    }
     // +8: DIRBUF
     mem_->store_mem(dph_addr + 8, dirbuf_addr & 0xFF);
     mem_->store_mem(dph_addr + 9, (dirbuf_addr >> 8) & 0xFF);
     // +10: DPB pointer
     mem_->store_mem(dph_addr + 10, dpb_addr & 0xFF);
     mem_->store_mem(dph_addr + 11, (dpb_addr >> 8) & 0xFF);
-    // +12: CSV (0 = no check)
-    mem_->store_mem(dph_addr + 12, 0x00);
-    mem_->store_mem(dph_addr + 13, 0x00);
-    // +14: ALV (allocation vector at DPB+15)
-    uint16_t alv_addr = dpb_addr + 15;
+    // +12: CSV and +14: ALV share the drive's page after the DPH table;
+    // the BDOS needs DSM/8+1 bytes of ALV, then CKS bytes of CSV
+    // (none for fixed disks)
+    const DiskParameterBlock& diskdpb = dsk->dpb();
+    uint16_t alv_addr = xios_base_ + 0x300 + (disk * 0x100);
+    uint16_t csv_addr = diskdpb.cks ? alv_addr + diskdpb.dsm / 8 + 1 : 0;
+    mem_->store_mem(dph_addr + 12, csv_addr & 0xFF);
+    mem_->store_mem(dph_addr + 13, (csv_addr >> 8) & 0xFF);
     mem_->store_mem(dph_addr + 14, alv_addr & 0xFF);
     mem_->store_mem(dph_addr + 15, (alv_addr >> 8) & 0xFF);
 
     // Write DPB (15 bytes) from disk's detected format
-    const DiskParameterBlock& diskdpb = dsk->dpb();
     uint16_t spt = diskdpb.spt;
     uint8_t bsh = diskdpb.bsh;
     uint8_t blm = diskdpb.blm;
@@ -396,8 +525,8 @@ void XIOS::do_seldsk() {
     uint16_t cks = diskdpb.cks;
     uint16_t off = diskdpb.off;
 
-    std::cout << "[SELDSK] DPB: spt=" << spt << " bsh=" << (int)bsh
-              << " format=" << (int)dsk->format() << std::endl;
+    LOG_DEBUG("DISK") << "SELDSK DPB: spt=" << spt << " bsh=" << (int)bsh
+                      << " format=" << (int)dsk->format();
 
     mem_->store_mem(dpb_addr + 0, spt & 0xFF);
     mem_->store_mem(dpb_addr + 1, (spt >> 8) & 0xFF);
@@ -438,38 +567,41 @@ void XIOS::do_setdma() {
     // For port dispatch: assembly copies BC to HL before OUT
     // For PC-based dispatch (legacy): BC = DMA address
     dma_addr_ = skip_ret_ ? cpu_->regs.HL.get_pair16() : cpu_->regs.BC.get_pair16();
-    std::cerr << "[SETDMA] addr=0x" << std::hex << dma_addr_
-              << " (was 0x" << old_dma << ")" << std::dec << std::endl;
+    LOG_TRACE("DISK") << "SETDMA addr=0x" << std::hex << dma_addr_
+                      << " (was 0x" << old_dma << ")";
     do_ret();
 }
 
 void XIOS::do_read() {
-    std::cerr << "[do_read] Called: trk=" << current_track_
-              << " sec=" << current_sector_
-              << " dma=0x" << std::hex << dma_addr_ << std::dec << std::endl;
+    LOG_TRACE("DISK") << "READ trk=" << current_track_
+                      << " sec=" << current_sector_
+                      << " dma=0x" << std::hex << dma_addr_;
 
     // Set up disk system with current parameters
     DiskSystem::instance().set_track(current_track_);
     DiskSystem::instance().set_sector(current_sector_);
     DiskSystem::instance().set_dma(dma_addr_);
 
-    // Perform read
+    // Perform read; the BDOS's DMA is in the caller's bank
+    uint8_t sys_bank = mem_->current_bank();
+    if (mirror_live_ && dma_addr_ < BankedMemory::COMMON_BASE) mem_->select_bank(user_bank());
     int result = DiskSystem::instance().read(mem_);
+    mem_->select_bank(sys_bank);
 
     // Trace reads to high memory (where system modules are loaded)
     static int read_trace = 0;
     if (read_trace++ < 300) {
-        std::cerr << "[XIOS READ] dma=0x" << std::hex << dma_addr_
-                  << " trk=" << std::dec << current_track_
-                  << " sec=" << current_sector_
-                  << " result=" << result << std::endl;
+        LOG_DEBUG("DISK") << "READ dma=0x" << std::hex << dma_addr_
+                          << " trk=" << std::dec << current_track_
+                          << " sec=" << current_sector_
+                          << " result=" << result;
     }
 
     // Also trace errors
     if (result != 0) {
-        std::cout << "[DISK ERROR] trk=" << current_track_
-                  << " sec=" << current_sector_
-                  << " result=" << result << std::endl;
+        LOG_WARN("DISK") << "Read error trk=" << current_track_
+                         << " sec=" << current_sector_
+                         << " result=" << result;
     }
 
     cpu_->regs.AF.set_high(result);
@@ -483,7 +615,10 @@ void XIOS::do_write() {
     DiskSystem::instance().set_dma(dma_addr_);
 
     // Perform write
+    uint8_t sys_bank = mem_->current_bank();
+    if (mirror_live_ && dma_addr_ < BankedMemory::COMMON_BASE) mem_->select_bank(user_bank());
     int result = DiskSystem::instance().write(mem_);
+    mem_->select_bank(sys_bank);
     cpu_->regs.AF.set_high(result);
     do_ret();
 }
@@ -501,8 +636,8 @@ void XIOS::do_sectran() {
     if (xlat_table != 0) {
         // Table contains physical sector numbers for each logical sector
         physical = mem_->fetch_mem(xlat_table + logical);
-        std::cout << "[SECTRAN] log=" << logical << " xlat=0x" << std::hex << xlat_table
-                  << " -> phys=" << std::dec << physical << std::endl;
+        LOG_TRACE("DISK") << "SECTRAN log=" << logical << " xlat=0x" << std::hex << xlat_table
+                          << " -> phys=" << std::dec << physical;
     }
 
     cpu_->regs.HL.set_pair16(physical);
@@ -524,33 +659,153 @@ void XIOS::do_selmemory() {
 void XIOS::do_polldevice() {
     // C = device number to poll
     // Return 0xFF if ready, 0x00 if not
-    uint8_t device = cpu_->regs.BC.get_low();
+    cpu_->regs.AF.set_high(poll_device(cpu_->regs.BC.get_low()));
+    do_ret();
+}
 
+uint8_t XIOS::poll_device(uint8_t device) {
     // Device 0 = printer (always ready for now)
-    // Device 1-4 = console output 0-3
-    // Device 5-8 = console input 0-3
+    // Device 01H-08H = console output 0-7
+    // Device 10H/11H = AUX reader/punch
+    // Device 18H-1FH = console input 0-7
 
     uint8_t result = 0x00;
 
-    if (device == 0) {
+    if (device == POLL_PRINTER) {
         // Printer - always ready
         result = 0xFF;
-    } else if (device >= 1 && device <= 4) {
-        // Console output - always ready
-        result = 0xFF;
-    } else if (device >= 5 && device <= 8) {
+    } else if (device >= POLL_CONOUT_BASE && device < POLL_CONOUT_BASE + MAX_CONSOLES) {
+        // Console output - queue space and rate budget
+        Console* con = ConsoleManager::instance().get(device - POLL_CONOUT_BASE);
+        if (!con || con->output_ready()) {
+            result = 0xFF;
+        }
+    } else if (device >= POLL_CONIN_BASE && device < POLL_CONIN_BASE + MAX_CONSOLES) {
         // Console input
-        int console = device - 5;
+        int console = device - POLL_CONIN_BASE;
         Console* con = ConsoleManager::instance().get(console);
         if (con && con->const_status()) {
             result = 0xFF;
         }
+    } else if (device == POLL_READER) {
+        if (AuxSystem::instance().reader().input_ready()) result = 0xFF;
+    } else if (device == POLL_PUNCH) {
+        if (AuxSystem::instance().punch().output_ready()) result = 0xFF;
     }
 
-    cpu_->regs.AF.set_high(result);
+    return result;
+}
+
+void XIOS::do_pollall() {
+    // HL = console input bitmap, DE = console output bitmap,
+    // A = bit 0 list, bit 1 reader, bit 2 punch
+    ConsoleManager& mgr = ConsoleManager::instance();
+    uint16_t out_mask = 0;
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        Console* con = mgr.get(i);
+        if (!con || con->output_ready()) out_mask |= 1u << i;
+    }
+
+    uint8_t aux = 0x01;  // Printer always ready
+    if (AuxSystem::instance().reader().input_ready()) aux |= 0x02;
+    if (AuxSystem::instance().punch().output_ready()) aux |= 0x04;
+
+    cpu_->regs.HL.set_pair16(static_cast<uint16_t>(mgr.input_ready_mask()));
+    cpu_->regs.DE.set_pair16(out_mask);
+    cpu_->regs.AF.set_high(aux);
     do_ret();
 }
 
+void XIOS::refresh_poll_mirror() {
+    if (!mirror_live_) return;
+    uint32_t mask = ConsoleManager::instance().input_ready_mask();
+    if (mask == mirror_mask_) return;
+    mirror_mask_ = mask;
+
+    // Unconnected consoles hold no input (their queues are cleared),
+    // so the bitmap alone answers POLLDEVICE for console input
+    for (int i = 0; i < MAX_CONSOLES; i++) {
+        mem_->store_mem(0xFB00 + XIOS_CINRDY + i, (mask >> i) & 1 ? 0xFF : 0x00);
+    }
+}
+
+uint16_t XIOS::bdos_entry() const {
+    return mem_->fetch_mem(SYSDAT_BASE + SYSDAT_XDOS) |
+           (mem_->fetch_mem(SYSDAT_BASE + SYSDAT_XDOS + 1) << 8);
+}
+
+uint8_t XIOS::user_bank() const {
+    auto word = [this](uint16_t addr) {
+        return static_cast<uint16_t>(mem_->fetch_mem(addr) | (mem_->fetch_mem(addr + 1) << 8));
+    };
+
+    // The resident BDOS keeps the caller's segment in USERMEMSEG while the
+    // PD says segment 0; its SWITCH$USER (RESBDOS+0CH) is CALL GETMEMSEG,
+    // LDA USERMEMSEG, so read the variable from there
+    uint16_t resbdos = mem_->fetch_mem(SYSDAT_BASE + SYSDAT_RESBDOS) << 8;
+    uint16_t datapg = word(SYSDAT_BASE + SYSDAT_DATAPG);
+    if (resbdos == 0 || datapg == 0) return mem_->current_bank();
+    uint16_t swtuser = word(resbdos + RESBDOS_SWTUSER + 1);
+    if (mem_->fetch_mem(swtuser + 3) != 0x3A) return mem_->current_bank();
+
+    // FF is a resident process: SWITCH$USER leaves the system bank in
+    uint8_t seg = mem_->fetch_mem(word(swtuser + 4));
+    if (seg == 0xFF) return 0;
+    return mem_->fetch_mem(datapg + DATAPG_MSEGTBL + 4 * seg + 3);
+}
+
+bool XIOS::read_console_buffer() {
+    auto word = [this](uint16_t addr) {
+        return static_cast<uint16_t>(mem_->fetch_mem(addr) | (mem_->fetch_mem(addr + 1) << 8));
+    };
+
+    uint16_t datapg = word(SYSDAT_BASE + SYSDAT_DATAPG);
+    uint16_t pd = datapg ? word(datapg + DATAPG_RLR) : 0;
+    if (pd == 0) return false;
+
+    // Only for the process attached to its console - the BDOS attaches
+    // (or waits for) the console itself. Raw processes get no editing.
+    uint8_t console = mem_->fetch_mem(pd + PD_CONSOLE) & 0x0F;
+    if (console >= MAX_CONSOLES || word(datapg + DATAPG_CNSATT + 2 * console) != pd) return false;
+    if (mem_->fetch_mem(pd + PD_NAME) & 0x80) return false;
+
+    Console* con = ConsoleManager::instance().get(console);
+    uint16_t buf = cpu_->regs.DE.get_pair16();
+    uint8_t max = mem_->fetch_mem(buf);
+    if (!con || max == 0 || con->has_unread()) return false;
+
+    LineEditor& editor = con->line_editor();
+    if (!editor.active_for(buf)) editor.begin(buf, max, con->column());
+
+    switch (editor.feed(*con)) {
+        case LineEditor::Status::WAITING:
+            park_bdos_call(POLL_CONIN_BASE + console);
+            return true;
+
+        case LineEditor::Status::HANDOFF:
+            return false;
+
+        case LineEditor::Status::DONE:
+            break;
+    }
+
+    // Deliver the line and return to the caller as the BDOS would
+    const std::string& line = editor.line();
+    mem_->store_mem(buf + 1, static_cast<uint8_t>(line.size()));
+    for (size_t i = 0; i < line.size(); i++) {
+        mem_->store_mem(buf + 2 + i, static_cast<uint8_t>(line[i]));
+    }
+    editor.reset();
+
+    uint16_t sp = cpu_->regs.SP.get_pair16();
+    cpu_->regs.PC.set_pair16(mem_->fetch_mem(sp) | (mem_->fetch_mem(sp + 1) << 8));
+    cpu_->regs.SP.set_pair16(sp + 2);
+    cpu_->regs.HL.set_pair16(0);
+    cpu_->regs.AF.set_high(0);
+    cpu_->regs.BC.set_high(0);
+    return true;
+}
+
 void XIOS::do_startclock() {
     tick_enabled_.store(true);
     do_ret();
@@ -580,17 +835,42 @@ void XIOS::do_systeminit() {
     // DE = breakpoint handler address
     // HL = XIOS direct jump table address
 
-    // TODO: Set up interrupt vectors in each bank
-    // For now, just initialize consoles
+    // MP/M has set up the base page of bank 0; the other banks need the
+    // same jumps: 0000H to the direct jump table (so JP 0 in a program
+    // ends it), the debugger RST, and the RST 38H interrupt vector
+    uint8_t sys_bank = mem_->current_bank();
+    uint16_t rst = (cpu_->regs.BC.get_low() & 7) * 8;
+    for (int bank = 0; bank < mem_->num_banks(); bank++) {
+        if (bank == sys_bank) continue;
+        auto jump = [&](uint16_t addr, uint16_t target) {
+            mem_->write_bank(bank, addr, 0xC3);
+            mem_->write_bank(bank, addr + 1, target & 0xFF);
+            mem_->write_bank(bank, addr + 2, target >> 8);
+        };
+        jump(0x0000, cpu_->regs.HL.get_pair16());
+        if (rst != 0) jump(rst, cpu_->regs.DE.get_pair16());
+        for (uint16_t addr = 0x0038; addr < 0x003B; addr++) {
+            mem_->write_bank(bank, addr, mem_->read_bank(sys_bank, addr));
+        }
+    }
+
     ConsoleManager::instance().init();
 
     do_ret();
 }
 
 void XIOS::do_idle() {
-    // Called when no processes are ready
-    // For a polled system, this would call the dispatcher
-    // For us, we can just return (or yield briefly)
+    // Called when no processes are ready. Polled devices are only looked
+    // at on a dispatch, so as in DRI's polled XIOS the idle procedure is
+    // MVI C,DISPATCH; JMP XDOS. A tickless Z80 thread sleeps here first.
+    idle_ = true;
+    uint16_t xdos = bdos_entry();
+    if (skip_ret_ && xdos != 0) {
+        cpu_->regs.BC.set_low(XDOS_DISPATCH);
+        redirect_pc_ = xdos;
+        redirect_ = true;
+        return;
+    }
     do_ret();
 }
 
@@ -638,28 +918,28 @@ void XIOS::do_sysdat() {
 // xios_port.bin - Z80 code for port-based XIOS dispatch at FB00
 // Generated from asm/xios_port.bin - do not edit manually
 static const uint8_t xios_port_code[] = {
-    0xc3, 0x5c, 0xfb, 0xc3, 0x61, 0xfb, 0xc3, 0x66, 0xfb, 0xc3, 0x6b, 0xfb,
-    0xc3, 0x70, 0xfb, 0xc3, 0x75, 0xfb, 0xc3, 0x7a, 0xfb, 0xc3, 0x7f, 0xfb,
-    0xc3, 0x84, 0xfb, 0xc3, 0x89, 0xfb, 0xc3, 0x8e, 0xfb, 0xc3, 0x95, 0xfb,
-    0xc3, 0x9c, 0xfb, 0xc3, 0xa3, 0xfb, 0xc3, 0xa8, 0xfb, 0xc3, 0xad, 0xfb,
-    0xc3, 0xb2, 0xfb, 0xc3, 0xb9, 0xfb, 0xc3, 0xbe, 0xfb, 0xc3, 0xc3, 0xfb,
-    0xc3, 0xc8, 0xfb, 0xc3, 0xcd, 0xfb, 0xc3, 0xd2, 0xfb, 0xc3, 0xd7, 0xfb,
-    0xc3, 0xdc, 0xfb, 0xc3, 0xe1, 0xfb, 0xc3, 0xe6, 0xfb, 0xc3, 0xeb, 0xfb,
-    0xc3, 0xf0, 0xfb, 0xc3, 0xf5, 0xfb, 0x00, 0xff, 0x3e, 0x00, 0xd3, 0xe0,
-    0xc9, 0x3e, 0x03, 0xd3, 0xe0, 0xc9, 0x3e, 0x06, 0xd3, 0xe0, 0xc9, 0x3e,
-    0x09, 0xd3, 0xe0, 0xc9, 0x3e, 0x0c, 0xd3, 0xe0, 0xc9, 0x3e, 0x0f, 0xd3,
-    0xe0, 0xc9, 0x3e, 0x12, 0xd3, 0xe0, 0xc9, 0x3e, 0x15, 0xd3, 0xe0, 0xc9,
-    0x3e, 0x18, 0xd3, 0xe0, 0xc9, 0x3e, 0x1b, 0xd3, 0xe0, 0xc9, 0x60, 0x69,
-    0x3e, 0x1e, 0xd3, 0xe0, 0xc9, 0x60, 0x69, 0x3e, 0x21, 0xd3, 0xe0, 0xc9,
-    0x60, 0x69, 0x3e, 0x24, 0xd3, 0xe0, 0xc9, 0x3e, 0x27, 0xd3, 0xe0, 0xc9,
-    0x3e, 0x2a, 0xd3, 0xe0, 0xc9, 0x3e, 0x2d, 0xd3, 0xe0, 0xc9, 0x60, 0x69,
-    0x3e, 0x30, 0xd3, 0xe0, 0xc9, 0x3e, 0x33, 0xd3, 0xe0, 0xc9, 0x3e, 0x36,
-    0xd3, 0xe0, 0xc9, 0x3e, 0x39, 0xd3, 0xe0, 0xc9, 0x3e, 0x3c, 0xd3, 0xe0,
-    0xc9, 0x3e, 0x3f, 0xd3, 0xe0, 0xc9, 0x3e, 0x42, 0xd3, 0xe0, 0xc9, 0x3e,
-    0x45, 0xd3, 0xe0, 0xc9, 0x3e, 0x48, 0xd3, 0xe0, 0xc9, 0x3e, 0x4b, 0xd3,
-    0xe0, 0xc9, 0x3e, 0x4e, 0xd3, 0xe0, 0xc9, 0x3e, 0x51, 0xd3, 0xe0, 0xc9,
-    0x3e, 0x54, 0xd3, 0xe0, 0xc9, 0x3e, 0x57, 0xd3, 0xe0, 0xc9, 0x00, 0x3c,
-    0x00
+    0xc3, 0x5c, 0xfb, 0xc3, 0x60, 0xfb, 0xc3, 0x64, 0xfb, 0xc3, 0x68, 0xfb,
+    0xc3, 0x6c, 0xfb, 0xc3, 0x70, 0xfb, 0xc3, 0x74, 0xfb, 0xc3, 0x78, 0xfb,
+    0xc3, 0x7c, 0xfb, 0xc3, 0x80, 0xfb, 0xc3, 0x84, 0xfb, 0xc3, 0x8a, 0xfb,
+    0xc3, 0x90, 0xfb, 0xc3, 0x96, 0xfb, 0xc3, 0x9a, 0xfb, 0xc3, 0x9e, 0xfb,
+    0xc3, 0xa2, 0xfb, 0xc3, 0xa8, 0xfb, 0xc3, 0xaf, 0xfb, 0xc3, 0xc1, 0xfb,
+    0xc3, 0xc5, 0xfb, 0xc3, 0xc9, 0xfb, 0xc3, 0xcd, 0xfb, 0xc3, 0xd1, 0xfb,
+    0xc3, 0xd5, 0xfb, 0xc3, 0xd9, 0xfb, 0xc3, 0xdd, 0xfb, 0xc3, 0xe1, 0xfb,
+    0xc3, 0xe5, 0xfb, 0xc3, 0xe9, 0xfb, 0x00, 0xff, 0x3e, 0x00, 0x18, 0x4c,
+    0x3e, 0x03, 0x18, 0x48, 0x3e, 0x06, 0x18, 0x44, 0x3e, 0x09, 0x18, 0x40,
+    0x3e, 0x0c, 0x18, 0x3c, 0x3e, 0x0f, 0x18, 0x38, 0x3e, 0x12, 0x18, 0x34,
+    0x3e, 0x15, 0x18, 0x30, 0x3e, 0x18, 0x18, 0x2c, 0x3e, 0x1b, 0x18, 0x28,
+    0x60, 0x69, 0x3e, 0x1e, 0x18, 0x22, 0x60, 0x69, 0x3e, 0x21, 0x18, 0x1c,
+    0x60, 0x69, 0x3e, 0x24, 0x18, 0x16, 0x3e, 0x27, 0x18, 0x12, 0x3e, 0x2a,
+    0x18, 0x0e, 0x3e, 0x2d, 0x18, 0x0a, 0x60, 0x69, 0x3e, 0x30, 0x18, 0x04,
+    0x3e, 0x33, 0x18, 0x00, 0xd3, 0xe0, 0xc9, 0x79, 0xd6, 0x18, 0xfe, 0x08,
+    0x30, 0x07, 0xc6, 0xf1, 0x6f, 0x26, 0xfb, 0x7e, 0xc9, 0x3e, 0x36, 0x18,
+    0xeb, 0x3e, 0x39, 0x18, 0xe7, 0x3e, 0x3c, 0x18, 0xe3, 0x3e, 0x3f, 0x18,
+    0xdf, 0x3e, 0x42, 0x18, 0xdb, 0x3e, 0x45, 0x18, 0xd7, 0x3e, 0x48, 0x18,
+    0xd3, 0x3e, 0x4b, 0x18, 0xcf, 0x3e, 0x4e, 0x18, 0xcb, 0x3e, 0x51, 0x18,
+    0xc7, 0x3e, 0x54, 0x18, 0xc3, 0x3e, 0x57, 0x18, 0xbf, 0x3e, 0xed, 0x18,
+    0xbb, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xd1, 0xc1,
+    0xc9, 0x00, 0x00, 0x00
 };
 static const size_t xios_port_code_len = sizeof(xios_port_code);
 
@@ -671,7 +951,7 @@ void XIOS::patch_bnkxios(uint16_t explicit_bnkxios_addr) {
     static bool xios_installed = false;
     if (xios_installed) return;
 
-    std::cerr << "[patch_bnkxios] Installing port-dispatch XIOS at FB00H" << std::endl;
+    LOG_DEBUG("BOOT") << "Installing port-dispatch XIOS at FB00H";
 
     // Install xios_port code at FB00 (XIOSJMP TBL location)
     for (size_t i = 0; i < xios_port_code_len; i++) {
@@ -684,23 +964,19 @@ void XIOS::patch_bnkxios(uint16_t explicit_bnkxios_addr) {
         // Try to read from 0xFF0D (page number stored by loader)
         uint8_t bnkxios_page = mem_->fetch_mem(0xFF0D);
         bnkxios_addr = static_cast<uint16_t>(bnkxios_page) << 8;
-        std::cerr << "[patch_bnkxios] 0xFF0D=" << std::hex << (int)bnkxios_page
-                  << "H -> BNKXIOS addr=" << bnkxios_addr << "H" << std::dec << std::endl;
+        LOG_DEBUG("BOOT") << "0xFF0D=" << std::hex << (int)bnkxios_page
+                          << "H -> BNKXIOS addr=" << bnkxios_addr << "H";
     } else {
-        std::cerr << "[patch_bnkxios] Using explicit BNKXIOS addr=" << std::hex
-                  << bnkxios_addr << "H" << std::dec << std::endl;
+        LOG_DEBUG("BOOT") << "Using explicit BNKXIOS addr=" << std::hex << bnkxios_addr << "H";
     }
 
     if (bnkxios_addr != 0 && bnkxios_addr != 0xFB00) {
-        std::cerr << "[patch_bnkxios] Patching BNKXIOS at " << std::hex << bnkxios_addr
-                  << "H to forward to FB00H" << std::dec << std::endl;
+        LOG_DEBUG("BOOT") << "Patching BNKXIOS at " << std::hex << bnkxios_addr
+                          << "H to forward to FB00H";
 
         // Dump what's there before patching
-        std::cerr << "[patch_bnkxios] BNKXIOS before: ";
-        for (int i = 0; i < 12; i++) {
-            std::cerr << std::hex << (int)mem_->fetch_mem(bnkxios_addr + i) << " ";
-        }
-        std::cerr << std::dec << std::endl;
+        LOG_DEBUG("BOOT") << "BNKXIOS before: "
+                          << log_hex(12, [&](int i) { return mem_->fetch_mem(bnkxios_addr + i); });
 
         // Patch each jump table entry (30 entries for standard XIOS + extended)
         // Each entry is 3 bytes: JP xxxx -> JP FB00+offset
@@ -716,24 +992,29 @@ void XIOS::patch_bnkxios(uint16_t explicit_bnkxios_addr) {
         }
 
         // Dump after patching
-        std::cerr << "[patch_bnkxios] BNKXIOS after:  ";
-        for (int i = 0; i < 12; i++) {
-            std::cerr << std::hex << (int)mem_->fetch_mem(bnkxios_addr + i) << " ";
-        }
-        std::cerr << std::dec << std::endl;
+        LOG_DEBUG("BOOT") << "BNKXIOS after:  "
+                          << log_hex(12, [&](int i) { return mem_->fetch_mem(bnkxios_addr + i); });
     }
 
     // Cache the BNKXIOS address for use by do_boot()
     bnkxios_addr_ = bnkxios_addr;
 
     xios_installed = true;
+    mirror_live_ = true;
+
+    // Delays are counted in ticks; programs convert with SYSDAT's rate
+    uint8_t gensys_ticks = mem_->fetch_mem(SYSDAT_BASE + SYSDAT_TICKS);
+    if (gensys_ticks != ticks_per_second_) {
+        LOG_INFO("XIOS") << "Ticks/second " << std::dec << (int)gensys_ticks
+                         << " -> " << (int)ticks_per_second_;
+        mem_->store_mem(SYSDAT_BASE + SYSDAT_TICKS, ticks_per_second_);
+    }
+    mirror_mask_ = 0;  // CINRDY is installed all clear
 
     // Verify FB00 installation
-    std::cerr << "[patch_bnkxios] Installed " << xios_port_code_len
-              << " bytes at FB00H, first bytes: "
-              << std::hex << (int)mem_->fetch_mem(0xFB00) << " "
-              << (int)mem_->fetch_mem(0xFB01) << " "
-              << (int)mem_->fetch_mem(0xFB02) << std::dec << std::endl;
+    LOG_DEBUG("BOOT") << "Installed " << xios_port_code_len
+                      << " bytes at FB00H, first bytes: "
+                      << log_hex(3, [&](int i) { return mem_->fetch_mem(0xFB00 + i); });
 }
 
 void XIOS::do_boot() {
@@ -754,8 +1035,8 @@ void XIOS::do_boot() {
     // Commonbase structure starts at SWTUSER offset within BNKXIOS
     uint16_t commonbase = bnkxios_addr + XIOS_SWTUSER;  // e.g., CD00+4E = CD4E
 
-    std::cerr << "[do_boot] BNKXIOS=" << std::hex << bnkxios_addr
-              << "H commonbase=" << commonbase << "H" << std::dec << std::endl;
+    LOG_DEBUG("BOOT") << "BNKXIOS=" << std::hex << bnkxios_addr
+                      << "H commonbase=" << commonbase << "H";
 
     cpu_->regs.HL.set_pair16(commonbase);
     do_ret();
@@ -763,7 +1044,16 @@ void XIOS::do_boot() {
 
 void XIOS::do_wboot() {
     // Warm boot - terminate current process
-    // In MP/M, this goes back to TMP
+    // A program's JP 0 comes here through the resident BDOS's fake BIOS
+    // table; as in DRI's XIOS this is MVI C,0; JMP XDOS, and the system
+    // reset ends the process so its TMP gets the console back
+    uint16_t xdos = bdos_entry();
+    if (skip_ret_ && xdos != 0) {
+        cpu_->regs.BC.set_low(0);
+        redirect_pc_ = xdos;
+        redirect_ = true;
+        return;
+    }
     do_ret();
 }
 
@@ -775,9 +1065,103 @@ void XIOS::tick() {
     }
 }
 
+bool XIOS::tick_needed() {
+    auto word = [this](uint16_t addr) {
+        return static_cast<uint16_t>(mem_->fetch_mem(addr) | (mem_->fetch_mem(addr + 1) << 8));
+    };
+
+    // Until the XDOS is up, tick as usual
+    uint16_t datapg = word(SYSDAT_BASE + SYSDAT_DATAPG);
+    if (datapg == 0) return true;
+
+    // A delay is counting down
+    if (word(datapg + DATAPG_DLR) != 0) return true;
+
+    // Anything but Idle on the ready list wants time slicing
+    uint16_t running = word(datapg + DATAPG_RLR);
+    static const char idle_name[] = "Idle    ";
+    for (int i = 0; i < 8; i++) {
+        if ((mem_->fetch_mem(running + PD_NAME + i) & 0x7F) != idle_name[i]) return true;
+    }
+
+    // A dispatch would ready a polling process
+    return poll_list_ready();
+}
+
+bool XIOS::poll_list_ready() {
+    auto word = [this](uint16_t addr) {
+        return static_cast<uint16_t>(mem_->fetch_mem(addr) | (mem_->fetch_mem(addr + 1) << 8));
+    };
+
+    uint16_t datapg = word(SYSDAT_BASE + SYSDAT_DATAPG);
+    if (datapg == 0) return false;
+
+    uint16_t pd = word(datapg + DATAPG_PLR);
+    for (int n = 0; pd != 0 && n < 64; n++) {
+        if (poll_device(mem_->fetch_mem(pd + PD_POLL_DEVICE))) return true;
+        pd = word(pd + PD_LINK);
+    }
+    return false;
+}
+
+void XIOS::set_tod_from_host() {
+    uint16_t datapg = mem_->fetch_mem(SYSDAT_BASE + SYSDAT_DATAPG) |
+                      (mem_->fetch_mem(SYSDAT_BASE + SYSDAT_DATAPG + 1) << 8);
+    if (datapg == 0) return;
+
+    time_t now = time(nullptr);
+    struct tm local;
+    localtime_r(&now, &local);
+
+    // Day 1 is 1 January 1978; hours, minutes and seconds are BCD
+    struct tm epoch = {};
+    epoch.tm_year = 78;
+    epoch.tm_mday = 1;
+    epoch.tm_isdst = -1;
+    struct tm today = local;
+    today.tm_hour = today.tm_min = today.tm_sec = 0;
+    today.tm_isdst = -1;
+    long days = std::lround(difftime(mktime(&today), mktime(&epoch)) / 86400.0) + 1;
+
+    auto bcd = [](int v) { return static_cast<uint8_t>(((v / 10) << 4) | (v % 10)); };
+    uint16_t tod = datapg + DATAPG_TOD;
+    mem_->store_mem(tod, days & 0xFF);
+    mem_->store_mem(tod + 1, (days >> 8) & 0xFF);
+    mem_->store_mem(tod + 2, bcd(local.tm_hour));
+    mem_->store_mem(tod + 3, bcd(local.tm_min));
+    mem_->store_mem(tod + 4, bcd(local.tm_sec));
+}
+
 void XIOS::one_second_tick() {
-    // Called once per second
-    // TODO: Set MP/M flag #2
+    // The XIOS sources here reload their one-second count from SYSDAT's
+    // ticks/second byte. Older images (and DRI's sample XIOS) reload a
+    // constant 60, which at other rates sets flag #2 too early or late:
+    // find "DEC (HL); JR/JP NZ; LD (HL),60" in the RST 38H handler and
+    // point it at the configured rate. Looked at once, as soon as the
+    // handler is installed.
+    if (second_checked_ || ticks_per_second_ == 60) return;
+    if (mem_->fetch_mem(0x0038) != 0xC3) return;
+    second_checked_ = true;
+    uint16_t handler = mem_->fetch_mem(0x0039) | (mem_->fetch_mem(0x003A) << 8);
+
+    for (uint16_t addr = handler; addr < handler + 96; addr++) {
+        if (mem_->fetch_mem(addr) != 0x35) continue;       // DEC (HL)
+        uint8_t jump = mem_->fetch_mem(addr + 1);
+        uint16_t reload;
+        if (jump == 0x20) {
+            reload = addr + 3;                              // JR NZ,e
+        } else if (jump == 0xC2) {
+            reload = addr + 4;                              // JP NZ,nn
+        } else {
+            continue;
+        }
+        if (mem_->fetch_mem(reload) != 0x36 || mem_->fetch_mem(reload + 1) != 60) continue;
+
+        mem_->store_mem(reload + 1, ticks_per_second_);
+        LOG_INFO("XIOS") << "One-second counter at " << std::hex << reload
+                         << "H reloads " << std::dec << (int)ticks_per_second_;
+        return;
+    }
 }
 
 void XIOS::do_bdos() {
@@ -789,7 +1173,7 @@ void XIOS::do_bdos() {
     // Debug output
     static int call_count = 0;
     if (call_count < 50) {
-        std::cerr << "[BDOS] func=" << (int)func << " DE=0x" << std::hex << de << std::dec << "\n";
+        LOG_DEBUG("BDOS") << "func=" << (int)func << " DE=0x" << std::hex << de;
         call_count++;
     }
 
@@ -803,9 +1187,13 @@ void XIOS::do_bdos() {
             {
                 Console* con = ConsoleManager::instance().get(0);
                 if (con) {
-                    uint8_t ch = con->read_char();
-                    cpu_->regs.AF.set_high(ch);
-                    con->write_char(ch);  // Echo
+                    int ch = con->read_char();
+                    if (ch < 0) {
+                        retry_call();
+                        return;
+                    }
+                    cpu_->regs.AF.set_high(static_cast<uint8_t>(ch));
+                    con->write_char(static_cast<uint8_t>(ch));  // Echo
                 } else {
                     cpu_->regs.AF.set_high(0x1A);
                 }
@@ -826,8 +1214,9 @@ void XIOS::do_bdos() {
             if ((de & 0xFF) == 0xFF) {
                 // Input
                 Console* con = ConsoleManager::instance().get(0);
-                if (con && con->const_status()) {
-                    cpu_->regs.AF.set_high(con->read_char());
+                int ch = con ? con->read_char() : -1;
+                if (ch >= 0) {
+                    cpu_->regs.AF.set_high(static_cast<uint8_t>(ch));
                 } else {
                     cpu_->regs.AF.set_high(0);
                 }
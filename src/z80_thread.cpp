@@ -4,12 +4,15 @@
 
 #include "z80_thread.h"
 #include "mpm_cpu.h"
+#include "fast_core.h"
 #include "banked_mem.h"
 #include "xios.h"
+#include "console.h"
+#include "interrupt_controller.h"
+#include "log.h"
 #include <fstream>
 #include <cstring>
 #include <iostream>
-#include <iomanip>
 
 
 Z80Thread::Z80Thread()
@@ -25,7 +28,7 @@ Z80Thread::~Z80Thread() {
 }
 
 bool Z80Thread::init(const std::string& boot_image) {
-    std::cerr << "[Z80] init() called with boot_image='" << boot_image << "'" << std::endl;
+    LOG_DEBUG("Z80") << "init() called with boot_image='" << boot_image << "'";
     // Create memory (4 banks = 128KB + 32KB common)
     memory_ = std::make_unique<BankedMemory>(4);
 
@@ -38,6 +41,7 @@ bool Z80Thread::init(const std::string& boot_image) {
 
     // Connect CPU to XIOS and banked memory for port dispatch
     cpu_->set_xios(xios_.get());
+    cpu_->set_instruction_counter(&instruction_count_);
     cpu_->set_banked_mem(memory_.get());
 
     // Load boot image if provided
@@ -62,10 +66,8 @@ bool Z80Thread::init(const std::string& boot_image) {
         memory_->load(0, 0x0000, buffer.data(), buffer.size());
 
         // Debug: verify FF4E loaded correctly
-        std::cerr << "[Z80] After load, FF4E=" << std::hex
-                  << (int)memory_->fetch_mem(0xFF4E) << " "
-                  << (int)memory_->fetch_mem(0xFF4F) << " "
-                  << (int)memory_->fetch_mem(0xFF50) << std::dec << std::endl;
+        LOG_DEBUG("Z80") << "After load, FF4E="
+                         << log_hex(3, [&](int i) { return memory_->fetch_mem(0xFF4E + i); });
 
         // Note: BNKXIOS pre-loading disabled - using patched NUCLEUS MPM.SYS
         // which already contains the BNKXIOS forwarding stub at BA00
@@ -75,26 +77,23 @@ bool Z80Thread::init(const std::string& boot_image) {
 
         // Set up stack pointer in high memory (will be reset by MPMLDR)
         cpu_->regs.SP.set_pair16(0x0080);
-        std::cerr << "[Z80] Boot image loaded, PC=0x0100" << std::endl;
+        LOG_INFO("Z80") << "Boot image loaded, PC=0x0100";
     }
 
-    std::cerr << "[Z80] init() returning true" << std::endl;
     return true;
 }
 
 void Z80Thread::start() {
-    std::cerr << "[Z80] start() called" << std::endl;
     if (running_.load()) return;
 
     stop_requested_.store(false);
     running_.store(true);
-    next_tick_ = std::chrono::steady_clock::now();
     tick_count_ = 0;
+    guest_irq_ = 0;
     instruction_count_.store(0);
 
-    std::cerr << "[Z80] Creating thread..." << std::endl;
+    InterruptController::instance().start_timer(tick_interval_);
     thread_ = std::thread(&Z80Thread::thread_func, this);
-    std::cerr << "[Z80] Thread created" << std::endl;
 }
 
 void Z80Thread::stop() {
@@ -104,6 +103,7 @@ void Z80Thread::stop() {
     if (thread_.joinable()) {
         thread_.join();
     }
+    InterruptController::instance().stop_timer();
     running_.store(false);
 }
 
@@ -113,6 +113,34 @@ void Z80Thread::set_xios_base(uint16_t base) {
     }
 }
 
+void Z80Thread::set_tick_rate(int hz) {
+    ticks_per_second_ = hz;
+    tick_interval_ = std::chrono::microseconds((1000000 + hz / 2) / hz);
+    if (xios_) xios_->set_ticks_per_second(static_cast<uint8_t>(hz));
+}
+
+void Z80Thread::set_fast_core(bool on) {
+    if (on && !fast_) {
+        fast_ = std::make_unique<FastCore>(cpu_.get(), memory_.get());
+    } else if (!on) {
+        fast_.reset();
+    }
+}
+
+void Z80Thread::set_superinstructions(bool on) {
+    if (fast_) fast_->set_superinstructions(on);
+}
+
+void Z80Thread::set_pair_profile(const std::string& path) {
+    pair_profile_ = path;
+    if (fast_ && !path.empty()) fast_->enable_pair_profile();
+}
+
+void Z80Thread::set_lockstep(bool on) {
+    lockstep_ = on;
+    if (fast_ && on) fast_->enable_lockstep();
+}
+
 void Z80Thread::enable_interrupts(bool enable) {
     if (cpu_) {
         cpu_->regs.IFF1 = enable ? 1 : 0;
@@ -124,36 +152,57 @@ uint64_t Z80Thread::cycles() const {
     return cpu_ ? cpu_->cycles : 0;
 }
 
-void Z80Thread::thread_func() {
-    std::cerr << "[Z80 Thread] Starting execution at PC=0x"
-              << std::hex << cpu_->regs.PC.get_pair16() << std::dec << std::endl;
+// Dump memory map around BNKXIOS and XDOS once the nucleus is reached
+void Z80Thread::dump_boot_memory() {
+    auto dump = [&](const char* title, uint16_t from, uint16_t to) {
+        LOG_DEBUG("BOOT") << title;
+        for (uint16_t addr = from; addr < to; addr += 16) {
+            LOG_DEBUG("BOOT") << "  " << std::hex << addr << ": "
+                              << log_hex(16, [&](int i) { return memory_->fetch_mem(addr + i); });
+        }
+    };
+
+    dump("BNKXIOS area (CD00-CD30):", 0xCD00, 0xCD30);
+    // Also dump XDOS area to check if it's loaded (E000-E100)
+    dump("XDOS area (E080-E0C0):", 0xE080, 0xE0C0);
+    dump("XDOS entry (E500-E520):", 0xE500, 0xE520);
+
+    // Dump broader XDOS area to find where code stops
+    LOG_DEBUG("BOOT") << "XDOS broad scan (CD00-F000):";
+    for (uint16_t addr = 0xCD00; addr < 0xF000; addr += 0x100) {
+        // Check if this 256-byte block is all zeros
+        bool all_zero = true;
+        for (int i = 0; i < 256; i++) {
+            if (memory_->fetch_mem(addr + i) != 0) {
+                all_zero = false;
+                break;
+            }
+        }
+        if (!all_zero) {
+            LOG_DEBUG("BOOT") << "  " << std::hex << addr << ": "
+                              << log_hex(16, [&](int i) { return memory_->fetch_mem(addr + i); })
+                              << " ...";
+        } else {
+            LOG_DEBUG("BOOT") << "  " << std::hex << addr << ": (all zeros)";
+        }
+    }
 
+    // Specifically dump E720-E740 to debug the E72B issue
+    dump("E720-E740 (call target E72B):", 0xE720, 0xE740);
+}
+
+void Z80Thread::thread_func() {
     // Debug: verify memory is accessible
-    uint16_t test_pc = cpu_->regs.PC.get_pair16();
-    std::cerr << "[Z80 Thread] Testing memory at PC=0x" << std::hex << test_pc << std::endl;
-    uint8_t byte0 = memory_->fetch_mem(test_pc);
-    uint8_t byte1 = memory_->fetch_mem(test_pc + 1);
-    uint8_t byte2 = memory_->fetch_mem(test_pc + 2);
-    std::cerr << "[Z80 Thread] Memory at PC: " << std::hex
-              << (int)byte0 << " " << (int)byte1 << " " << (int)byte2 << std::dec << std::endl;
+    uint16_t start_pc = cpu_->regs.PC.get_pair16();
+    LOG_DEBUG("Z80") << "Starting execution at PC=0x" << std::hex << start_pc << ", memory: "
+                     << log_hex(3, [&](int i) { return memory_->fetch_mem(start_pc + i); });
 
-    while (!stop_requested_.load()) {
-        // Check for timer interrupt
-        auto now = std::chrono::steady_clock::now();
-        if (now >= next_tick_) {
-            next_tick_ += TICK_INTERVAL;
-
-            // Deliver tick interrupt if clock is enabled
-            if (xios_->clock_enabled() && cpu_->regs.IFF1) {
-                deliver_tick_interrupt();
-            }
+    InterruptController& irq = InterruptController::instance();
 
-            // Check for one-second tick
-            if (++tick_count_ >= 60) {
-                tick_count_ = 0;
-                xios_->one_second_tick();
-            }
-        }
+    while (!stop_requested_.load()) {
+        // Interrupt lines raised since the last instruction
+        if (irq.pending()) service_irqs();
+        if (guest_irq_ && cpu_->regs.IFF1) deliver_interrupt();
 
         // Check for XIOS trap before executing
         uint16_t pc = cpu_->regs.PC.get_pair16();
@@ -172,31 +221,23 @@ void Z80Thread::thread_func() {
         // Trace jumps from low memory (loader) to high memory (nucleus)
         if (!booted && last_pc < 0x8000 && pc >= 0x8000) {
             uint16_t sp = cpu_->regs.SP.get_pair16();
-            fprintf(stderr, "\n[BOOT JUMP] from %04X to %04X, SP=%04X\n", last_pc, pc, sp);
+            LOG_DEBUG("BOOT") << std::hex << "Jump from " << last_pc << " to " << pc << ", SP=" << sp;
             // Dump memory at the jump destination
-            fprintf(stderr, "[BOOT JUMP] Code at %04X: ", pc);
-            for (int i = 0; i < 16; i++) {
-                fprintf(stderr, "%02X ", memory_->fetch_mem(pc + i));
-            }
-            fprintf(stderr, "\n");
+            LOG_DEBUG("BOOT") << "Code at " << std::hex << pc << ": "
+                              << log_hex(16, [&](int i) { return memory_->fetch_mem(pc + i); });
             // Dump stack contents
-            fprintf(stderr, "[BOOT JUMP] Stack at %04X: ", sp);
-            for (int i = 0; i < 16; i++) {
-                fprintf(stderr, "%02X ", memory_->fetch_mem(sp + i));
-            }
-            fprintf(stderr, "\n");
+            LOG_DEBUG("BOOT") << "Stack at " << std::hex << sp << ": "
+                              << log_hex(16, [&](int i) { return memory_->fetch_mem(sp + i); });
             // Dump what's at address 0A21 (where we came from)
-            fprintf(stderr, "[BOOT JUMP] Code at %04X (source): ", last_pc);
-            for (int i = 0; i < 8; i++) {
-                fprintf(stderr, "%02X ", memory_->fetch_mem(last_pc + i));
-            }
-            fprintf(stderr, "\n");
+            LOG_DEBUG("BOOT") << "Code at " << std::hex << last_pc << " (source): "
+                              << log_hex(8, [&](int i) { return memory_->fetch_mem(last_pc + i); });
         }
 
         // Trace when we first reach the nucleus area (8D00+)
         if (!booted && pc >= 0x8D00) {
             booted = true;
-            fprintf(stderr, "\n[BOOT] System reached high memory at 0x%04X (came from 0x%04X)\n", pc, last_pc);
+            LOG_INFO("BOOT") << "System reached high memory at 0x" << std::hex << pc
+                             << " (came from 0x" << last_pc << ")";
 
             // Patch BNKXIOS with forwarding stubs before XDOS takes over
             // The boot jump goes to XDOS (CD00), not BNKXIOS
@@ -211,91 +252,37 @@ void Z80Thread::thread_func() {
                 // Still not found - scan high memory for SPR modules
                 // Look for the pattern that indicates BNKXIOS (check loader output)
                 // For now, use hardcoded value from loader output: BA00
-                fprintf(stderr, "[BOOT] BNKXIOS page not found in memory, using BA00H\n");
+                LOG_WARN("BOOT") << "BNKXIOS page not found in memory, using BA00H";
                 bnkxios_page = 0xBA;
             }
             uint16_t bnkxios_addr = static_cast<uint16_t>(bnkxios_page) << 8;
-            fprintf(stderr, "[BOOT] BNKXIOS page=%02X, addr=%04X\n", bnkxios_page, bnkxios_addr);
+            LOG_DEBUG("BOOT") << "BNKXIOS page=" << std::hex << (int)bnkxios_page
+                              << ", addr=" << bnkxios_addr;
             xios_->patch_bnkxios(bnkxios_addr);
 
-            // Dump memory map around BNKXIOS (CD00-CDFF)
-            fprintf(stderr, "[BOOT] BNKXIOS area (CD00-CD30):\n");
-            for (uint16_t addr = 0xCD00; addr < 0xCD30; addr += 16) {
-                fprintf(stderr, "  %04X: ", addr);
-                for (int i = 0; i < 16; i++) {
-                    fprintf(stderr, "%02X ", memory_->fetch_mem(addr + i));
-                }
-                fprintf(stderr, "\n");
-            }
-            // Also dump XDOS area to check if it's loaded (E000-E100)
-            fprintf(stderr, "[BOOT] XDOS area (E080-E0C0):\n");
-            for (uint16_t addr = 0xE080; addr < 0xE0C0; addr += 16) {
-                fprintf(stderr, "  %04X: ", addr);
-                for (int i = 0; i < 16; i++) {
-                    fprintf(stderr, "%02X ", memory_->fetch_mem(addr + i));
-                }
-                fprintf(stderr, "\n");
-            }
-            // Dump XDOS entry area (E500-E520)
-            fprintf(stderr, "[BOOT] XDOS entry (E500-E520):\n");
-            for (uint16_t addr = 0xE500; addr < 0xE520; addr += 16) {
-                fprintf(stderr, "  %04X: ", addr);
-                for (int i = 0; i < 16; i++) {
-                    fprintf(stderr, "%02X ", memory_->fetch_mem(addr + i));
-                }
-                fprintf(stderr, "\n");
-            }
-            // Dump broader XDOS area to find where code stops
-            fprintf(stderr, "[BOOT] XDOS broad scan (CD00-F000):\n");
-            for (uint16_t addr = 0xCD00; addr < 0xF000; addr += 0x100) {
-                // Check if this 256-byte block is all zeros
-                bool all_zero = true;
-                for (int i = 0; i < 256; i++) {
-                    if (memory_->fetch_mem(addr + i) != 0) {
-                        all_zero = false;
-                        break;
-                    }
-                }
-                if (!all_zero) {
-                    fprintf(stderr, "  %04X: ", addr);
-                    for (int i = 0; i < 16; i++) {
-                        fprintf(stderr, "%02X ", memory_->fetch_mem(addr + i));
-                    }
-                    fprintf(stderr, "...\n");
-                } else {
-                    fprintf(stderr, "  %04X: (all zeros)\n", addr);
-                }
-            }
-            // Specifically dump E720-E740 to debug the E72B issue
-            fprintf(stderr, "[BOOT] E720-E740 (call target E72B):\n");
-            for (uint16_t addr = 0xE720; addr < 0xE740; addr += 16) {
-                fprintf(stderr, "  %04X: ", addr);
-                for (int i = 0; i < 16; i++) {
-                    fprintf(stderr, "%02X ", memory_->fetch_mem(addr + i));
-                }
-                fprintf(stderr, "\n");
-            }
+            if (log_enabled(LogLevel::DEBUG)) dump_boot_memory();
         }
 
         // Trace PC values in BNKXIOS range (CD00-CDFF)
         if (pc >= 0xCD00 && pc < 0xCE00 && pre_boot_trace++ < 20) {
-            fprintf(stderr, "[BNKXIOS] PC=%04X op=%02X\n", pc, memory_->fetch_mem(pc));
+            LOG_DEBUG("BNKXIOS") << "PC=" << std::hex << pc << " op=" << (int)memory_->fetch_mem(pc);
         }
 
         // Trace PC after boot to understand where we go
         if (booted && post_boot_trace++ < 50) {
             uint8_t op = memory_->fetch_mem(pc);
             uint16_t sp = cpu_->regs.SP.get_pair16();
-            fprintf(stderr, "[POST-BOOT %d] PC=%04X op=%02X SP=%04X AF=%04X DE=%04X HL=%04X\n",
-                    post_boot_trace, pc, op, sp,
-                    cpu_->regs.AF.get_pair16(),
-                    cpu_->regs.DE.get_pair16(),
-                    cpu_->regs.HL.get_pair16());
+            LOG_DEBUG("BOOT") << "post-boot " << post_boot_trace << std::hex
+                              << " PC=" << pc << " op=" << (int)op << " SP=" << sp
+                              << " AF=" << cpu_->regs.AF.get_pair16()
+                              << " DE=" << cpu_->regs.DE.get_pair16()
+                              << " HL=" << cpu_->regs.HL.get_pair16();
             // When we hit the RET at CD09, show stack contents
             if (pc == 0xCD09 && op == 0xC9) {
-                fprintf(stderr, "[RET at CD09] Stack at %04X: %02X %02X (ret addr = %04X)\n",
-                        sp, memory_->fetch_mem(sp), memory_->fetch_mem(sp+1),
-                        memory_->fetch_mem(sp) | (memory_->fetch_mem(sp+1) << 8));
+                LOG_DEBUG("BOOT") << "RET at CD09, stack at " << std::hex << sp << ": "
+                                  << log_hex(2, [&](int i) { return memory_->fetch_mem(sp + i); })
+                                  << " (ret addr = "
+                                  << (memory_->fetch_mem(sp) | (memory_->fetch_mem(sp + 1) << 8)) << ")";
             }
         }
 
@@ -318,6 +305,12 @@ void Z80Thread::thread_func() {
         // static bool loop_0f84_dumped = false;
         // if (pc == 0x0F84 && !loop_0f84_dumped) { ... }
 
+        // Read Console Buffer goes to the host line editor
+        if (line_edit_ && pc == bdos_entry_ && bdos_entry_ != 0 &&
+            cpu_->regs.BC.get_low() == BDOS_READ_BUFFER && xios_->read_console_buffer()) {
+            continue;
+        }
+
         // Check for HALT instruction (0x76) - handle specially for MP/M
         uint8_t opcode = memory_->fetch_mem(pc);
         // qkz80 library calls exit() on HALT, but MP/M uses HALT in idle loop
@@ -332,28 +325,130 @@ void Z80Thread::thread_func() {
                 std::this_thread::sleep_for(std::chrono::milliseconds(1));
             }
 
-            // If interrupts are enabled and clock is running, wait for tick
-            if (cpu_->regs.IFF1 && xios_->clock_enabled()) {
-                // Sleep until next tick
-                auto now = std::chrono::steady_clock::now();
-                if (now < next_tick_) {
-                    std::this_thread::sleep_until(next_tick_);
-                }
+            // If interrupts are enabled and clock is running, wait for one
+            if (cpu_->regs.IFF1 && xios_->clock_enabled() && !guest_irq_) {
+                irq.wait(100);
             }
             continue;
         }
 
         // Execute one instruction
-        cpu_->execute();
-        instruction_count_++;
+        if (fast_) {
+            instruction_count_ += fast_->step();
+        } else {
+            cpu_->execute();
+            instruction_count_++;
+        }
+
+        // A port-dispatch handler may have parked the process on the XDOS
+        uint16_t target;
+        if (xios_->take_redirect(target)) {
+            cpu_->regs.PC.set_pair16(target);
+        }
+
+        if (tickless_ && xios_->take_idle()) {
+            idle_sleep();
+        }
 
         // TODO: Check for I/O instructions (IN/OUT) and handle them
     }
+
+    // Leave F in the registers for anyone inspecting them afterwards
+    if (fast_) {
+        fast_->sync_flags();
+        if (!pair_profile_.empty() && fast_->write_pair_profile(pair_profile_, 64)) {
+            LOG_INFO("CPU") << "Opcode pair profile written to " << pair_profile_;
+        }
+        if (lockstep_) {
+            LOG_INFO("CPU") << "Lockstep: " << fast_->mismatches()
+                            << " instructions differed from qkz80";
+        }
+    }
 }
 
-void Z80Thread::deliver_tick_interrupt() {
-    // MP/M uses RST 7 (or configurable) for timer interrupt
-    // Push PC, jump to interrupt vector
+void Z80Thread::service_irqs() {
+    InterruptController& irq = InterruptController::instance();
+    uint32_t lines = irq.take_all();
+
+    if (lines & irq_bit(IRQ_TICK)) {
+        clock_tick(irq.take_ticks());
+    }
+
+    // Input for a process waiting on the poll list: take the next tick
+    // now. The timer skips the slot it borrows, so ticks per second,
+    // delays and the time of day stay exact.
+    if ((lines & irq_bit(IRQ_CONSOLE)) && boost_ && xios_->clock_enabled() &&
+        xios_->poll_list_ready() && irq.borrow_tick()) {
+        clock_tick(1);
+    }
+
+    // Device lines the guest XIOS asked for
+    guest_irq_ |= lines & irq.guest_mask();
+}
+
+void Z80Thread::clock_tick(unsigned count) {
+    // Console input that arrived since the last trap
+    xios_->refresh_poll_mirror();
+    if (line_edit_) {
+        bdos_entry_ = xios_->bdos_entry();
+        // Fused sequences must not run past the line editor's trap
+        if (fast_) fast_->set_stop_pc(bdos_entry_);
+    }
+
+    // Tick interrupt if the clock is enabled; several timer expirations
+    // (a busy host) still make one dispatch
+    if (xios_->clock_enabled() && (!tickless_ || xios_->tick_needed())) {
+        guest_irq_ |= irq_bit(IRQ_TICK);
+    }
+
+    for (unsigned i = 0; i < count; i++) second_elapsed();
+}
+
+void Z80Thread::second_elapsed() {
+    // Check for one-second tick
+    if (++tick_count_ >= ticks_per_second_) {
+        tick_count_ = 0;
+        xios_->one_second_tick();
+        // The CLOCK process only runs on ticks, so keep the time of day here
+        if (tickless_) xios_->set_tod_from_host();
+    }
+}
+
+void Z80Thread::idle_sleep() {
+    // Only Idle is ready and nothing is timed: no instructions until a
+    // delay is queued, a polled device becomes ready, a process is made
+    // ready from outside or the guest has an interrupt to take. Ticks
+    // are still counted for the second; waking up delivers one tick
+    // rather than a burst of missed ones.
+    InterruptController& irq = InterruptController::instance();
+    bool slept = false;
+    while (!stop_requested_.load() && !guest_irq_ && !xios_->tick_needed()) {
+        slept = true;
+        irq.wait(100);
+        service_irqs();
+    }
+
+    // Run the dispatcher now instead of at the next slot
+    if (slept && xios_->clock_enabled()) {
+        guest_irq_ |= irq_bit(IRQ_TICK);
+    }
+}
+
+void Z80Thread::deliver_interrupt() {
+    // Lowest line first in IM 2; IM 0/1 take every pending line at once
+    // through RST 38H, and the handler reads them from port 0xE3
+    uint16_t target = 0x0038;
+    uint32_t lines = guest_irq_;
+    if (cpu_->regs.IM == 2) {
+        int line = __builtin_ctz(lines);
+        lines = 1u << line;
+        uint16_t entry = static_cast<uint16_t>((cpu_->regs.I << 8) |
+                                               InterruptController::vector(static_cast<IrqLine>(line)));
+        target = memory_->fetch_mem(entry) | (memory_->fetch_mem(entry + 1) << 8);
+    } else {
+        InterruptController::instance().acknowledge(lines);
+    }
+    guest_irq_ &= ~lines;
 
     // Save current PC on stack
     uint16_t sp = cpu_->regs.SP.get_pair16();
@@ -363,16 +458,15 @@ void Z80Thread::deliver_tick_interrupt() {
     memory_->store_mem(sp, pc & 0xFF);
     memory_->store_mem(sp + 1, (pc >> 8) & 0xFF);
 
-    // Set preempted flag
-    xios_->set_preempted(true);
-
     // Disable interrupts
     cpu_->regs.IFF1 = 0;
     cpu_->regs.IFF2 = 0;
 
-    // Jump to interrupt handler (RST 38H = address 0x0038)
-    cpu_->regs.PC.set_pair16(0x0038);
+    cpu_->regs.PC.set_pair16(target);
 
-    // Signal tick to XIOS
-    xios_->tick();
+    if (lines & irq_bit(IRQ_TICK)) {
+        // Set preempted flag and signal tick to XIOS
+        xios_->set_preempted(true);
+        xios_->tick();
+    }
 }
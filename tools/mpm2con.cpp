@@ -0,0 +1,94 @@
+// mpm2con.cpp - Terminal client for the local shared-memory consoles
+// Part of MP/M II Emulator
+// SPDX-License-Identifier: GPL-3.0-or-later
+//
+// Attaches the terminal to a console of an emulator started with
+// --local-shm, without going through SSH. Ctrl-] exits.
+//
+// Usage: mpm2con [-s /mpm2-consoles] CONSOLE
+
+#include "local_console.h"
+
+#include <iostream>
+#include <cstdlib>
+#include <getopt.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+constexpr uint8_t EXIT_KEY = 0x1D;  // Ctrl-]
+
+int main(int argc, char* argv[]) {
+    std::string name = LOCAL_CONSOLE_DEFAULT_NAME;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:h")) != -1) {
+        switch (opt) {
+            case 's':
+                name = optarg;
+                break;
+            default:
+                std::cerr << "Usage: " << argv[0] << " [-s SEGMENT] CONSOLE\n";
+                return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind >= argc) {
+        std::cerr << "Usage: " << argv[0] << " [-s SEGMENT] CONSOLE\n";
+        return 1;
+    }
+    int console = std::atoi(argv[optind]);
+
+    LocalConsoleClient client;
+    if (!client.open(console, name)) {
+        std::cerr << "Cannot attach console " << console << " via " << name
+                  << " (emulator not running with --local-shm, or console in use)\n";
+        return 1;
+    }
+
+    bool tty = isatty(STDIN_FILENO);
+    struct termios saved;
+    if (tty) {
+        tcgetattr(STDIN_FILENO, &saved);
+        struct termios raw = saved;
+        cfmakeraw(&raw);
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &raw);
+        std::cerr << "Attached to console " << console << " - Ctrl-] to exit\r\n";
+    }
+
+    uint8_t buf[4096];
+    bool done = false;
+    while (!done) {
+        // Display first, then a short poll of the keyboard
+        size_t n;
+        while ((n = client.read(buf, sizeof(buf))) > 0) {
+            ssize_t w = write(STDOUT_FILENO, buf, n);
+            (void)w;
+        }
+
+        struct pollfd pfd;
+        pfd.fd = STDIN_FILENO;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if (poll(&pfd, 1, 0) > 0) {
+            ssize_t r = read(STDIN_FILENO, buf, sizeof(buf));
+            if (r <= 0) break;
+            for (ssize_t i = 0; i < r; i++) {
+                if (buf[i] == EXIT_KEY) {
+                    r = i;
+                    done = true;
+                    break;
+                }
+                if (buf[i] == '\n') buf[i] = '\r';
+            }
+            if (!client.write_all(buf, r)) break;
+        } else {
+            client.wait_readable(10);  // 10ms
+        }
+    }
+
+    client.close();
+    if (tty) {
+        tcsetattr(STDIN_FILENO, TCSAFLUSH, &saved);
+        std::cerr << "\nDetached\n";
+    }
+    return 0;
+}